@@ -2,24 +2,30 @@
 
 #include <cassert>
 #include <cmath>
+#include <compare>
 #include <cstddef>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <span>
 #include <stack>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <iostream>
 #include "compressed_pair.h"
 
-template <typename K, typename Compare>
-bool Equivalent(const K& key_1, const K& key_2, Compare compare) {
+template <typename K1, typename K2, typename Compare>
+bool Equivalent(const K1& key_1, const K2& key_2, Compare compare) {
     return !(compare(key_1, key_2)) && (!compare(key_2, key_1));
 }
 
 template <typename K, typename V>
 class MapNode;
 
+// Links shared by the tree nodes and the end sentinel. The sentinel is told apart by a flag
+// rather than by a vtable, so walking the prev/next thread is a plain load.
 template <typename K, typename V>
 class MapBaseNode {
 public:
@@ -30,22 +36,47 @@ public:
     MapBaseNode& operator=(MapBaseNode&& other) = delete;
     ~MapBaseNode() noexcept = default;
 
-    virtual const K& GetKey() const = 0;
-    virtual const V& GetValue() const = 0;
-    virtual V& GetValue() = 0;
-    virtual const std::unique_ptr<MapNode<K, V>>& GetLeft() const = 0;
-    virtual std::unique_ptr<MapNode<K, V>>& GetLeft() = 0;
-    virtual const std::unique_ptr<MapNode<K, V>>& GetRight() const = 0;
-    virtual std::unique_ptr<MapNode<K, V>>& GetRight() = 0;
-    virtual MapNode<K, V>* GetParent() const = 0;
-    virtual MapNode<K, V>*& GetParent() = 0;
-    virtual MapBaseNode<K, V>* GetPrev() const noexcept = 0;
-    virtual MapBaseNode<K, V>*& GetPrev() noexcept = 0;
-    virtual MapBaseNode<K, V>* GetNext() const noexcept = 0;
-    virtual MapBaseNode<K, V>*& GetNext() noexcept = 0;
-    virtual const std::pair<const K, V>& GetKeyValue() const = 0;
-    virtual std::pair<const K, V>& GetKeyValue() = 0;
-    virtual bool IsMapEndNode() const noexcept = 0;
+    MapBaseNode(MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next, bool end_node) noexcept
+        : prev_(prev), next_(next), end_node_(end_node) {
+    }
+    MapBaseNode<K, V>* GetPrev() const noexcept {
+        return prev_;
+    }
+    MapBaseNode<K, V>*& GetPrev() noexcept {
+        return prev_;
+    }
+    MapBaseNode<K, V>* GetNext() const noexcept {
+        return next_;
+    }
+    MapBaseNode<K, V>*& GetNext() noexcept {
+        return next_;
+    }
+    const std::pair<const K, V>& GetKeyValue() const {
+        return GetMapNode()->GetKeyValue();
+    }
+    std::pair<const K, V>& GetKeyValue() {
+        return GetMapNode()->GetKeyValue();
+    }
+    const MapNode<K, V>* GetMapNode() const {
+        if (IsMapEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<const MapNode<K, V>*>(this);
+    }
+    MapNode<K, V>* GetMapNode() {
+        if (IsMapEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<MapNode<K, V>*>(this);
+    }
+    bool IsMapEndNode() const noexcept {
+        return end_node_;
+    }
+
+private:
+    MapBaseNode<K, V>* prev_ = nullptr;
+    MapBaseNode<K, V>* next_ = nullptr;
+    bool end_node_ = false;
 };
 
 template <typename K, typename V>
@@ -59,18 +90,23 @@ public:
     ~MapNode() = default;
 
     MapNode(const K& key, const V& value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next)
-        : key_value_(key, value), prev_(prev), next_(next) {
+        : MapBaseNode<K, V>(prev, next, false), key_value_(key, value) {
     }
     MapNode(const std::pair<const K, V>& key_value, MapBaseNode<K, V>* prev,
             MapBaseNode<K, V>* next)
-        : key_value_(key_value), prev_(prev), next_(next) {
+        : MapBaseNode<K, V>(prev, next, false), key_value_(key_value) {
     }
     MapNode(std::pair<const K, V>&& key_value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next)
-        : key_value_(std::move(key_value)), prev_(prev), next_(next) {
+        : MapBaseNode<K, V>(prev, next, false), key_value_(std::move(key_value)) {
     }
     template <typename P>
     MapNode(P&& key_value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next)
-        : key_value_(std::forward<P>(key_value)), prev_(prev), next_(next) {
+        : MapBaseNode<K, V>(prev, next, false), key_value_(std::forward<P>(key_value)) {
+    }
+    // Builds the key-value pair from the arguments of an Emplace, unlinked.
+    template <typename... Args>
+    explicit MapNode(std::in_place_t, Args&&... args)
+        : MapBaseNode<K, V>(nullptr, nullptr, false), key_value_(std::forward<Args>(args)...) {
     }
     const K& GetKey() const noexcept {
         return key_value_.first;
@@ -99,41 +135,25 @@ public:
     MapNode<K, V>*& GetParent() noexcept {
         return parent_;
     }
-    MapBaseNode<K, V>* GetPrev() const noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>*& GetPrev() noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>* GetNext() const noexcept {
-        return next_;
-    }
-    MapBaseNode<K, V>*& GetNext() noexcept {
-        return next_;
-    }
     const std::pair<const K, V>& GetKeyValue() const noexcept {
         return key_value_;
     }
     std::pair<const K, V>& GetKeyValue() noexcept {
         return key_value_;
     }
-    bool IsMapEndNode() const noexcept {
-        return false;
-    }
 
 private:
     std::pair<const K, V> key_value_;
     std::unique_ptr<MapNode<K, V>> left_;
     std::unique_ptr<MapNode<K, V>> right_;
     MapNode<K, V>* parent_ = nullptr;
-    MapBaseNode<K, V>* prev_ = nullptr;
-    MapBaseNode<K, V>* next_ = nullptr;
 };
 
 template <typename K, typename V>
 class EndMapNode : public MapBaseNode<K, V> {
 public:
-    EndMapNode() noexcept = default;
+    EndMapNode() noexcept : MapBaseNode<K, V>(nullptr, nullptr, true) {
+    }
     EndMapNode(const EndMapNode& other) = delete;
     EndMapNode& operator=(const EndMapNode& other) = delete;
     EndMapNode(EndMapNode&& other) noexcept = default;
@@ -141,60 +161,8 @@ public:
     ~EndMapNode() noexcept = default;
 
     EndMapNode(MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next) noexcept
-        : prev_(prev), next_(next) {
+        : MapBaseNode<K, V>(prev, next, true) {
     }
-    const K& GetKey() const {
-        throw std::out_of_range("Out of range!");
-    }
-    const V& GetValue() const {
-        throw std::out_of_range("Out of range!");
-    }
-    V& GetValue() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<MapNode<K, V>>& GetLeft() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<MapNode<K, V>>& GetLeft() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<MapNode<K, V>>& GetRight() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<MapNode<K, V>>& GetRight() {
-        throw std::out_of_range("Out of range!");
-    }
-    MapNode<K, V>* GetParent() const {
-        throw std::out_of_range("Out of range!");
-    }
-    MapNode<K, V>*& GetParent() {
-        throw std::out_of_range("Out of range!");
-    }
-    MapBaseNode<K, V>* GetPrev() const noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>*& GetPrev() noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>* GetNext() const noexcept {
-        return next_;
-    }
-    MapBaseNode<K, V>*& GetNext() noexcept {
-        return next_;
-    }
-    const std::pair<const K, V>& GetKeyValue() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::pair<const K, V>& GetKeyValue() {
-        throw std::out_of_range("Out of range!");
-    }
-    bool IsMapEndNode() const noexcept {
-        return true;
-    }
-
-private:
-    MapBaseNode<K, V>* prev_ = nullptr;
-    MapBaseNode<K, V>* next_ = nullptr;
 };
 
 template <typename K, typename V, typename Compare = std::less<K>>
@@ -212,6 +180,8 @@ public:
     using Pointer = ValueType*;
     using ConstReference = const ValueType&;
     using ConstPointer = const ValueType*;
+    // Whether the lookups also take keys of other types, as std::less<> allows.
+    static constexpr bool kTransparentCompare = requires { typename Compare::is_transparent; };
 
     class ConstIterator;
 
@@ -456,13 +426,12 @@ public:
         Swap(tmp);
         return *this;
     }
-    ~MapBST() = default;
+    ~MapBST() {
+        DestroyNodes();
+    }
 
     void Clear() noexcept {
-        GetRoot() = nullptr;
-        size_ = 0;
-        end_node_.GetNext() = std::addressof(end_node_);
-        end_node_.GetPrev() = std::addressof(end_node_);
+        DestroyNodes();
     }
     void Swap(MapBST& other) {
         std::swap(GetRoot(), other.GetRoot());
@@ -488,73 +457,65 @@ public:
     void Insert(std::initializer_list<ValueType> ilist) {
         Insert(ilist.begin(), ilist.end());
     }
-    Iterator Find(const K& key) {
-        auto node = FindMapNode(key);
-        if (node == nullptr) {
-            return End();
+    // The key is not known before the element is built, so a duplicate costs a node that is
+    // thrown away; Emplace(key, value) with a ready key looks it up first, like TryEmplace.
+    template <typename... Args>
+    std::pair<Iterator, bool> Emplace(Args&&... args) {
+        if constexpr (IsKeyAndValue<Args...>()) {
+            return TryEmplace(std::forward<Args>(args)...);
+        } else {
+            auto node = std::make_unique<MapNode<K, V>>(std::in_place, std::forward<Args>(args)...);
+            auto [next, vacant] = FindInsertNext(node->GetKey());
+            if (!vacant) {
+                return {Iterator{next}, false};
+            }
+            return {Iterator{LinkMapNodeBefore(std::move(node), next)}, true};
         }
-        return Iterator{node};
+    }
+    // Looks the key up first and builds the value from the arguments only if the key is
+    // missing; otherwise the arguments are left untouched.
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(const K& key, Args&&... args) {
+        return TryEmplaceMapNode(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(K&& key, Args&&... args) {
+        return TryEmplaceMapNode(std::move(key), std::forward<Args>(args)...);
+    }
+    // Assigns to the value of an existing key, or inserts the pair if the key is missing.
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(const K& key, M&& value) {
+        return InsertOrAssignMapNode(key, std::forward<M>(value));
+    }
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(K&& key, M&& value) {
+        return InsertOrAssignMapNode(std::move(key), std::forward<M>(value));
+    }
+    Iterator Find(const K& key) {
+        return Iterator{FindOrEnd(key)};
     }
     ConstIterator Find(const K& key) const {
-        auto node = FindMapNode(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return ConstIterator{node};
+        return ConstIterator{FindOrEnd(key)};
     }
     Iterator LowerBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return Iterator{node};
+        return Iterator{LowerBoundOrEnd(key)};
     }
     ConstIterator LowerBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return ConstIterator{node};
+        return ConstIterator{LowerBoundOrEnd(key)};
     }
     Iterator UpperBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return Iterator{node->GetNext()};
-        }
-        return Iterator{node};
+        return Iterator{EqualRangeNodes(key).second};
     }
     ConstIterator UpperBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return ConstIterator{node->GetNext()};
-        }
-        return ConstIterator{node};
+        return ConstIterator{EqualRangeNodes(key).second};
     }
     std::pair<Iterator, Iterator> EqualRange(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {Iterator{node}, Iterator{node->GetNext()}};
-        }
-        return {Iterator{node}, Iterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
     }
     std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {ConstIterator{node}, ConstIterator{node->GetNext()}};
-        }
-        return {ConstIterator{node}, ConstIterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
     }
     bool Contains(const K& key) const {
         return FindMapNode(key) != nullptr;
@@ -562,6 +523,90 @@ public:
     size_t Count(const K& key) const {
         return static_cast<size_t>(Contains(key));
     }
+    // With a transparent comparator the lookups take any type it orders against K, so for
+    // example a std::string key is looked up by a std::string_view without building a string.
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator Find(const Key& key) {
+        return Iterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator Find(const Key& key) const {
+        return ConstIterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator LowerBound(const Key& key) {
+        return Iterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator LowerBound(const Key& key) const {
+        return ConstIterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator UpperBound(const Key& key) {
+        return Iterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator UpperBound(const Key& key) const {
+        return ConstIterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<Iterator, Iterator> EqualRange(const Key& key) {
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<ConstIterator, ConstIterator> EqualRange(const Key& key) const {
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    bool Contains(const Key& key) const {
+        return FindMapNode(key) != nullptr;
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    size_t Count(const Key& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    // Finger search: the same answer as LowerBound(key), found by climbing from the hint to
+    // the lowest ancestor whose subtree has to hold the answer and descending from there. The
+    // past-the-end hint stands for the last element. For an answer d elements away from the
+    // hint this takes O(log d) steps when the tree is balanced, and O(1) when it is adjacent.
+    Iterator LowerBound(ConstIterator hint, const K& key) {
+        return Iterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    ConstIterator LowerBound(ConstIterator hint, const K& key) const {
+        return ConstIterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    // Writes the lower bound of keys[i] to results[i], searching from the previous answer, so
+    // a batch sorted in ascending order costs O(log d) per key for a rank distance of d.
+    void LowerBoundSorted(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        const MapBaseNode<K, V>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = Iterator{node};
+            hint = node;
+        }
+    }
+    void LowerBoundSorted(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        const MapBaseNode<K, V>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = ConstIterator{node};
+            hint = node;
+        }
+    }
     Iterator Begin() noexcept {
         return Iterator{end_node_.GetNext()};
     }
@@ -622,35 +667,165 @@ public:
     }
 
 private:
-    MapNode<K, V>* FindMapNode(const K& key) const {
-        MapNode<K, V>* node = GetRootPtr();
+    // Walks the prev/next thread and frees the nodes one by one. The child links are released
+    // beforehand, so no unique_ptr destructor recurses into a subtree and a degenerate tree
+    // is torn down in constant stack space.
+    void DestroyNodes() noexcept {
+        GetRoot().release();
+        MapBaseNode<K, V>* node = end_node_.GetNext();
+        while (!node->IsMapEndNode()) {
+            MapBaseNode<K, V>* next = node->GetNext();
+            auto tree_node = static_cast<MapNode<K, V>*>(node);
+            tree_node->GetLeft().release();
+            tree_node->GetRight().release();
+            delete tree_node;
+            node = next;
+        }
+        size_ = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
+    }
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
-                return node;
+    // Keys ordered by std::less that also have a consistent operator<=> are compared three-way:
+    // the one comparison per level also tells equality, so a lookup stops at the matching node.
+    template <typename Key>
+    static constexpr bool kThreeWayCompare =
+        (std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>) &&
+        std::three_way_comparable_with<Key, K, std::weak_ordering>;
+
+    template <typename Key>
+    MapNode<K, V>* FindMapNode(const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            MapNode<K, V>* node = GetRootPtr();
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                node = (order < 0) ? node->GetLeft().get() : node->GetRight().get();
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            return nullptr;
+        } else {
+            MapNode<K, V>* bound = FindLowerBound(key);
+            if (bound != nullptr && !KeyCompare()(key, bound->GetKey())) {
+                return bound;
             }
+            return nullptr;
         }
-        return nullptr;
     }
 
-    MapNode<K, V>* FindLowerBound(const K& key) const {
-        MapNode<K, V>* node = GetRootPtr();
-        MapNode<K, V>* best_bound = nullptr;
+    static void CheckBatchSize(size_t keys, size_t results) {
+        if (keys != results) {
+            throw std::invalid_argument("Batch keys and results differ in size");
+        }
+    }
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
+    MapBaseNode<K, V>* FindLowerBoundFrom(const MapBaseNode<K, V>* hint, const K& key) const {
+        auto end_node = const_cast<EndMapNode<K, V>*>(std::addressof(end_node_));
+        if (Empty()) {
+            return end_node;
+        }
+        if (hint == nullptr || hint->IsMapEndNode()) {
+            hint = end_node_.GetPrev();
+        }
+        auto node = const_cast<MapNode<K, V>*>(hint->GetMapNode());
+        const Compare& compare = root_compare_.GetSecond();
+        MapNode<K, V>* best_bound = nullptr;
+        if (compare(node->GetKey(), key)) {
+            auto next = node->GetNext();
+            if (next->IsMapEndNode() || !compare(next->GetMapNode()->GetKey(), key)) {
+                return next;
+            }
+            // Up to the first ancestor on the right that is not below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetLeft().get() == node && !compare(parent->GetKey(), key)) {
+                    best_bound = parent;
+                    break;
+                }
+                node = parent;
+            }
+        } else {
+            auto prev = node->GetPrev();
+            if (prev->IsMapEndNode() || compare(prev->GetMapNode()->GetKey(), key)) {
                 return node;
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                best_bound = node;
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            // Up to the first ancestor on the left that is below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetRight().get() == node && compare(parent->GetKey(), key)) {
+                    break;
+                }
+                node = parent;
+            }
+        }
+        auto bound = FindLowerBound(node, best_bound, key);
+        if (bound == nullptr) {
+            return end_node;
+        }
+        return bound;
+    }
+
+    template <typename Key>
+    MapBaseNode<K, V>* FindOrEnd(const Key& key) const {
+        MapNode<K, V>* node = FindMapNode(key);
+        if (node == nullptr) {
+            return const_cast<EndMapNode<K, V>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    template <typename Key>
+    MapBaseNode<K, V>* LowerBoundOrEnd(const Key& key) const {
+        MapNode<K, V>* node = FindLowerBound(key);
+        if (node == nullptr) {
+            return const_cast<EndMapNode<K, V>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    // The lower bound and the node after the equivalent one, if the key is present.
+    template <typename Key>
+    std::pair<MapBaseNode<K, V>*, MapBaseNode<K, V>*> EqualRangeNodes(const Key& key) const {
+        MapBaseNode<K, V>* first = LowerBoundOrEnd(key);
+        if (!first->IsMapEndNode() &&
+            !KeyCompare()(key, first->GetMapNode()->GetKey())) {
+            return {first, first->GetNext()};
+        }
+        return {first, first};
+    }
+
+    template <typename Key>
+    MapNode<K, V>* FindLowerBound(const Key& key) const {
+        return FindLowerBound(GetRootPtr(), nullptr, key);
+    }
+
+    // Lower bound within the subtree of the node, or best_bound if the subtree has none.
+    template <typename Key>
+    MapNode<K, V>* FindLowerBound(MapNode<K, V>* node, MapNode<K, V>* best_bound,
+                                  const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                if (order < 0) {
+                    best_bound = node;
+                    node = node->GetLeft().get();
+                } else {
+                    node = node->GetRight().get();
+                }
+            }
+        } else {
+            const Compare& compare = root_compare_.GetSecond();
+            while (node != nullptr) {
+                if (compare(node->GetKey(), key)) {
+                    node = node->GetRight().get();
+                } else {
+                    best_bound = node;
+                    node = node->GetLeft().get();
+                }
             }
         }
         return best_bound;
@@ -885,6 +1060,66 @@ private:
         ++size_;
     }
 
+    // Where a new key goes: the node it would precede, paired with true, or the equivalent
+    // node, paired with false.
+    std::pair<MapBaseNode<K, V>*, bool> FindInsertNext(const K& key) const {
+        auto end_node = const_cast<EndMapNode<K, V>*>(std::addressof(end_node_));
+        MapNode<K, V>* bound = FindLowerBound(key);
+        if (bound == nullptr) {
+            return {end_node, true};
+        }
+        return {bound, KeyCompare()(key, bound->GetKey())};
+    }
+
+    // Hangs a new node between next and its predecessor. One of the two always has the slot
+    // free: if next has a left subtree, the predecessor is its maximum and has no right child.
+    MapNode<K, V>* LinkMapNodeBefore(std::unique_ptr<MapNode<K, V>> node,
+                                     MapBaseNode<K, V>* next) {
+        MapNode<K, V>* linked = node.get();
+        MapBaseNode<K, V>* prev = next->GetPrev();
+        if (GetRootPtr() == nullptr) {
+            GetRoot() = std::move(node);
+        } else if (!next->IsMapEndNode() && next->GetMapNode()->GetLeft() == nullptr) {
+            linked->GetParent() = next->GetMapNode();
+            next->GetMapNode()->GetLeft() = std::move(node);
+        } else {
+            linked->GetParent() = prev->GetMapNode();
+            prev->GetMapNode()->GetRight() = std::move(node);
+        }
+        ConnectPrevNext(linked, prev, next);
+        IncreaseSize();
+        return linked;
+    }
+
+    template <typename First = void, typename... Rest>
+    static constexpr bool IsKeyAndValue() {
+        return sizeof...(Rest) == 1 && std::is_same_v<std::remove_cvref_t<First>, K>;
+    }
+
+    template <typename KK, typename... Args>
+    std::pair<Iterator, bool> TryEmplaceMapNode(KK&& key, Args&&... args) {
+        auto [next, vacant] = FindInsertNext(key);
+        if (!vacant) {
+            return {Iterator{next}, false};
+        }
+        auto node = std::make_unique<MapNode<K, V>>(
+            std::in_place, std::piecewise_construct, std::forward_as_tuple(std::forward<KK>(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        return {Iterator{LinkMapNodeBefore(std::move(node), next)}, true};
+    }
+
+    template <typename KK, typename M>
+    std::pair<Iterator, bool> InsertOrAssignMapNode(KK&& key, M&& value) {
+        auto [next, vacant] = FindInsertNext(key);
+        if (!vacant) {
+            next->GetMapNode()->GetValue() = std::forward<M>(value);
+            return {Iterator{next}, false};
+        }
+        auto node = std::make_unique<MapNode<K, V>>(std::in_place, std::forward<KK>(key),
+                                                    std::forward<M>(value));
+        return {Iterator{LinkMapNodeBefore(std::move(node), next)}, true};
+    }
+
     template <typename P>
     std::pair<Iterator, bool> InsertMapNode(P&& key_value) {
         MapNode<K, V>* node = GetRootPtr();
@@ -892,8 +1127,34 @@ private:
         bool left = false;
         MapBaseNode<K, V>* current_prev = std::addressof(end_node_);
         MapBaseNode<K, V>* current_next = std::addressof(end_node_);
+        using Key = std::remove_cvref_t<decltype(key_value.first)>;
+
+        // A key past either end of the map is hung off the maximum or the minimum without a
+        // descent, so that loading sorted keys does not walk the whole spine every time.
+        if (!Empty()) {
+            MapNode<K, V>* max_node = end_node_.GetPrev()->GetMapNode();
+            MapNode<K, V>* min_node = end_node_.GetNext()->GetMapNode();
+            if (KeyCompare()(max_node->GetKey(), key_value.first)) {
+                node = nullptr;
+                parent = max_node;
+                current_prev = max_node;
+            } else if (KeyCompare()(key_value.first, min_node->GetKey())) {
+                node = nullptr;
+                parent = min_node;
+                left = true;
+                current_next = min_node;
+            }
+        }
 
         while (true) {
+            // With one comparison per level, an equivalent key is the last node the descent
+            // passed on the right.
+            if constexpr (!kThreeWayCompare<Key>) {
+                if (node == nullptr && !current_prev->IsMapEndNode() &&
+                    !KeyCompare()(current_prev->GetMapNode()->GetKey(), key_value.first)) {
+                    return {Iterator(current_prev->GetMapNode()), false};
+                }
+            }
             if ((node == nullptr) && (parent == nullptr)) {
                 GetRoot() = std::make_unique<MapNode<K, V>>(std::forward<P>(key_value),
                                                             std::addressof(end_node_),
@@ -918,17 +1179,20 @@ private:
                 IncreaseSize();
                 return {Iterator(parent->GetRight().get()), true};
             }
-            if ((node != nullptr) && Equivalent(node->GetKey(), key_value.first, KeyCompare())) {
-                return {Iterator(node), false};
+            if constexpr (kThreeWayCompare<Key>) {
+                auto order = key_value.first <=> node->GetKey();
+                if (order == 0) {
+                    return {Iterator(node), false};
+                }
+                left = order < 0;
+            } else {
+                left = KeyCompare()(key_value.first, node->GetKey());
             }
-            if ((node != nullptr) && (KeyCompare()(key_value.first, node->GetKey()))) {
-                left = true;
-                parent = node;
+            parent = node;
+            if (left) {
                 current_next = node;
                 node = node->GetLeft().get();
             } else {
-                left = false;
-                parent = node;
                 current_prev = node;
                 node = node->GetRight().get();
             }
@@ -2,12 +2,16 @@
 
 #include <cassert>
 #include <cmath>
+#include <compare>
 #include <cstddef>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <span>
 #include <stack>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <iostream>
 #include "compressed_pair.h"
@@ -20,6 +24,8 @@ bool Equivalent(const K1& key_1, const K2& key_2, Compare compare) {
 template <typename K>
 class SetNode;
 
+// Links shared by the tree nodes and the end sentinel. The sentinel is told apart by a flag
+// rather than by a vtable, so walking the prev/next thread is a plain load.
 template <typename K>
 class SetBaseNode {
 public:
@@ -30,19 +36,47 @@ public:
     SetBaseNode& operator=(SetBaseNode&& other) = delete;
     ~SetBaseNode() noexcept = default;
 
-    virtual const K& GetKey() const = 0;
-    virtual K& GetKey() = 0;
-    virtual const std::unique_ptr<SetNode<K>>& GetLeft() const = 0;
-    virtual std::unique_ptr<SetNode<K>>& GetLeft() = 0;
-    virtual const std::unique_ptr<SetNode<K>>& GetRight() const = 0;
-    virtual std::unique_ptr<SetNode<K>>& GetRight() = 0;
-    virtual SetNode<K>* GetParent() const = 0;
-    virtual SetNode<K>*& GetParent() = 0;
-    virtual SetBaseNode<K>* GetPrev() const noexcept = 0;
-    virtual SetBaseNode<K>*& GetPrev() noexcept = 0;
-    virtual SetBaseNode<K>* GetNext() const noexcept = 0;
-    virtual SetBaseNode<K>*& GetNext() noexcept = 0;
-    virtual bool IsSetEndNode() const noexcept = 0;
+    SetBaseNode(SetBaseNode<K>* prev, SetBaseNode<K>* next, bool end_node) noexcept
+        : prev_(prev), next_(next), end_node_(end_node) {
+    }
+    SetBaseNode<K>* GetPrev() const noexcept {
+        return prev_;
+    }
+    SetBaseNode<K>*& GetPrev() noexcept {
+        return prev_;
+    }
+    SetBaseNode<K>* GetNext() const noexcept {
+        return next_;
+    }
+    SetBaseNode<K>*& GetNext() noexcept {
+        return next_;
+    }
+    const K& GetKey() const {
+        return GetSetNode()->GetKey();
+    }
+    K& GetKey() {
+        return GetSetNode()->GetKey();
+    }
+    const SetNode<K>* GetSetNode() const {
+        if (IsSetEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<const SetNode<K>*>(this);
+    }
+    SetNode<K>* GetSetNode() {
+        if (IsSetEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<SetNode<K>*>(this);
+    }
+    bool IsSetEndNode() const noexcept {
+        return end_node_;
+    }
+
+private:
+    SetBaseNode<K>* prev_ = nullptr;
+    SetBaseNode<K>* next_ = nullptr;
+    bool end_node_ = false;
 };
 
 template <typename K>
@@ -56,14 +90,14 @@ public:
     ~SetNode() = default;
 
     SetNode(const K& key, SetBaseNode<K>* prev, SetBaseNode<K>* next)
-        : key_(key), prev_(prev), next_(next) {
+        : SetBaseNode<K>(prev, next, false), key_(key) {
     }
     SetNode(K&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next)
-        : key_(std::move(key)), prev_(prev), next_(next) {
+        : SetBaseNode<K>(prev, next, false), key_(std::move(key)) {
     }
     template <typename P>
     SetNode(P&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next)
-        : key_(std::forward<P>(key)), prev_(prev), next_(next) {
+        : SetBaseNode<K>(prev, next, false), key_(std::forward<P>(key)) {
     }
     const K& GetKey() const noexcept {
         return key_;
@@ -89,86 +123,28 @@ public:
     SetNode<K>*& GetParent() noexcept {
         return parent_;
     }
-    SetBaseNode<K>* GetPrev() const noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>*& GetPrev() noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>* GetNext() const noexcept {
-        return next_;
-    }
-    SetBaseNode<K>*& GetNext() noexcept {
-        return next_;
-    }
-    bool IsSetEndNode() const noexcept {
-        return false;
-    }
 
 private:
     K key_;
     std::unique_ptr<SetNode<K>> left_;
     std::unique_ptr<SetNode<K>> right_;
     SetNode<K>* parent_ = nullptr;
-    SetBaseNode<K>* prev_ = nullptr;
-    SetBaseNode<K>* next_ = nullptr;
 };
 
 template <typename K>
 class SetEndNode : public SetBaseNode<K> {
 public:
-    SetEndNode() noexcept = default;
+    SetEndNode() noexcept : SetBaseNode<K>(nullptr, nullptr, true) {
+    }
     SetEndNode(const SetEndNode& other) = delete;
     SetEndNode& operator=(const SetEndNode& other) = delete;
     SetEndNode(SetEndNode&& other) noexcept = default;
     SetEndNode& operator=(SetEndNode&& other) noexcept = default;
     ~SetEndNode() noexcept = default;
 
-    SetEndNode(SetBaseNode<K>* prev, SetBaseNode<K>* next) noexcept : prev_(prev), next_(next) {
-    }
-    const K& GetKey() const {
-        throw std::out_of_range("Out of range!");
-    }
-    K& GetKey() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<SetNode<K>>& GetLeft() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<SetNode<K>>& GetLeft() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<SetNode<K>>& GetRight() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<SetNode<K>>& GetRight() {
-        throw std::out_of_range("Out of range!");
-    }
-    SetNode<K>* GetParent() const {
-        throw std::out_of_range("Out of range!");
-    }
-    SetNode<K>*& GetParent() {
-        throw std::out_of_range("Out of range!");
-    }
-    SetBaseNode<K>* GetPrev() const noexcept {
-        return prev_;
+    SetEndNode(SetBaseNode<K>* prev, SetBaseNode<K>* next) noexcept
+        : SetBaseNode<K>(prev, next, true) {
     }
-    SetBaseNode<K>*& GetPrev() noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>* GetNext() const noexcept {
-        return next_;
-    }
-    SetBaseNode<K>*& GetNext() noexcept {
-        return next_;
-    }
-    bool IsSetEndNode() const noexcept {
-        return true;
-    }
-
-private:
-    SetBaseNode<K>* prev_ = nullptr;
-    SetBaseNode<K>* next_ = nullptr;
 };
 
 template <typename K, typename Compare = std::less<K>>
@@ -186,6 +162,8 @@ public:
     using Pointer = SetType*;
     using ConstReference = const SetType&;
     using ConstPointer = const SetType*;
+    // Whether the lookups also take keys of other types, as std::less<> allows.
+    static constexpr bool kTransparentCompare = requires { typename Compare::is_transparent; };
 
     class ConstIterator;
 
@@ -430,13 +408,12 @@ public:
         Swap(tmp);
         return *this;
     }
-    ~SetBST() = default;
+    ~SetBST() {
+        DestroyNodes();
+    }
 
     void Clear() noexcept {
-        GetRoot() = nullptr;
-        size_ = 0;
-        end_node_.GetNext() = std::addressof(end_node_);
-        end_node_.GetPrev() = std::addressof(end_node_);
+        DestroyNodes();
     }
     void Swap(SetBST& other) {
         std::swap(GetRoot(), other.GetRoot());
@@ -463,72 +440,30 @@ public:
         Insert(ilist.begin(), ilist.end());
     }
     Iterator Find(const K& key) {
-        auto node = FindSetNode(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return Iterator{node};
+        return Iterator{FindOrEnd(key)};
     }
     ConstIterator Find(const K& key) const {
-        auto node = FindSetNode(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return ConstIterator{node};
+        return ConstIterator{FindOrEnd(key)};
     }
     Iterator LowerBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return Iterator{node};
+        return Iterator{LowerBoundOrEnd(key)};
     }
     ConstIterator LowerBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return ConstIterator{node};
+        return ConstIterator{LowerBoundOrEnd(key)};
     }
     Iterator UpperBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return Iterator{node->GetNext()};
-        }
-        return Iterator{node};
+        return Iterator{EqualRangeNodes(key).second};
     }
     ConstIterator UpperBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return ConstIterator{node->GetNext()};
-        }
-        return ConstIterator{node};
+        return ConstIterator{EqualRangeNodes(key).second};
     }
     std::pair<Iterator, Iterator> EqualRange(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {Iterator{node}, Iterator{node->GetNext()}};
-        }
-        return {Iterator{node}, Iterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
     }
     std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {ConstIterator{node}, ConstIterator{node->GetNext()}};
-        }
-        return {ConstIterator{node}, ConstIterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
     }
     bool Contains(const K& key) const {
         return FindSetNode(key) != nullptr;
@@ -536,6 +471,90 @@ public:
     size_t Count(const K& key) const {
         return static_cast<size_t>(Contains(key));
     }
+    // With a transparent comparator the lookups take any type it orders against K, so for
+    // example a std::string key is looked up by a std::string_view without building a string.
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator Find(const Key& key) {
+        return Iterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator Find(const Key& key) const {
+        return ConstIterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator LowerBound(const Key& key) {
+        return Iterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator LowerBound(const Key& key) const {
+        return ConstIterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator UpperBound(const Key& key) {
+        return Iterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator UpperBound(const Key& key) const {
+        return ConstIterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<Iterator, Iterator> EqualRange(const Key& key) {
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<ConstIterator, ConstIterator> EqualRange(const Key& key) const {
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    bool Contains(const Key& key) const {
+        return FindSetNode(key) != nullptr;
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    size_t Count(const Key& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    // Finger search: the same answer as LowerBound(key), found by climbing from the hint to
+    // the lowest ancestor whose subtree has to hold the answer and descending from there. The
+    // past-the-end hint stands for the last element. For an answer d elements away from the
+    // hint this takes O(log d) steps when the tree is balanced, and O(1) when it is adjacent.
+    Iterator LowerBound(ConstIterator hint, const K& key) {
+        return Iterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    ConstIterator LowerBound(ConstIterator hint, const K& key) const {
+        return ConstIterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    // Writes the lower bound of keys[i] to results[i], searching from the previous answer, so
+    // a batch sorted in ascending order costs O(log d) per key for a rank distance of d.
+    void LowerBoundSorted(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        const SetBaseNode<K>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = Iterator{node};
+            hint = node;
+        }
+    }
+    void LowerBoundSorted(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        const SetBaseNode<K>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = ConstIterator{node};
+            hint = node;
+        }
+    }
 
     Iterator Begin() noexcept {
         return Iterator{end_node_.GetNext()};
@@ -598,35 +617,164 @@ public:
     }
 
 private:
-    SetNode<K>* FindSetNode(const K& key) const {
-        SetNode<K>* node = GetRootPtr();
+    // Walks the prev/next thread and frees the nodes one by one. The child links are released
+    // beforehand, so no unique_ptr destructor recurses into a subtree and a degenerate tree
+    // is torn down in constant stack space.
+    void DestroyNodes() noexcept {
+        GetRoot().release();
+        SetBaseNode<K>* node = end_node_.GetNext();
+        while (!node->IsSetEndNode()) {
+            SetBaseNode<K>* next = node->GetNext();
+            auto tree_node = static_cast<SetNode<K>*>(node);
+            tree_node->GetLeft().release();
+            tree_node->GetRight().release();
+            delete tree_node;
+            node = next;
+        }
+        size_ = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
+    }
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
-                return node;
+    // Keys ordered by std::less that also have a consistent operator<=> are compared three-way:
+    // the one comparison per level also tells equality, so a lookup stops at the matching node.
+    template <typename Key>
+    static constexpr bool kThreeWayCompare =
+        (std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>) &&
+        std::three_way_comparable_with<Key, K, std::weak_ordering>;
+
+    template <typename Key>
+    SetNode<K>* FindSetNode(const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            SetNode<K>* node = GetRootPtr();
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                node = (order < 0) ? node->GetLeft().get() : node->GetRight().get();
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            return nullptr;
+        } else {
+            SetNode<K>* bound = FindLowerBound(key);
+            if (bound != nullptr && !KeyCompare()(key, bound->GetKey())) {
+                return bound;
             }
+            return nullptr;
         }
-        return nullptr;
     }
 
-    SetNode<K>* FindLowerBound(const K& key) const {
-        SetNode<K>* node = GetRootPtr();
-        SetNode<K>* best_bound = nullptr;
+    static void CheckBatchSize(size_t keys, size_t results) {
+        if (keys != results) {
+            throw std::invalid_argument("Batch keys and results differ in size");
+        }
+    }
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
+    SetBaseNode<K>* FindLowerBoundFrom(const SetBaseNode<K>* hint, const K& key) const {
+        auto end_node = const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        if (Empty()) {
+            return end_node;
+        }
+        if (hint == nullptr || hint->IsSetEndNode()) {
+            hint = end_node_.GetPrev();
+        }
+        auto node = const_cast<SetNode<K>*>(hint->GetSetNode());
+        const Compare& compare = root_compare_.GetSecond();
+        SetNode<K>* best_bound = nullptr;
+        if (compare(node->GetKey(), key)) {
+            auto next = node->GetNext();
+            if (next->IsSetEndNode() || !compare(next->GetSetNode()->GetKey(), key)) {
+                return next;
+            }
+            // Up to the first ancestor on the right that is not below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetLeft().get() == node && !compare(parent->GetKey(), key)) {
+                    best_bound = parent;
+                    break;
+                }
+                node = parent;
+            }
+        } else {
+            auto prev = node->GetPrev();
+            if (prev->IsSetEndNode() || compare(prev->GetSetNode()->GetKey(), key)) {
                 return node;
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                best_bound = node;
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            // Up to the first ancestor on the left that is below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetRight().get() == node && compare(parent->GetKey(), key)) {
+                    break;
+                }
+                node = parent;
+            }
+        }
+        auto bound = FindLowerBound(node, best_bound, key);
+        if (bound == nullptr) {
+            return end_node;
+        }
+        return bound;
+    }
+
+    template <typename Key>
+    SetBaseNode<K>* FindOrEnd(const Key& key) const {
+        SetNode<K>* node = FindSetNode(key);
+        if (node == nullptr) {
+            return const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    template <typename Key>
+    SetBaseNode<K>* LowerBoundOrEnd(const Key& key) const {
+        SetNode<K>* node = FindLowerBound(key);
+        if (node == nullptr) {
+            return const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    // The lower bound and the node after the equivalent one, if the key is present.
+    template <typename Key>
+    std::pair<SetBaseNode<K>*, SetBaseNode<K>*> EqualRangeNodes(const Key& key) const {
+        SetBaseNode<K>* first = LowerBoundOrEnd(key);
+        if (!first->IsSetEndNode() &&
+            !KeyCompare()(key, first->GetSetNode()->GetKey())) {
+            return {first, first->GetNext()};
+        }
+        return {first, first};
+    }
+
+    template <typename Key>
+    SetNode<K>* FindLowerBound(const Key& key) const {
+        return FindLowerBound(GetRootPtr(), nullptr, key);
+    }
+
+    // Lower bound within the subtree of the node, or best_bound if the subtree has none.
+    template <typename Key>
+    SetNode<K>* FindLowerBound(SetNode<K>* node, SetNode<K>* best_bound, const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                if (order < 0) {
+                    best_bound = node;
+                    node = node->GetLeft().get();
+                } else {
+                    node = node->GetRight().get();
+                }
+            }
+        } else {
+            const Compare& compare = root_compare_.GetSecond();
+            while (node != nullptr) {
+                if (compare(node->GetKey(), key)) {
+                    node = node->GetRight().get();
+                } else {
+                    best_bound = node;
+                    node = node->GetLeft().get();
+                }
             }
         }
         return best_bound;
@@ -866,8 +1014,34 @@ private:
         bool left = false;
         SetBaseNode<K>* current_prev = std::addressof(end_node_);
         SetBaseNode<K>* current_next = std::addressof(end_node_);
+        using Key = std::remove_cvref_t<P>;
+
+        // A key past either end of the set is hung off the maximum or the minimum without a
+        // descent, so that loading sorted keys does not walk the whole spine every time.
+        if (!Empty()) {
+            SetNode<K>* max_node = end_node_.GetPrev()->GetSetNode();
+            SetNode<K>* min_node = end_node_.GetNext()->GetSetNode();
+            if (KeyCompare()(max_node->GetKey(), key)) {
+                node = nullptr;
+                parent = max_node;
+                current_prev = max_node;
+            } else if (KeyCompare()(key, min_node->GetKey())) {
+                node = nullptr;
+                parent = min_node;
+                left = true;
+                current_next = min_node;
+            }
+        }
 
         while (true) {
+            // With one comparison per level, an equivalent key is the last node the descent
+            // passed on the right.
+            if constexpr (!kThreeWayCompare<Key>) {
+                if (node == nullptr && !current_prev->IsSetEndNode() &&
+                    !KeyCompare()(current_prev->GetSetNode()->GetKey(), key)) {
+                    return {Iterator(current_prev->GetSetNode()), false};
+                }
+            }
             if ((node == nullptr) && (parent == nullptr)) {
                 GetRoot() = std::make_unique<SetNode<K>>(
                     std::forward<P>(key), std::addressof(end_node_), std::addressof(end_node_));
@@ -891,17 +1065,20 @@ private:
                 IncreaseSize();
                 return {Iterator(parent->GetRight().get()), true};
             }
-            if ((node != nullptr) && Equivalent(node->GetKey(), key, KeyCompare())) {
-                return {Iterator(node), false};
+            if constexpr (kThreeWayCompare<Key>) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return {Iterator(node), false};
+                }
+                left = order < 0;
+            } else {
+                left = KeyCompare()(key, node->GetKey());
             }
-            if ((node != nullptr) && (KeyCompare()(key, node->GetKey()))) {
-                left = true;
-                parent = node;
+            parent = node;
+            if (left) {
                 current_next = node;
                 node = node->GetLeft().get();
             } else {
-                left = false;
-                parent = node;
                 current_prev = node;
                 node = node->GetRight().get();
             }
@@ -0,0 +1,53 @@
+#include "MapBST.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+void BenchTeardown(const std::string& name, const std::vector<int>& keys) {
+    auto map_bst = std::make_unique<MapBST<int, int>>();
+    for (int key : keys) {
+        map_bst->Insert({key, key});
+    }
+    double seconds = MeasureSeconds([&] { map_bst.reset(); });
+    Report(name, keys.size(), keys.size(), seconds);
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchTeardown("BenchTeardownRandom", GenerateShuffledKeys(size, 42));
+        std::vector<int> sorted(size);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        BenchTeardown("BenchTeardownDegenerate", sorted);
+    }
+}
@@ -5,6 +5,8 @@
 #include <map>
 #include <random>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -975,6 +977,185 @@ void TestSwapOuter() {
     std::cout << "TestSwapStress passed\n";
 }
 
+void TestDestroyDegenerateTree() {
+    const int size = 10'000'000;
+    {
+        MapBST<int, int> ascending;
+        for (int i = 0; i < size; ++i) {
+            ascending.Insert({i, i});
+        }
+        assert(ascending.Size() == static_cast<size_t>(size));
+        assert(ascending.Begin()->first == 0);
+        assert(ascending.RBegin()->first == size - 1);
+        assert(ascending.GetRootPtr()->GetLeft() == nullptr);
+    }
+    MapBST<int, int> descending;
+    for (int i = size / 10; i > 0; --i) {
+        descending.Insert({i, i});
+    }
+    assert(descending.Size() == static_cast<size_t>(size / 10));
+    descending.Clear();
+    assert(descending.Empty());
+    assert(descending.Begin() == descending.End());
+    descending.Insert({1, 1});
+    descending.Insert({3, 3});
+    descending.Insert({2, 2});
+    assert(descending.Size() == 3);
+    assert((++descending.Begin())->first == 2);
+    std::cout << "TestDestroyDegenerateTree passed\n";
+}
+
+void TestLowerBoundHint() {
+    MapBST<int, int> map_bst;
+    for (int val : GenerateRandomVector(2000, 0, 10000, 78)) {
+        map_bst.Insert({val, val});
+    }
+    const auto& const_map = map_bst;
+    std::vector<MapBST<int, int>::ConstIterator> hints;
+    for (auto it = map_bst.CBegin(); it != map_bst.CEnd(); ++it) {
+        hints.push_back(it);
+    }
+    hints.push_back(map_bst.CEnd());
+    auto probes = GenerateRandomVector(200, -100, 10100, 79);
+    for (size_t i = 0; i < hints.size(); i += 7) {
+        for (int key : probes) {
+            assert(map_bst.LowerBound(hints[i], key) == map_bst.LowerBound(key));
+            assert(const_map.LowerBound(hints[i], key) == map_bst.LowerBound(key));
+        }
+    }
+
+    for (bool sorted : {true, false}) {
+        auto keys = GenerateRandomVector(3000, -100, 10100, 80);
+        if (sorted) {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::vector<MapBST<int, int>::Iterator> results(keys.size(), map_bst.End());
+        std::vector<MapBST<int, int>::ConstIterator> const_results(keys.size(), map_bst.CEnd());
+        map_bst.LowerBoundSorted(keys, results);
+        const_map.LowerBoundSorted(keys, const_results);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            assert(results[i] == map_bst.LowerBound(keys[i]));
+            assert(const_results[i] == map_bst.LowerBound(keys[i]));
+        }
+    }
+
+    MapBST<int, int> empty;
+    assert(empty.LowerBound(empty.CEnd(), 5) == empty.End());
+    std::vector<int> keys = {1, 2};
+    std::vector<MapBST<int, int>::Iterator> results(keys.size(), map_bst.End());
+    empty.LowerBoundSorted(keys, results);
+    assert(results[0] == empty.End() && results[1] == empty.End());
+    std::cout << "TestLowerBoundHint passed\n";
+}
+
+// Counts how many values were built, to check that a present key builds none.
+struct CountedValue {
+    static inline int constructed = 0;
+    std::string text;
+    explicit CountedValue(std::string text_value) : text(std::move(text_value)) {
+        ++constructed;
+    }
+    CountedValue(size_t count, char symbol) : text(count, symbol) {
+        ++constructed;
+    }
+    CountedValue(const CountedValue& other) : text(other.text) {
+        ++constructed;
+    }
+    CountedValue& operator=(const CountedValue& other) = default;
+};
+
+void TestEmplace() {
+    MapBST<int, CountedValue> map;
+    CountedValue::constructed = 0;
+    auto [it, inserted] = map.Emplace(1, "one");
+    assert(inserted && it->first == 1 && it->second.text == "one");
+    std::tie(it, inserted) = map.Emplace(1, "uno");
+    assert(!inserted && it->second.text == "one");
+    assert(CountedValue::constructed == 1);
+    std::tie(it, inserted) = map.Emplace(std::piecewise_construct, std::forward_as_tuple(2),
+                                         std::forward_as_tuple(3, 'b'));
+    assert(inserted && it->second.text == "bbb");
+    std::tie(it, inserted) = map.Emplace(std::make_pair(2, CountedValue("two")));
+    assert(!inserted && it->second.text == "bbb");
+
+    CountedValue::constructed = 0;
+    std::tie(it, inserted) = map.TryEmplace(3, 2, 'c');
+    assert(inserted && it->first == 3 && it->second.text == "cc");
+    std::tie(it, inserted) = map.TryEmplace(3, 5, 'x');
+    assert(!inserted && it->second.text == "cc");
+    assert(CountedValue::constructed == 1);
+
+    std::tie(it, inserted) = map.InsertOrAssign(0, CountedValue("zero"));
+    assert(inserted && it == map.Begin() && it->second.text == "zero");
+    std::tie(it, inserted) = map.InsertOrAssign(3, CountedValue("three"));
+    assert(!inserted && it->second.text == "three");
+    assert(map.Size() == 4);
+
+    MapBST<std::string, std::string> strings;
+    std::string key = "key";
+    std::string value = "value";
+    strings.TryEmplace(std::move(key), std::move(value));
+    assert(key.empty() && value.empty() && strings.Find("key")->second == "value");
+    std::string taken = "value";
+    strings.TryEmplace("key", std::move(taken));
+    assert(taken == "value");
+
+    std::map<int, int> expected;
+    MapBST<int, int> random;
+    std::mt19937 gen(82);
+    std::uniform_int_distribution<int> dis(0, 500);
+    for (int i = 0; i < 2000; ++i) {
+        int key = dis(gen);
+        if (i % 3 == 0) {
+            random.Emplace(key, i);
+            expected.emplace(key, i);
+        } else if (i % 3 == 1) {
+            random.TryEmplace(key, i);
+            expected.try_emplace(key, i);
+        } else {
+            random.InsertOrAssign(key, i);
+            expected.insert_or_assign(key, i);
+        }
+    }
+    assert(random.Size() == expected.size());
+    auto random_it = random.Begin();
+    for (const auto& [key, value] : expected) {
+        assert(random_it->first == key && random_it->second == value);
+        ++random_it;
+    }
+    std::cout << "TestEmplace passed\n";
+}
+
+void TestTransparentLookup() {
+    MapBST<std::string, int, std::less<>> map_bst;
+    for (int i = 0; i < 100; ++i) {
+        map_bst.Insert({"key" + std::to_string(i * 2), i});
+    }
+    const auto& const_map = map_bst;
+    std::string_view present = "key10";
+    assert(map_bst.Find(present) == map_bst.Find(std::string("key10")));
+    assert(map_bst.Find(present) != map_bst.End());
+    assert(const_map.Find("key10") == map_bst.Find(present));
+    assert(map_bst.Find(std::string_view("key11")) == map_bst.End());
+    assert(map_bst.Contains("key0") && !map_bst.Contains(std::string_view("key")));
+    assert(map_bst.Count(std::string_view("key4")) == 1 && const_map.Count("key5") == 0);
+    for (const char* probe : {"", "key", "key1", "key10", "key11", "key98", "key99", "z"}) {
+        std::string key = probe;
+        std::string_view view = probe;
+        assert(map_bst.LowerBound(view) == map_bst.LowerBound(key));
+        assert(const_map.LowerBound(probe) == map_bst.LowerBound(key));
+        assert(map_bst.UpperBound(view) == map_bst.UpperBound(key));
+        assert(const_map.UpperBound(probe) == map_bst.UpperBound(key));
+        assert(map_bst.EqualRange(view) == map_bst.EqualRange(key));
+        assert(const_map.EqualRange(probe).first == map_bst.LowerBound(key));
+    }
+
+    MapBST<std::string, int> plain;
+    plain.Insert({"key", 1});
+    assert(plain.Find("key") != plain.End() && plain.Contains("key"));
+    std::cout << "TestTransparentLookup passed\n";
+}
+
 int main() {
     TestDefaultConstructor();
     TestComparatorConstructor();
@@ -1008,6 +1189,10 @@ int main() {
     TestOperatorEqual();
     TestOperatorNotEqual();
     TestSwapOuter();
+    TestDestroyDegenerateTree();
+    TestLowerBoundHint();
+    TestEmplace();
+    TestTransparentLookup();
 
     std::cout << "\nAll tests passed\n";
 }
\ No newline at end of file
@@ -933,6 +933,102 @@ void TestSwapOuter() {
     std::cout << "TestSwapStress passed\n";
 }
 
+void TestDestroyDegenerateTree() {
+    const int size = 1'000'000;
+    {
+        SetBST<int> ascending;
+        for (int i = 0; i < size; ++i) {
+            ascending.Insert(i);
+        }
+        assert(ascending.Size() == static_cast<size_t>(size));
+        assert(*ascending.RBegin() == size - 1);
+    }
+    SetBST<int> descending;
+    for (int i = size; i > 0; --i) {
+        descending.Insert(i);
+    }
+    assert(*descending.Begin() == 1);
+    descending.Clear();
+    assert(descending.Empty());
+    descending.Insert(2);
+    descending.Insert(1);
+    assert(*descending.Begin() == 1);
+    std::cout << "TestDestroyDegenerateTree passed\n";
+}
+
+void TestLowerBoundHint() {
+    SetBST<int> set_bst;
+    for (int val : GenerateRandomVector(2000, 0, 10000, 78)) {
+        set_bst.Insert(val);
+    }
+    const auto& const_set = set_bst;
+    std::vector<SetBST<int>::ConstIterator> hints;
+    for (auto it = set_bst.CBegin(); it != set_bst.CEnd(); ++it) {
+        hints.push_back(it);
+    }
+    hints.push_back(set_bst.CEnd());
+    auto probes = GenerateRandomVector(200, -100, 10100, 79);
+    for (size_t i = 0; i < hints.size(); i += 7) {
+        for (int key : probes) {
+            assert(set_bst.LowerBound(hints[i], key) == set_bst.LowerBound(key));
+            assert(const_set.LowerBound(hints[i], key) == set_bst.LowerBound(key));
+        }
+    }
+
+    for (bool sorted : {true, false}) {
+        auto keys = GenerateRandomVector(3000, -100, 10100, 80);
+        if (sorted) {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::vector<SetBST<int>::Iterator> results(keys.size(), set_bst.End());
+        std::vector<SetBST<int>::ConstIterator> const_results(keys.size(), set_bst.CEnd());
+        set_bst.LowerBoundSorted(keys, results);
+        const_set.LowerBoundSorted(keys, const_results);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            assert(results[i] == set_bst.LowerBound(keys[i]));
+            assert(const_results[i] == set_bst.LowerBound(keys[i]));
+        }
+    }
+
+    SetBST<int> empty;
+    assert(empty.LowerBound(empty.CEnd(), 5) == empty.End());
+    std::vector<int> keys = {1, 2};
+    std::vector<SetBST<int>::Iterator> results(keys.size(), set_bst.End());
+    empty.LowerBoundSorted(keys, results);
+    assert(results[0] == empty.End() && results[1] == empty.End());
+    std::cout << "TestLowerBoundHint passed\n";
+}
+
+void TestTransparentLookup() {
+    SetBST<std::string, std::less<>> set_bst;
+    for (int i = 0; i < 100; ++i) {
+        set_bst.Insert("key" + std::to_string(i * 2));
+    }
+    const auto& const_set = set_bst;
+    std::string_view present = "key10";
+    assert(set_bst.Find(present) == set_bst.Find(std::string("key10")));
+    assert(set_bst.Find(present) != set_bst.End());
+    assert(const_set.Find("key10") == set_bst.Find(present));
+    assert(set_bst.Find(std::string_view("key11")) == set_bst.End());
+    assert(set_bst.Contains("key0") && !set_bst.Contains(std::string_view("key")));
+    assert(set_bst.Count(std::string_view("key4")) == 1 && const_set.Count("key5") == 0);
+    for (const char* probe : {"", "key", "key1", "key10", "key11", "key98", "key99", "z"}) {
+        std::string key = probe;
+        std::string_view view = probe;
+        assert(set_bst.LowerBound(view) == set_bst.LowerBound(key));
+        assert(const_set.LowerBound(probe) == set_bst.LowerBound(key));
+        assert(set_bst.UpperBound(view) == set_bst.UpperBound(key));
+        assert(const_set.UpperBound(probe) == set_bst.UpperBound(key));
+        assert(set_bst.EqualRange(view) == set_bst.EqualRange(key));
+        assert(const_set.EqualRange(probe).first == set_bst.LowerBound(key));
+    }
+
+    SetBST<std::string> plain;
+    plain.Insert("key");
+    assert(plain.Find("key") != plain.End() && plain.Contains("key"));
+    std::cout << "TestTransparentLookup passed\n";
+}
+
 int main() {
 
     TestDefaultConstructor();
@@ -967,6 +1063,9 @@ int main() {
     TestOperatorEqual();
     TestOperatorNotEqual();
     TestSwapOuter();
+    TestDestroyDegenerateTree();
+    TestLowerBoundHint();
+    TestTransparentLookup();
 
     std::cout << "\nAll tests passed\n";
 }
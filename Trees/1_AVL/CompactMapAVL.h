@@ -0,0 +1,702 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "compressed_pair.h"
+
+// AVL map whose nodes live in one std::vector and refer to each other by 32-bit indices.
+// A node is the key-value pair plus three links: left, right and parent. The balance factor
+// takes no room of its own: the top bit of a child link marks that child's subtree as the
+// taller one. There is no prev/next thread; iterators climb the parent links instead. For a
+// MapAVL<int, int> node of 56 bytes this leaves 20.
+//
+// Erase moves the last node of the vector into the freed slot, so the vector stays dense, and
+// Insert may reallocate it: unlike MapAVL, both invalidate all iterators and references. The
+// elements are std::pair<K, V> rather than std::pair<const K, V>, so that Erase can move one
+// into the freed slot by assignment; the key of an element must not be changed through an
+// iterator. Holds up to 2^31 - 2 elements.
+template <typename K, typename V, typename Compare = std::less<K>,
+          typename Allocator = std::allocator<std::pair<K, V>>>
+class CompactMapAVL {
+    using Index = uint32_t;
+    static constexpr Index kTaller = Index{1} << 31;
+    static constexpr Index kNull = kTaller - 1;
+
+    struct Node {
+        template <typename... Args>
+        explicit Node(Index parent_index, Args&&... args)
+            : key_value(std::forward<Args>(args)...), parent(parent_index) {
+        }
+        Node(const Node& other) = default;
+        Node(Node&& other) = default;
+
+        std::pair<K, V> key_value;
+        Index left = kNull;
+        Index right = kNull;
+        Index parent = kNull;
+    };
+
+public:
+    using ValueType = std::pair<K, V>;
+
+    class ConstIterator;
+
+    class Iterator {
+    public:
+        Iterator() = default;
+
+        ValueType& operator*() const {
+            return map_->nodes_[index_].key_value;
+        }
+        ValueType* operator->() const {
+            return std::addressof(map_->nodes_[index_].key_value);
+        }
+        Iterator& operator++() {
+            index_ = map_->Successor(index_);
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            index_ = map_->Predecessor(index_);
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const noexcept {
+            return index_ == other.index_;
+        }
+
+    private:
+        friend class CompactMapAVL;
+        friend class ConstIterator;
+
+        Iterator(CompactMapAVL* map, Index index) noexcept : map_(map), index_(index) {
+        }
+
+        CompactMapAVL* map_ = nullptr;
+        Index index_ = kNull;
+    };
+
+    class ConstIterator {
+    public:
+        ConstIterator() = default;
+        ConstIterator(const Iterator& other) noexcept : map_(other.map_), index_(other.index_) {
+        }
+
+        const ValueType& operator*() const {
+            return map_->nodes_[index_].key_value;
+        }
+        const ValueType* operator->() const {
+            return std::addressof(map_->nodes_[index_].key_value);
+        }
+        ConstIterator& operator++() {
+            index_ = map_->Successor(index_);
+            return *this;
+        }
+        ConstIterator operator++(int) {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        ConstIterator& operator--() {
+            index_ = map_->Predecessor(index_);
+            return *this;
+        }
+        ConstIterator operator--(int) {
+            ConstIterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const ConstIterator& other) const noexcept {
+            return index_ == other.index_;
+        }
+
+    private:
+        friend class CompactMapAVL;
+
+        ConstIterator(const CompactMapAVL* map, Index index) noexcept
+            : map_(map), index_(index) {
+        }
+
+        const CompactMapAVL* map_ = nullptr;
+        Index index_ = kNull;
+    };
+
+    CompactMapAVL() : CompactMapAVL(Compare()) {
+    }
+    explicit CompactMapAVL(const Compare& compare, const Allocator& allocator = Allocator())
+        : nodes_(NodeAllocator(allocator)), root_compare_(kNull, compare) {
+    }
+    explicit CompactMapAVL(const Allocator& allocator) : CompactMapAVL(Compare(), allocator) {
+    }
+    template <typename InputIt>
+    CompactMapAVL(InputIt first, InputIt last, const Compare& compare = Compare(),
+                  const Allocator& allocator = Allocator())
+        : CompactMapAVL(compare, allocator) {
+        Insert(first, last);
+    }
+    CompactMapAVL(const CompactMapAVL& other) = default;
+    CompactMapAVL(CompactMapAVL&& other) noexcept
+        : nodes_(std::move(other.nodes_)), root_compare_(std::move(other.root_compare_)) {
+        other.Clear();
+    }
+    // Copy and swap, so a copy that throws leaves this map as it was; assigning the node
+    // vector in place could stop halfway through.
+    CompactMapAVL& operator=(const CompactMapAVL& other) {
+        CompactMapAVL copy(other);
+        Swap(copy);
+        return *this;
+    }
+    CompactMapAVL& operator=(CompactMapAVL&& other) noexcept {
+        CompactMapAVL moved(std::move(other));
+        Swap(moved);
+        return *this;
+    }
+    ~CompactMapAVL() = default;
+    CompactMapAVL(std::initializer_list<ValueType> values, const Compare& compare = Compare(),
+                  const Allocator& allocator = Allocator())
+        : CompactMapAVL(values.begin(), values.end(), compare, allocator) {
+    }
+
+    std::pair<Iterator, bool> Insert(const ValueType& key_value) {
+        return EmplaceKey(key_value.first, key_value);
+    }
+    std::pair<Iterator, bool> Insert(ValueType&& key_value) {
+        return EmplaceKey(key_value.first, std::move(key_value));
+    }
+    template <typename InputIt>
+    void Insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            Insert(*first);
+        }
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(const K& key, Args&&... args) {
+        return EmplaceKey(key, std::piecewise_construct, std::forward_as_tuple(key),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+    V& operator[](const K& key) {
+        return TryEmplace(key).first->second;
+    }
+    V& At(const K& key) {
+        Index index = FindIndex(key);
+        if (index == kNull) {
+            throw std::out_of_range("Key not found");
+        }
+        return nodes_[index].key_value.second;
+    }
+    const V& At(const K& key) const {
+        Index index = FindIndex(key);
+        if (index == kNull) {
+            throw std::out_of_range("Key not found");
+        }
+        return nodes_[index].key_value.second;
+    }
+
+    size_t Erase(const K& key) {
+        Index index = FindIndex(key);
+        if (index == kNull) {
+            return 0;
+        }
+        EraseIndex(index);
+        return 1;
+    }
+    void Clear() noexcept {
+        nodes_.clear();
+        GetRoot() = kNull;
+    }
+    void Swap(CompactMapAVL& other) noexcept {
+        nodes_.swap(other.nodes_);
+        std::swap(root_compare_, other.root_compare_);
+    }
+
+    Iterator Find(const K& key) {
+        return Iterator{this, FindIndex(key)};
+    }
+    ConstIterator Find(const K& key) const {
+        return ConstIterator{this, FindIndex(key)};
+    }
+    bool Contains(const K& key) const {
+        return FindIndex(key) != kNull;
+    }
+    size_t Count(const K& key) const {
+        return Contains(key) ? 1 : 0;
+    }
+    Iterator LowerBound(const K& key) {
+        return Iterator{this, LowerBoundIndex(key)};
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return ConstIterator{this, LowerBoundIndex(key)};
+    }
+    Iterator UpperBound(const K& key) {
+        return Iterator{this, UpperBoundIndex(key)};
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return ConstIterator{this, UpperBoundIndex(key)};
+    }
+
+    Iterator Begin() noexcept {
+        return Iterator{this, Leftmost(GetRoot())};
+    }
+    ConstIterator Begin() const noexcept {
+        return ConstIterator{this, Leftmost(GetRoot())};
+    }
+    Iterator End() noexcept {
+        return Iterator{this, kNull};
+    }
+    ConstIterator End() const noexcept {
+        return ConstIterator{this, kNull};
+    }
+    ConstIterator CBegin() const noexcept {
+        return Begin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return End();
+    }
+
+    size_t Size() const noexcept {
+        return nodes_.size();
+    }
+    bool Empty() const noexcept {
+        return nodes_.empty();
+    }
+    static constexpr size_t MaxSize() noexcept {
+        return kNull - 1;
+    }
+    void Reserve(size_t count) {
+        nodes_.reserve(count);
+    }
+    void ShrinkToFit() {
+        nodes_.shrink_to_fit();
+    }
+    // Bytes held by the map, counting the unused capacity of the vector.
+    size_t MemoryUsage() const noexcept {
+        return sizeof(*this) + nodes_.capacity() * sizeof(Node);
+    }
+    Compare KeyCompare() const {
+        return root_compare_.GetSecond();
+    }
+    Allocator GetAllocator() const {
+        return Allocator(nodes_.get_allocator());
+    }
+
+    // Read access to the links, for tests of the tree invariants. Child links come without
+    // the taller bit; a missing child is NullIndex().
+    static constexpr Index NullIndex() noexcept {
+        return kNull;
+    }
+    Index GetRootIndex() const noexcept {
+        return GetRoot();
+    }
+    Index GetLeft(Index index) const noexcept {
+        return nodes_[index].left & kNull;
+    }
+    Index GetRight(Index index) const noexcept {
+        return nodes_[index].right & kNull;
+    }
+    Index GetParent(Index index) const noexcept {
+        return nodes_[index].parent;
+    }
+    int GetBalance(Index index) const noexcept {
+        return static_cast<int>(nodes_[index].right >> 31) -
+               static_cast<int>(nodes_[index].left >> 31);
+    }
+    const ValueType& GetKeyValue(Index index) const noexcept {
+        return nodes_[index].key_value;
+    }
+
+private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    Index GetRoot() const noexcept {
+        return root_compare_.GetFirst();
+    }
+    Index& GetRoot() noexcept {
+        return root_compare_.GetFirst();
+    }
+    const K& GetKey(Index index) const noexcept {
+        return nodes_[index].key_value.first;
+    }
+
+    void SetLeft(Index index, Index child) noexcept {
+        nodes_[index].left = (nodes_[index].left & kTaller) | child;
+    }
+    void SetRight(Index index, Index child) noexcept {
+        nodes_[index].right = (nodes_[index].right & kTaller) | child;
+    }
+    void SetBalance(Index index, int balance) noexcept {
+        Node& node = nodes_[index];
+        node.left = (node.left & kNull) | (balance < 0 ? kTaller : 0);
+        node.right = (node.right & kNull) | (balance > 0 ? kTaller : 0);
+    }
+    // Points the link that led to old_child, in its parent or in the root, to new_child.
+    void ReplaceChild(Index parent, Index old_child, Index new_child) noexcept {
+        if (parent == kNull) {
+            GetRoot() = new_child;
+        } else if (GetLeft(parent) == old_child) {
+            SetLeft(parent, new_child);
+        } else {
+            SetRight(parent, new_child);
+        }
+    }
+
+    Index Leftmost(Index index) const noexcept {
+        if (index == kNull) {
+            return kNull;
+        }
+        while (GetLeft(index) != kNull) {
+            index = GetLeft(index);
+        }
+        return index;
+    }
+    Index Rightmost(Index index) const noexcept {
+        if (index == kNull) {
+            return kNull;
+        }
+        while (GetRight(index) != kNull) {
+            index = GetRight(index);
+        }
+        return index;
+    }
+    Index Successor(Index index) const noexcept {
+        if (GetRight(index) != kNull) {
+            return Leftmost(GetRight(index));
+        }
+        Index parent = GetParent(index);
+        while (parent != kNull && GetRight(parent) == index) {
+            index = parent;
+            parent = GetParent(index);
+        }
+        return parent;
+    }
+    // The predecessor of End() is the largest element.
+    Index Predecessor(Index index) const noexcept {
+        if (index == kNull) {
+            return Rightmost(GetRoot());
+        }
+        if (GetLeft(index) != kNull) {
+            return Rightmost(GetLeft(index));
+        }
+        Index parent = GetParent(index);
+        while (parent != kNull && GetLeft(parent) == index) {
+            index = parent;
+            parent = GetParent(index);
+        }
+        return parent;
+    }
+
+    Index FindIndex(const K& key) const {
+        const Compare& compare = root_compare_.GetSecond();
+        Index index = GetRoot();
+        while (index != kNull) {
+            if (compare(key, GetKey(index))) {
+                index = GetLeft(index);
+            } else if (compare(GetKey(index), key)) {
+                index = GetRight(index);
+            } else {
+                return index;
+            }
+        }
+        return kNull;
+    }
+    Index LowerBoundIndex(const K& key) const {
+        const Compare& compare = root_compare_.GetSecond();
+        Index index = GetRoot();
+        Index result = kNull;
+        while (index != kNull) {
+            if (compare(GetKey(index), key)) {
+                index = GetRight(index);
+            } else {
+                result = index;
+                index = GetLeft(index);
+            }
+        }
+        return result;
+    }
+    Index UpperBoundIndex(const K& key) const {
+        const Compare& compare = root_compare_.GetSecond();
+        Index index = GetRoot();
+        Index result = kNull;
+        while (index != kNull) {
+            if (compare(key, GetKey(index))) {
+                result = index;
+                index = GetLeft(index);
+            } else {
+                index = GetRight(index);
+            }
+        }
+        return result;
+    }
+
+    // Descends to the slot of key and builds the new node there from args, unless the key
+    // is already present.
+    template <typename... Args>
+    std::pair<Iterator, bool> EmplaceKey(const K& key, Args&&... args) {
+        const Compare& compare = root_compare_.GetSecond();
+        Index parent = kNull;
+        bool left = false;
+        for (Index index = GetRoot(); index != kNull;) {
+            parent = index;
+            if (compare(key, GetKey(index))) {
+                left = true;
+                index = GetLeft(index);
+            } else if (compare(GetKey(index), key)) {
+                left = false;
+                index = GetRight(index);
+            } else {
+                return {Iterator{this, index}, false};
+            }
+        }
+        if (Size() >= MaxSize()) {
+            throw std::length_error("CompactMapAVL is full");
+        }
+        auto index = static_cast<Index>(nodes_.size());
+        nodes_.emplace_back(parent, std::forward<Args>(args)...);
+        if (parent == kNull) {
+            GetRoot() = index;
+        } else if (left) {
+            SetLeft(parent, index);
+        } else {
+            SetRight(parent, index);
+        }
+        BalanceAfterInsert(index);
+        return {Iterator{this, index}, true};
+    }
+
+    // Walks up from a new leaf while the subtree heights grow, and rotates at the first node
+    // that leans too far.
+    void BalanceAfterInsert(Index child) {
+        for (Index parent = GetParent(child); parent != kNull;
+             child = parent, parent = GetParent(parent)) {
+            int balance = GetBalance(parent) + (GetLeft(parent) == child ? -1 : 1);
+            if (balance == 0) {
+                SetBalance(parent, 0);
+                return;
+            }
+            if (balance == 1 || balance == -1) {
+                SetBalance(parent, balance);
+                continue;
+            }
+            Rebalance(parent, balance);
+            return;
+        }
+    }
+
+    // Removes the node at index, keeping the vector dense. The last node of the vector first
+    // hands its pair over to the node at index. Then the node at index leaves the tree, and
+    // the last node's slot takes its place in the tree. Both steps only relink nodes. Only the
+    // hand-over touches elements, and it runs before the tree changes. It moves when neither
+    // K nor V can throw on a move, and copies otherwise, so a throw leaves the last element
+    // whole. The value goes first, so if assigning the key throws without changing it, the
+    // tree keeps its order; only the value of the element being erased has changed.
+    void EraseIndex(Index index) {
+        const auto last = static_cast<Index>(nodes_.size() - 1);
+        if (index != last) {
+            ValueType& target = nodes_[index].key_value;
+            ValueType& source = nodes_[last].key_value;
+            if constexpr (std::is_nothrow_move_assignable_v<K> &&
+                          std::is_nothrow_move_assignable_v<V>) {
+                target.second = std::move(source.second);
+                target.first = std::move(source.first);
+            } else {
+                target.second = source.second;
+                target.first = source.first;
+            }
+        }
+        UnlinkIndex(index);
+        if (index != last) {
+            MoveLinks(last, index);
+        }
+        nodes_.pop_back();
+    }
+
+    // Takes the node at index out of the tree by relinking nodes; a node with two children
+    // is replaced by its successor.
+    void UnlinkIndex(Index index) noexcept {
+        Index parent = GetParent(index);
+        Index left_child = GetLeft(index);
+        Index right_child = GetRight(index);
+        if (left_child == kNull || right_child == kNull) {
+            Index child = left_child != kNull ? left_child : right_child;
+            bool left = parent != kNull && GetLeft(parent) == index;
+            ReplaceChild(parent, index, child);
+            if (child != kNull) {
+                nodes_[child].parent = parent;
+            }
+            BalanceAfterErase(parent, left);
+            return;
+        }
+        Index successor = Leftmost(right_child);
+        Index shrunk_parent = successor;
+        bool shrunk_left = false;
+        if (successor != right_child) {
+            shrunk_parent = GetParent(successor);
+            shrunk_left = true;
+            Index successor_right = GetRight(successor);
+            SetLeft(shrunk_parent, successor_right);
+            if (successor_right != kNull) {
+                nodes_[successor_right].parent = shrunk_parent;
+            }
+            SetRight(successor, right_child);
+            nodes_[right_child].parent = successor;
+        }
+        SetLeft(successor, left_child);
+        nodes_[left_child].parent = successor;
+        SetBalance(successor, GetBalance(index));
+        ReplaceChild(parent, index, successor);
+        nodes_[successor].parent = parent;
+        BalanceAfterErase(shrunk_parent, shrunk_left);
+    }
+
+    // Walks up from the parent of a removed node while the subtree heights shrink.
+    void BalanceAfterErase(Index parent, bool left) {
+        while (parent != kNull) {
+            int balance = GetBalance(parent) + (left ? 1 : -1);
+            if (balance == 1 || balance == -1) {
+                SetBalance(parent, balance);
+                return;
+            }
+            if (balance == 0) {
+                SetBalance(parent, 0);
+            } else {
+                bool shrunk = false;
+                parent = Rebalance(parent, balance, &shrunk);
+                if (!shrunk) {
+                    return;
+                }
+            }
+            Index grandparent = GetParent(parent);
+            left = grandparent != kNull && GetLeft(grandparent) == parent;
+            parent = grandparent;
+        }
+    }
+
+    // Puts the node at to, which is out of the tree, in the place of the node at from.
+    void MoveLinks(Index from, Index to) noexcept {
+        Node& node = nodes_[to];
+        node.left = nodes_[from].left;
+        node.right = nodes_[from].right;
+        node.parent = nodes_[from].parent;
+        ReplaceChild(node.parent, from, to);
+        if (GetLeft(to) != kNull) {
+            nodes_[GetLeft(to)].parent = to;
+        }
+        if (GetRight(to) != kNull) {
+            nodes_[GetRight(to)].parent = to;
+        }
+    }
+
+    // Restores the balance of a node whose subtrees differ in height by two, by a single or
+    // a double rotation. Returns the new root of the subtree; shrunk tells whether the
+    // subtree got lower, which after an insert it always does.
+    Index Rebalance(Index index, int balance, bool* shrunk = nullptr) {
+        if (balance > 0) {
+            Index right = GetRight(index);
+            int right_balance = GetBalance(right);
+            if (right_balance >= 0) {
+                RotateLeft(index);
+                SetBalance(index, right_balance == 0 ? 1 : 0);
+                SetBalance(right, right_balance == 0 ? -1 : 0);
+                if (shrunk != nullptr) {
+                    *shrunk = right_balance != 0;
+                }
+                return right;
+            }
+            Index middle = GetLeft(right);
+            int middle_balance = GetBalance(middle);
+            RotateRight(right);
+            RotateLeft(index);
+            SetBalance(index, middle_balance > 0 ? -1 : 0);
+            SetBalance(right, middle_balance < 0 ? 1 : 0);
+            SetBalance(middle, 0);
+            if (shrunk != nullptr) {
+                *shrunk = true;
+            }
+            return middle;
+        }
+        Index left = GetLeft(index);
+        int left_balance = GetBalance(left);
+        if (left_balance <= 0) {
+            RotateRight(index);
+            SetBalance(index, left_balance == 0 ? -1 : 0);
+            SetBalance(left, left_balance == 0 ? 1 : 0);
+            if (shrunk != nullptr) {
+                *shrunk = left_balance != 0;
+            }
+            return left;
+        }
+        Index middle = GetRight(left);
+        int middle_balance = GetBalance(middle);
+        RotateLeft(left);
+        RotateRight(index);
+        SetBalance(index, middle_balance < 0 ? 1 : 0);
+        SetBalance(left, middle_balance > 0 ? -1 : 0);
+        SetBalance(middle, 0);
+        if (shrunk != nullptr) {
+            *shrunk = true;
+        }
+        return middle;
+    }
+
+    // Plain relinking; the callers set the balances afterwards.
+    void RotateLeft(Index index) {
+        Index right = GetRight(index);
+        Index inner = GetLeft(right);
+        Index parent = GetParent(index);
+        SetRight(index, inner);
+        if (inner != kNull) {
+            nodes_[inner].parent = index;
+        }
+        ReplaceChild(parent, index, right);
+        nodes_[right].parent = parent;
+        SetLeft(right, index);
+        nodes_[index].parent = right;
+    }
+    void RotateRight(Index index) {
+        Index left = GetLeft(index);
+        Index inner = GetRight(left);
+        Index parent = GetParent(index);
+        SetLeft(index, inner);
+        if (inner != kNull) {
+            nodes_[inner].parent = index;
+        }
+        ReplaceChild(parent, index, left);
+        nodes_[left].parent = parent;
+        SetRight(left, index);
+        nodes_[index].parent = left;
+    }
+
+    std::vector<Node, NodeAllocator> nodes_;
+    CompressedPair<Index, Compare> root_compare_;
+};
+
+template <typename K, typename V, typename Compare, typename Allocator>
+bool operator==(const CompactMapAVL<K, V, Compare, Allocator>& lhs,
+                const CompactMapAVL<K, V, Compare, Allocator>& rhs) {
+    if (lhs.Size() != rhs.Size()) {
+        return false;
+    }
+    Compare compare = lhs.KeyCompare();
+    for (auto it = lhs.Begin(), jt = rhs.Begin(); it != lhs.End(); ++it, ++jt) {
+        if (compare(it->first, jt->first) || compare(jt->first, it->first) ||
+            (it->second != jt->second)) {
+            return false;
+        }
+    }
+    return true;
+}
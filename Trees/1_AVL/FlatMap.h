@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "compressed_pair.h"
+
+// Ordered map over one sorted std::vector of key-value pairs, with the interface of MapAVL.
+// Lookups are binary searches over contiguous memory and iteration is a sequential scan, so for
+// small maps and maps that are read far more often than written it beats the node tree; an
+// insert or erase in the middle moves every element after it, so single updates cost O(n).
+// Bulk Insert sorts the new elements and merges them in, in O(n + m log m).
+//
+// The elements are std::pair<K, V> rather than std::pair<const K, V>, so that the vector can
+// move them; the key of an element must not be changed through an iterator. Inserts and
+// erases invalidate all iterators and references, as for a std::vector.
+template <typename K, typename V, typename Compare = std::less<K>,
+          typename Allocator = std::allocator<std::pair<K, V>>>
+class FlatMap {
+    using Container = std::vector<std::pair<K, V>, Allocator>;
+    static constexpr bool kTransparentCompare = requires { typename Compare::is_transparent; };
+
+public:
+    using ValueType = std::pair<K, V>;
+    using Iterator = typename Container::iterator;
+    using ConstIterator = typename Container::const_iterator;
+    using ReverseIterator = typename Container::reverse_iterator;
+    using ConstReverseIterator = typename Container::const_reverse_iterator;
+
+    FlatMap() : FlatMap(Compare()) {
+    }
+    explicit FlatMap(const Compare& compare, const Allocator& allocator = Allocator())
+        : entries_compare_(Container(allocator), compare) {
+    }
+    explicit FlatMap(const Allocator& allocator) : FlatMap(Compare(), allocator) {
+    }
+    template <typename InputIt>
+    FlatMap(InputIt first, InputIt last, const Compare& compare = Compare(),
+            const Allocator& allocator = Allocator())
+        : FlatMap(compare, allocator) {
+        Insert(first, last);
+    }
+    FlatMap(std::initializer_list<ValueType> values, const Compare& compare = Compare(),
+            const Allocator& allocator = Allocator())
+        : FlatMap(values.begin(), values.end(), compare, allocator) {
+    }
+    FlatMap(const FlatMap& other) = default;
+    FlatMap(FlatMap&& other) noexcept = default;
+    FlatMap& operator=(const FlatMap& other) = default;
+    FlatMap& operator=(FlatMap&& other) noexcept = default;
+    ~FlatMap() = default;
+
+    void Clear() noexcept {
+        Entries().clear();
+    }
+    void Swap(FlatMap& other) noexcept {
+        std::swap(entries_compare_, other.entries_compare_);
+    }
+
+    std::pair<Iterator, bool> Insert(const ValueType& key_value) {
+        return TryEmplace(key_value.first, key_value.second);
+    }
+    std::pair<Iterator, bool> Insert(ValueType&& key_value) {
+        return TryEmplace(std::move(key_value.first), std::move(key_value.second));
+    }
+    template <typename P>
+        requires std::is_constructible_v<ValueType, P&&>
+    std::pair<Iterator, bool> Insert(P&& key_value) {
+        return Insert(ValueType(std::forward<P>(key_value)));
+    }
+    // Appends the range, sorts it and merges it with the elements already in place: one pass
+    // over the map instead of a shift per element. Of several equivalent keys the element
+    // already in the map wins, then the first one in the range, as with repeated Insert. If
+    // an exception escapes before the merge, the map is left as it was.
+    template <typename InputIt>
+    void Insert(InputIt first, InputIt last) {
+        Container& entries = Entries();
+        const size_t old_size = entries.size();
+        try {
+            for (; first != last; ++first) {
+                entries.emplace_back(*first);
+            }
+            auto middle = entries.begin() + old_size;
+            if (!std::is_sorted(middle, entries.end(), ValueCompare())) {
+                std::stable_sort(middle, entries.end(), ValueCompare());
+            }
+            auto tail_end = std::unique(middle, entries.end(), ValueEquivalent());
+            tail_end = RemoveExisting(middle, tail_end);
+            entries.erase(tail_end, entries.end());
+        } catch (...) {
+            entries.erase(entries.begin() + old_size, entries.end());
+            throw;
+        }
+        auto middle = entries.begin() + old_size;
+        if (middle != entries.begin() && middle != entries.end() &&
+            ValueCompare()(*middle, *(middle - 1))) {
+            std::inplace_merge(entries.begin(), middle, entries.end(), ValueCompare());
+        }
+    }
+    void Insert(std::initializer_list<ValueType> ilist) {
+        Insert(ilist.begin(), ilist.end());
+    }
+    // Inserts without a search when the key belongs right before the hint; any other hint
+    // costs a binary search. Returns the inserted or the equivalent element.
+    Iterator Insert(ConstIterator hint, const ValueType& key_value) {
+        return EmplaceHint(hint, key_value);
+    }
+    Iterator Insert(ConstIterator hint, ValueType&& key_value) {
+        return EmplaceHint(hint, std::move(key_value));
+    }
+    template <typename... Args>
+    Iterator EmplaceHint(ConstIterator hint, Args&&... args) {
+        ValueType key_value(std::forward<Args>(args)...);
+        const Compare& compare = GetCompare();
+        if ((hint == CEnd() || compare(key_value.first, hint->first)) &&
+            (hint == CBegin() || compare((hint - 1)->first, key_value.first))) {
+            return Entries().insert(hint, std::move(key_value));
+        }
+        return Insert(std::move(key_value)).first;
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> Emplace(Args&&... args) {
+        return Insert(ValueType(std::forward<Args>(args)...));
+    }
+    // Looks the key up first and builds the value from the arguments only if the key is
+    // missing; otherwise the arguments are left untouched.
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(const K& key, Args&&... args) {
+        return TryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(K&& key, Args&&... args) {
+        return TryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    // Assigns to the value of an existing key, or inserts the pair if the key is missing.
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(const K& key, M&& value) {
+        auto [it, inserted] = TryEmplace(key, std::forward<M>(value));
+        if (!inserted) {
+            it->second = std::forward<M>(value);
+        }
+        return {it, inserted};
+    }
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(K&& key, M&& value) {
+        auto [it, inserted] = TryEmplace(std::move(key), std::forward<M>(value));
+        if (!inserted) {
+            it->second = std::forward<M>(value);
+        }
+        return {it, inserted};
+    }
+    V& operator[](const K& key) {
+        return TryEmplace(key).first->second;
+    }
+    V& At(const K& key) {
+        Iterator it = Find(key);
+        if (it == End()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return it->second;
+    }
+    const V& At(const K& key) const {
+        ConstIterator it = Find(key);
+        if (it == End()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return it->second;
+    }
+
+    Iterator Erase(ConstIterator pos) {
+        return Entries().erase(pos);
+    }
+    Iterator Erase(Iterator pos) {
+        return Entries().erase(pos);
+    }
+    Iterator Erase(ConstIterator first, ConstIterator last) {
+        return Entries().erase(first, last);
+    }
+    size_t Erase(const K& key) {
+        Iterator it = Find(key);
+        if (it == End()) {
+            return 0;
+        }
+        Entries().erase(it);
+        return 1;
+    }
+
+    Iterator Find(const K& key) {
+        return FindIn(*this, key);
+    }
+    ConstIterator Find(const K& key) const {
+        return FindIn(*this, key);
+    }
+    Iterator LowerBound(const K& key) {
+        return LowerBoundIn(*this, key);
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return LowerBoundIn(*this, key);
+    }
+    Iterator UpperBound(const K& key) {
+        return UpperBoundIn(*this, key);
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return UpperBoundIn(*this, key);
+    }
+    std::pair<Iterator, Iterator> EqualRange(const K& key) {
+        Iterator it = Find(key);
+        return {it, it == End() ? it : std::next(it)};
+    }
+    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
+        ConstIterator it = Find(key);
+        return {it, it == End() ? it : std::next(it)};
+    }
+    bool Contains(const K& key) const {
+        return Find(key) != End();
+    }
+    size_t Count(const K& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    // With a transparent comparator the lookups take any type it orders against K.
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator Find(const Key& key) {
+        return FindIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator Find(const Key& key) const {
+        return FindIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator LowerBound(const Key& key) {
+        return LowerBoundIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator LowerBound(const Key& key) const {
+        return LowerBoundIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator UpperBound(const Key& key) {
+        return UpperBoundIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator UpperBound(const Key& key) const {
+        return UpperBoundIn(*this, key);
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<Iterator, Iterator> EqualRange(const Key& key) {
+        Iterator it = Find(key);
+        return {it, it == End() ? it : std::next(it)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<ConstIterator, ConstIterator> EqualRange(const Key& key) const {
+        ConstIterator it = Find(key);
+        return {it, it == End() ? it : std::next(it)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    bool Contains(const Key& key) const {
+        return Find(key) != End();
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    size_t Count(const Key& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+
+    Iterator Begin() noexcept {
+        return Entries().begin();
+    }
+    ConstIterator Begin() const noexcept {
+        return Entries().begin();
+    }
+    Iterator End() noexcept {
+        return Entries().end();
+    }
+    ConstIterator End() const noexcept {
+        return Entries().end();
+    }
+    ConstIterator CBegin() const noexcept {
+        return Entries().cbegin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return Entries().cend();
+    }
+    ReverseIterator RBegin() noexcept {
+        return Entries().rbegin();
+    }
+    ConstReverseIterator RBegin() const noexcept {
+        return Entries().rbegin();
+    }
+    ReverseIterator REnd() noexcept {
+        return Entries().rend();
+    }
+    ConstReverseIterator REnd() const noexcept {
+        return Entries().rend();
+    }
+    ConstReverseIterator CRBegin() const noexcept {
+        return Entries().crbegin();
+    }
+    ConstReverseIterator CREnd() const noexcept {
+        return Entries().crend();
+    }
+
+    size_t Size() const noexcept {
+        return Entries().size();
+    }
+    size_t MaxSize() const noexcept {
+        return Entries().max_size();
+    }
+    bool Empty() const noexcept {
+        return Entries().empty();
+    }
+    void Reserve(size_t count) {
+        Entries().reserve(count);
+    }
+    void ShrinkToFit() {
+        Entries().shrink_to_fit();
+    }
+    Compare KeyCompare() const {
+        return GetCompare();
+    }
+    Allocator GetAllocator() const {
+        return Entries().get_allocator();
+    }
+
+private:
+    Container& Entries() noexcept {
+        return entries_compare_.GetFirst();
+    }
+    const Container& Entries() const noexcept {
+        return entries_compare_.GetFirst();
+    }
+    const Compare& GetCompare() const noexcept {
+        return entries_compare_.GetSecond();
+    }
+    auto ValueCompare() const {
+        return [&compare = GetCompare()](const ValueType& lhs, const ValueType& rhs) {
+            return compare(lhs.first, rhs.first);
+        };
+    }
+    auto ValueEquivalent() const {
+        return [&compare = GetCompare()](const ValueType& lhs, const ValueType& rhs) {
+            return !compare(lhs.first, rhs.first) && !compare(rhs.first, lhs.first);
+        };
+    }
+
+    // Moves the elements of the sorted tail [first, last) whose keys are not among the
+    // elements before it to the front of the tail, in one merge-like pass, and returns the
+    // end of the kept ones.
+    Iterator RemoveExisting(Iterator first, Iterator last) {
+        const Compare& compare = GetCompare();
+        Iterator existing = Begin();
+        const Iterator existing_end = first;
+        Iterator out = first;
+        for (Iterator it = first; it != last; ++it) {
+            while (existing != existing_end && compare(existing->first, it->first)) {
+                ++existing;
+            }
+            if (existing == existing_end || compare(it->first, existing->first)) {
+                if (out != it) {
+                    *out = std::move(*it);
+                }
+                ++out;
+            }
+        }
+        return out;
+    }
+
+    template <typename Self, typename Key>
+    static auto LowerBoundIn(Self& self, const Key& key) {
+        const Compare& compare = self.GetCompare();
+        return std::lower_bound(
+            self.Entries().begin(), self.Entries().end(), key,
+            [&](const ValueType& key_value, const Key& k) { return compare(key_value.first, k); });
+    }
+    template <typename Self, typename Key>
+    static auto UpperBoundIn(Self& self, const Key& key) {
+        const Compare& compare = self.GetCompare();
+        return std::upper_bound(
+            self.Entries().begin(), self.Entries().end(), key,
+            [&](const Key& k, const ValueType& key_value) { return compare(k, key_value.first); });
+    }
+    template <typename Self, typename Key>
+    static auto FindIn(Self& self, const Key& key) {
+        auto it = LowerBoundIn(self, key);
+        if (it != self.Entries().end() && self.GetCompare()(key, it->first)) {
+            return self.Entries().end();
+        }
+        return it;
+    }
+
+    template <typename Key, typename... Args>
+    std::pair<Iterator, bool> TryEmplaceKey(Key&& key, Args&&... args) {
+        Iterator it = LowerBound(key);
+        if (it != End() && !GetCompare()(key, it->first)) {
+            return {it, false};
+        }
+        it = Entries().emplace(it, std::piecewise_construct,
+                               std::forward_as_tuple(std::forward<Key>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        return {it, true};
+    }
+
+    CompressedPair<Container, Compare> entries_compare_;
+};
+
+template <typename K, typename V, typename Compare, typename Allocator>
+bool operator==(const FlatMap<K, V, Compare, Allocator>& lhs,
+                const FlatMap<K, V, Compare, Allocator>& rhs) {
+    if (lhs.Size() != rhs.Size()) {
+        return false;
+    }
+    Compare compare = lhs.KeyCompare();
+    for (auto it = lhs.Begin(), jt = rhs.Begin(); it != lhs.End(); ++it, ++jt) {
+        if (compare(it->first, jt->first) || compare(jt->first, it->first) ||
+            (it->second != jt->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename K, typename V, typename Compare, typename Allocator>
+void Swap(FlatMap<K, V, Compare, Allocator>& lhs, FlatMap<K, V, Compare, Allocator>& rhs) {
+    lhs.Swap(rhs);
+}
+
+template <typename K, typename V, typename Compare, typename Allocator>
+bool operator!=(const FlatMap<K, V, Compare, Allocator>& lhs,
+                const FlatMap<K, V, Compare, Allocator>& rhs) {
+    return !(lhs == rhs);
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "compressed_pair.h"
+
+// Search structure over n sorted keys laid out in Eytzinger order: the complete binary search
+// tree stored level by level in one array, the root at index 1 and the children of index k at
+// 2k and 2k + 1. A search reads one key per level, as in the AVL tree, but follows no pointers,
+// so the keys kPrefetchLevels levels below k, which sit side by side from k << kPrefetchLevels
+// on, are prefetched while the levels in between are compared. The comparison only picks the
+// next index; the loop has no branch that depends on the keys.
+//
+// The keys are copies of the ones the FrozenMap or FrozenSet keeps in sorted order, and a
+// search returns the rank of the key it finds in that order.
+template <typename K, typename Compare = std::less<K>>
+class EytzingerIndex {
+public:
+    EytzingerIndex() = default;
+    // Lays out the keys key_of(0), ..., key_of(size - 1), which have to be sorted by compare.
+    template <typename KeyOf>
+    EytzingerIndex(size_t size, const KeyOf& key_of, const Compare& compare)
+        : keys_compare_(std::vector<K>(), compare) {
+        if (size == 0) {
+            return;
+        }
+        std::vector<K>& keys = keys_compare_.GetFirst();
+        keys.reserve(size + 1);
+        // Index 0 is never compared; it holds a key only so that K needs no default constructor.
+        keys.push_back(key_of(0));
+        for (size_t index = 1; index <= size; ++index) {
+            keys.push_back(key_of(RankOf(index, size)));
+        }
+    }
+
+    size_t Size() const noexcept {
+        const std::vector<K>& keys = keys_compare_.GetFirst();
+        return keys.empty() ? 0 : keys.size() - 1;
+    }
+    Compare KeyCompare() const {
+        return keys_compare_.GetSecond();
+    }
+
+    // Rank of the first key not less than key, or Size() if there is none.
+    template <typename Key>
+    size_t LowerBound(const Key& key) const {
+        const Compare& compare = keys_compare_.GetSecond();
+        return Search(
+            [&](const K& node_key) { return static_cast<size_t>(compare(node_key, key)); });
+    }
+    // Rank of the first key greater than key, or Size() if there is none.
+    template <typename Key>
+    size_t UpperBound(const Key& key) const {
+        const Compare& compare = keys_compare_.GetSecond();
+        return Search(
+            [&](const K& node_key) { return static_cast<size_t>(!compare(key, node_key)); });
+    }
+
+    // Rank in sorted order of the key at Eytzinger index 1 <= index <= size. Index k on level
+    // d = bit_width(k) - 1 would be at position (2(k - 2^d) + 1) 2^(h - 1 - d) of the perfect
+    // tree of height h = bit_width(size), counting from 1; the leaves missing from the last
+    // level are the ones past the first size - 2^(h-1) + 1 of them, and every such leaf before
+    // that position moves it down by one.
+    static size_t RankOf(size_t index, size_t size) noexcept {
+        const int height = static_cast<int>(std::bit_width(size));
+        const int depth = static_cast<int>(std::bit_width(index)) - 1;
+        const size_t level_begin = size_t{1} << depth;
+        const size_t position = (2 * (index - level_begin) + 1) << (height - 1 - depth);
+        const size_t last_level = size - ((size_t{1} << (height - 1)) - 1);
+        const size_t missing = position / 2 > last_level ? position / 2 - last_level : 0;
+        return position - 1 - missing;
+    }
+
+private:
+    // Levels between a key and the block of its descendants that gets prefetched: the block
+    // holds 2^kPrefetchLevels keys, as many as fit in a 64-byte cache line.
+    static constexpr int kPrefetchLevels =
+        std::max(1, static_cast<int>(std::bit_width(std::max<size_t>(64 / sizeof(K), 1))) - 1);
+
+    static void Prefetch(const void* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    // Descends from the root, going right where go_right returns 1, until it falls off the
+    // tree. The answer is the last node where the search went left: dropping the trailing
+    // right turns and that left turn from the final index leaves its index, or 0 if the
+    // search never went left.
+    template <typename GoRight>
+    size_t Search(const GoRight& go_right) const {
+        const size_t size = Size();
+        const K* keys = keys_compare_.GetFirst().data();
+        size_t index = 1;
+        while (index <= size) {
+            const size_t ahead = index << kPrefetchLevels;
+            if (ahead <= size) {
+                Prefetch(keys + ahead);
+            }
+            index = 2 * index + go_right(keys[index]);
+        }
+        index >>= std::countr_one(index) + 1;
+        return index == 0 ? size : RankOf(index, size);
+    }
+
+    CompressedPair<std::vector<K>, Compare> keys_compare_;
+};
+
+// Immutable sorted map, made by MapAVL::Freeze for tables that are built once and then only
+// read. The elements sit in sorted order in one std::vector, so iteration is a sequential scan,
+// and Find, LowerBound and UpperBound search an EytzingerIndex of the keys. Iterators, which
+// are those of the vector, and references stay valid for the life of the map.
+template <typename K, typename V, typename Compare = std::less<K>>
+class FrozenMap {
+public:
+    using ValueType = std::pair<const K, V>;
+    using ConstIterator = typename std::vector<ValueType>::const_iterator;
+    using ConstReverseIterator = typename std::vector<ValueType>::const_reverse_iterator;
+
+    FrozenMap() = default;
+    // Takes over entries, which have to be sorted by compare with no two keys equivalent.
+    explicit FrozenMap(std::vector<ValueType> entries, const Compare& compare = Compare())
+        : entries_(std::move(entries)),
+          index_(
+              entries_.size(), [this](size_t rank) -> const K& { return entries_[rank].first; },
+              compare) {
+    }
+    FrozenMap(const FrozenMap& other) = default;
+    FrozenMap(FrozenMap&& other) noexcept = default;
+    // The keys in entries_ are const, so the vector cannot assign them; a copy is moved in
+    // instead.
+    FrozenMap& operator=(const FrozenMap& other) {
+        if (this != &other) {
+            FrozenMap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    FrozenMap& operator=(FrozenMap&& other) noexcept = default;
+    ~FrozenMap() = default;
+
+    ConstIterator Begin() const noexcept {
+        return entries_.begin();
+    }
+    ConstIterator End() const noexcept {
+        return entries_.end();
+    }
+    ConstIterator CBegin() const noexcept {
+        return entries_.cbegin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return entries_.cend();
+    }
+    ConstReverseIterator RBegin() const noexcept {
+        return entries_.rbegin();
+    }
+    ConstReverseIterator REnd() const noexcept {
+        return entries_.rend();
+    }
+
+    size_t Size() const noexcept {
+        return entries_.size();
+    }
+    bool Empty() const noexcept {
+        return entries_.empty();
+    }
+    Compare KeyCompare() const {
+        return index_.KeyCompare();
+    }
+
+    ConstIterator Find(const K& key) const {
+        ConstIterator it = LowerBound(key);
+        if (it == End() || KeyCompare()(key, it->first)) {
+            return End();
+        }
+        return it;
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return Begin() + index_.LowerBound(key);
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return Begin() + index_.UpperBound(key);
+    }
+    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
+        ConstIterator it = Find(key);
+        return {it, it == End() ? it : it + 1};
+    }
+    bool Contains(const K& key) const {
+        return Find(key) != End();
+    }
+    size_t Count(const K& key) const {
+        return Contains(key) ? 1 : 0;
+    }
+    const V& At(const K& key) const {
+        ConstIterator it = Find(key);
+        if (it == End()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return it->second;
+    }
+
+private:
+    std::vector<ValueType> entries_;
+    EytzingerIndex<K, Compare> index_;
+};
+
+template <typename K, typename V, typename Compare>
+bool operator==(const FrozenMap<K, V, Compare>& lhs, const FrozenMap<K, V, Compare>& rhs) {
+    if (lhs.Size() != rhs.Size()) {
+        return false;
+    }
+    Compare compare = lhs.KeyCompare();
+    for (auto it = lhs.Begin(), jt = rhs.Begin(); it != lhs.End(); ++it, ++jt) {
+        if (compare(it->first, jt->first) || compare(jt->first, it->first) ||
+            (it->second != jt->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Immutable sorted set, made by SetAVL::Freeze; see FrozenMap.
+template <typename K, typename Compare = std::less<K>>
+class FrozenSet {
+public:
+    using ConstIterator = typename std::vector<K>::const_iterator;
+    using ConstReverseIterator = typename std::vector<K>::const_reverse_iterator;
+
+    FrozenSet() = default;
+    // Takes over keys, which have to be sorted by compare with no two equivalent.
+    explicit FrozenSet(std::vector<K> keys, const Compare& compare = Compare())
+        : keys_(std::move(keys)),
+          index_(
+              keys_.size(), [this](size_t rank) -> const K& { return keys_[rank]; }, compare) {
+    }
+    FrozenSet(const FrozenSet& other) = default;
+    FrozenSet(FrozenSet&& other) noexcept = default;
+    FrozenSet& operator=(const FrozenSet& other) = default;
+    FrozenSet& operator=(FrozenSet&& other) noexcept = default;
+    ~FrozenSet() = default;
+
+    ConstIterator Begin() const noexcept {
+        return keys_.begin();
+    }
+    ConstIterator End() const noexcept {
+        return keys_.end();
+    }
+    ConstIterator CBegin() const noexcept {
+        return keys_.cbegin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return keys_.cend();
+    }
+    ConstReverseIterator RBegin() const noexcept {
+        return keys_.rbegin();
+    }
+    ConstReverseIterator REnd() const noexcept {
+        return keys_.rend();
+    }
+
+    size_t Size() const noexcept {
+        return keys_.size();
+    }
+    bool Empty() const noexcept {
+        return keys_.empty();
+    }
+    Compare KeyCompare() const {
+        return index_.KeyCompare();
+    }
+
+    ConstIterator Find(const K& key) const {
+        ConstIterator it = LowerBound(key);
+        if (it == End() || KeyCompare()(key, *it)) {
+            return End();
+        }
+        return it;
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return Begin() + index_.LowerBound(key);
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return Begin() + index_.UpperBound(key);
+    }
+    bool Contains(const K& key) const {
+        return Find(key) != End();
+    }
+    size_t Count(const K& key) const {
+        return Contains(key) ? 1 : 0;
+    }
+
+private:
+    std::vector<K> keys_;
+    EytzingerIndex<K, Compare> index_;
+};
+
+template <typename K, typename Compare>
+bool operator==(const FrozenSet<K, Compare>& lhs, const FrozenSet<K, Compare>& rhs) {
+    if (lhs.Size() != rhs.Size()) {
+        return false;
+    }
+    Compare compare = lhs.KeyCompare();
+    for (auto it = lhs.Begin(), jt = rhs.Begin(); it != lhs.End(); ++it, ++jt) {
+        if (compare(*it, *jt) || compare(*jt, *it)) {
+            return false;
+        }
+    }
+    return true;
+}
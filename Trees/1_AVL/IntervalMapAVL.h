@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "MapAVL.h"
+
+// Half-open interval [begin, end). Intervals are ordered by begin, then by end; an interval
+// with end <= begin is empty and overlaps nothing.
+template <typename T>
+struct Interval {
+    T begin;
+    T end;
+
+    bool Contains(const T& point) const {
+        return !(point < begin) && point < end;
+    }
+    bool Empty() const {
+        return !(begin < end);
+    }
+    bool Overlaps(const Interval& other) const {
+        return begin < other.end && other.begin < end && !Empty() && !other.Empty();
+    }
+    auto operator<=>(const Interval& other) const = default;
+};
+
+// Augmentation with the largest end of the intervals in a subtree, which tells whether any of
+// them can reach a query.
+template <typename T>
+struct MaxEndpoint {
+    using Summary = T;
+
+    static Summary Identity() {
+        return std::numeric_limits<T>::lowest();
+    }
+    template <typename V>
+    static Summary Lift(const std::pair<const Interval<T>, V>& key_value) {
+        return key_value.first.end;
+    }
+    static Summary Combine(const Summary& lhs, const Summary& rhs) {
+        return std::max(lhs, rhs);
+    }
+};
+
+// Map from intervals to values that finds the intervals overlapping a point or another
+// interval. It is a MapAVL keyed by the intervals in order of their begin, so inserts and
+// erases go through the same balancing, and every node keeps the largest end in its subtree.
+// A query skips the subtrees that end before it and the right subtrees that begin after it.
+// Every other subtree it enters holds a match, but each match may need its own path from the
+// root, so reporting k intervals costs O(log n + k log(n / k)): O(log n + k) when the matches
+// sit together in key order, as for short intervals, and O(k log n) at worst, when they are
+// scattered over the leaves. A centered interval tree or a priority search tree would bound it
+// by O(log n + k), at the price of balancing code of its own.
+template <typename T, typename V,
+          typename Allocator = std::allocator<std::pair<const Interval<T>, V>>>
+class IntervalMapAVL {
+public:
+    using IntervalType = Interval<T>;
+    using Tree = MapAVL<Interval<T>, V, std::less<Interval<T>>, Allocator, MaxEndpoint<T>>;
+    using ValueType = typename Tree::ValueType;
+    using Iterator = typename Tree::Iterator;
+    using ConstIterator = typename Tree::ConstIterator;
+
+    IntervalMapAVL() = default;
+    explicit IntervalMapAVL(const Allocator& allocator) : tree_(allocator) {
+    }
+
+    std::pair<Iterator, bool> Insert(const ValueType& key_value) {
+        return tree_.Insert(key_value);
+    }
+    std::pair<Iterator, bool> Insert(ValueType&& key_value) {
+        return tree_.Insert(std::move(key_value));
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> Emplace(Args&&... args) {
+        return tree_.Emplace(std::forward<Args>(args)...);
+    }
+    Iterator Erase(ConstIterator pos) {
+        return tree_.Erase(pos);
+    }
+    size_t Erase(const Interval<T>& interval) {
+        return tree_.Erase(interval);
+    }
+    void Clear() noexcept {
+        tree_.Clear();
+    }
+
+    Iterator Find(const Interval<T>& interval) {
+        return tree_.Find(interval);
+    }
+    ConstIterator Find(const Interval<T>& interval) const {
+        return tree_.Find(interval);
+    }
+    bool Contains(const Interval<T>& interval) const {
+        return tree_.Contains(interval);
+    }
+
+    // The intervals that contain the point, in order.
+    std::vector<ConstIterator> Overlapping(const T& point) const {
+        std::vector<ConstIterator> result;
+        ForEachOverlapping(point, [&](ConstIterator it) { result.push_back(it); });
+        return result;
+    }
+    // The intervals that share at least one point with the query, in order.
+    std::vector<ConstIterator> Overlapping(const Interval<T>& interval) const {
+        std::vector<ConstIterator> result;
+        ForEachOverlapping(interval, [&](ConstIterator it) { result.push_back(it); });
+        return result;
+    }
+    // Calls visit with every interval that contains the point, in order, without collecting
+    // them first.
+    template <typename F>
+    void ForEachOverlapping(const T& point, F&& visit) const {
+        VisitOverlapping(tree_.GetRootPtr(), point,
+                         [&](const Interval<T>& key) { return !(point < key.begin); }, visit);
+    }
+    template <typename F>
+    void ForEachOverlapping(const Interval<T>& interval, F&& visit) const {
+        if (interval.Empty()) {
+            return;
+        }
+        VisitOverlapping(tree_.GetRootPtr(), interval.begin,
+                         [&](const Interval<T>& key) { return key.begin < interval.end; }, visit);
+    }
+    size_t CountOverlapping(const T& point) const {
+        size_t count = 0;
+        ForEachOverlapping(point, [&](ConstIterator) { ++count; });
+        return count;
+    }
+
+    Iterator Begin() noexcept {
+        return tree_.Begin();
+    }
+    ConstIterator Begin() const noexcept {
+        return tree_.Begin();
+    }
+    Iterator End() noexcept {
+        return tree_.End();
+    }
+    ConstIterator End() const noexcept {
+        return tree_.End();
+    }
+    ConstIterator CBegin() const noexcept {
+        return tree_.CBegin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return tree_.CEnd();
+    }
+    size_t Size() const noexcept {
+        return tree_.Size();
+    }
+    bool Empty() const noexcept {
+        return tree_.Empty();
+    }
+    const Tree& GetTree() const noexcept {
+        return tree_;
+    }
+
+private:
+    using Node = MapNode<Interval<T>, V, MaxEndpoint<T>>;
+
+    // In-order walk of the subtree restricted to the intervals that end after low and, by
+    // begins_before, begin before the end of the query. It enters only subtrees whose largest
+    // end is past low, so it stays on the paths to the matches, plus the one path along which
+    // begins_before first fails.
+    template <typename BeginsBefore, typename F>
+    static void VisitOverlapping(const Node* node, const T& low, const BeginsBefore& begins_before,
+                                 F& visit) {
+        while (node != nullptr && low < node->GetSummary()) {
+            VisitOverlapping(node->GetLeft(), low, begins_before, visit);
+            if (!begins_before(node->GetKey())) {
+                return;
+            }
+            if (low < node->GetKey().end && !node->GetKey().Empty()) {
+                // The tree is threaded, so its iterators need no end node.
+                visit(ConstIterator{node, nullptr});
+            }
+            node = node->GetRight();
+        }
+    }
+
+    Tree tree_;
+};
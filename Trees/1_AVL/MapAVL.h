@@ -1,28 +1,117 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <compare>
 #include <cstddef>
+#include <functional>
+#include <iterator>
 #include <limits>
 #include <memory>
-#include <stack>
+#include <span>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include <iostream>
+#include "FrozenMap.h"
 #include "compressed_pair.h"
+#include "pool_allocator.h"
+#include "task_pool.h"
 
-template <typename K, typename Compare>
-bool Equivalent(const K& key_1, const K& key_2, Compare compare) {
+template <typename K1, typename K2, typename Compare>
+bool Equivalent(const K1& key_1, const K2& key_2, Compare compare) {
     return !(compare(key_1, key_2)) && (!compare(key_2, key_1));
 }
 
-template <typename K, typename V>
+// Augmentation policies. A policy keeps in every node a Summary of its subtree: Lift turns one
+// key-value pair into a summary, and Combine joins the summaries of neighbouring ranges, with
+// Identity as its neutral element. Combine has to be associative but need not be commutative.
+// The tree keeps the summaries up to date through inserts, erases, rotations and
+// InsertOrAssign; a value changed in place through an iterator leaves them stale.
+
+// No summary at all; the member it would occupy takes no space.
+struct NoAugmentation {
+    struct Summary {};
+};
+
+// Subtree sizes, which give rank and select queries in logarithmic time.
+struct OrderStatistics {
+    using Summary = size_t;
+
+    static Summary Identity() noexcept {
+        return 0;
+    }
+    template <typename K, typename V>
+    static Summary Lift(const std::pair<const K, V>&) noexcept {
+        return 1;
+    }
+    static Summary Combine(Summary lhs, Summary rhs) noexcept {
+        return lhs + rhs;
+    }
+};
+
+// Sum of the values, e.g. the total size of the entries in a key range.
+template <typename V>
+struct SumOfValues {
+    using Summary = V;
+
+    static Summary Identity() {
+        return V{};
+    }
+    template <typename K>
+    static Summary Lift(const std::pair<const K, V>& key_value) {
+        return key_value.second;
+    }
+    static Summary Combine(const Summary& lhs, const Summary& rhs) {
+        return lhs + rhs;
+    }
+};
+
+// Smallest and largest value. The summary of an empty range has min > max.
+template <typename V>
+struct MinMaxOfValues {
+    struct Summary {
+        V min = std::numeric_limits<V>::max();
+        V max = std::numeric_limits<V>::lowest();
+    };
+
+    static Summary Identity() {
+        return {};
+    }
+    template <typename K>
+    static Summary Lift(const std::pair<const K, V>& key_value) {
+        return {key_value.second, key_value.second};
+    }
+    static Summary Combine(const Summary& lhs, const Summary& rhs) {
+        return {std::min(lhs.min, rhs.min), std::max(lhs.max, rhs.max)};
+    }
+};
+
+// Threading policies. A threaded tree links every node to its neighbours in key order, so the
+// iterators step in O(1) and Erase finds the successor without a walk. An unthreaded tree
+// drops these two pointers, 16 bytes per node, and the stores that keep them up to date on
+// every insert and erase; its iterators walk the parent links instead, O(1) amortized over a
+// full pass. Split, Join, ExtractRange and Merge relink whole threads and need a threaded tree.
+struct Threaded {};
+struct Unthreaded {};
+
+template <typename K, typename V, typename Augment = NoAugmentation,
+          typename Threading = Threaded>
 class MapNode;
 
-template <typename K, typename V>
+// Links shared by the tree nodes and the end sentinel. The sentinel is told apart by a flag
+// rather than by a vtable, so walking the prev/next thread is a plain load. Unthreaded nodes
+// carry no thread at all and keep only the flag.
+template <typename K, typename V, typename Augment = NoAugmentation,
+          typename Threading = Threaded>
 class MapBaseNode {
 public:
+    static constexpr bool kThreaded = std::is_same_v<Threading, Threaded>;
+
     MapBaseNode() noexcept = default;
     MapBaseNode(const MapBaseNode& other) = delete;
     MapBaseNode& operator=(const MapBaseNode& other) = delete;
@@ -30,28 +119,60 @@ public:
     MapBaseNode& operator=(MapBaseNode&& other) = delete;
     ~MapBaseNode() noexcept = default;
 
-    virtual const K& GetKey() const = 0;
-    virtual const V& GetValue() const = 0;
-    virtual V& GetValue() = 0;
-    virtual const std::unique_ptr<MapNode<K, V>>& GetLeft() const = 0;
-    virtual std::unique_ptr<MapNode<K, V>>& GetLeft() = 0;
-    virtual const std::unique_ptr<MapNode<K, V>>& GetRight() const = 0;
-    virtual std::unique_ptr<MapNode<K, V>>& GetRight() = 0;
-    virtual MapNode<K, V>* GetParent() const = 0;
-    virtual MapNode<K, V>*& GetParent() = 0;
-    virtual MapBaseNode<K, V>* GetPrev() const noexcept = 0;
-    virtual MapBaseNode<K, V>*& GetPrev() noexcept = 0;
-    virtual MapBaseNode<K, V>* GetNext() const noexcept = 0;
-    virtual MapBaseNode<K, V>*& GetNext() noexcept = 0;
-    virtual const std::pair<const K, V>& GetKeyValue() const = 0;
-    virtual std::pair<const K, V>& GetKeyValue() = 0;
-    virtual signed char GetBalance() const = 0;
-    virtual signed char& GetBalance() = 0;
-    virtual bool IsMapEndNode() const noexcept = 0;
+    MapBaseNode(MapBaseNode* prev, MapBaseNode* next, bool end_node) noexcept
+        : end_node_(end_node) {
+        if constexpr (kThreaded) {
+            links_.prev = prev;
+            links_.next = next;
+        }
+    }
+    MapBaseNode* GetPrev() const noexcept requires kThreaded {
+        return links_.prev;
+    }
+    MapBaseNode*& GetPrev() noexcept requires kThreaded {
+        return links_.prev;
+    }
+    MapBaseNode* GetNext() const noexcept requires kThreaded {
+        return links_.next;
+    }
+    MapBaseNode*& GetNext() noexcept requires kThreaded {
+        return links_.next;
+    }
+    const std::pair<const K, V>& GetKeyValue() const {
+        return GetMapNode()->GetKeyValue();
+    }
+    std::pair<const K, V>& GetKeyValue() {
+        return GetMapNode()->GetKeyValue();
+    }
+    const MapNode<K, V, Augment, Threading>* GetMapNode() const {
+        if (IsMapEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<const MapNode<K, V, Augment, Threading>*>(this);
+    }
+    MapNode<K, V, Augment, Threading>* GetMapNode() {
+        if (IsMapEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<MapNode<K, V, Augment, Threading>*>(this);
+    }
+    bool IsMapEndNode() const noexcept {
+        return end_node_;
+    }
+
+private:
+    struct Links {
+        MapBaseNode* prev = nullptr;
+        MapBaseNode* next = nullptr;
+    };
+    struct NoLinks {};
+
+    [[no_unique_address]] std::conditional_t<kThreaded, Links, NoLinks> links_;
+    bool end_node_ = false;
 };
 
-template <typename K, typename V>
-class MapNode : public MapBaseNode<K, V> {
+template <typename K, typename V, typename Augment, typename Threading>
+class MapNode : public MapBaseNode<K, V, Augment, Threading> {
 public:
     MapNode() = default;
     MapNode(const MapNode& other) = delete;
@@ -60,21 +181,36 @@ public:
     MapNode& operator=(MapNode&& other) = delete;
     ~MapNode() = default;
 
-    MapNode(const K& key, const V& value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next,
-            signed char balance)
-        : key_value_(key, value), prev_(prev), next_(next), balance_(balance) {
+    MapNode(const K& key, const V& value, MapBaseNode<K, V, Augment, Threading>* prev,
+            MapBaseNode<K, V, Augment, Threading>* next, signed char balance)
+        : MapBaseNode<K, V, Augment, Threading>(prev, next, false),
+          balance_(balance),
+          key_value_(key, value) {
     }
-    MapNode(const std::pair<const K, V>& key_value, MapBaseNode<K, V>* prev,
-            MapBaseNode<K, V>* next, signed char balance)
-        : key_value_(key_value), prev_(prev), next_(next), balance_(balance) {
+    MapNode(const std::pair<const K, V>& key_value, MapBaseNode<K, V, Augment, Threading>* prev,
+            MapBaseNode<K, V, Augment, Threading>* next, signed char balance)
+        : MapBaseNode<K, V, Augment, Threading>(prev, next, false),
+          balance_(balance),
+          key_value_(key_value) {
     }
-    MapNode(std::pair<const K, V>&& key_value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next,
-            signed char balance)
-        : key_value_(std::move(key_value)), prev_(prev), next_(next), balance_(balance) {
+    MapNode(std::pair<const K, V>&& key_value, MapBaseNode<K, V, Augment, Threading>* prev,
+            MapBaseNode<K, V, Augment, Threading>* next, signed char balance)
+        : MapBaseNode<K, V, Augment, Threading>(prev, next, false),
+          balance_(balance),
+          key_value_(std::move(key_value)) {
     }
     template <typename P>
-    MapNode(P&& key_value, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next, signed char balance)
-        : key_value_(std::forward<P>(key_value)), prev_(prev), next_(next), balance_(balance) {
+    MapNode(P&& key_value, MapBaseNode<K, V, Augment, Threading>* prev,
+            MapBaseNode<K, V, Augment, Threading>* next, signed char balance)
+        : MapBaseNode<K, V, Augment, Threading>(prev, next, false),
+          balance_(balance),
+          key_value_(std::forward<P>(key_value)) {
+    }
+    // Builds the key-value pair from the arguments of an Emplace, unlinked.
+    template <typename... Args>
+    explicit MapNode(std::in_place_t, Args&&... args)
+        : MapBaseNode<K, V, Augment, Threading>(nullptr, nullptr, false),
+          key_value_(std::forward<Args>(args)...) {
     }
     const K& GetKey() const noexcept {
         return key_value_.first;
@@ -85,36 +221,24 @@ public:
     V& GetValue() noexcept {
         return key_value_.second;
     }
-    const std::unique_ptr<MapNode<K, V>>& GetLeft() const noexcept {
+    MapNode<K, V, Augment, Threading>* GetLeft() const noexcept {
         return left_;
     }
-    std::unique_ptr<MapNode<K, V>>& GetLeft() noexcept {
+    MapNode<K, V, Augment, Threading>*& GetLeft() noexcept {
         return left_;
     }
-    const std::unique_ptr<MapNode<K, V>>& GetRight() const noexcept {
+    MapNode<K, V, Augment, Threading>* GetRight() const noexcept {
         return right_;
     }
-    std::unique_ptr<MapNode<K, V>>& GetRight() noexcept {
+    MapNode<K, V, Augment, Threading>*& GetRight() noexcept {
         return right_;
     }
-    MapNode<K, V>* GetParent() const noexcept {
+    MapNode<K, V, Augment, Threading>* GetParent() const noexcept {
         return parent_;
     }
-    MapNode<K, V>*& GetParent() noexcept {
+    MapNode<K, V, Augment, Threading>*& GetParent() noexcept {
         return parent_;
     }
-    MapBaseNode<K, V>* GetPrev() const noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>*& GetPrev() noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>* GetNext() const noexcept {
-        return next_;
-    }
-    MapBaseNode<K, V>*& GetNext() noexcept {
-        return next_;
-    }
     const std::pair<const K, V>& GetKeyValue() const noexcept {
         return key_value_;
     }
@@ -127,112 +251,122 @@ public:
     signed char& GetBalance() {
         return balance_;
     }
-    bool IsMapEndNode() const noexcept {
-        return false;
+    const typename Augment::Summary& GetSummary() const noexcept {
+        return summary_;
+    }
+    typename Augment::Summary& GetSummary() noexcept {
+        return summary_;
     }
 
 private:
-    std::pair<const K, V> key_value_;
-    std::unique_ptr<MapNode<K, V>> left_;
-    std::unique_ptr<MapNode<K, V>> right_;
-    MapNode<K, V>* parent_ = nullptr;
-    MapBaseNode<K, V>* prev_ = nullptr;
-    MapBaseNode<K, V>* next_ = nullptr;
+    // Declared first so that it lands in the tail padding of MapBaseNode.
     signed char balance_ = 0;
+    std::pair<const K, V> key_value_;
+    MapNode<K, V, Augment, Threading>* left_ = nullptr;
+    MapNode<K, V, Augment, Threading>* right_ = nullptr;
+    MapNode<K, V, Augment, Threading>* parent_ = nullptr;
+    [[no_unique_address]] typename Augment::Summary summary_{};
 };
 
-template <typename K, typename V>
-class EndMapNode : public MapBaseNode<K, V> {
+// The end sentinel. It holds the first and the last node of the tree: in the thread when there
+// is one, in links of its own otherwise.
+template <typename K, typename V, typename Augment = NoAugmentation,
+          typename Threading = Threaded>
+class EndMapNode : public MapBaseNode<K, V, Augment, Threading> {
 public:
-    EndMapNode() noexcept = default;
+    using Base = MapBaseNode<K, V, Augment, Threading>;
+
+    EndMapNode() noexcept : Base(nullptr, nullptr, true) {
+    }
     EndMapNode(const EndMapNode& other) = delete;
     EndMapNode& operator=(const EndMapNode& other) = delete;
     EndMapNode(EndMapNode&& other) noexcept = default;
     EndMapNode& operator=(EndMapNode&& other) noexcept = default;
     ~EndMapNode() noexcept = default;
 
-    EndMapNode(MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next) noexcept
-        : prev_(prev), next_(next) {
-    }
-    const K& GetKey() const {
-        throw std::out_of_range("Out of range!");
-    }
-    const V& GetValue() const {
-        throw std::out_of_range("Out of range!");
-    }
-    V& GetValue() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<MapNode<K, V>>& GetLeft() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<MapNode<K, V>>& GetLeft() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<MapNode<K, V>>& GetRight() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<MapNode<K, V>>& GetRight() {
-        throw std::out_of_range("Out of range!");
-    }
-    MapNode<K, V>* GetParent() const {
-        throw std::out_of_range("Out of range!");
-    }
-    MapNode<K, V>*& GetParent() {
-        throw std::out_of_range("Out of range!");
-    }
-    MapBaseNode<K, V>* GetPrev() const noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>*& GetPrev() noexcept {
-        return prev_;
-    }
-    MapBaseNode<K, V>* GetNext() const noexcept {
-        return next_;
-    }
-    MapBaseNode<K, V>*& GetNext() noexcept {
-        return next_;
-    }
-    const std::pair<const K, V>& GetKeyValue() const {
-        throw std::out_of_range("Out of range!");
+    EndMapNode(Base* prev, Base* next) noexcept : Base(prev, next, true) {
+        if constexpr (!Base::kThreaded) {
+            bounds_.last = prev;
+            bounds_.first = next;
+        }
     }
-    std::pair<const K, V>& GetKeyValue() {
-        throw std::out_of_range("Out of range!");
+    Base* GetPrev() const noexcept {
+        if constexpr (Base::kThreaded) {
+            return Base::GetPrev();
+        } else {
+            return bounds_.last;
+        }
     }
-    signed char GetBalance() const {
-        throw std::out_of_range("Out of range!");
+    Base*& GetPrev() noexcept {
+        if constexpr (Base::kThreaded) {
+            return Base::GetPrev();
+        } else {
+            return bounds_.last;
+        }
     }
-    signed char& GetBalance() {
-        throw std::out_of_range("Out of range!");
+    Base* GetNext() const noexcept {
+        if constexpr (Base::kThreaded) {
+            return Base::GetNext();
+        } else {
+            return bounds_.first;
+        }
     }
-    bool IsMapEndNode() const noexcept {
-        return true;
+    Base*& GetNext() noexcept {
+        if constexpr (Base::kThreaded) {
+            return Base::GetNext();
+        } else {
+            return bounds_.first;
+        }
     }
 
 private:
-    MapBaseNode<K, V>* prev_ = nullptr;
-    MapBaseNode<K, V>* next_ = nullptr;
+    struct Bounds {
+        Base* first = nullptr;
+        Base* last = nullptr;
+    };
+    struct NoBounds {};
+
+    [[no_unique_address]] std::conditional_t<Base::kThreaded, NoBounds, Bounds> bounds_;
 };
 
-template <typename K, typename V, typename Compare = std::less<K>>
+template <typename K, typename V, typename Compare = std::less<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>,
+          typename Augment = NoAugmentation, typename Threading = Threaded>
 class MapAVL {
 public:
-    enum {
-        LEFT_VISITED = true,
-        LEFT_NOT_VISITED = false,
-        RIGHT_VISITED = true,
-        RIGHT_NOT_VISITED = false
-    };
-
     using ValueType = std::pair<const K, V>;
     using Reference = ValueType&;
     using Pointer = ValueType*;
     using ConstReference = const ValueType&;
     using ConstPointer = const ValueType*;
+    using AllocatorType = Allocator;
+    // Whether the lookups also take keys of other types, as std::less<> allows.
+    static constexpr bool kTransparentCompare = requires { typename Compare::is_transparent; };
+    // Whether the nodes keep summaries of their subtrees, which enables Aggregate.
+    static constexpr bool kAugmented = !std::is_same_v<Augment, NoAugmentation>;
+    // Whether the nodes count their subtrees, which enables Rank, Nth, CountRange and
+    // iterator arithmetic in O(log n).
+    static constexpr bool kOrderStatistics = std::is_same_v<Augment, OrderStatistics>;
+    // Whether the nodes are linked in key order; see Threaded and Unthreaded.
+    static constexpr bool kThreaded = std::is_same_v<Threading, Threaded>;
 
+private:
+    // The iterators of an unthreaded tree also hold its end node, which they step onto from
+    // the last node and back from. A threaded tree reaches it along the thread.
+    struct NoEndLink {
+        NoEndLink() noexcept = default;
+        NoEndLink(const void*) noexcept {
+        }
+    };
+    template <typename Base>
+    using EndLink = std::conditional_t<kThreaded, NoEndLink, Base*>;
+
+public:
     class Iterator {
     public:
-        explicit Iterator(MapBaseNode<K, V>* node) noexcept : node_(node) {
+        explicit Iterator(MapBaseNode<K, V, Augment, Threading>* node,
+                          EndLink<MapBaseNode<K, V, Augment, Threading>> end) noexcept
+            : node_(node), end_(end) {
         }
         Reference operator*() const {
             return node_->GetKeyValue();
@@ -264,32 +398,56 @@ public:
         bool operator!=(const Iterator& other) const noexcept {
             return node_ != other.node_;
         }
+        // Random access in O(log n) per jump, with order statistics only. Throws
+        // std::out_of_range when the jump leaves [Begin(), End()].
+        Iterator& operator+=(std::ptrdiff_t offset) requires kOrderStatistics {
+            node_ = Advance(node_, end_, offset);
+            return *this;
+        }
+        Iterator& operator-=(std::ptrdiff_t offset) requires kOrderStatistics {
+            node_ = Advance(node_, end_, -offset);
+            return *this;
+        }
+        Iterator operator+(std::ptrdiff_t offset) const requires kOrderStatistics {
+            return Iterator{Advance(node_, end_, offset), end_};
+        }
+        Iterator operator-(std::ptrdiff_t offset) const requires kOrderStatistics {
+            return Iterator{Advance(node_, end_, -offset), end_};
+        }
+        std::ptrdiff_t operator-(const Iterator& other) const requires kOrderStatistics {
+            return static_cast<std::ptrdiff_t>(RankOf(node_)) -
+                   static_cast<std::ptrdiff_t>(RankOf(other.node_));
+        }
 
         friend class ConstIterator;
+        friend class MapAVL;
 
     private:
         void Inc() {
             if (node_ != nullptr && !node_->IsMapEndNode()) {
-                node_ = node_->GetNext();
+                node_ = NextNode(node_, end_);
             } else {
                 node_ = nullptr;
             }
         }
         void Dec() {
-            if (node_ != nullptr && !(node_->GetPrev()->IsMapEndNode())) {
-                node_ = node_->GetPrev();
-            } else {
-                node_ = nullptr;
+            if (node_ == nullptr) {
+                return;
             }
+            auto neighbour = PrevNode(node_, end_);
+            node_ = neighbour->IsMapEndNode() ? nullptr : neighbour;
         }
-        MapBaseNode<K, V>* node_ = nullptr;
+        MapBaseNode<K, V, Augment, Threading>* node_ = nullptr;
+        [[no_unique_address]] EndLink<MapBaseNode<K, V, Augment, Threading>> end_;
     };
 
     class ConstIterator {
     public:
-        explicit ConstIterator(const MapBaseNode<K, V>* node) noexcept : node_(node) {
+        explicit ConstIterator(const MapBaseNode<K, V, Augment, Threading>* node,
+                               EndLink<const MapBaseNode<K, V, Augment, Threading>> end) noexcept
+            : node_(node), end_(end) {
         }
-        ConstIterator(Iterator it) noexcept : node_(it.node_) {
+        ConstIterator(Iterator it) noexcept : node_(it.node_), end_(it.end_) {
         }
         ConstReference operator*() const {
             return node_->GetKeyValue();
@@ -321,29 +479,50 @@ public:
         bool operator!=(const ConstIterator& other) const noexcept {
             return node_ != other.node_;
         }
+        ConstIterator& operator+=(std::ptrdiff_t offset) requires kOrderStatistics {
+            node_ = Advance(node_, end_, offset);
+            return *this;
+        }
+        ConstIterator& operator-=(std::ptrdiff_t offset) requires kOrderStatistics {
+            node_ = Advance(node_, end_, -offset);
+            return *this;
+        }
+        ConstIterator operator+(std::ptrdiff_t offset) const requires kOrderStatistics {
+            return ConstIterator{Advance(node_, end_, offset), end_};
+        }
+        ConstIterator operator-(std::ptrdiff_t offset) const requires kOrderStatistics {
+            return ConstIterator{Advance(node_, end_, -offset), end_};
+        }
+        std::ptrdiff_t operator-(const ConstIterator& other) const requires kOrderStatistics {
+            return static_cast<std::ptrdiff_t>(RankOf(node_)) -
+                   static_cast<std::ptrdiff_t>(RankOf(other.node_));
+        }
         friend class MapAVL;
 
     private:
         void Inc() {
             if (node_ != nullptr && !node_->IsMapEndNode()) {
-                node_ = node_->GetNext();
+                node_ = NextNode(node_, end_);
             } else {
                 node_ = nullptr;
             }
         }
         void Dec() {
-            if (node_ != nullptr && !(node_->GetPrev()->IsMapEndNode())) {
-                node_ = node_->GetPrev();
-            } else {
-                node_ = nullptr;
+            if (node_ == nullptr) {
+                return;
             }
+            auto neighbour = PrevNode(node_, end_);
+            node_ = neighbour->IsMapEndNode() ? nullptr : neighbour;
         }
-        const MapBaseNode<K, V>* node_ = nullptr;
+        const MapBaseNode<K, V, Augment, Threading>* node_ = nullptr;
+        [[no_unique_address]] EndLink<const MapBaseNode<K, V, Augment, Threading>> end_;
     };
 
     class ReverseIterator {
     public:
-        explicit ReverseIterator(MapBaseNode<K, V>* node) : node_(node) {
+        explicit ReverseIterator(MapBaseNode<K, V, Augment, Threading>* node,
+                                 EndLink<MapBaseNode<K, V, Augment, Threading>> end) noexcept
+            : node_(node), end_(end) {
         }
         Reference operator*() const {
             return node_->GetKeyValue();
@@ -381,26 +560,30 @@ public:
     private:
         void Inc() {
             if (node_ != nullptr && !node_->IsMapEndNode()) {
-                node_ = node_->GetPrev();
+                node_ = PrevNode(node_, end_);
             } else {
                 node_ = nullptr;
             }
         }
         void Dec() {
-            if (node_ != nullptr && !(node_->GetNext()->IsMapEndNode())) {
-                node_ = node_->GetNext();
-            } else {
-                node_ = nullptr;
+            if (node_ == nullptr) {
+                return;
             }
+            auto neighbour = NextNode(node_, end_);
+            node_ = neighbour->IsMapEndNode() ? nullptr : neighbour;
         }
-        MapBaseNode<K, V>* node_ = nullptr;
+        MapBaseNode<K, V, Augment, Threading>* node_ = nullptr;
+        [[no_unique_address]] EndLink<MapBaseNode<K, V, Augment, Threading>> end_;
     };
 
     class ConstReverseIterator {
     public:
-        explicit ConstReverseIterator(const MapBaseNode<K, V>* node) noexcept : node_(node) {
+        explicit ConstReverseIterator(
+            const MapBaseNode<K, V, Augment, Threading>* node,
+            EndLink<const MapBaseNode<K, V, Augment, Threading>> end) noexcept
+            : node_(node), end_(end) {
         }
-        ConstReverseIterator(ReverseIterator it) noexcept : node_(it.node_) {
+        ConstReverseIterator(ReverseIterator it) noexcept : node_(it.node_), end_(it.end_) {
         }
         ConstReference operator*() const noexcept {
             return node_->GetKeyValue();
@@ -436,71 +619,146 @@ public:
     private:
         void Inc() {
             if (node_ != nullptr && !node_->IsMapEndNode()) {
-                node_ = node_->GetPrev();
+                node_ = PrevNode(node_, end_);
             } else {
                 node_ = nullptr;
             }
         }
         void Dec() {
-            if (node_ != nullptr && !(node_->GetNext()->IsMapEndNode())) {
-                node_ = node_->GetNext();
-            } else {
-                node_ = nullptr;
+            if (node_ == nullptr) {
+                return;
             }
+            auto neighbour = NextNode(node_, end_);
+            node_ = neighbour->IsMapEndNode() ? nullptr : neighbour;
         }
-        const MapBaseNode<K, V>* node_ = nullptr;
+        const MapBaseNode<K, V, Augment, Threading>* node_ = nullptr;
+        [[no_unique_address]] EndLink<const MapBaseNode<K, V, Augment, Threading>> end_;
     };
 
     MapAVL() : MapAVL(Compare()) {
     }
-    explicit MapAVL(const Compare& compare) : root_compare_(nullptr, compare) {
+    explicit MapAVL(const Compare& compare, const Allocator& allocator = Allocator())
+        : root_compare_(nullptr, compare),
+          size_allocator_(size_t{0}, NodeAllocator(allocator)) {
     }
-    MapAVL(const MapAVL& other) {
+    explicit MapAVL(const Allocator& allocator) : MapAVL(Compare(), allocator) {
+    }
+    template <typename InputIt>
+    MapAVL(InputIt first, InputIt last, const Compare& compare = Compare(),
+           const Allocator& allocator = Allocator())
+        : MapAVL(compare, allocator) {
+        try {
+            Insert(first, last);
+        } catch (...) {
+            DestroyNodes();
+            throw;
+        }
+    }
+    MapAVL(const MapAVL& other)
+        : MapAVL(other, Allocator(NodeTraits::select_on_container_copy_construction(
+                         other.GetNodeAllocator()))) {
+    }
+    MapAVL(const MapAVL& other, const Allocator& allocator)
+        : root_compare_(nullptr, other.KeyCompare()),
+          size_allocator_(size_t{0}, NodeAllocator(allocator)) {
         Copy(other);
     }
-    MapAVL& operator=(const MapAVL& other) {
-        return *this = MapAVL(other);
+    // Builds the map out of a random-access range sorted by strictly ascending keys on the
+    // threads of the pool: the middle element becomes the root and both halves are built
+    // at once, down to subtrees of kParallelGrain nodes. A range out of order is inserted
+    // one by one instead.
+    template <std::random_access_iterator RandomIt>
+    MapAVL(RandomIt first, RandomIt last, TaskPool& pool, const Compare& compare = Compare(),
+           const Allocator& allocator = Allocator())
+        : MapAVL(compare, allocator) {
+        auto out_of_order = [&](const auto& lhs, const auto& rhs) {
+            return !compare(lhs.first, rhs.first);
+        };
+        if (std::adjacent_find(first, last, out_of_order) != last) {
+            try {
+                Insert(first, last);
+            } catch (...) {
+                DestroyNodes();
+                throw;
+            }
+            return;
+        }
+        BuildParallel(static_cast<size_t>(last - first),
+                      [&](size_t index) { return CreateNode(first[index], nullptr, nullptr, 0); },
+                      pool);
     }
-    MapAVL(MapAVL&& other) noexcept {
-        Swap(other);
+    // Copies the tree shape of other on the threads of the pool.
+    MapAVL(const MapAVL& other, TaskPool& pool)
+        : MapAVL(other.KeyCompare(), Allocator(NodeTraits::select_on_container_copy_construction(
+                                         other.GetNodeAllocator()))) {
+        if constexpr (!kParallelAllocation) {
+            Copy(other);
+            return;
+        }
+        MapNode<K, V, Augment, Threading>* first = nullptr;
+        MapNode<K, V, Augment, Threading>* last = nullptr;
+        GetRoot() = CloneSubtree(other.GetRootPtr(), std::addressof(pool), first, last);
+        LinkBuiltTree(first, last, other.Size());
     }
-    MapAVL& operator=(MapAVL&& other) noexcept {
-        MapAVL tmp = std::move(other);
-        Swap(tmp);
+    MapAVL& operator=(const MapAVL& other) {
+        if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) {
+            return *this = MapAVL(other, other.GetAllocator());
+        } else {
+            return *this = MapAVL(other, GetAllocator());
+        }
+    }
+    MapAVL(MapAVL&& other) noexcept
+        : root_compare_(nullptr, other.KeyCompare()),
+          size_allocator_(size_t{0}, other.GetNodeAllocator()) {
+        SwapNodes(other);
+    }
+    MapAVL& operator=(MapAVL&& other) noexcept(
+        NodeTraits::propagate_on_container_move_assignment::value ||
+        NodeTraits::is_always_equal::value) {
+        if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+            MapAVL tmp = std::move(other);
+            std::swap(GetNodeAllocator(), tmp.GetNodeAllocator());
+            SwapNodes(tmp);
+        } else if (GetNodeAllocator() == other.GetNodeAllocator()) {
+            MapAVL tmp = std::move(other);
+            SwapNodes(tmp);
+        } else {
+            MoveElements(other);
+        }
         return *this;
     }
-    ~MapAVL() = default;
+    ~MapAVL() {
+        DestroyNodes();
+    }
 
     void Clear() noexcept {
-        GetRoot() = nullptr;
-        size_ = 0;
-        end_node_.GetNext() = std::addressof(end_node_);
-        end_node_.GetPrev() = std::addressof(end_node_);
+        DestroyNodes();
     }
     void Swap(MapAVL& other) {
-        std::swap(GetRoot(), other.GetRoot());
-        std::swap(size_, other.size_);
-        ConnectEndMapNodesAfterSwap(other);
+        if constexpr (NodeTraits::propagate_on_container_swap::value) {
+            std::swap(GetNodeAllocator(), other.GetNodeAllocator());
+        }
+        SwapNodes(other);
     }
     std::pair<Iterator, bool> Insert(const ValueType& key_value) {
         auto pair = InsertMapNode(key_value);
         auto node = pair.first;
         auto inserted = pair.second;
         if (!inserted) {
-            return {Iterator(node), false};
+            return {Iterator(node, EndNode()), false};
         }
         BalanceAfterInsert(node);
-        return {Iterator(node), true};
+        return {Iterator(node, EndNode()), true};
     }
     std::pair<Iterator, bool> Insert(ValueType&& key_value) {
         auto pair = InsertMapNode(std::move(key_value));
         auto node = pair.first;
         auto inserted = pair.second;
         if (!inserted) {
-            return {Iterator(node), false};
+            return {Iterator(node, EndNode()), false};
         }
         BalanceAfterInsert(node);
-        return {Iterator(node), true};
+        return {Iterator(node, EndNode()), true};
     }
     template <typename P>
     std::pair<Iterator, bool> Insert(P&& key_value) {
@@ -508,87 +766,273 @@ public:
         auto node = pair.first;
         auto inserted = pair.second;
         if (!inserted) {
-            return {Iterator(node), false};
+            return {Iterator(node, EndNode()), false};
         }
         BalanceAfterInsert(node);
-        return {Iterator(node), true};
+        return {Iterator(node, EndNode()), true};
     }
+    // An empty map takes the longest sorted prefix of the range in O(n), without comparing
+    // against the tree; the rest of the range, if any, is inserted element by element.
     template <typename InputIt>
     void Insert(InputIt first, InputIt last) {
-        for (auto it = first; it != last; ++it) {
+        auto it = first;
+        if (Empty()) {
+            it = BuildFromSortedPrefix(first, last);
+        }
+        for (; it != last; ++it) {
             Insert(*it);
         }
     }
     void Insert(std::initializer_list<ValueType> ilist) {
         Insert(ilist.begin(), ilist.end());
     }
-    Iterator Find(const K& key) {
-        auto node = FindMapNode(key);
-        if (node == nullptr) {
-            return End();
+    // Inserts in O(1) before rebalancing when the key belongs right before or right after the
+    // hint, which the prev/next thread confirms with at most three comparisons; any other hint
+    // costs a descent from the root. Appending in order with End() or the previous result as
+    // the hint always takes the fast path. Returns the inserted or the equivalent element.
+    Iterator Insert(ConstIterator hint, const ValueType& key_value) {
+        return Iterator{InsertMapNodeHint(hint.node_, key_value), EndNode()};
+    }
+    Iterator Insert(ConstIterator hint, ValueType&& key_value) {
+        return Iterator{InsertMapNodeHint(hint.node_, std::move(key_value)), EndNode()};
+    }
+    template <typename P>
+        requires std::is_constructible_v<ValueType, P&&>
+    Iterator Insert(ConstIterator hint, P&& key_value) {
+        return Iterator{InsertMapNodeHint(hint.node_, std::forward<P>(key_value)), EndNode()};
+    }
+    // Builds the element first, so the key can be compared against the hint.
+    template <typename... Args>
+    Iterator EmplaceHint(ConstIterator hint, Args&&... args) {
+        MapNode<K, V, Augment, Threading>* node =
+            CreateNode(std::in_place, std::forward<Args>(args)...);
+        auto [next, vacant] = FindHintedNext(hint.node_, node->GetKey());
+        if (next == nullptr) {
+            std::tie(next, vacant) = FindInsertNext(node->GetKey());
+        }
+        if (!vacant) {
+            DestroyNode(node);
+            return Iterator{next, EndNode()};
+        }
+        LinkMapNodeBefore(node, next);
+        return Iterator{node, EndNode()};
+    }
+    // The key is not known before the element is built, so a duplicate costs a node that is
+    // thrown away; Emplace(key, value) with a ready key looks it up first, like TryEmplace.
+    template <typename... Args>
+    std::pair<Iterator, bool> Emplace(Args&&... args) {
+        if constexpr (IsKeyAndValue<Args...>()) {
+            return TryEmplace(std::forward<Args>(args)...);
+        } else {
+            MapNode<K, V, Augment, Threading>* node =
+                CreateNode(std::in_place, std::forward<Args>(args)...);
+            auto [next, vacant] = FindInsertNext(node->GetKey());
+            if (!vacant) {
+                DestroyNode(node);
+                return {Iterator{next, EndNode()}, false};
+            }
+            LinkMapNodeBefore(node, next);
+            return {Iterator{node, EndNode()}, true};
         }
-        return Iterator{node};
     }
-    ConstIterator Find(const K& key) const {
+    // Looks the key up first and builds the value from the arguments only if the key is
+    // missing; otherwise the arguments are left untouched.
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(const K& key, Args&&... args) {
+        return TryEmplaceMapNode(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<Iterator, bool> TryEmplace(K&& key, Args&&... args) {
+        return TryEmplaceMapNode(std::move(key), std::forward<Args>(args)...);
+    }
+    // Assigns to the value of an existing key, or inserts the pair if the key is missing.
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(const K& key, M&& value) {
+        return InsertOrAssignMapNode(key, std::forward<M>(value));
+    }
+    template <typename M>
+    std::pair<Iterator, bool> InsertOrAssign(K&& key, M&& value) {
+        return InsertOrAssignMapNode(std::move(key), std::forward<M>(value));
+    }
+    Iterator Erase(ConstIterator pos) {
+        auto base = const_cast<MapBaseNode<K, V, Augment, Threading>*>(pos.node_);
+        auto next = NextNode(base, EndNode());
+        EraseMapNode(base->GetMapNode());
+        return Iterator{next, EndNode()};
+    }
+    Iterator Erase(Iterator pos) {
+        return Erase(ConstIterator{pos});
+    }
+    Iterator Erase(ConstIterator first, ConstIterator last) {
+        auto last_node = const_cast<MapBaseNode<K, V, Augment, Threading>*>(last.node_);
+        EraseMapNodes(const_cast<MapBaseNode<K, V, Augment, Threading>*>(first.node_), last_node);
+        return Iterator{last_node, EndNode()};
+    }
+    size_t Erase(const K& key) {
         auto node = FindMapNode(key);
         if (node == nullptr) {
-            return End();
+            return 0;
         }
-        return ConstIterator{node};
-    }
-    Iterator LowerBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
+        EraseMapNode(node);
+        return 1;
+    }
+    // Moves the elements with keys not less than key into the returned map, which gets a copy
+    // of the allocator. The tree is cut along one root-to-leaf path in O(log n); what is left
+    // is finding the sizes of the halves, which takes O(log n) with order statistics and
+    // otherwise a walk along the thread over the smaller half.
+    MapAVL Split(const K& key) requires kThreaded {
+        MapAVL result(KeyCompare(), GetAllocator());
+        SplitMapAVL(LowerBoundOrEnd(key), result);
+        return result;
+    }
+    // Appends the elements of right, whose keys all have to be greater than those of this
+    // map, in O(log n) when the allocators are equal; otherwise the elements are moved one by
+    // one. Throws std::invalid_argument if the key ranges overlap. Leaves right empty.
+    void Join(MapAVL&& right) requires kThreaded {
+        if (right.Empty()) {
+            return;
         }
-        return Iterator{node};
-    }
-    ConstIterator LowerBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
+        const K& right_first = right.end_node_.GetNext()->GetMapNode()->GetKey();
+        if (!Empty()) {
+            CheckJoinOrder(end_node_.GetPrev()->GetMapNode()->GetKey(), right_first);
         }
-        return ConstIterator{node};
+        if (GetNodeAllocator() != right.GetNodeAllocator()) {
+            MoveElementsFrom(right);
+            return;
+        }
+        MapNode<K, V, Augment, Threading>* middle = right.end_node_.GetNext()->GetMapNode();
+        right.UnlinkMapNode(middle);
+        JoinMapAVL(middle, right);
     }
-    Iterator UpperBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
+    // Appends the pivot and then the elements of right: all keys of this map < pivot < all
+    // keys of right.
+    void Join(const ValueType& pivot, MapAVL&& right) requires kThreaded {
+        if (!Empty()) {
+            CheckJoinOrder(end_node_.GetPrev()->GetMapNode()->GetKey(), pivot.first);
         }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return Iterator{node->GetNext()};
+        if (!right.Empty()) {
+            CheckJoinOrder(pivot.first, right.end_node_.GetNext()->GetMapNode()->GetKey());
         }
-        return Iterator{node};
-    }
-    ConstIterator UpperBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
+        if (GetNodeAllocator() != right.GetNodeAllocator()) {
+            Insert(pivot);
+            MoveElementsFrom(right);
+            return;
         }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return ConstIterator{node->GetNext()};
+        JoinMapAVL(CreateNode(std::in_place, pivot), right);
+    }
+    // Moves the elements with keys in [lower, upper) into the returned map with two splits
+    // and a join. That is O(log n) with order statistics. Without them each split also walks
+    // the thread over its smaller half, as in Split, so the cost grows with the elements on
+    // the smaller side of each cut and reaches O(n) for a cut near the middle.
+    MapAVL ExtractRange(const K& lower, const K& upper) requires kThreaded {
+        if (!KeyCompare()(lower, upper)) {
+            return MapAVL(KeyCompare(), GetAllocator());
+        }
+        MapAVL extracted = Split(lower);
+        Join(extracted.Split(upper));
+        return extracted;
+    }
+    // Moves into this map the elements of other whose keys it does not have yet; the others
+    // stay in other. Key ranges that do not interleave are joined in O(log n). Otherwise the
+    // nodes are relinked one by one, in O(log n) each and without allocating.
+    void Merge(MapAVL& other) requires kThreaded {
+        if (other.Empty() || this == std::addressof(other)) {
+            return;
         }
-        return ConstIterator{node};
-    }
-    std::pair<Iterator, Iterator> EqualRange(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
+        if (GetNodeAllocator() != other.GetNodeAllocator()) {
+            for (auto it = other.Begin(); it != other.End();) {
+                if (Insert(*it).second) {
+                    it = other.Erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            return;
+        }
+        const Compare& compare = KeyCompare();
+        if (Empty() || compare(end_node_.GetPrev()->GetMapNode()->GetKey(),
+                               other.end_node_.GetNext()->GetMapNode()->GetKey())) {
+            Join(std::move(other));
+            return;
+        }
+        if (compare(other.end_node_.GetPrev()->GetMapNode()->GetKey(),
+                    end_node_.GetNext()->GetMapNode()->GetKey())) {
+            other.Join(std::move(*this));
+            SwapNodes(other);
+            return;
         }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {Iterator{node}, Iterator{node->GetNext()}};
+        for (MapBaseNode<K, V, Augment, Threading>* base = other.end_node_.GetNext();
+             !base->IsMapEndNode();) {
+            MapNode<K, V, Augment, Threading>* node = base->GetMapNode();
+            base = base->GetNext();
+            auto [next, vacant] = FindInsertNext(node->GetKey());
+            if (vacant) {
+                other.UnlinkMapNode(node);
+                node->GetLeft() = nullptr;
+                node->GetRight() = nullptr;
+                node->GetBalance() = 0;
+                LinkMapNodeBefore(node, next);
+            }
         }
-        return {Iterator{node}, Iterator{node}};
     }
-    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
+    void Merge(MapAVL&& other) requires kThreaded {
+        Merge(other);
+    }
+    // Same as operator==, with the comparison split into pieces for the threads of the
+    // pool. The pieces of this map end at the nodes of the top levels of its tree, and the
+    // same keys, looked up in other, end the pieces of other.
+    bool Equal(const MapAVL& other, TaskPool& pool) const {
+        if (Size() != other.Size()) {
+            return false;
         }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {ConstIterator{node}, ConstIterator{node->GetNext()}};
+        if (Size() < kParallelGrain || pool.Size() == 1) {
+            return *this == other;
+        }
+        std::vector<const MapBaseNode<K, V, Augment, Threading>*> bounds{end_node_.GetNext()};
+        std::vector<const MapBaseNode<K, V, Augment, Threading>*> other_bounds{
+            other.end_node_.GetNext()};
+        CollectSplitters(GetRootPtr(), std::bit_width(pool.Size() * 4), bounds);
+        for (size_t i = 1; i < bounds.size(); ++i) {
+            const MapNode<K, V, Augment, Threading>* found = other.FindMapNode(
+                static_cast<const MapNode<K, V, Augment, Threading>*>(bounds[i])->GetKey());
+            if (found == nullptr) {
+                return false;
+            }
+            other_bounds.push_back(found);
         }
-        return {ConstIterator{node}, ConstIterator{node}};
+        bounds.push_back(std::addressof(end_node_));
+        other_bounds.push_back(std::addressof(other.end_node_));
+        std::vector<char> equal(bounds.size() - 1);
+        pool.ParallelFor(0, equal.size(), [&](size_t i) {
+            equal[i] = EqualPieces(bounds[i], bounds[i + 1], other_bounds[i], other_bounds[i + 1]);
+        });
+        return std::all_of(equal.begin(), equal.end(), [](char piece) { return piece != 0; });
+    }
+    Iterator Find(const K& key) {
+        return Iterator{FindOrEnd(key), EndNode()};
+    }
+    ConstIterator Find(const K& key) const {
+        return ConstIterator{FindOrEnd(key), EndNode()};
+    }
+    Iterator LowerBound(const K& key) {
+        return Iterator{LowerBoundOrEnd(key), EndNode()};
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return ConstIterator{LowerBoundOrEnd(key), EndNode()};
+    }
+    Iterator UpperBound(const K& key) {
+        return Iterator{EqualRangeNodes(key).second, EndNode()};
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return ConstIterator{EqualRangeNodes(key).second, EndNode()};
+    }
+    std::pair<Iterator, Iterator> EqualRange(const K& key) {
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first, EndNode()}, Iterator{last, EndNode()}};
+    }
+    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first, EndNode()}, ConstIterator{last, EndNode()}};
     }
     bool Contains(const K& key) const {
         return FindMapNode(key) != nullptr;
@@ -596,48 +1040,251 @@ public:
     size_t Count(const K& key) const {
         return static_cast<size_t>(Contains(key));
     }
+    // With a transparent comparator the lookups take any type it orders against K, so for
+    // example a std::string key is looked up by a std::string_view without building a string.
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator Find(const Key& key) {
+        return Iterator{FindOrEnd(key), EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator Find(const Key& key) const {
+        return ConstIterator{FindOrEnd(key), EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator LowerBound(const Key& key) {
+        return Iterator{LowerBoundOrEnd(key), EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator LowerBound(const Key& key) const {
+        return ConstIterator{LowerBoundOrEnd(key), EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator UpperBound(const Key& key) {
+        return Iterator{EqualRangeNodes(key).second, EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator UpperBound(const Key& key) const {
+        return ConstIterator{EqualRangeNodes(key).second, EndNode()};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<Iterator, Iterator> EqualRange(const Key& key) {
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first, EndNode()}, Iterator{last, EndNode()}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<ConstIterator, ConstIterator> EqualRange(const Key& key) const {
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first, EndNode()}, ConstIterator{last, EndNode()}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    bool Contains(const Key& key) const {
+        return FindMapNode(key) != nullptr;
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    size_t Count(const Key& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    // Finger search: the same answer as LowerBound(key), found by climbing from the hint to
+    // the lowest ancestor whose subtree has to hold the answer and descending from there. The
+    // past-the-end hint stands for the last element. For an answer d elements away from the
+    // hint this takes O(log d) steps when the tree is balanced, and O(1) when it is adjacent.
+    Iterator LowerBound(ConstIterator hint, const K& key) {
+        return Iterator{FindLowerBoundFrom(hint.node_, key), EndNode()};
+    }
+    ConstIterator LowerBound(ConstIterator hint, const K& key) const {
+        return ConstIterator{FindLowerBoundFrom(hint.node_, key), EndNode()};
+    }
+    // Writes the lower bound of keys[i] to results[i], searching from the previous answer, so
+    // a batch sorted in ascending order costs O(log d) per key for a rank distance of d.
+    void LowerBoundSorted(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        const MapBaseNode<K, V, Augment, Threading>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = Iterator{node, EndNode()};
+            hint = node;
+        }
+    }
+    void LowerBoundSorted(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        const MapBaseNode<K, V, Augment, Threading>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = ConstIterator{node, EndNode()};
+            hint = node;
+        }
+    }
+    // Number of elements with keys less than key, i.e. the index LowerBound(key) points to.
+    size_t Rank(const K& key) const requires kOrderStatistics {
+        const Compare& compare = root_compare_.GetSecond();
+        size_t rank = 0;
+        for (const MapNode<K, V, Augment, Threading>* node = GetRootPtr(); node != nullptr;) {
+            if (compare(node->GetKey(), key)) {
+                rank += GetSubtreeSize(node->GetLeft()) + 1;
+                node = node->GetRight();
+            } else {
+                node = node->GetLeft();
+            }
+        }
+        return rank;
+    }
+    // The element at the given index in key order, or End() if there are not that many.
+    Iterator Nth(size_t index) requires kOrderStatistics {
+        return Iterator{NthOrEnd(index), EndNode()};
+    }
+    ConstIterator Nth(size_t index) const requires kOrderStatistics {
+        return ConstIterator{NthOrEnd(index), EndNode()};
+    }
+    // Number of elements with keys in [lower, upper).
+    size_t CountRange(const K& lower, const K& upper) const requires kOrderStatistics {
+        if (!root_compare_.GetSecond()(lower, upper)) {
+            return 0;
+        }
+        return Rank(upper) - Rank(lower);
+    }
+    // Summary of the whole map.
+    typename Augment::Summary Aggregate() const requires kAugmented {
+        return GetSummary(GetRootPtr());
+    }
+    // Summary of the elements with keys in [lower, upper), combined in key order. Descends to
+    // the highest node inside the range and from there along both bounds, taking whole
+    // subtrees that lie inside, so it costs O(log n) summaries and comparisons.
+    typename Augment::Summary Aggregate(const K& lower, const K& upper) const
+        requires kAugmented {
+        const Compare& compare = root_compare_.GetSecond();
+        const MapNode<K, V, Augment, Threading>* fork = GetRootPtr();
+        while (fork != nullptr) {
+            if (compare(fork->GetKey(), lower)) {
+                fork = fork->GetRight();
+            } else if (!compare(fork->GetKey(), upper)) {
+                fork = fork->GetLeft();
+            } else {
+                break;
+            }
+        }
+        if (fork == nullptr) {
+            return Augment::Identity();
+        }
+        auto left = Augment::Identity();
+        for (auto node = fork->GetLeft(); node != nullptr;) {
+            if (compare(node->GetKey(), lower)) {
+                node = node->GetRight();
+            } else {
+                auto taken = Augment::Combine(Augment::Lift(node->GetKeyValue()),
+                                              GetSummary(node->GetRight()));
+                left = Augment::Combine(taken, left);
+                node = node->GetLeft();
+            }
+        }
+        auto right = Augment::Identity();
+        for (auto node = fork->GetRight(); node != nullptr;) {
+            if (compare(node->GetKey(), upper)) {
+                auto taken = Augment::Combine(GetSummary(node->GetLeft()),
+                                              Augment::Lift(node->GetKeyValue()));
+                right = Augment::Combine(right, taken);
+                node = node->GetRight();
+            } else {
+                node = node->GetLeft();
+            }
+        }
+        return Augment::Combine(Augment::Combine(left, Augment::Lift(fork->GetKeyValue())), right);
+    }
+    // Batch lookups write the answer for keys[i] to results[i]. The descents of up to
+    // kBatchLanes keys are interleaved and each next node is prefetched, so the cache misses of
+    // different keys overlap instead of being paid one after another.
+    void FindBatch(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        DescendBatch<false>(keys, [&](size_t index, MapBaseNode<K, V, Augment, Threading>* node) {
+            results[index] = Iterator{node, EndNode()};
+        });
+    }
+    void FindBatch(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        DescendBatch<false>(keys, [&](size_t index, MapBaseNode<K, V, Augment, Threading>* node) {
+            results[index] = ConstIterator{node, EndNode()};
+        });
+    }
+    void LowerBoundBatch(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        DescendBatch<true>(keys, [&](size_t index, MapBaseNode<K, V, Augment, Threading>* node) {
+            results[index] = Iterator{node, EndNode()};
+        });
+    }
+    void LowerBoundBatch(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        DescendBatch<true>(keys, [&](size_t index, MapBaseNode<K, V, Augment, Threading>* node) {
+            results[index] = ConstIterator{node, EndNode()};
+        });
+    }
+    void ContainsBatch(std::span<const K> keys, std::span<bool> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        DescendBatch<false>(keys, [&](size_t index, MapBaseNode<K, V, Augment, Threading>* node) {
+            results[index] = !node->IsMapEndNode();
+        });
+    }
+    // Copies the elements into an immutable FrozenMap, whose flat Eytzinger layout serves
+    // lookups faster than the tree once the map is no longer modified.
+    FrozenMap<K, V, Compare> Freeze() const {
+        std::vector<std::pair<const K, V>> entries;
+        entries.reserve(Size());
+        for (auto it = Begin(); it != End(); ++it) {
+            entries.push_back(*it);
+        }
+        return FrozenMap<K, V, Compare>(std::move(entries), KeyCompare());
+    }
     Iterator Begin() noexcept {
-        return Iterator{end_node_.GetNext()};
+        return Iterator{end_node_.GetNext(), EndNode()};
     }
     ConstIterator Begin() const noexcept {
-        return ConstIterator{end_node_.GetNext()};
+        return ConstIterator{end_node_.GetNext(), EndNode()};
     }
     Iterator End() noexcept {
-        return Iterator{std::addressof(end_node_)};
+        return Iterator{std::addressof(end_node_), EndNode()};
     }
     ConstIterator End() const noexcept {
-        return ConstIterator{std::addressof(end_node_)};
+        return ConstIterator{std::addressof(end_node_), EndNode()};
     }
     ConstIterator CBegin() const noexcept {
-        return ConstIterator{end_node_.GetNext()};
+        return ConstIterator{end_node_.GetNext(), EndNode()};
     }
     ConstIterator CEnd() const noexcept {
-        return ConstIterator{std::addressof(end_node_)};
+        return ConstIterator{std::addressof(end_node_), EndNode()};
     }
     ReverseIterator RBegin() noexcept {
-        return ReverseIterator{end_node_.GetPrev()};
+        return ReverseIterator{end_node_.GetPrev(), EndNode()};
     }
     ConstReverseIterator RBegin() const noexcept {
-        return ConstReverseIterator{end_node_.GetPrev()};
+        return ConstReverseIterator{end_node_.GetPrev(), EndNode()};
     }
     ReverseIterator REnd() noexcept {
-        return ReverseIterator{std::addressof(end_node_)};
+        return ReverseIterator{std::addressof(end_node_), EndNode()};
     }
     ConstReverseIterator REnd() const noexcept {
-        return ConstReverseIterator{std::addressof(end_node_)};
+        return ConstReverseIterator{std::addressof(end_node_), EndNode()};
     }
     ConstReverseIterator CRBegin() const noexcept {
-        return ConstReverseIterator{end_node_.GetPrev()};
+        return ConstReverseIterator{end_node_.GetPrev(), EndNode()};
     }
     ConstReverseIterator CREnd() const noexcept {
-        return ConstReverseIterator{std::addressof(end_node_)};
+        return ConstReverseIterator{std::addressof(end_node_), EndNode()};
     }
 
     size_t Size() const noexcept {
-        return size_;
+        return size_allocator_.GetFirst();
     }
     static constexpr size_t MaxSize() noexcept {
-        return (std::numeric_limits<std::ptrdiff_t>::max() / sizeof(MapNode<K, V>));
+        return (std::numeric_limits<std::ptrdiff_t>::max() /
+                sizeof(MapNode<K, V, Augment, Threading>));
     }
     bool Empty() const noexcept {
         return (GetRoot() == nullptr);
@@ -645,390 +1292,1076 @@ public:
     Compare KeyCompare() const {
         return root_compare_.GetSecond();
     }
-    const std::unique_ptr<MapNode<K, V>>& GetRoot() const {
+    Allocator GetAllocator() const {
+        return Allocator(GetNodeAllocator());
+    }
+    MapNode<K, V, Augment, Threading>* GetRoot() const {
         return root_compare_.GetFirst();
     }
-    std::unique_ptr<MapNode<K, V>>& GetRoot() {
+    MapNode<K, V, Augment, Threading>*& GetRoot() {
         return root_compare_.GetFirst();
     }
-    MapNode<K, V>* GetRootPtr() const {
-        return GetRoot().get();
+    MapNode<K, V, Augment, Threading>* GetRootPtr() const {
+        return GetRoot();
     }
 
 private:
-    signed char GetNodeBalance(MapNode<K, V>* node) const {
-        if (node == nullptr) {
-            return 0;
-        }
-        return node->GetBalance();
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<
+        MapNode<K, V, Augment, Threading>>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    size_t& GetSize() noexcept {
+        return size_allocator_.GetFirst();
     }
-    bool IsBalanceNormal(MapNode<K, V>* node) const {
-        return std::abs(GetNodeBalance(node)) <= 2;
+    const NodeAllocator& GetNodeAllocator() const noexcept {
+        return size_allocator_.GetSecond();
+    }
+    NodeAllocator& GetNodeAllocator() noexcept {
+        return size_allocator_.GetSecond();
+    }
+    MapBaseNode<K, V, Augment, Threading>* EndNode() noexcept {
+        return std::addressof(end_node_);
+    }
+    const MapBaseNode<K, V, Augment, Threading>* EndNode() const noexcept {
+        return std::addressof(end_node_);
     }
 
-    bool LeftRotateNeeded(MapNode<K, V>* node) {
-        if (node == nullptr || node->GetRight() == nullptr) {
-            return false;
+    // The neighbours of a node in key order, with the end node past either edge. Without the
+    // thread they are found along the links: the extreme node of the child subtree on that
+    // side, or else the nearest ancestor on that side, where end stands in for the parent of
+    // the root. The end node itself keeps the first and the last node.
+    template <typename Base, typename End>
+    static Base* NextNode(Base* base, End end) noexcept {
+        if constexpr (kThreaded) {
+            return base->GetNext();
+        } else {
+            return WalkToNeighbour<true>(base, end);
         }
-        return (GetNodeBalance(node) == -2) && ((GetNodeBalance(node->GetRight().get()) == -1) ||
-                                                (GetNodeBalance(node->GetRight().get()) == 0));
     }
-    bool RightRotateNeded(MapNode<K, V>* node) {
-        if (node == nullptr || node->GetLeft() == nullptr) {
-            return false;
+    template <typename Base, typename End>
+    static Base* PrevNode(Base* base, End end) noexcept {
+        if constexpr (kThreaded) {
+            return base->GetPrev();
+        } else {
+            return WalkToNeighbour<false>(base, end);
+        }
+    }
+    template <bool kForward, typename Base>
+    static Base* WalkToNeighbour(Base* base,
+                                 const MapBaseNode<K, V, Augment, Threading>* end) noexcept {
+        constexpr bool kConst = std::is_const_v<Base>;
+        using EndType = std::conditional_t<kConst, const EndMapNode<K, V, Augment, Threading>,
+                                           EndMapNode<K, V, Augment, Threading>>;
+        using NodeType = std::conditional_t<kConst, const MapNode<K, V, Augment, Threading>,
+                                            MapNode<K, V, Augment, Threading>>;
+        // The end node is nearly always end itself. Testing that before the flag lets the
+        // compiler see that it never reaches the MapNode cast below.
+        if (base == end || base->IsMapEndNode()) {
+            auto end_node = static_cast<EndType*>(base);
+            return kForward ? end_node->GetNext() : end_node->GetPrev();
+        }
+        auto node = static_cast<NodeType*>(base);
+        auto child = kForward ? node->GetRight() : node->GetLeft();
+        if (child != nullptr) {
+            for (auto inner = kForward ? child->GetLeft() : child->GetRight(); inner != nullptr;
+                 inner = kForward ? child->GetLeft() : child->GetRight()) {
+                child = inner;
+            }
+            return child;
         }
-        return (GetNodeBalance(node) == 2) && ((GetNodeBalance(node->GetLeft().get()) == 1) ||
-                                               (GetNodeBalance(node->GetLeft().get()) == 0));
-    }
-    bool RightLeftRotateNeeded(MapNode<K, V>* node) {
-        if (node == nullptr || node->GetRight() == nullptr ||
-            node->GetRight()->GetLeft() == nullptr) {
-            return false;
+        for (auto parent = node->GetParent(); parent != nullptr; parent = parent->GetParent()) {
+            if ((kForward ? parent->GetLeft() : parent->GetRight()) == node) {
+                return parent;
+            }
+            node = parent;
         }
-        return (GetNodeBalance(node) == -2) && (GetNodeBalance(node->GetRight().get()) == 1);
+        return const_cast<Base*>(end);
     }
-    bool LeftRightRotateNeeded(MapNode<K, V>* node) {
-        if (node == nullptr || node->GetLeft() == nullptr ||
-            node->GetLeft()->GetRight() == nullptr) {
-            return false;
+
+    template <typename... Args>
+    MapNode<K, V, Augment, Threading>* CreateNode(Args&&... args) {
+        MapNode<K, V, Augment, Threading>* node = NodeTraits::allocate(GetNodeAllocator(), 1);
+        try {
+            NodeTraits::construct(GetNodeAllocator(), node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(GetNodeAllocator(), node, 1);
+            throw;
         }
-        return (GetNodeBalance(node) == 2) && (GetNodeBalance(node->GetLeft().get()) == -1);
+        return node;
     }
-    MapNode<K, V>* FindMapNode(const K& key) const {
-        MapNode<K, V>* node = GetRootPtr();
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
-                return node;
+    void DestroyNode(MapNode<K, V, Augment, Threading>* node) noexcept {
+        NodeTraits::destroy(GetNodeAllocator(), node);
+        NodeTraits::deallocate(GetNodeAllocator(), node, 1);
+    }
+
+    // Walks the prev/next thread, so the teardown is iterative whatever the shape of the
+    // tree. Without the thread, left children are rotated up until the root has none, and
+    // then the root goes. An unshared PoolAllocator gives its chunks back at once instead of
+    // taking the nodes one by one.
+    void DestroyNodes() noexcept {
+        bool exclusive_pool = IsExclusivePool(GetNodeAllocator());
+        auto destroy = [&](MapNode<K, V, Augment, Threading>* node) {
+            NodeTraits::destroy(GetNodeAllocator(), node);
+            if (!exclusive_pool) {
+                NodeTraits::deallocate(GetNodeAllocator(), node, 1);
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                node = node->GetLeft().get();
+        };
+        if (!exclusive_pool ||
+            !std::is_trivially_destructible_v<MapNode<K, V, Augment, Threading>>) {
+            if constexpr (kThreaded) {
+                MapBaseNode<K, V, Augment, Threading>* node = end_node_.GetNext();
+                while (node != nullptr && !node->IsMapEndNode()) {
+                    MapBaseNode<K, V, Augment, Threading>* next = node->GetNext();
+                    destroy(static_cast<MapNode<K, V, Augment, Threading>*>(node));
+                    node = next;
+                }
             } else {
-                node = node->GetRight().get();
+                MapNode<K, V, Augment, Threading>* node = GetRootPtr();
+                while (node != nullptr) {
+                    MapNode<K, V, Augment, Threading>* left = node->GetLeft();
+                    if (left != nullptr) {
+                        node->GetLeft() = left->GetRight();
+                        left->GetRight() = node;
+                        node = left;
+                    } else {
+                        MapNode<K, V, Augment, Threading>* right = node->GetRight();
+                        destroy(node);
+                        node = right;
+                    }
+                }
             }
         }
-        return nullptr;
+        if (exclusive_pool) {
+            ReleasePool(GetNodeAllocator());
+        }
+        GetRoot() = nullptr;
+        GetSize() = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
     }
 
-    MapNode<K, V>* FindLowerBound(const K& key) const {
-        MapNode<K, V>* node = GetRootPtr();
-        MapNode<K, V>* best_bound = nullptr;
-
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
-                return node;
+    // Takes a node out of the tree and the thread without destroying it. Without the thread,
+    // the end node moves on to the neighbour when the first or the last node goes.
+    void UnlinkMapNode(MapNode<K, V, Augment, Threading>* node) {
+        if constexpr (kThreaded) {
+            node->GetPrev()->GetNext() = node->GetNext();
+            node->GetNext()->GetPrev() = node->GetPrev();
+        } else {
+            if (end_node_.GetNext() == node) {
+                end_node_.GetNext() =
+                    NextNode<MapBaseNode<K, V, Augment, Threading>>(node, EndNode());
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                best_bound = node;
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            if (end_node_.GetPrev() == node) {
+                end_node_.GetPrev() =
+                    PrevNode<MapBaseNode<K, V, Augment, Threading>>(node, EndNode());
             }
         }
-        return best_bound;
+        DetachMapNode(node);
+        --GetSize();
     }
 
-    void ConnectEndMapNodesAfterSwap(MapAVL& other) {
-        if (Empty() && other.Empty()) {
-            return;
-        }
+    // Forgets the nodes, which now belong to another container.
+    void ResetToEmpty() noexcept {
+        GetRoot() = nullptr;
+        GetSize() = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
+    }
 
-        auto other_min_node = end_node_.GetNext();
-        auto other_max_node = end_node_.GetPrev();
-        auto min_node = other.end_node_.GetNext();
-        auto max_node = other.end_node_.GetPrev();
+    void CheckJoinOrder(const K& lower, const K& upper) const {
+        if (!KeyCompare()(lower, upper)) {
+            throw std::invalid_argument("Joined key ranges overlap");
+        }
+    }
 
-        if (Empty() && !other.Empty()) {
-            other.end_node_.GetPrev() = other_max_node;
-            other.end_node_.GetNext() = other_min_node;
-            other_max_node->GetNext() = std::addressof(other.end_node_);
-            other_min_node->GetPrev() = std::addressof(other.end_node_);
+    // Hangs middle and then the nodes of right after the nodes of this map. The trees are
+    // joined by JoinMapNodes; the threads are spliced at both ends.
+    void JoinMapAVL(MapNode<K, V, Augment, Threading>* middle, MapAVL& right) {
+        MapBaseNode<K, V, Augment, Threading>* end_node = std::addressof(end_node_);
+        MapBaseNode<K, V, Augment, Threading>* last = end_node->GetPrev();
+        if (right.Empty()) {
+            ConnectPrevNext(middle, last, end_node);
+        } else {
+            MapBaseNode<K, V, Augment, Threading>* right_first = right.end_node_.GetNext();
+            MapBaseNode<K, V, Augment, Threading>* right_last = right.end_node_.GetPrev();
+            ConnectPrevNext(middle, last, right_first);
+            right_last->GetNext() = end_node;
+            end_node->GetPrev() = right_last;
+        }
+        GetRoot() = JoinMapNodes(GetRootPtr(), middle, right.GetRootPtr());
+        GetSize() += right.Size() + 1;
+        right.ResetToEmpty();
+    }
 
-            end_node_.GetPrev() = std::addressof(end_node_);
-            end_node_.GetNext() = std::addressof(end_node_);
+    // Moves the nodes from pivot on into result, which has to be empty and share the
+    // allocator.
+    void SplitMapAVL(MapBaseNode<K, V, Augment, Threading>* pivot, MapAVL& result) {
+        if (pivot->IsMapEndNode()) {
             return;
         }
-
-        if (!Empty() && other.Empty()) {
-            end_node_.GetPrev() = max_node;
-            end_node_.GetNext() = min_node;
-            max_node->GetNext() = std::addressof(end_node_);
-            min_node->GetPrev() = std::addressof(end_node_);
-
-            other.end_node_.GetPrev() = std::addressof(other.end_node_);
-            other.end_node_.GetNext() = std::addressof(other.end_node_);
+        if (pivot == end_node_.GetNext()) {
+            result.SwapNodes(*this);
             return;
         }
+        size_t moved = CountFrom(pivot);
+        MapBaseNode<K, V, Augment, Threading>* kept_last = pivot->GetPrev();
+        MapBaseNode<K, V, Augment, Threading>* last = end_node_.GetPrev();
+        auto [left, right] = SplitMapNodes(pivot->GetMapNode());
+        GetRoot() = left;
+        GetSize() -= moved;
+        kept_last->GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = kept_last;
+        result.GetRoot() = right;
+        result.GetSize() = moved;
+        pivot->GetPrev() = std::addressof(result.end_node_);
+        result.end_node_.GetNext() = pivot;
+        last->GetNext() = std::addressof(result.end_node_);
+        result.end_node_.GetPrev() = last;
+    }
+
+    // Number of nodes from the node to the end of the thread. Without subtree sizes the
+    // thread is walked in both directions at once until one of them runs out.
+    size_t CountFrom(const MapBaseNode<K, V, Augment, Threading>* node) const {
+        if constexpr (kOrderStatistics) {
+            return Size() - RankOf(node);
+        } else {
+            const MapBaseNode<K, V, Augment, Threading>* forward = node;
+            const MapBaseNode<K, V, Augment, Threading>* backward = node->GetPrev();
+            size_t before = 0;
+            for (size_t from = 0;; ++from, ++before) {
+                if (forward->IsMapEndNode()) {
+                    return from;
+                }
+                if (backward->IsMapEndNode()) {
+                    return Size() - before;
+                }
+                forward = forward->GetNext();
+                backward = backward->GetPrev();
+            }
+        }
+    }
 
-        end_node_.GetPrev() = max_node;
-        end_node_.GetNext() = min_node;
-        max_node->GetNext() = std::addressof(end_node_);
-        min_node->GetPrev() = std::addressof(end_node_);
+    // Join between containers whose allocators differ.
+    void MoveElementsFrom(MapAVL& right) {
+        for (auto it = right.Begin(); it != right.End(); ++it) {
+            Insert(End(), ValueType(it->first, std::move(it->second)));
+        }
+        right.Clear();
+    }
 
-        other.end_node_.GetPrev() = other_max_node;
-        other.end_node_.GetNext() = other_min_node;
-        other_max_node->GetNext() = std::addressof(other.end_node_);
-        other_min_node->GetPrev() = std::addressof(other.end_node_);
+    // Move assignment between containers whose allocators neither propagate nor compare
+    // equal: the nodes cannot change hands, so the elements are moved one by one.
+    void MoveElements(MapAVL& other) {
+        Clear();
+        for (auto it = other.Begin(); it != other.End(); ++it) {
+            Insert(ValueType(it->first, std::move(it->second)));
+        }
+        other.Clear();
     }
 
-    void ConnectEndMapNodesAfterCopy(MapBaseNode<K, V>* max_node) {
+    // Appends the elements to the thread as long as they come in ascending order (later
+    // duplicates are dropped, as Insert would do) and then links the appended nodes into a
+    // perfectly balanced tree. Returns the first element that broke the order. Without the
+    // thread the nodes are chained through their right links until the tree is built.
+    template <typename InputIt>
+    InputIt BuildFromSortedPrefix(InputIt first, InputIt last) {
+        MapBaseNode<K, V, Augment, Threading>* end_node = std::addressof(end_node_);
+        try {
+            for (; first != last; ++first) {
+                decltype(auto) key_value = *first;
+                MapBaseNode<K, V, Augment, Threading>* max_node = end_node_.GetPrev();
+                if (max_node != end_node) {
+                    const K& max_key = max_node->GetMapNode()->GetKey();
+                    if (Equivalent(max_key, key_value.first, KeyCompare())) {
+                        continue;
+                    }
+                    if (KeyCompare()(key_value.first, max_key)) {
+                        break;
+                    }
+                }
+                auto node = CreateNode(std::forward<decltype(key_value)>(key_value), max_node,
+                                       end_node, 0);
+                if constexpr (kThreaded) {
+                    max_node->GetNext() = node;
+                } else if (max_node == end_node) {
+                    end_node_.GetNext() = node;
+                } else {
+                    static_cast<MapNode<K, V, Augment, Threading>*>(max_node)->GetRight() = node;
+                }
+                end_node_.GetPrev() = node;
+                IncreaseSize();
+            }
+        } catch (...) {
+            BuildFromThread();
+            throw;
+        }
+        BuildFromThread();
+        return first;
+    }
+
+    void BuildFromThread() {
+        MapBaseNode<K, V, Augment, Threading>* cursor = end_node_.GetNext();
+        GetRoot() = BuildBalanced(cursor, Size());
         if (GetRoot() != nullptr) {
-            max_node->GetNext() = std::addressof(end_node_);
-            end_node_.GetPrev() = max_node;
+            GetRoot()->GetParent() = nullptr;
         }
     }
 
-    void MarkVisited(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& nodes, bool left) const {
-        auto top_other_node = std::get<0>(nodes.top());
-        auto visit_left = std::get<1>(nodes.top());
-        auto visit_right = std::get<2>(nodes.top());
-        nodes.pop();
-        if (left) {
-            nodes.push({top_other_node, LEFT_VISITED, visit_right});
-        } else {
-            nodes.push({top_other_node, visit_left, RIGHT_VISITED});
+    // Builds a subtree out of the next count nodes of the thread. Both halves differ in size
+    // by at most one, so a subtree of m nodes is std::bit_width(m) high and the balance is
+    // known without measuring anything. The recursion is O(log n) deep.
+    MapNode<K, V, Augment, Threading>* BuildBalanced(
+        MapBaseNode<K, V, Augment, Threading>*& cursor, size_t count) {
+        if (count == 0) {
+            return nullptr;
         }
+        size_t left_count = (count - 1) / 2;
+        size_t right_count = count - 1 - left_count;
+        MapNode<K, V, Augment, Threading>* left = BuildBalanced(cursor, left_count);
+        auto node = static_cast<MapNode<K, V, Augment, Threading>*>(cursor);
+        if constexpr (kThreaded) {
+            cursor = cursor->GetNext();
+        } else {
+            cursor = node->GetRight();
+        }
+        MapNode<K, V, Augment, Threading>* right = BuildBalanced(cursor, right_count);
+        ConnectAfterRotation(node, left, true);
+        ConnectAfterRotation(node, right, false);
+        int balance = static_cast<int>(std::bit_width(left_count)) -
+                      static_cast<int>(std::bit_width(right_count));
+        node->GetBalance() = static_cast<signed char>(balance);
+        UpdateSummary(node);
+        return node;
+    }
+
+    // Nodes can be allocated from several threads at once only if every copy of the allocator
+    // is interchangeable, which rules out the pool allocator.
+    static constexpr bool kParallelAllocation = NodeTraits::is_always_equal::value;
+    // Subtrees below this size are built on one thread.
+    static constexpr size_t kParallelGrain = size_t{1} << 14;
+
+    template <typename MakeNode>
+    void BuildParallel(size_t count, const MakeNode& make_node, TaskPool& pool) {
+        MapNode<K, V, Augment, Threading>* first = nullptr;
+        MapNode<K, V, Augment, Threading>* last = nullptr;
+        TaskPool* fork_pool = kParallelAllocation ? std::addressof(pool) : nullptr;
+        GetRoot() = BuildSubtree(0, count, make_node, fork_pool, first, last);
+        LinkBuiltTree(first, last, count);
     }
 
-    void MakeVisited(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& nodes,
-                     MapNode<K, V>* child) const {
-        if (nodes.size() == 0) {
+    // Threads the end node to a tree built by BuildSubtree or CloneSubtree.
+    void LinkBuiltTree(MapNode<K, V, Augment, Threading>* first,
+                       MapNode<K, V, Augment, Threading>* last, size_t count) {
+        if (GetRoot() == nullptr) {
             return;
         }
-        auto top_other_node = std::get<0>(nodes.top());
-        if (top_other_node->GetLeft().get() == child) {
-            MarkVisited(nodes, true);
-        } else {
-            MarkVisited(nodes, false);
+        GetRoot()->GetParent() = nullptr;
+        if constexpr (kThreaded) {
+            first->GetPrev() = std::addressof(end_node_);
+            last->GetNext() = std::addressof(end_node_);
+        }
+        end_node_.GetNext() = first;
+        end_node_.GetPrev() = last;
+        GetSize() = count;
+    }
+
+    // BuildBalanced over the nodes make_node(offset) to make_node(offset + count - 1), which
+    // forks the halves of subtrees above kParallelGrain nodes into the pool, if any. Returns
+    // the subtree threaded from first to last; on an exception nothing is left behind.
+    template <typename MakeNode>
+    MapNode<K, V, Augment, Threading>* BuildSubtree(size_t offset, size_t count,
+                                                    const MakeNode& make_node, TaskPool* pool,
+                                                    MapNode<K, V, Augment, Threading>*& first,
+                                                    MapNode<K, V, Augment, Threading>*& last) {
+        if (count == 0) {
+            return nullptr;
+        }
+        size_t left_count = (count - 1) / 2;
+        size_t right_count = count - 1 - left_count;
+        MapNode<K, V, Augment, Threading>* left = nullptr;
+        MapNode<K, V, Augment, Threading>* right = nullptr;
+        MapNode<K, V, Augment, Threading>* left_last = nullptr;
+        MapNode<K, V, Augment, Threading>* right_first = nullptr;
+        MapNode<K, V, Augment, Threading>* node = nullptr;
+        auto build_left = [&] {
+            left = BuildSubtree(offset, left_count, make_node, pool, first, left_last);
+        };
+        auto build_right = [&] {
+            right = BuildSubtree(offset + left_count + 1, right_count, make_node, pool,
+                                 right_first, last);
+        };
+        try {
+            if (pool != nullptr && count > kParallelGrain) {
+                pool->Invoke(build_left, build_right);
+                node = make_node(offset + left_count);
+            } else {
+                build_left();
+                node = make_node(offset + left_count);
+                build_right();
+            }
+        } catch (...) {
+            DestroySubtree(left);
+            DestroySubtree(right);
+            if (node != nullptr) {
+                DestroyNode(node);
+            }
+            throw;
         }
+        int balance = static_cast<int>(std::bit_width(left_count)) -
+                      static_cast<int>(std::bit_width(right_count));
+        node->GetBalance() = static_cast<signed char>(balance);
+        LinkSubtree(node, left, left_last, right, right_first, first, last);
+        return node;
     }
 
-    bool LeftNull(MapNode<K, V>* node) const {
-        return node->GetLeft() == nullptr;
+    // Copies the subtree of source node by node, keeping its shape and balances. Forks the
+    // children of nodes higher than a subtree of kParallelGrain nodes into the pool.
+    MapNode<K, V, Augment, Threading>* CloneSubtree(
+        const MapNode<K, V, Augment, Threading>* source, TaskPool* pool,
+        MapNode<K, V, Augment, Threading>*& first, MapNode<K, V, Augment, Threading>*& last) {
+        if (source == nullptr) {
+            return nullptr;
+        }
+        if (pool != nullptr &&
+            GetHeight(source) <= static_cast<int>(std::bit_width(kParallelGrain))) {
+            pool = nullptr;
+        }
+        MapNode<K, V, Augment, Threading>* left = nullptr;
+        MapNode<K, V, Augment, Threading>* right = nullptr;
+        MapNode<K, V, Augment, Threading>* left_last = nullptr;
+        MapNode<K, V, Augment, Threading>* right_first = nullptr;
+        MapNode<K, V, Augment, Threading>* node = nullptr;
+        auto clone_left = [&] { left = CloneSubtree(source->GetLeft(), pool, first, left_last); };
+        auto clone_right = [&] {
+            right = CloneSubtree(source->GetRight(), pool, right_first, last);
+        };
+        auto clone_node = [&] {
+            node = CreateNode(source->GetKeyValue(), nullptr, nullptr, source->GetBalance());
+        };
+        try {
+            if (pool != nullptr) {
+                pool->Invoke(clone_left, clone_right);
+                clone_node();
+            } else {
+                clone_left();
+                clone_node();
+                clone_right();
+            }
+        } catch (...) {
+            if (node != nullptr) {
+                DestroyNode(node);
+            }
+            DestroySubtree(left);
+            DestroySubtree(right);
+            throw;
+        }
+        LinkSubtree(node, left, left_last, right, right_first, first, last);
+        return node;
     }
 
-    bool RightNull(MapNode<K, V>* node) const {
-        return node->GetRight() == nullptr;
+    // Hangs the subtrees under node and threads node between them. first and last end up
+    // at the ends of the whole subtree.
+    void LinkSubtree(MapNode<K, V, Augment, Threading>* node,
+                     MapNode<K, V, Augment, Threading>* left,
+                     MapNode<K, V, Augment, Threading>* left_last,
+                     MapNode<K, V, Augment, Threading>* right,
+                     MapNode<K, V, Augment, Threading>* right_first,
+                     MapNode<K, V, Augment, Threading>*& first,
+                     MapNode<K, V, Augment, Threading>*& last) {
+        ConnectAfterRotation(node, left, true);
+        ConnectAfterRotation(node, right, false);
+        UpdateSummary(node);
+        if (left == nullptr) {
+            first = node;
+        } else if constexpr (kThreaded) {
+            left_last->GetNext() = node;
+            node->GetPrev() = left_last;
+        }
+        if (right == nullptr) {
+            last = node;
+        } else if constexpr (kThreaded) {
+            node->GetNext() = right_first;
+            right_first->GetPrev() = node;
+        }
+    }
+
+    void DestroySubtree(MapNode<K, V, Augment, Threading>* node) noexcept {
+        if (node == nullptr) {
+            return;
+        }
+        DestroySubtree(node->GetLeft());
+        DestroySubtree(node->GetRight());
+        DestroyNode(node);
     }
 
-    bool LeftVisited(MapNode<K, V>* node, bool visit_left) const {
-        return (node->GetLeft() != nullptr) && (visit_left);
+    // The nodes of the top depth levels of the subtree, in order.
+    static void CollectSplitters(
+        const MapNode<K, V, Augment, Threading>* node, size_t depth,
+        std::vector<const MapBaseNode<K, V, Augment, Threading>*>& splitters) {
+        if (node == nullptr || depth == 0) {
+            return;
+        }
+        CollectSplitters(node->GetLeft(), depth - 1, splitters);
+        splitters.push_back(node);
+        CollectSplitters(node->GetRight(), depth - 1, splitters);
+    }
+
+    // A piece that does not reach the end of its tree has a successor for each of its nodes,
+    // so its bound can stand in for the end node.
+    bool EqualPieces(const MapBaseNode<K, V, Augment, Threading>* node,
+                     const MapBaseNode<K, V, Augment, Threading>* node_end,
+                     const MapBaseNode<K, V, Augment, Threading>* other,
+                     const MapBaseNode<K, V, Augment, Threading>* other_end) const {
+        Compare compare = KeyCompare();
+        for (; node != node_end && other != other_end;
+             node = NextNode(node, node_end), other = NextNode(other, other_end)) {
+            const auto& key_value =
+                static_cast<const MapNode<K, V, Augment, Threading>*>(node)->GetKeyValue();
+            const auto& other_key_value =
+                static_cast<const MapNode<K, V, Augment, Threading>*>(other)->GetKeyValue();
+            if (!Equivalent(key_value.first, other_key_value.first, compare) ||
+                (key_value.second != other_key_value.second)) {
+                return false;
+            }
+        }
+        return node == node_end && other == other_end;
     }
 
-    bool RightVisited(MapNode<K, V>* node, bool visit_right) const {
-        return (node->GetRight() != nullptr) && (visit_right);
+    void SwapNodes(MapAVL& other) noexcept {
+        std::swap(GetRoot(), other.GetRoot());
+        std::swap(GetSize(), other.GetSize());
+        ConnectEndMapNodesAfterSwap(other);
     }
 
-    bool LeftNotVisited(MapNode<K, V>* node, bool visit_left) const {
-        return (node->GetLeft() != nullptr) && (!visit_left);
+    signed char GetNodeBalance(MapNode<K, V, Augment, Threading>* node) const {
+        if (node == nullptr) {
+            return 0;
+        }
+        return node->GetBalance();
     }
-
-    bool RightNotVisited(MapNode<K, V>* node, bool visit_right) const {
-        return (node->GetRight() != nullptr) && (!visit_right);
+    bool IsBalanceNormal(MapNode<K, V, Augment, Threading>* node) const {
+        return std::abs(GetNodeBalance(node)) <= 2;
     }
 
-    std::unique_ptr<MapNode<K, V>> CreateCopied(MapNode<K, V>* top_other_node,
-                                                MapBaseNode<K, V>*& prev_node) {
-        auto node =
-            std::make_unique<MapNode<K, V>>(top_other_node->GetKey(), top_other_node->GetValue(),
-                                            nullptr, nullptr, top_other_node->GetBalance());
-        node->GetPrev() = prev_node;
-        prev_node->GetNext() = node.get();
-        prev_node = node.get();
-        return node;
+    bool LeftRotateNeeded(MapNode<K, V, Augment, Threading>* node) {
+        if (node == nullptr || node->GetRight() == nullptr) {
+            return false;
+        }
+        return (GetNodeBalance(node) == -2) && ((GetNodeBalance(node->GetRight()) == -1) ||
+                                                (GetNodeBalance(node->GetRight()) == 0));
+    }
+    bool RightRotateNeded(MapNode<K, V, Augment, Threading>* node) {
+        if (node == nullptr || node->GetLeft() == nullptr) {
+            return false;
+        }
+        return (GetNodeBalance(node) == 2) && ((GetNodeBalance(node->GetLeft()) == 1) ||
+                                               (GetNodeBalance(node->GetLeft()) == 0));
+    }
+    bool RightLeftRotateNeeded(MapNode<K, V, Augment, Threading>* node) {
+        if (node == nullptr || node->GetRight() == nullptr ||
+            node->GetRight()->GetLeft() == nullptr) {
+            return false;
+        }
+        return (GetNodeBalance(node) == -2) && (GetNodeBalance(node->GetRight()) == 1);
+    }
+    bool LeftRightRotateNeeded(MapNode<K, V, Augment, Threading>* node) {
+        if (node == nullptr || node->GetLeft() == nullptr ||
+            node->GetLeft()->GetRight() == nullptr) {
+            return false;
+        }
+        return (GetNodeBalance(node) == 2) && (GetNodeBalance(node->GetLeft()) == -1);
+    }
+    // Keys ordered by std::less that also have a consistent operator<=> are compared three-way:
+    // the one comparison per level also tells equality, so a lookup stops at the matching node.
+    template <typename Key>
+    static constexpr bool kThreeWayCompare =
+        (std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>) &&
+        std::three_way_comparable_with<Key, K, std::weak_ordering>;
+
+    template <typename Key>
+    MapNode<K, V, Augment, Threading>* FindMapNode(const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            MapNode<K, V, Augment, Threading>* node = GetRootPtr();
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                node = (order < 0) ? node->GetLeft() : node->GetRight();
+            }
+            return nullptr;
+        } else {
+            MapNode<K, V, Augment, Threading>* bound = FindLowerBound(key);
+            if (bound != nullptr && !KeyCompare()(key, bound->GetKey())) {
+                return bound;
+            }
+            return nullptr;
+        }
     }
 
-    void PushOrRoot(const MapAVL& other, std::stack<std::unique_ptr<MapNode<K, V>>>& nodes,
-                    std::unique_ptr<MapNode<K, V>>&& node, MapNode<K, V>* top_other_node) {
-        if (top_other_node == other.GetRoot().get()) {
-            GetRoot() = std::move(node);
+    MapBaseNode<K, V, Augment, Threading>* FindLowerBoundFrom(
+        const MapBaseNode<K, V, Augment, Threading>* hint, const K& key) const {
+        auto end_node =
+            const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        if (Empty()) {
+            return end_node;
+        }
+        if (hint == nullptr || hint->IsMapEndNode()) {
+            hint = end_node_.GetPrev();
+        }
+        auto node = const_cast<MapNode<K, V, Augment, Threading>*>(hint->GetMapNode());
+        const Compare& compare = root_compare_.GetSecond();
+        MapNode<K, V, Augment, Threading>* best_bound = nullptr;
+        if (compare(node->GetKey(), key)) {
+            auto next = NextNode<MapBaseNode<K, V, Augment, Threading>>(node, end_node);
+            if (next->IsMapEndNode() || !compare(next->GetMapNode()->GetKey(), key)) {
+                return next;
+            }
+            // Up to the first ancestor on the right that is not below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetLeft() == node && !compare(parent->GetKey(), key)) {
+                    best_bound = parent;
+                    break;
+                }
+                node = parent;
+            }
         } else {
-            nodes.push(std::move(node));
+            auto prev = PrevNode<MapBaseNode<K, V, Augment, Threading>>(node, end_node);
+            if (prev->IsMapEndNode() || compare(prev->GetMapNode()->GetKey(), key)) {
+                return node;
+            }
+            // Up to the first ancestor on the left that is below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetRight() == node && compare(parent->GetKey(), key)) {
+                    break;
+                }
+                node = parent;
+            }
         }
+        auto bound = FindLowerBound(node, best_bound, key);
+        if (bound == nullptr) {
+            return end_node;
+        }
+        return bound;
     }
 
-    void LNVRN(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& other_nodes,
-               MapNode<K, V>* top_other_node) {
-        other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetLeft().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+    template <typename Key>
+    MapBaseNode<K, V, Augment, Threading>* FindOrEnd(const Key& key) const {
+        MapNode<K, V, Augment, Threading>* node = FindMapNode(key);
+        if (node == nullptr) {
+            return const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        }
+        return node;
     }
-    void LNVRNV(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& other_nodes,
-                MapNode<K, V>* top_other_node) {
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
-        other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_NOT_VISITED});
-        other_nodes.push({top_other_node->GetLeft().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+
+    template <typename Key>
+    MapBaseNode<K, V, Augment, Threading>* LowerBoundOrEnd(const Key& key) const {
+        MapNode<K, V, Augment, Threading>* node = FindLowerBound(key);
+        if (node == nullptr) {
+            return const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        }
+        return node;
     }
-    void LVRNV(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& other_nodes,
-               MapNode<K, V>* top_other_node) {
-        other_nodes.pop();
-        other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+
+    // The lower bound and the node after the equivalent one, if the key is present.
+    template <typename Key>
+    std::pair<MapBaseNode<K, V, Augment, Threading>*, MapBaseNode<K, V, Augment, Threading>*>
+    EqualRangeNodes(const Key& key) const {
+        MapBaseNode<K, V, Augment, Threading>* first = LowerBoundOrEnd(key);
+        if (!first->IsMapEndNode() &&
+            !KeyCompare()(key, first->GetMapNode()->GetKey())) {
+            return {first, NextNode(first, EndNode())};
+        }
+        return {first, first};
     }
-    void LNRNV(std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& other_nodes,
-               MapNode<K, V>* top_other_node) {
-        other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+
+    template <typename Key>
+    MapNode<K, V, Augment, Threading>* FindLowerBound(const Key& key) const {
+        return FindLowerBound(GetRootPtr(), nullptr, key);
     }
-    std::unique_ptr<MapNode<K, V>> ConnectL(std::unique_ptr<MapNode<K, V>>&& node,
-                                            std::stack<std::unique_ptr<MapNode<K, V>>>& nodes) {
-        node->GetLeft() = std::move(nodes.top());
-        node->GetLeft()->GetParent() = node.get();
-        nodes.pop();
-        return node;
+
+    // Lower bound within the subtree of the node, or best_bound if the subtree has none.
+    template <typename Key>
+    MapNode<K, V, Augment, Threading>* FindLowerBound(
+        MapNode<K, V, Augment, Threading>* node, MapNode<K, V, Augment, Threading>* best_bound,
+        const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                if (order < 0) {
+                    best_bound = node;
+                    node = node->GetLeft();
+                } else {
+                    node = node->GetRight();
+                }
+            }
+        } else {
+            const Compare& compare = root_compare_.GetSecond();
+            while (node != nullptr) {
+                if (compare(node->GetKey(), key)) {
+                    node = node->GetRight();
+                } else {
+                    best_bound = node;
+                    node = node->GetLeft();
+                }
+            }
+        }
+        return best_bound;
     }
-    std::unique_ptr<MapNode<K, V>> ConnectR(std::stack<std::unique_ptr<MapNode<K, V>>>& nodes) {
-        auto rhs = std::move(nodes.top());
-        nodes.pop();
-        auto current = std::move(nodes.top());
-        nodes.pop();
-        current->GetRight() = std::move(rhs);
-        current->GetRight()->GetParent() = current.get();
-        return current;
-    }
-
-    void CopyIteration(const MapAVL& other,
-                       std::stack<std::tuple<MapNode<K, V>*, bool, bool>>& other_nodes,
-                       std::stack<std::unique_ptr<MapNode<K, V>>>& nodes,
-                       MapNode<K, V>* top_other_node, bool visit_left, bool visit_right,
-                       MapBaseNode<K, V>*& prev_node) {
-        if (LeftNotVisited(top_other_node, visit_left) && RightNull(top_other_node)) {
-            LNVRN(other_nodes, top_other_node);
-        } else if (LeftNotVisited(top_other_node, visit_left) &&
-                   RightNotVisited(top_other_node, visit_right)) {
-            LNVRNV(other_nodes, top_other_node);
-        } else if (LeftVisited(top_other_node, visit_left) &&
-                   RightNotVisited(top_other_node, visit_right)) {
-            auto node = CreateCopied(top_other_node, prev_node);
-            node = ConnectL(std::move(node), nodes);
-            nodes.push(std::move(node));
-            LVRNV(other_nodes, top_other_node);
-        } else if (LeftVisited(top_other_node, visit_left) && RightNull(top_other_node)) {
-            auto node = CreateCopied(top_other_node, prev_node);
-            node = ConnectL(std::move(node), nodes);
-            PushOrRoot(other, nodes, std::move(node), top_other_node);
-            MakeVisited(other_nodes, top_other_node);
-        } else if (LeftVisited(top_other_node, visit_left) &&
-                   RightVisited(top_other_node, visit_right)) {
-            auto current = ConnectR(nodes);
-            PushOrRoot(other, nodes, std::move(current), top_other_node);
-            MakeVisited(other_nodes, top_other_node);
-        } else if (LeftNull(top_other_node) && RightNotVisited(top_other_node, visit_right)) {
-            auto node = CreateCopied(top_other_node, prev_node);
-            nodes.push(std::move(node));
-            LNRNV(other_nodes, top_other_node);
-        } else if (LeftNull(top_other_node) && RightVisited(top_other_node, visit_right)) {
-            auto current = ConnectR(nodes);
-            PushOrRoot(other, nodes, std::move(current), top_other_node);
-            MakeVisited(other_nodes, top_other_node);
-        } else if (LeftNull(top_other_node) && RightNull(top_other_node)) {
-            auto node = CreateCopied(top_other_node, prev_node);
-            PushOrRoot(other, nodes, std::move(node), top_other_node);
-            MakeVisited(other_nodes, top_other_node);
+
+    static constexpr size_t kBatchLanes = 16;
+
+    static void CheckBatchSize(size_t keys, size_t results) {
+        if (keys != results) {
+            throw std::invalid_argument("Batch keys and results differ in size");
+        }
+    }
+    static void Prefetch(const void* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    // Runs FindMapNode (or FindLowerBound with kLowerBound) for every key, advancing each lane
+    // by one level per round, and hands emit(index, node) the result, with the end node for
+    // a miss. A lane that finishes takes the next key right away.
+    template <bool kLowerBound, typename Emit>
+    void DescendBatch(std::span<const K> keys, Emit&& emit) const {
+        struct Lane {
+            MapNode<K, V, Augment, Threading>* node;
+            MapNode<K, V, Augment, Threading>* bound;
+            size_t index;
+        };
+        Lane lanes[kBatchLanes];
+        size_t active = std::min(keys.size(), kBatchLanes);
+        size_t next = active;
+        for (size_t i = 0; i < active; ++i) {
+            lanes[i] = {GetRootPtr(), nullptr, i};
+        }
+        const Compare& compare = root_compare_.GetSecond();
+        auto end_node =
+            const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        while (active > 0) {
+            for (size_t i = 0; i < active;) {
+                Lane& lane = lanes[i];
+                const K& key = keys[lane.index];
+                MapNode<K, V, Augment, Threading>* node = lane.node;
+                MapBaseNode<K, V, Augment, Threading>* result = end_node;
+                if (node != nullptr) {
+                    if (compare(key, node->GetKey())) {
+                        if constexpr (kLowerBound) {
+                            lane.bound = node;
+                        }
+                        lane.node = node->GetLeft();
+                    } else if (compare(node->GetKey(), key)) {
+                        lane.node = node->GetRight();
+                    } else {
+                        lane.node = nullptr;
+                        lane.bound = node;
+                    }
+                    if (lane.node != nullptr) {
+                        Prefetch(std::addressof(lane.node->GetKeyValue()));
+                        ++i;
+                        continue;
+                    }
+                    if (lane.bound != nullptr) {
+                        result = lane.bound;
+                    }
+                }
+                emit(lane.index, result);
+                if (next < keys.size()) {
+                    lane = {GetRootPtr(), nullptr, next++};
+                    ++i;
+                } else {
+                    lane = lanes[--active];
+                }
+            }
         }
     }
 
-    void Copy(const MapAVL& other) {
-        if (other.Empty()) {
+    void ConnectEndMapNodesAfterSwap(MapAVL& other) {
+        if (Empty() && other.Empty()) {
             return;
         }
-        MapBaseNode<K, V>* prev_node = std::addressof(end_node_);
-        std::stack<std::tuple<MapNode<K, V>*, bool, bool>> other_nodes;
-        std::stack<std::unique_ptr<MapNode<K, V>>> nodes;
-        other_nodes.push({other.GetRootPtr(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
-        while (!other_nodes.empty()) {
-            auto top_other_node = std::get<0>(other_nodes.top());
-            auto visit_left = std::get<1>(other_nodes.top());
-            auto visit_right = std::get<2>(other_nodes.top());
-            other_nodes.pop();
-            CopyIteration(other, other_nodes, nodes, top_other_node, visit_left, visit_right,
-                          prev_node);
+
+        auto other_min_node = end_node_.GetNext();
+        auto other_max_node = end_node_.GetPrev();
+        auto min_node = other.end_node_.GetNext();
+        auto max_node = other.end_node_.GetPrev();
+
+        if (Empty() && !other.Empty()) {
+            other.end_node_.GetPrev() = other_max_node;
+            other.end_node_.GetNext() = other_min_node;
+            if constexpr (kThreaded) {
+                other_max_node->GetNext() = std::addressof(other.end_node_);
+                other_min_node->GetPrev() = std::addressof(other.end_node_);
+            }
+
+            end_node_.GetPrev() = std::addressof(end_node_);
+            end_node_.GetNext() = std::addressof(end_node_);
+            return;
+        }
+
+        if (!Empty() && other.Empty()) {
+            end_node_.GetPrev() = max_node;
+            end_node_.GetNext() = min_node;
+            if constexpr (kThreaded) {
+                max_node->GetNext() = std::addressof(end_node_);
+                min_node->GetPrev() = std::addressof(end_node_);
+            }
+
+            other.end_node_.GetPrev() = std::addressof(other.end_node_);
+            other.end_node_.GetNext() = std::addressof(other.end_node_);
+            return;
+        }
+
+        end_node_.GetPrev() = max_node;
+        end_node_.GetNext() = min_node;
+        if constexpr (kThreaded) {
+            max_node->GetNext() = std::addressof(end_node_);
+            min_node->GetPrev() = std::addressof(end_node_);
+        }
+
+        other.end_node_.GetPrev() = other_max_node;
+        other.end_node_.GetNext() = other_min_node;
+        if constexpr (kThreaded) {
+            other_max_node->GetNext() = std::addressof(other.end_node_);
+            other_min_node->GetPrev() = std::addressof(other.end_node_);
         }
-        ConnectEndMapNodesAfterCopy(prev_node);
-        size_ = other.size_;
     }
 
-    void ConnectPrevNext(MapNode<K, V>* node, MapBaseNode<K, V>* prev, MapBaseNode<K, V>* next) {
-        node->GetNext() = next;
-        next->GetPrev() = node;
-        node->GetPrev() = prev;
-        prev->GetNext() = node;
+    // Clones the tree of other recursively, which takes a stack as deep as the tree. A
+    // PoolAllocator first makes room for all the nodes in one block, so the copy is laid out
+    // in key order, whatever order the nodes of other were allocated in.
+    void Copy(const MapAVL& other) {
+        ReservePool(GetNodeAllocator(), other.Size());
+        MapNode<K, V, Augment, Threading>* first = nullptr;
+        MapNode<K, V, Augment, Threading>* last = nullptr;
+        GetRoot() = CloneSubtree(other.GetRootPtr(), nullptr, first, last);
+        LinkBuiltTree(first, last, other.Size());
+    }
+
+    void ConnectPrevNext(MapNode<K, V, Augment, Threading>* node,
+                         MapBaseNode<K, V, Augment, Threading>* prev,
+                         MapBaseNode<K, V, Augment, Threading>* next) {
+        if constexpr (kThreaded) {
+            node->GetNext() = next;
+            next->GetPrev() = node;
+            node->GetPrev() = prev;
+            prev->GetNext() = node;
+        } else {
+            // Only the end node has links to update: the first and the last node.
+            if (prev->IsMapEndNode()) {
+                end_node_.GetNext() = node;
+            }
+            if (next->IsMapEndNode()) {
+                end_node_.GetPrev() = node;
+            }
+        }
     }
 
     void IncreaseSize() {
-        ++size_;
+        ++GetSize();
     }
 
     template <typename P>
-    std::pair<MapNode<K, V>*, bool> InsertMapNode(P&& key_value) {
-        MapNode<K, V>* node = GetRootPtr();
-        MapNode<K, V>* parent = nullptr;
+    std::pair<MapNode<K, V, Augment, Threading>*, bool> InsertMapNode(P&& key_value) {
+        MapNode<K, V, Augment, Threading>* node = GetRootPtr();
+        MapNode<K, V, Augment, Threading>* parent = nullptr;
         bool left = false;
-        MapBaseNode<K, V>* current_prev = std::addressof(end_node_);
-        MapBaseNode<K, V>* current_next = std::addressof(end_node_);
+        MapBaseNode<K, V, Augment, Threading>* current_prev = std::addressof(end_node_);
+        MapBaseNode<K, V, Augment, Threading>* current_next = std::addressof(end_node_);
+        using Key = std::remove_cvref_t<decltype(key_value.first)>;
 
         while (true) {
+            // With one comparison per level, an equivalent key is the last node the descent
+            // passed on the right.
+            if constexpr (!kThreeWayCompare<Key>) {
+                if (node == nullptr && !current_prev->IsMapEndNode() &&
+                    !KeyCompare()(current_prev->GetMapNode()->GetKey(), key_value.first)) {
+                    return {current_prev->GetMapNode(), false};
+                }
+            }
             if ((node == nullptr) && (parent == nullptr)) {
-                GetRoot() = std::make_unique<MapNode<K, V>>(std::forward<P>(key_value),
-                                                            std::addressof(end_node_),
-                                                            std::addressof(end_node_), 0);
+                GetRoot() = CreateNode(std::forward<P>(key_value), std::addressof(end_node_),
+                                       std::addressof(end_node_), 0);
                 ConnectPrevNext(GetRootPtr(), current_prev, current_next);
                 IncreaseSize();
                 return {GetRootPtr(), true};
             }
             if ((node == nullptr) && (parent != nullptr) && left) {
-                parent->GetLeft() = std::make_unique<MapNode<K, V>>(std::forward<P>(key_value),
-                                                                    nullptr, nullptr, 0);
+                parent->GetLeft() = CreateNode(std::forward<P>(key_value), nullptr, nullptr, 0);
                 parent->GetLeft()->GetParent() = parent;
-                ConnectPrevNext(parent->GetLeft().get(), current_prev, current_next);
+                ConnectPrevNext(parent->GetLeft(), current_prev, current_next);
                 IncreaseSize();
-                return {parent->GetLeft().get(), true};
+                return {parent->GetLeft(), true};
             }
             if ((node == nullptr) && (parent != nullptr) && !left) {
-                parent->GetRight() = std::make_unique<MapNode<K, V>>(std::forward<P>(key_value),
-                                                                     nullptr, nullptr, 0);
+                parent->GetRight() = CreateNode(std::forward<P>(key_value), nullptr, nullptr, 0);
                 parent->GetRight()->GetParent() = parent;
-                ConnectPrevNext(parent->GetRight().get(), current_prev, current_next);
+                ConnectPrevNext(parent->GetRight(), current_prev, current_next);
                 IncreaseSize();
-                return {parent->GetRight().get(), true};
+                return {parent->GetRight(), true};
             }
-            if ((node != nullptr) && Equivalent(node->GetKey(), key_value.first, KeyCompare())) {
-                return {node, false};
+            if constexpr (kThreeWayCompare<Key>) {
+                auto order = key_value.first <=> node->GetKey();
+                if (order == 0) {
+                    return {node, false};
+                }
+                left = order < 0;
+            } else {
+                left = KeyCompare()(key_value.first, node->GetKey());
             }
-            if ((node != nullptr) && (KeyCompare()(key_value.first, node->GetKey()))) {
-                left = true;
-                parent = node;
+            parent = node;
+            if (left) {
                 current_next = node;
-                node = node->GetLeft().get();
+                node = node->GetLeft();
             } else {
-                left = false;
-                parent = node;
                 current_prev = node;
-                node = node->GetRight().get();
+                node = node->GetRight();
+            }
+        }
+    }
+
+    // Where a key goes when it belongs right before or right after the hint: the node it would
+    // precede, paired with true, or the equivalent node, paired with false. Null when the hint
+    // is not adjacent to the key.
+    std::pair<MapBaseNode<K, V, Augment, Threading>*, bool> FindHintedNext(
+        const MapBaseNode<K, V, Augment, Threading>* hint, const K& key) const {
+        const Compare& compare = root_compare_.GetSecond();
+        auto next = const_cast<MapBaseNode<K, V, Augment, Threading>*>(hint);
+        if (next == nullptr) {
+            next = const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        }
+        if (next->IsMapEndNode() || compare(key, next->GetMapNode()->GetKey())) {
+            auto prev = PrevNode(next, EndNode());
+            if (prev->IsMapEndNode() || compare(prev->GetMapNode()->GetKey(), key)) {
+                return {next, true};
+            }
+            if (!compare(key, prev->GetMapNode()->GetKey())) {
+                return {prev, false};
             }
+            return {nullptr, false};
+        }
+        if (!compare(next->GetMapNode()->GetKey(), key)) {
+            return {next, false};
+        }
+        auto after = NextNode(next, EndNode());
+        if (after->IsMapEndNode() || compare(key, after->GetMapNode()->GetKey())) {
+            return {after, true};
+        }
+        return {nullptr, false};
+    }
+
+    // The same answer as FindHintedNext, found by a descent from the root.
+    std::pair<MapBaseNode<K, V, Augment, Threading>*, bool> FindInsertNext(const K& key) const {
+        auto end_node =
+            const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        MapNode<K, V, Augment, Threading>* bound = FindLowerBound(key);
+        if (bound == nullptr) {
+            return {end_node, true};
+        }
+        return {bound, KeyCompare()(key, bound->GetKey())};
+    }
+
+    // Hangs a new node between next and its predecessor. One of the two always has the slot
+    // free: if next has a left subtree, the predecessor is its maximum and has no right child.
+    void LinkMapNodeBefore(MapNode<K, V, Augment, Threading>* node,
+                           MapBaseNode<K, V, Augment, Threading>* next) {
+        MapBaseNode<K, V, Augment, Threading>* prev = PrevNode(next, EndNode());
+        if (GetRootPtr() == nullptr) {
+            GetRoot() = node;
+        } else if (!next->IsMapEndNode() && next->GetMapNode()->GetLeft() == nullptr) {
+            ConnectAfterRotation(next->GetMapNode(), node, true);
+        } else {
+            ConnectAfterRotation(prev->GetMapNode(), node, false);
+        }
+        ConnectPrevNext(node, prev, next);
+        IncreaseSize();
+        BalanceAfterInsert(node);
+    }
+
+    template <typename First = void, typename... Rest>
+    static constexpr bool IsKeyAndValue() {
+        return sizeof...(Rest) == 1 && std::is_same_v<std::remove_cvref_t<First>, K>;
+    }
+
+    template <typename KK, typename... Args>
+    std::pair<Iterator, bool> TryEmplaceMapNode(KK&& key, Args&&... args) {
+        auto [next, vacant] = FindInsertNext(key);
+        if (!vacant) {
+            return {Iterator{next, EndNode()}, false};
         }
+        MapNode<K, V, Augment, Threading>* node =
+            CreateNode(std::in_place, std::piecewise_construct,
+                       std::forward_as_tuple(std::forward<KK>(key)),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+        LinkMapNodeBefore(node, next);
+        return {Iterator{node, EndNode()}, true};
     }
 
-    MapNode<K, V>* GetReleased(std::unique_ptr<MapNode<K, V>>& node) {
-        if (node != nullptr) {
-            return node.release();
+    template <typename KK, typename M>
+    std::pair<Iterator, bool> InsertOrAssignMapNode(KK&& key, M&& value) {
+        auto [next, vacant] = FindInsertNext(key);
+        if (!vacant) {
+            next->GetMapNode()->GetValue() = std::forward<M>(value);
+            UpdateSummaries(next->GetMapNode());
+            return {Iterator{next, EndNode()}, false};
         }
-        return nullptr;
+        MapNode<K, V, Augment, Threading>* node =
+            CreateNode(std::in_place, std::forward<KK>(key), std::forward<M>(value));
+        LinkMapNodeBefore(node, next);
+        return {Iterator{node, EndNode()}, true};
     }
 
-    void ConnectAfterRotation(MapNode<K, V>* parent, MapNode<K, V>* child, bool left) {
+    template <typename P>
+    MapBaseNode<K, V, Augment, Threading>* InsertMapNodeHint(
+        const MapBaseNode<K, V, Augment, Threading>* hint, P&& key_value) {
+        auto [next, vacant] = FindHintedNext(hint, key_value.first);
+        if (next == nullptr) {
+            auto pair = InsertMapNode(std::forward<P>(key_value));
+            if (pair.second) {
+                BalanceAfterInsert(pair.first);
+            }
+            return pair.first;
+        }
+        if (!vacant) {
+            return next;
+        }
+        MapNode<K, V, Augment, Threading>* node =
+            CreateNode(std::forward<P>(key_value), nullptr, nullptr, 0);
+        LinkMapNodeBefore(node, next);
+        return node;
+    }
+
+    MapNode<K, V, Augment, Threading>* GetReleased(MapNode<K, V, Augment, Threading>*& node) {
+        MapNode<K, V, Augment, Threading>* released = node;
+        node = nullptr;
+        return released;
+    }
+
+    void ConnectAfterRotation(MapNode<K, V, Augment, Threading>* parent,
+                              MapNode<K, V, Augment, Threading>* child, bool left) {
         if (child != nullptr) {
             child->GetParent() = parent;
         }
         if (parent != nullptr && left) {
-            parent->GetLeft() = std::unique_ptr<MapNode<K, V>>(child);
+            parent->GetLeft() = child;
         } else if (parent != nullptr) {
-            parent->GetRight() = std::unique_ptr<MapNode<K, V>>(child);
+            parent->GetRight() = child;
         } else {
-            GetRoot() = std::unique_ptr<MapNode<K, V>>(child);
+            GetRoot() = child;
         }
     }
 
-    void FixLeftBalance(MapNode<K, V>* left_child, MapNode<K, V>* node) {
+    void FixLeftBalance(MapNode<K, V, Augment, Threading>* left_child,
+                        MapNode<K, V, Augment, Threading>* node) {
         if ((GetNodeBalance(left_child) == -2) && (GetNodeBalance(node) == -1)) {
             left_child->GetBalance() = 0;
             node->GetBalance() = 0;
@@ -1037,7 +2370,8 @@ private:
             node->GetBalance() = 1;
         }
     }
-    void FixRightBalance(MapNode<K, V>* right_child, MapNode<K, V>* node) {
+    void FixRightBalance(MapNode<K, V, Augment, Threading>* right_child,
+                         MapNode<K, V, Augment, Threading>* node) {
         if ((GetNodeBalance(right_child) == 2) && (GetNodeBalance(node) == 1)) {
             right_child->GetBalance() = 0;
             node->GetBalance() = 0;
@@ -1046,8 +2380,9 @@ private:
             node->GetBalance() = -1;
         }
     }
-    void FixRightLeftBalance(MapNode<K, V>* left_child, MapNode<K, V>* right_child,
-                             MapNode<K, V>* node) {
+    void FixRightLeftBalance(MapNode<K, V, Augment, Threading>* left_child,
+                             MapNode<K, V, Augment, Threading>* right_child,
+                             MapNode<K, V, Augment, Threading>* node) {
         if ((GetNodeBalance(left_child) == -2) && (GetNodeBalance(right_child) == 1) &&
             (GetNodeBalance(node) == 1)) {
             left_child->GetBalance() = 0;
@@ -1067,8 +2402,9 @@ private:
             node->GetBalance() = 0;
         }
     }
-    void FixLeftRightBalance(MapNode<K, V>* right_child, MapNode<K, V>* left_child,
-                             MapNode<K, V>* node) {
+    void FixLeftRightBalance(MapNode<K, V, Augment, Threading>* right_child,
+                             MapNode<K, V, Augment, Threading>* left_child,
+                             MapNode<K, V, Augment, Threading>* node) {
         if ((GetNodeBalance(right_child) == 2) && (GetNodeBalance(left_child) == -1) &&
             (GetNodeBalance(node) == -1)) {
             right_child->GetBalance() = 0;
@@ -1089,15 +2425,16 @@ private:
         }
     }
 
-    std::pair<MapNode<K, V>*, MapNode<K, V>*> DoLeftRotate(std::unique_ptr<MapNode<K, V>>& node) {
+    std::pair<MapNode<K, V, Augment, Threading>*, MapNode<K, V, Augment, Threading>*> DoLeftRotate(
+        MapNode<K, V, Augment, Threading>*& node) {
 
-        std::unique_ptr<MapNode<K, V>>& right_child = node->GetRight();
-        std::unique_ptr<MapNode<K, V>>& left_subtree = node->GetLeft();
-        std::unique_ptr<MapNode<K, V>>& middle_subtree = right_child->GetLeft();
-        std::unique_ptr<MapNode<K, V>>& right_subtree = right_child->GetRight();
+        MapNode<K, V, Augment, Threading>*& right_child = node->GetRight();
+        MapNode<K, V, Augment, Threading>*& left_subtree = node->GetLeft();
+        MapNode<K, V, Augment, Threading>*& middle_subtree = right_child->GetLeft();
+        MapNode<K, V, Augment, Threading>*& right_subtree = right_child->GetRight();
 
         auto parent_ptr = node->GetParent();
-        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft().get() == node.get());
+        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft() == node);
         auto node_ptr = GetReleased(node);
         auto right_child_ptr = GetReleased(right_child);
         auto left_subtree_ptr = GetReleased(left_subtree);
@@ -1109,11 +2446,13 @@ private:
         ConnectAfterRotation(node_ptr, left_subtree_ptr, true);
         ConnectAfterRotation(node_ptr, middle_subtree_ptr, false);
         ConnectAfterRotation(right_child_ptr, right_subtree_ptr, false);
+        UpdateSummary(node_ptr);
+        UpdateSummary(right_child_ptr);
 
         return {node_ptr, right_child_ptr};
     }
 
-    MapNode<K, V>* RotateLeft(std::unique_ptr<MapNode<K, V>>& node) {
+    MapNode<K, V, Augment, Threading>* RotateLeft(MapNode<K, V, Augment, Threading>*& node) {
 
         auto pair = DoLeftRotate(node);
         auto left_child_ptr = pair.first;
@@ -1123,15 +2462,16 @@ private:
         return node_ptr;
     }
 
-    std::pair<MapNode<K, V>*, MapNode<K, V>*> DoRightRotate(std::unique_ptr<MapNode<K, V>>& node) {
+    std::pair<MapNode<K, V, Augment, Threading>*, MapNode<K, V, Augment, Threading>*> DoRightRotate(
+        MapNode<K, V, Augment, Threading>*& node) {
 
-        std::unique_ptr<MapNode<K, V>>& left_child = node->GetLeft();
-        std::unique_ptr<MapNode<K, V>>& left_subtree = left_child->GetLeft();
-        std::unique_ptr<MapNode<K, V>>& middle_subtree = left_child->GetRight();
-        std::unique_ptr<MapNode<K, V>>& right_subtree = node->GetRight();
+        MapNode<K, V, Augment, Threading>*& left_child = node->GetLeft();
+        MapNode<K, V, Augment, Threading>*& left_subtree = left_child->GetLeft();
+        MapNode<K, V, Augment, Threading>*& middle_subtree = left_child->GetRight();
+        MapNode<K, V, Augment, Threading>*& right_subtree = node->GetRight();
 
         auto parent_ptr = node->GetParent();
-        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft().get() == node.get());
+        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft() == node);
         auto node_ptr = GetReleased(node);
         auto left_child_ptr = GetReleased(left_child);
         auto left_subtree_ptr = GetReleased(left_subtree);
@@ -1143,11 +2483,13 @@ private:
         ConnectAfterRotation(left_child_ptr, left_subtree_ptr, true);
         ConnectAfterRotation(node_ptr, middle_subtree_ptr, true);
         ConnectAfterRotation(node_ptr, right_subtree_ptr, false);
+        UpdateSummary(node_ptr);
+        UpdateSummary(left_child_ptr);
 
         return {node_ptr, left_child_ptr};
     }
 
-    MapNode<K, V>* RotateRight(std::unique_ptr<MapNode<K, V>>& node) {
+    MapNode<K, V, Augment, Threading>* RotateRight(MapNode<K, V, Augment, Threading>*& node) {
         auto pair = DoRightRotate(node);
         auto right_child_ptr = pair.first;
         auto node_ptr = pair.second;
@@ -1156,7 +2498,7 @@ private:
         return node_ptr;
     }
 
-    MapNode<K, V>* RotateRightLeft(std::unique_ptr<MapNode<K, V>>& node) {
+    MapNode<K, V, Augment, Threading>* RotateRightLeft(MapNode<K, V, Augment, Threading>*& node) {
 
         auto pair = DoRightRotate(node->GetRight());
         auto right_child_ptr = pair.first;
@@ -1169,7 +2511,7 @@ private:
         return node_ptr;
     }
 
-    MapNode<K, V>* RotateLeftRight(std::unique_ptr<MapNode<K, V>>& node) {
+    MapNode<K, V, Augment, Threading>* RotateLeftRight(MapNode<K, V, Augment, Threading>*& node) {
 
         auto pair = DoLeftRotate(node->GetLeft());
         auto left_child_ptr = pair.first;
@@ -1182,21 +2524,37 @@ private:
         return node_ptr;
     }
 
-    std::unique_ptr<MapNode<K, V>>& GetNodeUn(MapNode<K, V>* node) {
+    MapNode<K, V, Augment, Threading>*& GetNodeUn(MapNode<K, V, Augment, Threading>* node) {
         if (node->GetParent() == nullptr) {
             return GetRoot();
-        } else if (node->GetParent()->GetLeft().get() == node) {
+        } else if (node->GetParent()->GetLeft() == node) {
             return node->GetParent()->GetLeft();
         } else {
             return node->GetParent()->GetRight();
         }
     }
 
-    void BalanceAfterInsert(MapNode<K, V>* inserted_node) {
-        MapNode<K, V>* current_node = inserted_node->GetParent();
-        MapNode<K, V>* previous_node = inserted_node;
+    // Restores a node whose balance has reached +-2 and returns the new root of its subtree.
+    MapNode<K, V, Augment, Threading>* Rebalance(MapNode<K, V, Augment, Threading>*& node) {
+        MapNode<K, V, Augment, Threading>* current_node = node;
+        if (LeftRotateNeeded(current_node)) {
+            return RotateLeft(node);
+        } else if (RightRotateNeded(current_node)) {
+            return RotateRight(node);
+        } else if (RightLeftRotateNeeded(current_node)) {
+            return RotateRightLeft(node);
+        } else if (LeftRightRotateNeeded(current_node)) {
+            return RotateLeftRight(node);
+        }
+        return current_node;
+    }
+
+    void BalanceAfterInsert(MapNode<K, V, Augment, Threading>* inserted_node) {
+        UpdateSummaries(inserted_node);
+        MapNode<K, V, Augment, Threading>* current_node = inserted_node->GetParent();
+        MapNode<K, V, Augment, Threading>* previous_node = inserted_node;
         while (current_node != nullptr) {
-            if (current_node->GetLeft().get() == previous_node) {
+            if (current_node->GetLeft() == previous_node) {
                 ++(current_node->GetBalance());
             } else {
                 --(current_node->GetBalance());
@@ -1208,16 +2566,7 @@ private:
                 previous_node = current_node;
                 current_node = current_node->GetParent();
             } else {
-                std::unique_ptr<MapNode<K, V>>& current_node_smart = GetNodeUn(current_node);
-                if (LeftRotateNeeded(current_node)) {
-                    current_node = RotateLeft(current_node_smart);
-                } else if (RightRotateNeded(current_node)) {
-                    current_node = RotateRight(current_node_smart);
-                } else if (RightLeftRotateNeeded(current_node)) {
-                    current_node = RotateRightLeft(current_node_smart);
-                } else if (LeftRightRotateNeeded(current_node)) {
-                    current_node = RotateLeftRight(current_node_smart);
-                }
+                current_node = Rebalance(GetNodeUn(current_node));
                 if (current_node->GetBalance() == 0) {
                     return;
                 } else {
@@ -1228,13 +2577,323 @@ private:
         }
     }
 
-    CompressedPair<std::unique_ptr<MapNode<K, V>>, Compare> root_compare_;
-    EndMapNode<K, V> end_node_{std::addressof(end_node_), std::addressof(end_node_)};
-    size_t size_ = 0;
+    // Retracing after a subtree of the node lost one level of height. Stops as soon as the
+    // height of the current subtree is unchanged.
+    void BalanceAfterErase(MapNode<K, V, Augment, Threading>* node, bool left_shrunk) {
+        while (node != nullptr) {
+            MapNode<K, V, Augment, Threading>* parent = node->GetParent();
+            bool left = (parent != nullptr) && (parent->GetLeft() == node);
+            if (left_shrunk) {
+                --(node->GetBalance());
+            } else {
+                ++(node->GetBalance());
+            }
+            if (std::abs(node->GetBalance()) == 1) {
+                return;
+            }
+            if (std::abs(node->GetBalance()) == 2) {
+                node = Rebalance(GetNodeUn(node));
+                if (node->GetBalance() != 0) {
+                    return;
+                }
+            }
+            left_shrunk = left;
+            node = parent;
+        }
+    }
+
+    void ReplaceMapNode(MapNode<K, V, Augment, Threading>* node,
+                        MapNode<K, V, Augment, Threading>* replacement) {
+        MapNode<K, V, Augment, Threading>* parent = node->GetParent();
+        bool left = (parent != nullptr) && (parent->GetLeft() == node);
+        ConnectAfterRotation(parent, replacement, left);
+    }
+
+    // Takes the node out of the tree and rebalances it. The prev/next thread is left alone.
+    // A node with two children is replaced by its successor, which is relinked rather than
+    // copied, so iterators to the successor stay valid.
+    void DetachMapNode(MapNode<K, V, Augment, Threading>* node) {
+        MapNode<K, V, Augment, Threading>* retrace_node = nullptr;
+        bool left_shrunk = false;
+        if (node->GetLeft() != nullptr && node->GetRight() != nullptr) {
+            auto successor = static_cast<MapNode<K, V, Augment, Threading>*>(
+                NextNode<MapBaseNode<K, V, Augment, Threading>>(node, EndNode()));
+            if (successor == node->GetRight()) {
+                retrace_node = successor;
+            } else {
+                retrace_node = successor->GetParent();
+                left_shrunk = true;
+                ConnectAfterRotation(retrace_node, successor->GetRight(), true);
+                ConnectAfterRotation(successor, node->GetRight(), false);
+            }
+            ConnectAfterRotation(successor, node->GetLeft(), true);
+            successor->GetBalance() = node->GetBalance();
+            ReplaceMapNode(node, successor);
+        } else {
+            retrace_node = node->GetParent();
+            left_shrunk = (retrace_node != nullptr) && (retrace_node->GetLeft() == node);
+            ReplaceMapNode(node, node->GetLeft() != nullptr ? node->GetLeft() : node->GetRight());
+        }
+        UpdateSummaries(retrace_node);
+        BalanceAfterErase(retrace_node, left_shrunk);
+    }
+
+    void EraseMapNode(MapNode<K, V, Augment, Threading>* node) {
+        UnlinkMapNode(node);
+        DestroyNode(node);
+    }
+
+    // Height of a subtree, found by descending along its taller side.
+    int GetHeight(const MapNode<K, V, Augment, Threading>* node) const {
+        int height = 0;
+        while (node != nullptr) {
+            ++height;
+            node = (node->GetBalance() < 0) ? node->GetRight() : node->GetLeft();
+        }
+        return height;
+    }
+
+    static typename Augment::Summary GetSummary(const MapNode<K, V, Augment, Threading>* node) {
+        return (node == nullptr) ? Augment::Identity() : node->GetSummary();
+    }
+
+    // Recomputes the summary of a node from its own element and the summaries of its children,
+    // which have to be up to date. Does nothing without an augmentation.
+    void UpdateSummary(MapNode<K, V, Augment, Threading>* node) {
+        if constexpr (kAugmented) {
+            node->GetSummary() = Augment::Combine(
+                Augment::Combine(GetSummary(node->GetLeft()), Augment::Lift(node->GetKeyValue())),
+                GetSummary(node->GetRight()));
+        }
+    }
+
+    // Recomputes the summaries on the path from the node to the root, after the subtree of the
+    // node gained or lost elements.
+    void UpdateSummaries(MapNode<K, V, Augment, Threading>* node) {
+        if constexpr (kAugmented) {
+            for (; node != nullptr; node = node->GetParent()) {
+                UpdateSummary(node);
+            }
+        }
+    }
+
+    static size_t GetSubtreeSize(const MapNode<K, V, Augment, Threading>* node) {
+        return GetSummary(node);
+    }
+
+    // Index of the node in the whole tree; the end sentinel comes right after the last node.
+    static size_t RankOf(const MapBaseNode<K, V, Augment, Threading>* base) {
+        if (base->IsMapEndNode()) {
+            const MapBaseNode<K, V, Augment, Threading>* last = PrevNode(base, base);
+            return last->IsMapEndNode() ? 0 : RankOf(last) + 1;
+        }
+        const MapNode<K, V, Augment, Threading>* node = base->GetMapNode();
+        size_t rank = GetSubtreeSize(node->GetLeft());
+        for (auto parent = node->GetParent(); parent != nullptr; parent = parent->GetParent()) {
+            if (parent->GetRight() == node) {
+                rank += GetSubtreeSize(parent->GetLeft()) + 1;
+            }
+            node = parent;
+        }
+        return rank;
+    }
+
+    // The node at the given index of the subtree, which has to hold more than index nodes.
+    MapBaseNode<K, V, Augment, Threading>* NthOrEnd(size_t index) const {
+        if (index >= Size()) {
+            return const_cast<EndMapNode<K, V, Augment, Threading>*>(std::addressof(end_node_));
+        }
+        return SelectNode(GetRootPtr(), index);
+    }
+
+    static MapNode<K, V, Augment, Threading>* SelectNode(MapNode<K, V, Augment, Threading>* node,
+                                                         size_t index) {
+        while (true) {
+            size_t left_size = GetSubtreeSize(node->GetLeft());
+            if (index < left_size) {
+                node = node->GetLeft();
+            } else if (index == left_size) {
+                return node;
+            } else {
+                index -= left_size + 1;
+                node = node->GetRight();
+            }
+        }
+    }
+
+    // Moves offset positions along the thread by climbing to the root and selecting the
+    // target index there, so the cost is O(log n) whatever the distance.
+    template <typename End>
+    static MapBaseNode<K, V, Augment, Threading>* Advance(
+        const MapBaseNode<K, V, Augment, Threading>* base, End end, std::ptrdiff_t offset) {
+        if (base == nullptr) {
+            throw std::out_of_range("Out of range!");
+        }
+        auto result = const_cast<MapBaseNode<K, V, Augment, Threading>*>(base);
+        if (offset == 0) {
+            return result;
+        }
+        const MapBaseNode<K, V, Augment, Threading>* anchor =
+            base->IsMapEndNode() ? PrevNode(base, base) : base;
+        if (anchor->IsMapEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        auto root = const_cast<MapNode<K, V, Augment, Threading>*>(anchor->GetMapNode());
+        while (root->GetParent() != nullptr) {
+            root = root->GetParent();
+        }
+        auto size = static_cast<std::ptrdiff_t>(GetSubtreeSize(root));
+        std::ptrdiff_t index = static_cast<std::ptrdiff_t>(RankOf(base)) + offset;
+        if (index < 0 || index > size) {
+            throw std::out_of_range("Out of range!");
+        }
+        if (index == size) {
+            return NextNode<MapBaseNode<K, V, Augment, Threading>>(SelectNode(root, size - 1), end);
+        }
+        return SelectNode(root, index);
+    }
+
+    // Joins two detached trees and a middle node, all keys of left < middle < all keys of
+    // right. The middle node is hung on the spine of the taller tree at the height of the
+    // lower one and the tree is retraced as after an insertion, so the cost is proportional
+    // to the difference in heights. Uses the root slot as scratch and returns the new root.
+    MapNode<K, V, Augment, Threading>* JoinMapNodes(MapNode<K, V, Augment, Threading>* left,
+                                                    MapNode<K, V, Augment, Threading>* middle,
+                                                    MapNode<K, V, Augment, Threading>* right) {
+        int left_height = GetHeight(left);
+        int right_height = GetHeight(right);
+        middle->GetParent() = nullptr;
+        if (std::abs(left_height - right_height) <= 1) {
+            ConnectAfterRotation(middle, left, true);
+            ConnectAfterRotation(middle, right, false);
+            middle->GetBalance() = static_cast<signed char>(left_height - right_height);
+            UpdateSummary(middle);
+            return middle;
+        }
+        if (left_height > right_height) {
+            MapNode<K, V, Augment, Threading>* parent = nullptr;
+            MapNode<K, V, Augment, Threading>* node = left;
+            int height = left_height;
+            while (height > right_height + 1) {
+                height -= (node->GetBalance() > 0) ? 2 : 1;
+                parent = node;
+                node = node->GetRight();
+            }
+            ConnectAfterRotation(middle, node, true);
+            ConnectAfterRotation(middle, right, false);
+            middle->GetBalance() = static_cast<signed char>(height - right_height);
+            GetRoot() = left;
+            ConnectAfterRotation(parent, middle, false);
+        } else {
+            MapNode<K, V, Augment, Threading>* parent = nullptr;
+            MapNode<K, V, Augment, Threading>* node = right;
+            int height = right_height;
+            while (height > left_height + 1) {
+                height -= (node->GetBalance() < 0) ? 2 : 1;
+                parent = node;
+                node = node->GetLeft();
+            }
+            ConnectAfterRotation(middle, left, true);
+            ConnectAfterRotation(middle, node, false);
+            middle->GetBalance() = static_cast<signed char>(left_height - height);
+            GetRoot() = right;
+            ConnectAfterRotation(parent, middle, true);
+        }
+        BalanceAfterInsert(middle);
+        return GetRoot();
+    }
+
+    MapNode<K, V, Augment, Threading>* DetachChild(MapNode<K, V, Augment, Threading>* child) {
+        if (child != nullptr) {
+            child->GetParent() = nullptr;
+        }
+        return child;
+    }
+
+    // Splits the tree into the nodes before the pivot and the nodes from the pivot on by
+    // joining the subtrees hanging off the path from the pivot to the root. Returns the two
+    // roots; the root slot is left pointing to garbage.
+    std::pair<MapNode<K, V, Augment, Threading>*, MapNode<K, V, Augment, Threading>*> SplitMapNodes(
+        MapNode<K, V, Augment, Threading>* pivot) {
+        MapNode<K, V, Augment, Threading>* parent = pivot->GetParent();
+        MapNode<K, V, Augment, Threading>* left = DetachChild(pivot->GetLeft());
+        MapNode<K, V, Augment, Threading>* right = DetachChild(pivot->GetRight());
+        right = JoinMapNodes(nullptr, pivot, right);
+        MapNode<K, V, Augment, Threading>* child = pivot;
+        while (parent != nullptr) {
+            MapNode<K, V, Augment, Threading>* grandparent = parent->GetParent();
+            if (parent->GetLeft() == child) {
+                right = JoinMapNodes(right, parent, DetachChild(parent->GetRight()));
+            } else {
+                left = JoinMapNodes(DetachChild(parent->GetLeft()), parent, left);
+            }
+            child = parent;
+            parent = grandparent;
+        }
+        return {left, right};
+    }
+
+    // Short ranges are erased node by node, each in O(log n). Longer ones are cut out with
+    // two splits and a join, which costs O(log^2 n) on top of visiting the erased nodes.
+    void EraseMapNodes(MapBaseNode<K, V, Augment, Threading>* first,
+                       MapBaseNode<K, V, Augment, Threading>* last) {
+        size_t count = 0;
+        for (auto node = first; node != last; node = NextNode(node, EndNode())) {
+            ++count;
+        }
+        if (count == Size()) {
+            DestroyNodes();
+            return;
+        }
+        if (count < static_cast<size_t>(GetHeight(GetRoot()))) {
+            while (first != last) {
+                auto next = NextNode(first, EndNode());
+                EraseMapNode(first->GetMapNode());
+                first = next;
+            }
+            return;
+        }
+        MapBaseNode<K, V, Augment, Threading>* prev = PrevNode(first, EndNode());
+        auto [before, rest] = SplitMapNodes(first->GetMapNode());
+        MapNode<K, V, Augment, Threading>* erased = rest;
+        MapNode<K, V, Augment, Threading>* after = nullptr;
+        if (!last->IsMapEndNode()) {
+            GetRoot() = rest;
+            std::tie(erased, after) = SplitMapNodes(last->GetMapNode());
+        }
+        if (before == nullptr || after == nullptr) {
+            GetRoot() = (before == nullptr) ? after : before;
+        } else {
+            MapNode<K, V, Augment, Threading>* middle = last->GetMapNode();
+            GetRoot() = after;
+            DetachMapNode(middle);
+            GetRoot() = JoinMapNodes(before, middle, GetRoot());
+        }
+        DestroySubtree(erased);
+        if constexpr (kThreaded) {
+            prev->GetNext() = last;
+            last->GetPrev() = prev;
+        } else {
+            if (prev->IsMapEndNode()) {
+                end_node_.GetNext() = last;
+            }
+            if (last->IsMapEndNode()) {
+                end_node_.GetPrev() = prev;
+            }
+        }
+        GetSize() -= count;
+    }
+
+    CompressedPair<MapNode<K, V, Augment, Threading>*, Compare> root_compare_;
+    EndMapNode<K, V, Augment, Threading> end_node_{std::addressof(end_node_),
+                                                std::addressof(end_node_)};
+    CompressedPair<size_t, NodeAllocator> size_allocator_;
 };
 
-template <typename K, typename V, typename Compare>
-bool operator==(const MapAVL<K, V, Compare>& lhs, const MapAVL<K, V, Compare>& rhs) {
+template <typename K, typename V, typename Compare, typename Allocator, typename Augment,
+          typename Threading>
+bool operator==(const MapAVL<K, V, Compare, Allocator, Augment, Threading>& lhs,
+                const MapAVL<K, V, Compare, Allocator, Augment, Threading>& rhs) {
     if (lhs.Size() != rhs.Size()) {
         return false;
     }
@@ -1249,23 +2908,47 @@ bool operator==(const MapAVL<K, V, Compare>& lhs, const MapAVL<K, V, Compare>& r
     return true;
 }
 
-template <typename K, typename V, typename Compare>
-void Swap(MapAVL<K, V, Compare>& lhs, MapAVL<K, V, Compare>& rhs) {
+template <typename K, typename V, typename Compare, typename Allocator, typename Augment,
+          typename Threading>
+void Swap(MapAVL<K, V, Compare, Allocator, Augment, Threading>& lhs,
+          MapAVL<K, V, Compare, Allocator, Augment, Threading>& rhs) {
     lhs.Swap(rhs);
 }
 
-template <typename K, typename V, typename Compare>
-bool operator!=(const MapAVL<K, V, Compare>& lhs, const MapAVL<K, V, Compare>& rhs) {
+template <typename K, typename V, typename Compare, typename Allocator, typename Augment,
+          typename Threading>
+bool operator!=(const MapAVL<K, V, Compare, Allocator, Augment, Threading>& lhs,
+                const MapAVL<K, V, Compare, Allocator, Augment, Threading>& rhs) {
     return !(lhs == rhs);
 }
 
-template <typename K, typename V>
-size_t CalcNodeHeight(const MapNode<K, V>* node) {
+template <typename K, typename V, typename Augment, typename Threading>
+size_t CalcNodeHeight(const MapNode<K, V, Augment, Threading>* node) {
+    if (!node) {
+        return 0;
+    }
+    size_t left_height = CalcNodeHeight(node->GetLeft());
+    size_t right_height = CalcNodeHeight(node->GetRight());
+    return 1 + std::max(left_height, right_height);
+}
+
+// Recomputes the height of every subtree and checks it against the stored balances and
+// parent links. Returns -1 if the tree is not a valid AVL tree.
+template <typename K, typename V, typename Augment, typename Threading>
+int CheckNodeBalance(const MapNode<K, V, Augment, Threading>* node) {
     if (!node) {
         return 0;
     }
-    size_t left_height = CalcNodeHeight(node->GetLeft().get());
-    size_t right_height = CalcNodeHeight(node->GetRight().get());
+    int left_height = CheckNodeBalance(node->GetLeft());
+    int right_height = CheckNodeBalance(node->GetRight());
+    if (left_height < 0 || right_height < 0 || left_height - right_height != node->GetBalance() ||
+        std::abs(left_height - right_height) > 1) {
+        return -1;
+    }
+    if ((node->GetLeft() && node->GetLeft()->GetParent() != node) ||
+        (node->GetRight() && node->GetRight()->GetParent() != node)) {
+        return -1;
+    }
     return 1 + std::max(left_height, right_height);
 }
 
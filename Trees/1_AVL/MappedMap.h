@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout written by MappedMap::Write. The header sits at offset 0, followed by the keys
+// and then the values, each as a plain array in sorted order that starts on a 64-byte
+// boundary. All offsets are from the start of the file, so the image can be mapped at any
+// address and used without a pass over it.
+struct MappedMapHeader {
+    static constexpr char kMagic[8] = {'M', 'A', 'P', 'A', 'V', 'L', '\0', '\0'};
+    static constexpr uint32_t kVersion = 1;
+    // Read back in a different order on a machine of the other endianness.
+    static constexpr uint32_t kByteOrder = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;
+    uint32_t key_size;
+    uint32_t key_align;
+    uint32_t value_size;
+    uint32_t value_align;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+    uint64_t file_size;
+};
+
+// Read-only ordered map over a file image of a MapAVL, or of any map with sorted unique keys,
+// mapped into memory with mmap. Opening reads nothing but the header: the keys and values are
+// used in place, and pages come in from the file as lookups touch them. Find and LowerBound
+// are binary searches over the key array, and iteration walks both arrays in order.
+//
+// K and V have to be trivially copyable, since their bytes are written out and read back as
+// they are, and the image has to be read with the ordering it was written with; the header
+// records the sizes and alignments of K and V and the byte order, and Open rejects an image
+// that does not match. Iterators and references stay valid while the map is open.
+template <typename K, typename V, typename Compare = std::less<K>>
+class MappedMap {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+                  "MappedMap stores K and V as raw bytes");
+
+public:
+    // Dereferences to a pair of references into the mapped arrays.
+    class ConstIterator {
+    public:
+        using Reference = std::pair<const K&, const V&>;
+        struct Pointer {
+            const Reference* operator->() const {
+                return &reference;
+            }
+            Reference reference;
+        };
+
+        ConstIterator() = default;
+
+        Reference operator*() const {
+            return {*key_, *value_};
+        }
+        Pointer operator->() const {
+            return Pointer{**this};
+        }
+        ConstIterator& operator++() {
+            ++key_;
+            ++value_;
+            return *this;
+        }
+        ConstIterator operator++(int) {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        ConstIterator& operator--() {
+            --key_;
+            --value_;
+            return *this;
+        }
+        ConstIterator operator--(int) {
+            ConstIterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const ConstIterator& other) const {
+            return key_ == other.key_;
+        }
+        bool operator!=(const ConstIterator& other) const {
+            return key_ != other.key_;
+        }
+
+    private:
+        friend class MappedMap;
+
+        ConstIterator(const K* key, const V* value) : key_(key), value_(value) {
+        }
+
+        const K* key_ = nullptr;
+        const V* value_ = nullptr;
+    };
+
+    MappedMap() = default;
+    // Maps the image at path; see Open.
+    explicit MappedMap(const std::string& path, const Compare& compare = Compare())
+        : compare_(compare) {
+        Open(path);
+    }
+    MappedMap(const MappedMap& other) = delete;
+    MappedMap& operator=(const MappedMap& other) = delete;
+    MappedMap(MappedMap&& other) noexcept {
+        Swap(other);
+    }
+    MappedMap& operator=(MappedMap&& other) noexcept {
+        MappedMap moved(std::move(other));
+        Swap(moved);
+        return *this;
+    }
+    ~MappedMap() {
+        Close();
+    }
+
+    // Writes the elements of map, which have to be sorted by Compare with unique keys, as an
+    // image for Open. The image goes to a temporary file next to path first and replaces path
+    // only once it is complete, so a reader never maps a partial image. If the write or the
+    // rename fails, the temporary file is removed and path is left as it was.
+    template <typename Map>
+    static void Write(const std::string& path, const Map& map) {
+        MappedMapHeader header{};
+        std::memcpy(header.magic, MappedMapHeader::kMagic, sizeof(header.magic));
+        header.version = MappedMapHeader::kVersion;
+        header.byte_order = MappedMapHeader::kByteOrder;
+        header.size = map.Size();
+        header.key_size = sizeof(K);
+        header.key_align = alignof(K);
+        header.value_size = sizeof(V);
+        header.value_align = alignof(V);
+        header.keys_offset = AlignUp(sizeof(MappedMapHeader));
+        header.values_offset = AlignUp(header.keys_offset + header.size * sizeof(K));
+        header.file_size = header.values_offset + header.size * sizeof(V);
+
+        const std::string temporary = TemporaryPathFor(path);
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot create " + temporary);
+        }
+        try {
+            WriteBytes(out, &header, sizeof(header));
+            WritePadding(out, header.keys_offset - sizeof(header));
+            WriteArray(out, map,
+                       [](const auto& key_value) -> const K& { return key_value.first; });
+            WritePadding(out,
+                         header.values_offset - header.keys_offset - header.size * sizeof(K));
+            WriteArray(out, map,
+                       [](const auto& key_value) -> const V& { return key_value.second; });
+            out.close();
+            if (!out) {
+                throw std::runtime_error("Cannot write " + temporary);
+            }
+            std::filesystem::rename(temporary, path);
+        } catch (...) {
+            out.close();
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+    }
+
+    // Maps the image at path read-only, closing the image mapped before. Throws
+    // std::system_error if the file cannot be opened or mapped, and std::runtime_error if it is
+    // not an image of this MappedMap.
+    void Open(const std::string& path) {
+        Close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "Cannot stat " + path);
+        }
+        const auto file_size = static_cast<size_t>(status.st_size);
+        if (file_size < sizeof(MappedMapHeader)) {
+            ::close(fd);
+            throw std::runtime_error(path + " is too short for a MappedMap image");
+        }
+        void* address = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        // The mapping keeps the file open by itself.
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(), "Cannot map " + path);
+        }
+        address_ = address;
+        mapped_size_ = file_size;
+        const auto& header = *static_cast<const MappedMapHeader*>(address);
+        if (const char* problem = CheckHeader(header, file_size)) {
+            Close();
+            throw std::runtime_error(path + ": " + problem);
+        }
+        const auto* bytes = static_cast<const std::byte*>(address);
+        keys_ = reinterpret_cast<const K*>(bytes + header.keys_offset);
+        values_ = reinterpret_cast<const V*>(bytes + header.values_offset);
+        size_ = header.size;
+    }
+    // Unmaps the image, leaving the map empty.
+    void Close() noexcept {
+        if (address_ != nullptr) {
+            ::munmap(address_, mapped_size_);
+        }
+        address_ = nullptr;
+        mapped_size_ = 0;
+        keys_ = nullptr;
+        values_ = nullptr;
+        size_ = 0;
+    }
+    void Swap(MappedMap& other) noexcept {
+        std::swap(address_, other.address_);
+        std::swap(mapped_size_, other.mapped_size_);
+        std::swap(keys_, other.keys_);
+        std::swap(values_, other.values_);
+        std::swap(size_, other.size_);
+        std::swap(compare_, other.compare_);
+    }
+
+    ConstIterator Find(const K& key) const {
+        size_t rank = LowerBoundRank(key);
+        if (rank == size_ || compare_(key, keys_[rank])) {
+            return End();
+        }
+        return At(rank);
+    }
+    ConstIterator LowerBound(const K& key) const {
+        return At(LowerBoundRank(key));
+    }
+    ConstIterator UpperBound(const K& key) const {
+        return At(std::upper_bound(keys_, keys_ + size_, key, compare_) - keys_);
+    }
+    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
+        size_t rank = LowerBoundRank(key);
+        if (rank == size_ || compare_(key, keys_[rank])) {
+            return {At(rank), At(rank)};
+        }
+        return {At(rank), At(rank + 1)};
+    }
+    bool Contains(const K& key) const {
+        return Find(key) != End();
+    }
+    size_t Count(const K& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+
+    ConstIterator Begin() const noexcept {
+        return At(0);
+    }
+    ConstIterator End() const noexcept {
+        return At(size_);
+    }
+    ConstIterator CBegin() const noexcept {
+        return Begin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return End();
+    }
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+    bool Empty() const noexcept {
+        return size_ == 0;
+    }
+    Compare KeyCompare() const {
+        return compare_;
+    }
+
+private:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kWriteChunk = size_t{1} << 16;
+
+    static uint64_t AlignUp(uint64_t offset) noexcept {
+        return (offset + kAlignment - 1) / kAlignment * kAlignment;
+    }
+    // A name next to path that no other writer uses at the same time: the process id tells
+    // processes apart and the counter the writers within one.
+    static std::string TemporaryPathFor(const std::string& path) {
+        static std::atomic<uint64_t> counter = 0;
+        return path + ".tmp." + std::to_string(::getpid()) + "." +
+               std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+    }
+    static void WriteBytes(std::ofstream& out, const void* data, size_t size) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+    static void WritePadding(std::ofstream& out, size_t size) {
+        const char zeros[kAlignment] = {};
+        WriteBytes(out, zeros, size);
+    }
+    // Writes field(element) of every element in order, a chunk at a time.
+    template <typename Map, typename Field>
+    static void WriteArray(std::ofstream& out, const Map& map, const Field& field) {
+        using T = std::remove_cvref_t<decltype(field(*map.Begin()))>;
+        std::vector<T> chunk;
+        chunk.reserve(std::min<size_t>(map.Size(), kWriteChunk));
+        for (auto it = map.Begin(); it != map.End(); ++it) {
+            chunk.push_back(field(*it));
+            if (chunk.size() == kWriteChunk) {
+                WriteBytes(out, chunk.data(), chunk.size() * sizeof(T));
+                chunk.clear();
+            }
+        }
+        WriteBytes(out, chunk.data(), chunk.size() * sizeof(T));
+    }
+
+    // Returns what is wrong with the header, or nullptr if it describes a valid image of
+    // file_size bytes for these K and V.
+    static const char* CheckHeader(const MappedMapHeader& header, size_t file_size) noexcept {
+        if (std::memcmp(header.magic, MappedMapHeader::kMagic, sizeof(header.magic)) != 0) {
+            return "not a MappedMap image";
+        }
+        if (header.version != MappedMapHeader::kVersion) {
+            return "unsupported MappedMap image version";
+        }
+        if (header.byte_order != MappedMapHeader::kByteOrder) {
+            return "MappedMap image of the other byte order";
+        }
+        if (header.key_size != sizeof(K) || header.key_align != alignof(K) ||
+            header.value_size != sizeof(V) || header.value_align != alignof(V)) {
+            return "MappedMap image of other key or value types";
+        }
+        // The offsets are ordered before anything is added to them or subtracted from them,
+        // and size is bounded first, so that no check can be passed by wraparound.
+        if (header.file_size != file_size || header.keys_offset % kAlignment != 0 ||
+            header.values_offset % kAlignment != 0 ||
+            header.keys_offset < sizeof(MappedMapHeader) ||
+            header.keys_offset > header.values_offset || header.values_offset > file_size ||
+            header.size > file_size / std::max(sizeof(K), sizeof(V)) ||
+            header.size * sizeof(K) > header.values_offset - header.keys_offset ||
+            header.size * sizeof(V) > file_size - header.values_offset) {
+            return "MappedMap image is truncated or corrupt";
+        }
+        return nullptr;
+    }
+
+    ConstIterator At(size_t rank) const noexcept {
+        return ConstIterator{keys_ + rank, values_ + rank};
+    }
+
+    // Binary search whose step is a conditional move rather than a branch: the range shrinks
+    // to its upper half or stays put depending on the comparison. The midpoints of both
+    // halves of the next step are prefetched, so the page or cache line it needs is on its
+    // way whichever way it goes.
+    size_t LowerBoundRank(const K& key) const {
+        if (size_ == 0) {
+            return 0;
+        }
+        const K* base = keys_;
+        size_t count = size_;
+        while (count > 1) {
+            const size_t half = count / 2;
+            Prefetch(base + half / 2);
+            Prefetch(base + half + half / 2);
+            base = compare_(base[half], key) ? base + half : base;
+            count -= half;
+        }
+        return static_cast<size_t>(base - keys_) + static_cast<size_t>(compare_(*base, key));
+    }
+    static void Prefetch(const void* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    void* address_ = nullptr;
+    size_t mapped_size_ = 0;
+    const K* keys_ = nullptr;
+    const V* values_ = nullptr;
+    size_t size_ = 0;
+    [[no_unique_address]] Compare compare_;
+};
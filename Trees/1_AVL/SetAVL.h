@@ -1,17 +1,27 @@
 #pragma once
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <compare>
 #include <cstddef>
+#include <functional>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <span>
 #include <stack>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include <iostream>
+#include "FrozenMap.h"
 #include "compressed_pair.h"
+#include "pool_allocator.h"
+#include "task_pool.h"
 
 template <typename K1, typename K2, typename Compare>
 bool Equivalent(const K1& key_1, const K2& key_2, Compare compare) {
@@ -21,6 +31,8 @@ bool Equivalent(const K1& key_1, const K2& key_2, Compare compare) {
 template <typename K>
 class SetNode;
 
+// Links shared by the tree nodes and the end sentinel. The sentinel is told apart by a flag
+// rather than by a vtable, so walking the prev/next thread is a plain load.
 template <typename K>
 class SetBaseNode {
 public:
@@ -31,21 +43,47 @@ public:
     SetBaseNode& operator=(SetBaseNode&& other) = delete;
     ~SetBaseNode() noexcept = default;
 
-    virtual const K& GetKey() const = 0;
-    virtual K& GetKey() = 0;
-    virtual const std::unique_ptr<SetNode<K>>& GetLeft() const = 0;
-    virtual std::unique_ptr<SetNode<K>>& GetLeft() = 0;
-    virtual const std::unique_ptr<SetNode<K>>& GetRight() const = 0;
-    virtual std::unique_ptr<SetNode<K>>& GetRight() = 0;
-    virtual SetNode<K>* GetParent() const = 0;
-    virtual SetNode<K>*& GetParent() = 0;
-    virtual SetBaseNode<K>* GetPrev() const noexcept = 0;
-    virtual SetBaseNode<K>*& GetPrev() noexcept = 0;
-    virtual SetBaseNode<K>* GetNext() const noexcept = 0;
-    virtual SetBaseNode<K>*& GetNext() noexcept = 0;
-    virtual signed char GetBalance() const = 0;
-    virtual signed char& GetBalance() = 0;
-    virtual bool IsSetEndNode() const noexcept = 0;
+    SetBaseNode(SetBaseNode<K>* prev, SetBaseNode<K>* next, bool end_node) noexcept
+        : prev_(prev), next_(next), end_node_(end_node) {
+    }
+    SetBaseNode<K>* GetPrev() const noexcept {
+        return prev_;
+    }
+    SetBaseNode<K>*& GetPrev() noexcept {
+        return prev_;
+    }
+    SetBaseNode<K>* GetNext() const noexcept {
+        return next_;
+    }
+    SetBaseNode<K>*& GetNext() noexcept {
+        return next_;
+    }
+    const K& GetKey() const {
+        return GetSetNode()->GetKey();
+    }
+    K& GetKey() {
+        return GetSetNode()->GetKey();
+    }
+    const SetNode<K>* GetSetNode() const {
+        if (IsSetEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<const SetNode<K>*>(this);
+    }
+    SetNode<K>* GetSetNode() {
+        if (IsSetEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<SetNode<K>*>(this);
+    }
+    bool IsSetEndNode() const noexcept {
+        return end_node_;
+    }
+
+private:
+    SetBaseNode<K>* prev_ = nullptr;
+    SetBaseNode<K>* next_ = nullptr;
+    bool end_node_ = false;
 };
 
 template <typename K>
@@ -59,14 +97,19 @@ public:
     ~SetNode() = default;
 
     SetNode(const K& key, SetBaseNode<K>* prev, SetBaseNode<K>* next, signed char balance)
-        : key_(key), prev_(prev), next_(next), balance_(balance) {
+        : SetBaseNode<K>(prev, next, false), balance_(balance), key_(key) {
     }
-    SetNode(K&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next, size_t size, signed char balance)
-        : key_(std::move(key)), prev_(prev), next_(next), balance_(balance) {
+    SetNode(K&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next, signed char balance)
+        : SetBaseNode<K>(prev, next, false), balance_(balance), key_(std::move(key)) {
     }
     template <typename P>
-    SetNode(P&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next, size_t size, signed char balance)
-        : key_(std::forward<P>(key)), prev_(prev), next_(next), balance_(balance) {
+    SetNode(P&& key, SetBaseNode<K>* prev, SetBaseNode<K>* next, signed char balance)
+        : SetBaseNode<K>(prev, next, false), balance_(balance), key_(std::forward<P>(key)) {
+    }
+    // Builds the key from the arguments of an Emplace, unlinked.
+    template <typename... Args>
+    explicit SetNode(std::in_place_t, Args&&... args)
+        : SetBaseNode<K>(nullptr, nullptr, false), key_(std::forward<Args>(args)...) {
     }
     const K& GetKey() const noexcept {
         return key_;
@@ -74,16 +117,16 @@ public:
     K& GetKey() noexcept {
         return key_;
     }
-    const std::unique_ptr<SetNode<K>>& GetLeft() const noexcept {
+    SetNode<K>* GetLeft() const noexcept {
         return left_;
     }
-    std::unique_ptr<SetNode<K>>& GetLeft() noexcept {
+    SetNode<K>*& GetLeft() noexcept {
         return left_;
     }
-    const std::unique_ptr<SetNode<K>>& GetRight() const noexcept {
+    SetNode<K>* GetRight() const noexcept {
         return right_;
     }
-    std::unique_ptr<SetNode<K>>& GetRight() noexcept {
+    SetNode<K>*& GetRight() noexcept {
         return right_;
     }
     SetNode<K>* GetParent() const noexcept {
@@ -92,102 +135,40 @@ public:
     SetNode<K>*& GetParent() noexcept {
         return parent_;
     }
-    SetBaseNode<K>* GetPrev() const noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>*& GetPrev() noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>* GetNext() const noexcept {
-        return next_;
-    }
-    SetBaseNode<K>*& GetNext() noexcept {
-        return next_;
-    }
     signed char GetBalance() const {
         return balance_;
     }
     signed char& GetBalance() {
         return balance_;
     }
-    bool IsSetEndNode() const noexcept {
-        return false;
-    }
 
 private:
+    // Declared first so that it lands in the tail padding of SetBaseNode.
+    signed char balance_ = 0;
     K key_;
-    std::unique_ptr<SetNode<K>> left_;
-    std::unique_ptr<SetNode<K>> right_;
+    SetNode<K>* left_ = nullptr;
+    SetNode<K>* right_ = nullptr;
     SetNode<K>* parent_ = nullptr;
-    SetBaseNode<K>* prev_ = nullptr;
-    SetBaseNode<K>* next_ = nullptr;
-    signed char balance_ = 0;
 };
 
 template <typename K>
 class SetEndNode : public SetBaseNode<K> {
 public:
-    SetEndNode() noexcept = default;
+    SetEndNode() noexcept : SetBaseNode<K>(nullptr, nullptr, true) {
+    }
     SetEndNode(const SetEndNode& other) = delete;
     SetEndNode& operator=(const SetEndNode& other) = delete;
     SetEndNode(SetEndNode&& other) noexcept = default;
     SetEndNode& operator=(SetEndNode&& other) noexcept = default;
     ~SetEndNode() noexcept = default;
 
-    SetEndNode(SetBaseNode<K>* prev, SetBaseNode<K>* next) noexcept : prev_(prev), next_(next) {
-    }
-    const K& GetKey() const {
-        throw std::out_of_range("Out of range!");
-    }
-    K& GetKey() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<SetNode<K>>& GetLeft() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<SetNode<K>>& GetLeft() {
-        throw std::out_of_range("Out of range!");
-    }
-    const std::unique_ptr<SetNode<K>>& GetRight() const {
-        throw std::out_of_range("Out of range!");
-    }
-    std::unique_ptr<SetNode<K>>& GetRight() {
-        throw std::out_of_range("Out of range!");
-    }
-    SetNode<K>* GetParent() const {
-        throw std::out_of_range("Out of range!");
-    }
-    SetNode<K>*& GetParent() {
-        throw std::out_of_range("Out of range!");
-    }
-    SetBaseNode<K>* GetPrev() const noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>*& GetPrev() noexcept {
-        return prev_;
-    }
-    SetBaseNode<K>* GetNext() const noexcept {
-        return next_;
-    }
-    SetBaseNode<K>*& GetNext() noexcept {
-        return next_;
-    }
-    signed char GetBalance() const {
-        throw std::out_of_range("Out of range!");
+    SetEndNode(SetBaseNode<K>* prev, SetBaseNode<K>* next) noexcept
+        : SetBaseNode<K>(prev, next, true) {
     }
-    signed char& GetBalance() {
-        throw std::out_of_range("Out of range!");
-    }
-    bool IsSetEndNode() const noexcept {
-        return true;
-    }
-
-private:
-    SetBaseNode<K>* prev_ = nullptr;
-    SetBaseNode<K>* next_ = nullptr;
 };
 
-template <typename K, typename Compare = std::less<K>>
+template <typename K, typename Compare = std::less<K>,
+          typename Allocator = std::allocator<K>>
 class SetAVL {
 public:
     enum {
@@ -202,6 +183,9 @@ public:
     using Pointer = SetType*;
     using ConstReference = const SetType&;
     using ConstPointer = const SetType*;
+    using AllocatorType = Allocator;
+    // Whether the lookups also take keys of other types, as std::less<> allows.
+    static constexpr bool kTransparentCompare = requires { typename Compare::is_transparent; };
 
     class ConstIterator;
 
@@ -241,6 +225,7 @@ public:
         }
 
         friend class ConstIterator;
+        friend class SetAVL;
 
     private:
         void Inc() {
@@ -297,6 +282,7 @@ public:
         bool operator!=(const ConstIterator& other) const noexcept {
             return node_ != other.node_;
         }
+        friend class SetAVL;
 
     private:
         void Inc() {
@@ -430,34 +416,108 @@ public:
 
     SetAVL() : SetAVL(Compare()) {
     }
-    explicit SetAVL(const Compare& compare) : root_compare_(nullptr, compare) {
+    explicit SetAVL(const Compare& compare, const Allocator& allocator = Allocator())
+        : root_compare_(nullptr, compare),
+          size_allocator_(size_t{0}, NodeAllocator(allocator)) {
     }
-    SetAVL(const SetAVL& other) {
-        Copy(other);
+    explicit SetAVL(const Allocator& allocator) : SetAVL(Compare(), allocator) {
     }
-    SetAVL& operator=(const SetAVL& other) {
-        return *this = SetAVL(other);
+    template <typename InputIt>
+    SetAVL(InputIt first, InputIt last, const Compare& compare = Compare(),
+           const Allocator& allocator = Allocator())
+        : SetAVL(compare, allocator) {
+        try {
+            Insert(first, last);
+        } catch (...) {
+            DestroyNodes();
+            throw;
+        }
+    }
+    SetAVL(const SetAVL& other)
+        : SetAVL(other, Allocator(NodeTraits::select_on_container_copy_construction(
+                         other.GetNodeAllocator()))) {
+    }
+    SetAVL(const SetAVL& other, const Allocator& allocator)
+        : root_compare_(nullptr, other.KeyCompare()),
+          size_allocator_(size_t{0}, NodeAllocator(allocator)) {
+        try {
+            Copy(other);
+        } catch (...) {
+            DestroyNodes();
+            throw;
+        }
+    }
+    // Builds the set out of a random-access range sorted in strictly ascending order on the
+    // threads of the pool: the middle element becomes the root and both halves are built
+    // at once, down to subtrees of kParallelGrain nodes. A range out of order is inserted
+    // one by one instead.
+    template <std::random_access_iterator RandomIt>
+    SetAVL(RandomIt first, RandomIt last, TaskPool& pool, const Compare& compare = Compare(),
+           const Allocator& allocator = Allocator())
+        : SetAVL(compare, allocator) {
+        auto out_of_order = [&](const auto& lhs, const auto& rhs) { return !compare(lhs, rhs); };
+        if (std::adjacent_find(first, last, out_of_order) != last) {
+            try {
+                Insert(first, last);
+            } catch (...) {
+                DestroyNodes();
+                throw;
+            }
+            return;
+        }
+        BuildParallel(static_cast<size_t>(last - first),
+                      [&](size_t index) { return CreateNode(first[index], nullptr, nullptr, 0); },
+                      pool);
     }
-    SetAVL(SetAVL&& other) noexcept {
-        Swap(other);
+    // Copies the tree shape of other on the threads of the pool.
+    SetAVL(const SetAVL& other, TaskPool& pool)
+        : SetAVL(other.KeyCompare(), Allocator(NodeTraits::select_on_container_copy_construction(
+                                         other.GetNodeAllocator()))) {
+        SetNode<K>* first = nullptr;
+        SetNode<K>* last = nullptr;
+        TaskPool* fork_pool = kParallelAllocation ? std::addressof(pool) : nullptr;
+        GetRoot() = CloneSubtree(other.GetRootPtr(), fork_pool, first, last);
+        LinkBuiltTree(first, last, other.Size());
     }
-    SetAVL& operator=(SetAVL&& other) noexcept {
-        SetAVL tmp = std::move(other);
-        Swap(tmp);
+    SetAVL& operator=(const SetAVL& other) {
+        if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) {
+            return *this = SetAVL(other, other.GetAllocator());
+        } else {
+            return *this = SetAVL(other, GetAllocator());
+        }
+    }
+    SetAVL(SetAVL&& other) noexcept
+        : root_compare_(nullptr, other.KeyCompare()),
+          size_allocator_(size_t{0}, other.GetNodeAllocator()) {
+        SwapNodes(other);
+    }
+    SetAVL& operator=(SetAVL&& other) noexcept(
+        NodeTraits::propagate_on_container_move_assignment::value ||
+        NodeTraits::is_always_equal::value) {
+        if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+            SetAVL tmp = std::move(other);
+            std::swap(GetNodeAllocator(), tmp.GetNodeAllocator());
+            SwapNodes(tmp);
+        } else if (GetNodeAllocator() == other.GetNodeAllocator()) {
+            SetAVL tmp = std::move(other);
+            SwapNodes(tmp);
+        } else {
+            MoveElements(other);
+        }
         return *this;
     }
-    ~SetAVL() = default;
+    ~SetAVL() {
+        DestroyNodes();
+    }
 
     void Clear() noexcept {
-        GetRoot() = nullptr;
-        size_ = 0;
-        end_node_.GetNext() = std::addressof(end_node_);
-        end_node_.GetPrev() = std::addressof(end_node_);
+        DestroyNodes();
     }
     void Swap(SetAVL& other) {
-        std::swap(GetRoot(), other.GetRoot());
-        std::swap(size_, other.size_);
-        ConnectSetEndNodesAfterSwap(other);
+        if constexpr (NodeTraits::propagate_on_container_swap::value) {
+            std::swap(GetNodeAllocator(), other.GetNodeAllocator());
+        }
+        SwapNodes(other);
     }
     std::pair<Iterator, bool> Insert(const SetType& key) {
         auto pair = InsertSetNode(key);
@@ -490,82 +550,93 @@ public:
         BalanceAfterInsert(node);
         return {Iterator(node), true};
     }
+    // An empty set takes the longest sorted prefix of the range in O(n), without comparing
+    // against the tree; the rest of the range, if any, is inserted element by element.
     template <typename InputIt>
     void Insert(InputIt first, InputIt last) {
-        for (auto it = first; it != last; ++it) {
+        auto it = first;
+        if (Empty()) {
+            it = BuildFromSortedPrefix(first, last);
+        }
+        for (; it != last; ++it) {
             Insert(*it);
         }
     }
     void Insert(std::initializer_list<SetType> ilist) {
         Insert(ilist.begin(), ilist.end());
     }
-    Iterator Find(const K& key) {
-        auto node = FindSetNode(key);
-        if (node == nullptr) {
-            return End();
-        }
+    // Inserts in O(1) before rebalancing when the key belongs right before or right after the
+    // hint, which the prev/next thread confirms with at most three comparisons; any other hint
+    // costs a descent from the root. Appending in order with End() or the previous result as
+    // the hint always takes the fast path. Returns the inserted or the equivalent element.
+    Iterator Insert(ConstIterator hint, const SetType& key) {
+        return Iterator{InsertSetNodeHint(hint.node_, key)};
+    }
+    Iterator Insert(ConstIterator hint, SetType&& key) {
+        return Iterator{InsertSetNodeHint(hint.node_, std::move(key))};
+    }
+    // Builds the element first, so the key can be compared against the hint.
+    template <typename... Args>
+    Iterator EmplaceHint(ConstIterator hint, Args&&... args) {
+        SetNode<K>* node = CreateNode(std::in_place, std::forward<Args>(args)...);
+        auto [next, vacant] = FindHintedNext(hint.node_, node->GetKey());
+        if (next == nullptr) {
+            std::tie(next, vacant) = FindInsertNext(node->GetKey());
+        }
+        if (!vacant) {
+            DestroyNode(node);
+            return Iterator{next};
+        }
+        LinkSetNodeBefore(node, next);
         return Iterator{node};
     }
-    ConstIterator Find(const K& key) const {
+    Iterator Erase(ConstIterator pos) {
+        auto node = const_cast<SetBaseNode<K>*>(pos.node_)->GetSetNode();
+        auto next = node->GetNext();
+        EraseSetNode(node);
+        return Iterator{next};
+    }
+    Iterator Erase(Iterator pos) {
+        return Erase(ConstIterator{pos});
+    }
+    Iterator Erase(ConstIterator first, ConstIterator last) {
+        auto last_node = const_cast<SetBaseNode<K>*>(last.node_);
+        EraseSetNodes(const_cast<SetBaseNode<K>*>(first.node_), last_node);
+        return Iterator{last_node};
+    }
+    size_t Erase(const K& key) {
         auto node = FindSetNode(key);
         if (node == nullptr) {
-            return End();
+            return 0;
         }
-        return ConstIterator{node};
+        EraseSetNode(node);
+        return 1;
+    }
+    Iterator Find(const K& key) {
+        return Iterator{FindOrEnd(key)};
+    }
+    ConstIterator Find(const K& key) const {
+        return ConstIterator{FindOrEnd(key)};
     }
     Iterator LowerBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return Iterator{node};
+        return Iterator{LowerBoundOrEnd(key)};
     }
     ConstIterator LowerBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        return ConstIterator{node};
+        return ConstIterator{LowerBoundOrEnd(key)};
     }
     Iterator UpperBound(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return Iterator{node->GetNext()};
-        }
-        return Iterator{node};
+        return Iterator{EqualRangeNodes(key).second};
     }
     ConstIterator UpperBound(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return End();
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return ConstIterator{node->GetNext()};
-        }
-        return ConstIterator{node};
+        return ConstIterator{EqualRangeNodes(key).second};
     }
     std::pair<Iterator, Iterator> EqualRange(const K& key) {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {Iterator{node}, Iterator{node->GetNext()}};
-        }
-        return {Iterator{node}, Iterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
     }
     std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
-        auto node = FindLowerBound(key);
-        if (node == nullptr) {
-            return {End(), End()};
-        }
-        if (Equivalent(node->GetKey(), key, KeyCompare())) {
-            return {ConstIterator{node}, ConstIterator{node->GetNext()}};
-        }
-        return {ConstIterator{node}, ConstIterator{node}};
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
     }
     bool Contains(const K& key) const {
         return FindSetNode(key) != nullptr;
@@ -573,6 +644,155 @@ public:
     size_t Count(const K& key) const {
         return static_cast<size_t>(Contains(key));
     }
+    // Copies the keys into an immutable FrozenSet, whose flat Eytzinger layout serves lookups
+    // faster than the tree once the set is no longer modified.
+    FrozenSet<K, Compare> Freeze() const {
+        std::vector<K> keys;
+        keys.reserve(Size());
+        for (auto it = Begin(); it != End(); ++it) {
+            keys.push_back(*it);
+        }
+        return FrozenSet<K, Compare>(std::move(keys), KeyCompare());
+    }
+    // With a transparent comparator the lookups take any type it orders against K, so for
+    // example a std::string key is looked up by a std::string_view without building a string.
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator Find(const Key& key) {
+        return Iterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator Find(const Key& key) const {
+        return ConstIterator{FindOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator LowerBound(const Key& key) {
+        return Iterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator LowerBound(const Key& key) const {
+        return ConstIterator{LowerBoundOrEnd(key)};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    Iterator UpperBound(const Key& key) {
+        return Iterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    ConstIterator UpperBound(const Key& key) const {
+        return ConstIterator{EqualRangeNodes(key).second};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<Iterator, Iterator> EqualRange(const Key& key) {
+        auto [first, last] = EqualRangeNodes(key);
+        return {Iterator{first}, Iterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    std::pair<ConstIterator, ConstIterator> EqualRange(const Key& key) const {
+        auto [first, last] = EqualRangeNodes(key);
+        return {ConstIterator{first}, ConstIterator{last}};
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    bool Contains(const Key& key) const {
+        return FindSetNode(key) != nullptr;
+    }
+    template <typename Key>
+        requires kTransparentCompare
+    size_t Count(const Key& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    // Finger search: the same answer as LowerBound(key), found by climbing from the hint to
+    // the lowest ancestor whose subtree has to hold the answer and descending from there. The
+    // past-the-end hint stands for the last element. For an answer d elements away from the
+    // hint this takes O(log d) steps when the tree is balanced, and O(1) when it is adjacent.
+    Iterator LowerBound(ConstIterator hint, const K& key) {
+        return Iterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    ConstIterator LowerBound(ConstIterator hint, const K& key) const {
+        return ConstIterator{FindLowerBoundFrom(hint.node_, key)};
+    }
+    // Writes the lower bound of keys[i] to results[i], searching from the previous answer, so
+    // a batch sorted in ascending order costs O(log d) per key for a rank distance of d.
+    void LowerBoundSorted(std::span<const K> keys, std::span<Iterator> results) {
+        CheckBatchSize(keys.size(), results.size());
+        const SetBaseNode<K>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = Iterator{node};
+            hint = node;
+        }
+    }
+    void LowerBoundSorted(std::span<const K> keys, std::span<ConstIterator> results) const {
+        CheckBatchSize(keys.size(), results.size());
+        const SetBaseNode<K>* hint = end_node_.GetNext();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto node = FindLowerBoundFrom(hint, keys[i]);
+            results[i] = ConstIterator{node};
+            hint = node;
+        }
+    }
+    // Set algebra. Each result is a new set with the comparator and the allocator of this one.
+    // Both sets are walked in order, and a run of elements from one set that falls between two
+    // elements of the other is skipped with one finger search. For sets of m <= n elements
+    // this costs O(m log(n / m + 1)) comparisons, plus building the result, which is linear in
+    // its size and balanced from the start.
+    SetAVL Union(const SetAVL& other) const {
+        return Combine(other, kOnlyInThis | kInBoth | kOnlyInOther);
+    }
+    SetAVL Intersection(const SetAVL& other) const {
+        return Combine(other, kInBoth);
+    }
+    SetAVL Difference(const SetAVL& other) const {
+        return Combine(other, kOnlyInThis);
+    }
+    SetAVL SymmetricDifference(const SetAVL& other) const {
+        return Combine(other, kOnlyInThis | kOnlyInOther);
+    }
+    // Union and Intersection on the threads of the pool. The key space is cut at the nodes of
+    // the top levels of the larger set, the pieces are merged at once into lists of keys, and
+    // the result is built from the lists as by the parallel range constructor.
+    SetAVL Union(const SetAVL& other, TaskPool& pool) const {
+        return CombineParallel(other, kOnlyInThis | kInBoth | kOnlyInOther, pool);
+    }
+    SetAVL Intersection(const SetAVL& other, TaskPool& pool) const {
+        return CombineParallel(other, kInBoth, pool);
+    }
+    // Same as operator==, with the comparison split into pieces for the threads of the
+    // pool. The pieces of this set end at the nodes of the top levels of its tree, and the
+    // same keys, looked up in other, end the pieces of other.
+    bool Equal(const SetAVL& other, TaskPool& pool) const {
+        if (Size() != other.Size()) {
+            return false;
+        }
+        if (Size() < kParallelGrain || pool.Size() == 1) {
+            return *this == other;
+        }
+        std::vector<const SetBaseNode<K>*> bounds{end_node_.GetNext()};
+        std::vector<const SetBaseNode<K>*> other_bounds{other.end_node_.GetNext()};
+        CollectSplitters(GetRootPtr(), std::bit_width(pool.Size() * 4), bounds);
+        for (size_t i = 1; i < bounds.size(); ++i) {
+            const SetNode<K>* found =
+                other.FindSetNode(static_cast<const SetNode<K>*>(bounds[i])->GetKey());
+            if (found == nullptr) {
+                return false;
+            }
+            other_bounds.push_back(found);
+        }
+        bounds.push_back(std::addressof(end_node_));
+        other_bounds.push_back(std::addressof(other.end_node_));
+        std::vector<char> equal(bounds.size() - 1);
+        pool.ParallelFor(0, equal.size(), [&](size_t i) {
+            equal[i] = EqualPieces(bounds[i], bounds[i + 1], other_bounds[i], other_bounds[i + 1]);
+        });
+        return std::all_of(equal.begin(), equal.end(), [](char piece) { return piece != 0; });
+    }
     Iterator Begin() noexcept {
         return Iterator{end_node_.GetNext()};
     }
@@ -611,7 +831,7 @@ public:
     }
 
     size_t Size() const noexcept {
-        return size_;
+        return size_allocator_.GetFirst();
     }
     static constexpr size_t MaxSize() noexcept {
         return (std::numeric_limits<std::ptrdiff_t>::max() / sizeof(SetNode<K>));
@@ -622,17 +842,437 @@ public:
     Compare KeyCompare() const {
         return root_compare_.GetSecond();
     }
-    const std::unique_ptr<SetNode<K>>& GetRoot() const {
+    Allocator GetAllocator() const {
+        return Allocator(GetNodeAllocator());
+    }
+    SetNode<K>* GetRoot() const {
         return root_compare_.GetFirst();
     }
-    std::unique_ptr<SetNode<K>>& GetRoot() {
+    SetNode<K>*& GetRoot() {
         return root_compare_.GetFirst();
     }
     SetNode<K>* GetRootPtr() const {
-        return GetRoot().get();
+        return GetRoot();
     }
 
 private:
+    using NodeAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<SetNode<K>>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    size_t& GetSize() noexcept {
+        return size_allocator_.GetFirst();
+    }
+    const NodeAllocator& GetNodeAllocator() const noexcept {
+        return size_allocator_.GetSecond();
+    }
+    NodeAllocator& GetNodeAllocator() noexcept {
+        return size_allocator_.GetSecond();
+    }
+
+    template <typename... Args>
+    SetNode<K>* CreateNode(Args&&... args) {
+        SetNode<K>* node = NodeTraits::allocate(GetNodeAllocator(), 1);
+        try {
+            NodeTraits::construct(GetNodeAllocator(), node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(GetNodeAllocator(), node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void DestroyNode(SetNode<K>* node) noexcept {
+        NodeTraits::destroy(GetNodeAllocator(), node);
+        NodeTraits::deallocate(GetNodeAllocator(), node, 1);
+    }
+
+    // Walks the prev/next thread, so the teardown is iterative whatever the shape of the
+    // tree. Also copes with the unterminated thread left by a Copy that threw. An unshared
+    // PoolAllocator gives its chunks back at once instead of taking the nodes one by one.
+    void DestroyNodes() noexcept {
+        bool exclusive_pool = IsExclusivePool(GetNodeAllocator());
+        if (!exclusive_pool || !std::is_trivially_destructible_v<SetNode<K>>) {
+            SetBaseNode<K>* node = end_node_.GetNext();
+            while (node != nullptr && !node->IsSetEndNode()) {
+                SetBaseNode<K>* next = node->GetNext();
+                auto tree_node = static_cast<SetNode<K>*>(node);
+                NodeTraits::destroy(GetNodeAllocator(), tree_node);
+                if (!exclusive_pool) {
+                    NodeTraits::deallocate(GetNodeAllocator(), tree_node, 1);
+                }
+                node = next;
+            }
+        }
+        if (exclusive_pool) {
+            ReleasePool(GetNodeAllocator());
+        }
+        GetRoot() = nullptr;
+        GetSize() = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
+    }
+
+    // Move assignment between containers whose allocators neither propagate nor compare
+    // equal: the nodes cannot change hands, so the elements are moved one by one.
+    void MoveElements(SetAVL& other) {
+        Clear();
+        for (auto it = other.Begin(); it != other.End(); ++it) {
+            Insert(std::move(*it));
+        }
+        other.Clear();
+    }
+
+    static constexpr unsigned kOnlyInThis = 1;
+    static constexpr unsigned kInBoth = 2;
+    static constexpr unsigned kOnlyInOther = 4;
+
+    // Merges the two sets in order and keeps the elements of the kinds in the mask.
+    SetAVL Combine(const SetAVL& other, unsigned keep) const {
+        SetAVL result(KeyCompare(), GetAllocator());
+        CombineRange(end_node_.GetNext(), std::addressof(end_node_), other,
+                     other.end_node_.GetNext(), std::addressof(other.end_node_), keep,
+                     [&](const SetBaseNode<K>* first, const SetBaseNode<K>* last) {
+                         result.AppendNodes(first, last);
+                     });
+        result.BuildFromThread();
+        return result;
+    }
+
+    // Merges the nodes [lhs, lhs_end) of this set with the nodes [rhs, rhs_end) of other and
+    // passes the runs of nodes to keep to append, in order.
+    template <typename Append>
+    void CombineRange(const SetBaseNode<K>* lhs, const SetBaseNode<K>* lhs_end,
+                      const SetAVL& other, const SetBaseNode<K>* rhs,
+                      const SetBaseNode<K>* rhs_end, unsigned keep, const Append& append) const {
+        const Compare& compare = KeyCompare();
+        while (lhs != lhs_end && rhs != rhs_end) {
+            const K& lhs_key = lhs->GetSetNode()->GetKey();
+            const K& rhs_key = rhs->GetSetNode()->GetKey();
+            if (compare(lhs_key, rhs_key)) {
+                const SetBaseNode<K>* run_end = FindLowerBoundFrom(lhs, rhs_key);
+                if (keep & kOnlyInThis) {
+                    append(lhs, run_end);
+                }
+                lhs = run_end;
+            } else if (compare(rhs_key, lhs_key)) {
+                const SetBaseNode<K>* run_end = other.FindLowerBoundFrom(rhs, lhs_key);
+                if (keep & kOnlyInOther) {
+                    append(rhs, run_end);
+                }
+                rhs = run_end;
+            } else {
+                if (keep & kInBoth) {
+                    append(lhs, lhs->GetNext());
+                }
+                lhs = lhs->GetNext();
+                rhs = rhs->GetNext();
+            }
+        }
+        if (keep & kOnlyInThis) {
+            append(lhs, lhs_end);
+        }
+        if (keep & kOnlyInOther) {
+            append(rhs, rhs_end);
+        }
+    }
+
+    SetAVL CombineParallel(const SetAVL& other, unsigned keep, TaskPool& pool) const {
+        if (!kParallelAllocation || pool.Size() == 1 ||
+            Size() + other.Size() < kParallelGrain) {
+            return Combine(other, keep);
+        }
+        const SetAVL& larger = Size() >= other.Size() ? *this : other;
+        std::vector<const SetBaseNode<K>*> splitters;
+        CollectSplitters(larger.GetRootPtr(), std::bit_width(pool.Size() * 4), splitters);
+        std::vector<const SetBaseNode<K>*> bounds{end_node_.GetNext()};
+        std::vector<const SetBaseNode<K>*> other_bounds{other.end_node_.GetNext()};
+        for (const SetBaseNode<K>* splitter : splitters) {
+            const K& key = static_cast<const SetNode<K>*>(splitter)->GetKey();
+            bounds.push_back(LowerBoundOrEnd(key));
+            other_bounds.push_back(other.LowerBoundOrEnd(key));
+        }
+        bounds.push_back(std::addressof(end_node_));
+        other_bounds.push_back(std::addressof(other.end_node_));
+        std::vector<std::vector<const K*>> pieces(splitters.size() + 1);
+        pool.ParallelFor(0, pieces.size(), [&](size_t i) {
+            CombineRange(bounds[i], bounds[i + 1], other, other_bounds[i], other_bounds[i + 1],
+                         keep, [&](const SetBaseNode<K>* first, const SetBaseNode<K>* last) {
+                             for (; first != last; first = first->GetNext()) {
+                                 pieces[i].push_back(std::addressof(first->GetSetNode()->GetKey()));
+                             }
+                         });
+        });
+        std::vector<size_t> offsets{0};
+        for (const auto& piece : pieces) {
+            offsets.push_back(offsets.back() + piece.size());
+        }
+        SetAVL result(KeyCompare(), GetAllocator());
+        result.BuildParallel(
+            offsets.back(),
+            [&](size_t index) {
+                size_t piece = std::upper_bound(offsets.begin(), offsets.end(), index) -
+                               offsets.begin() - 1;
+                return result.CreateNode(*pieces[piece][index - offsets[piece]], nullptr,
+                                         nullptr, 0);
+            },
+            pool);
+        return result;
+    }
+
+    // Appends copies of the keys in [first, last) of another set, which have to come after
+    // the keys of this one, to the thread only; BuildFromThread links them into a tree.
+    void AppendNodes(const SetBaseNode<K>* first, const SetBaseNode<K>* last) {
+        SetBaseNode<K>* end_node = std::addressof(end_node_);
+        for (; first != last; first = first->GetNext()) {
+            SetBaseNode<K>* max_node = end_node->GetPrev();
+            auto node = CreateNode(first->GetSetNode()->GetKey(), max_node, end_node, 0);
+            max_node->GetNext() = node;
+            end_node->GetPrev() = node;
+            IncreaseSize();
+        }
+    }
+
+    // Appends the elements to the thread as long as they come in ascending order (later
+    // duplicates are dropped, as Insert would do) and then links the appended nodes into a
+    // perfectly balanced tree. Returns the first element that broke the order.
+    template <typename InputIt>
+    InputIt BuildFromSortedPrefix(InputIt first, InputIt last) {
+        SetBaseNode<K>* end_node = std::addressof(end_node_);
+        try {
+            for (; first != last; ++first) {
+                decltype(auto) key = *first;
+                SetBaseNode<K>* max_node = end_node->GetPrev();
+                if (max_node != end_node) {
+                    const K& max_key = max_node->GetSetNode()->GetKey();
+                    if (Equivalent(max_key, key, KeyCompare())) {
+                        continue;
+                    }
+                    if (KeyCompare()(key, max_key)) {
+                        break;
+                    }
+                }
+                auto node = CreateNode(std::forward<decltype(key)>(key), max_node, end_node, 0);
+                max_node->GetNext() = node;
+                end_node->GetPrev() = node;
+                IncreaseSize();
+            }
+        } catch (...) {
+            BuildFromThread();
+            throw;
+        }
+        BuildFromThread();
+        return first;
+    }
+
+    void BuildFromThread() {
+        SetBaseNode<K>* cursor = end_node_.GetNext();
+        GetRoot() = BuildBalanced(cursor, Size());
+        if (GetRoot() != nullptr) {
+            GetRoot()->GetParent() = nullptr;
+        }
+    }
+
+    // Builds a subtree out of the next count nodes of the thread. Both halves differ in size
+    // by at most one, so a subtree of m nodes is std::bit_width(m) high and the balance is
+    // known without measuring anything. The recursion is O(log n) deep.
+    SetNode<K>* BuildBalanced(SetBaseNode<K>*& cursor, size_t count) {
+        if (count == 0) {
+            return nullptr;
+        }
+        size_t left_count = (count - 1) / 2;
+        size_t right_count = count - 1 - left_count;
+        SetNode<K>* left = BuildBalanced(cursor, left_count);
+        auto node = static_cast<SetNode<K>*>(cursor);
+        cursor = cursor->GetNext();
+        SetNode<K>* right = BuildBalanced(cursor, right_count);
+        ConnectAfterRotation(node, left, true);
+        ConnectAfterRotation(node, right, false);
+        int balance = static_cast<int>(std::bit_width(left_count)) -
+                      static_cast<int>(std::bit_width(right_count));
+        node->GetBalance() = static_cast<signed char>(balance);
+        return node;
+    }
+
+    // Nodes can be allocated from several threads at once only if every copy of the allocator
+    // is interchangeable, which rules out the pool allocator.
+    static constexpr bool kParallelAllocation = NodeTraits::is_always_equal::value;
+    // Subtrees below this size are built on one thread.
+    static constexpr size_t kParallelGrain = size_t{1} << 14;
+
+    template <typename MakeNode>
+    void BuildParallel(size_t count, const MakeNode& make_node, TaskPool& pool) {
+        SetNode<K>* first = nullptr;
+        SetNode<K>* last = nullptr;
+        TaskPool* fork_pool = kParallelAllocation ? std::addressof(pool) : nullptr;
+        GetRoot() = BuildSubtree(0, count, make_node, fork_pool, first, last);
+        LinkBuiltTree(first, last, count);
+    }
+
+    // Threads the end node to a tree built by BuildSubtree or CloneSubtree.
+    void LinkBuiltTree(SetNode<K>* first, SetNode<K>* last, size_t count) {
+        if (GetRoot() == nullptr) {
+            return;
+        }
+        GetRoot()->GetParent() = nullptr;
+        first->GetPrev() = std::addressof(end_node_);
+        end_node_.GetNext() = first;
+        last->GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = last;
+        GetSize() = count;
+    }
+
+    // BuildBalanced over the nodes make_node(offset) to make_node(offset + count - 1), which
+    // forks the halves of subtrees above kParallelGrain nodes into the pool, if any. Returns
+    // the subtree threaded from first to last; on an exception nothing is left behind.
+    template <typename MakeNode>
+    SetNode<K>* BuildSubtree(size_t offset, size_t count, const MakeNode& make_node,
+                             TaskPool* pool, SetNode<K>*& first, SetNode<K>*& last) {
+        if (count == 0) {
+            return nullptr;
+        }
+        size_t left_count = (count - 1) / 2;
+        size_t right_count = count - 1 - left_count;
+        SetNode<K>* left = nullptr;
+        SetNode<K>* right = nullptr;
+        SetNode<K>* left_last = nullptr;
+        SetNode<K>* right_first = nullptr;
+        SetNode<K>* node = nullptr;
+        auto build_left = [&] {
+            left = BuildSubtree(offset, left_count, make_node, pool, first, left_last);
+        };
+        auto build_right = [&] {
+            right = BuildSubtree(offset + left_count + 1, right_count, make_node, pool,
+                                 right_first, last);
+        };
+        try {
+            if (pool != nullptr && count > kParallelGrain) {
+                pool->Invoke(build_left, build_right);
+                node = make_node(offset + left_count);
+            } else {
+                build_left();
+                node = make_node(offset + left_count);
+                build_right();
+            }
+        } catch (...) {
+            DestroySubtree(left);
+            DestroySubtree(right);
+            if (node != nullptr) {
+                DestroyNode(node);
+            }
+            throw;
+        }
+        int balance = static_cast<int>(std::bit_width(left_count)) -
+                      static_cast<int>(std::bit_width(right_count));
+        node->GetBalance() = static_cast<signed char>(balance);
+        LinkSubtree(node, left, left_last, right, right_first, first, last);
+        return node;
+    }
+
+    // Copies the subtree of source node by node, keeping its shape and balances. Forks the
+    // children of nodes higher than a subtree of kParallelGrain nodes into the pool.
+    SetNode<K>* CloneSubtree(const SetNode<K>* source, TaskPool* pool, SetNode<K>*& first,
+                             SetNode<K>*& last) {
+        if (source == nullptr) {
+            return nullptr;
+        }
+        if (pool != nullptr &&
+            GetHeight(source) <= static_cast<int>(std::bit_width(kParallelGrain))) {
+            pool = nullptr;
+        }
+        SetNode<K>* left = nullptr;
+        SetNode<K>* right = nullptr;
+        SetNode<K>* left_last = nullptr;
+        SetNode<K>* right_first = nullptr;
+        SetNode<K>* node = nullptr;
+        auto clone_left = [&] { left = CloneSubtree(source->GetLeft(), pool, first, left_last); };
+        auto clone_right = [&] {
+            right = CloneSubtree(source->GetRight(), pool, right_first, last);
+        };
+        auto clone_node = [&] {
+            node = CreateNode(source->GetKey(), nullptr, nullptr, source->GetBalance());
+        };
+        try {
+            if (pool != nullptr) {
+                pool->Invoke(clone_left, clone_right);
+                clone_node();
+            } else {
+                clone_left();
+                clone_node();
+                clone_right();
+            }
+        } catch (...) {
+            if (node != nullptr) {
+                DestroyNode(node);
+            }
+            DestroySubtree(left);
+            DestroySubtree(right);
+            throw;
+        }
+        LinkSubtree(node, left, left_last, right, right_first, first, last);
+        return node;
+    }
+
+    // Hangs the subtrees under node and threads node between them. first and last end up
+    // at the ends of the whole subtree.
+    void LinkSubtree(SetNode<K>* node, SetNode<K>* left, SetNode<K>* left_last,
+                     SetNode<K>* right, SetNode<K>* right_first, SetNode<K>*& first,
+                     SetNode<K>*& last) {
+        ConnectAfterRotation(node, left, true);
+        ConnectAfterRotation(node, right, false);
+        if (left != nullptr) {
+            left_last->GetNext() = node;
+            node->GetPrev() = left_last;
+        } else {
+            first = node;
+        }
+        if (right != nullptr) {
+            node->GetNext() = right_first;
+            right_first->GetPrev() = node;
+        } else {
+            last = node;
+        }
+    }
+
+    void DestroySubtree(SetNode<K>* node) noexcept {
+        if (node == nullptr) {
+            return;
+        }
+        DestroySubtree(node->GetLeft());
+        DestroySubtree(node->GetRight());
+        DestroyNode(node);
+    }
+
+    // The nodes of the top depth levels of the subtree, in order.
+    static void CollectSplitters(const SetNode<K>* node, size_t depth,
+                                 std::vector<const SetBaseNode<K>*>& splitters) {
+        if (node == nullptr || depth == 0) {
+            return;
+        }
+        CollectSplitters(node->GetLeft(), depth - 1, splitters);
+        splitters.push_back(node);
+        CollectSplitters(node->GetRight(), depth - 1, splitters);
+    }
+
+    bool EqualPieces(const SetBaseNode<K>* node, const SetBaseNode<K>* node_end,
+                     const SetBaseNode<K>* other, const SetBaseNode<K>* other_end) const {
+        Compare compare = KeyCompare();
+        for (; node != node_end && other != other_end;
+             node = node->GetNext(), other = other->GetNext()) {
+            if (!Equivalent(static_cast<const SetNode<K>*>(node)->GetKey(),
+                            static_cast<const SetNode<K>*>(other)->GetKey(), compare)) {
+                return false;
+            }
+        }
+        return node == node_end && other == other_end;
+    }
+
+    void SwapNodes(SetAVL& other) noexcept {
+        std::swap(GetRoot(), other.GetRoot());
+        std::swap(GetSize(), other.GetSize());
+        ConnectSetEndNodesAfterSwap(other);
+    }
+
     signed char GetNodeBalance(SetNode<K>* node) const {
         if (node == nullptr) {
             return 0;
@@ -647,60 +1287,170 @@ private:
         if (node == nullptr || node->GetRight() == nullptr) {
             return false;
         }
-        return (GetNodeBalance(node) == -2) && ((GetNodeBalance(node->GetRight().get()) == -1) ||
-                                                (GetNodeBalance(node->GetRight().get()) == 0));
+        return (GetNodeBalance(node) == -2) && ((GetNodeBalance(node->GetRight()) == -1) ||
+                                                (GetNodeBalance(node->GetRight()) == 0));
     }
     bool RightRotateNeded(SetNode<K>* node) {
         if (node == nullptr || node->GetLeft() == nullptr) {
             return false;
         }
-        return (GetNodeBalance(node) == 2) && ((GetNodeBalance(node->GetLeft().get()) == 1) ||
-                                               (GetNodeBalance(node->GetLeft().get()) == 0));
+        return (GetNodeBalance(node) == 2) && ((GetNodeBalance(node->GetLeft()) == 1) ||
+                                               (GetNodeBalance(node->GetLeft()) == 0));
     }
     bool RightLeftRotateNeeded(SetNode<K>* node) {
         if (node == nullptr || node->GetRight() == nullptr ||
             node->GetRight()->GetLeft() == nullptr) {
             return false;
         }
-        return (GetNodeBalance(node) == -2) && (GetNodeBalance(node->GetRight().get()) == 1);
+        return (GetNodeBalance(node) == -2) && (GetNodeBalance(node->GetRight()) == 1);
     }
     bool LeftRightRotateNeeded(SetNode<K>* node) {
         if (node == nullptr || node->GetLeft() == nullptr ||
             node->GetLeft()->GetRight() == nullptr) {
             return false;
         }
-        return (GetNodeBalance(node) == 2) && (GetNodeBalance(node->GetLeft().get()) == -1);
+        return (GetNodeBalance(node) == 2) && (GetNodeBalance(node->GetLeft()) == -1);
     }
 
-    SetNode<K>* FindSetNode(const K& key) const {
-        SetNode<K>* node = GetRootPtr();
+    // Keys ordered by std::less that also have a consistent operator<=> are compared three-way:
+    // the one comparison per level also tells equality, so a lookup stops at the matching node.
+    template <typename Key>
+    static constexpr bool kThreeWayCompare =
+        (std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>) &&
+        std::three_way_comparable_with<Key, K, std::weak_ordering>;
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
-                return node;
+    template <typename Key>
+    SetNode<K>* FindSetNode(const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            SetNode<K>* node = GetRootPtr();
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                node = (order < 0) ? node->GetLeft() : node->GetRight();
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            return nullptr;
+        } else {
+            SetNode<K>* bound = FindLowerBound(key);
+            if (bound != nullptr && !KeyCompare()(key, bound->GetKey())) {
+                return bound;
             }
+            return nullptr;
         }
-        return nullptr;
     }
 
-    SetNode<K>* FindLowerBound(const K& key) const {
-        SetNode<K>* node = GetRootPtr();
-        SetNode<K>* best_bound = nullptr;
+    static void CheckBatchSize(size_t keys, size_t results) {
+        if (keys != results) {
+            throw std::invalid_argument("Batch keys and results differ in size");
+        }
+    }
 
-        while (node != nullptr) {
-            if (Equivalent(key, node->GetKey(), KeyCompare())) {
+    SetBaseNode<K>* FindLowerBoundFrom(const SetBaseNode<K>* hint, const K& key) const {
+        auto end_node = const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        if (Empty()) {
+            return end_node;
+        }
+        if (hint == nullptr || hint->IsSetEndNode()) {
+            hint = end_node_.GetPrev();
+        }
+        auto node = const_cast<SetNode<K>*>(hint->GetSetNode());
+        const Compare& compare = root_compare_.GetSecond();
+        SetNode<K>* best_bound = nullptr;
+        if (compare(node->GetKey(), key)) {
+            auto next = node->GetNext();
+            if (next->IsSetEndNode() || !compare(next->GetSetNode()->GetKey(), key)) {
+                return next;
+            }
+            // Up to the first ancestor on the right that is not below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetLeft() == node && !compare(parent->GetKey(), key)) {
+                    best_bound = parent;
+                    break;
+                }
+                node = parent;
+            }
+        } else {
+            auto prev = node->GetPrev();
+            if (prev->IsSetEndNode() || compare(prev->GetSetNode()->GetKey(), key)) {
                 return node;
             }
-            if (KeyCompare()(key, node->GetKey())) {
-                best_bound = node;
-                node = node->GetLeft().get();
-            } else {
-                node = node->GetRight().get();
+            // Up to the first ancestor on the left that is below the key.
+            while (node->GetParent() != nullptr) {
+                auto parent = node->GetParent();
+                if (parent->GetRight() == node && compare(parent->GetKey(), key)) {
+                    break;
+                }
+                node = parent;
+            }
+        }
+        auto bound = FindLowerBound(node, best_bound, key);
+        if (bound == nullptr) {
+            return end_node;
+        }
+        return bound;
+    }
+
+    template <typename Key>
+    SetBaseNode<K>* FindOrEnd(const Key& key) const {
+        SetNode<K>* node = FindSetNode(key);
+        if (node == nullptr) {
+            return const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    template <typename Key>
+    SetBaseNode<K>* LowerBoundOrEnd(const Key& key) const {
+        SetNode<K>* node = FindLowerBound(key);
+        if (node == nullptr) {
+            return const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        }
+        return node;
+    }
+
+    // The lower bound and the node after the equivalent one, if the key is present.
+    template <typename Key>
+    std::pair<SetBaseNode<K>*, SetBaseNode<K>*> EqualRangeNodes(const Key& key) const {
+        SetBaseNode<K>* first = LowerBoundOrEnd(key);
+        if (!first->IsSetEndNode() &&
+            !KeyCompare()(key, first->GetSetNode()->GetKey())) {
+            return {first, first->GetNext()};
+        }
+        return {first, first};
+    }
+
+    template <typename Key>
+    SetNode<K>* FindLowerBound(const Key& key) const {
+        return FindLowerBound(GetRootPtr(), nullptr, key);
+    }
+
+    // Lower bound within the subtree of the node, or best_bound if the subtree has none.
+    template <typename Key>
+    SetNode<K>* FindLowerBound(SetNode<K>* node, SetNode<K>* best_bound, const Key& key) const {
+        if constexpr (kThreeWayCompare<Key>) {
+            while (node != nullptr) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return node;
+                }
+                if (order < 0) {
+                    best_bound = node;
+                    node = node->GetLeft();
+                } else {
+                    node = node->GetRight();
+                }
+            }
+        } else {
+            const Compare& compare = root_compare_.GetSecond();
+            while (node != nullptr) {
+                if (compare(node->GetKey(), key)) {
+                    node = node->GetRight();
+                } else {
+                    best_bound = node;
+                    node = node->GetLeft();
+                }
             }
         }
         return best_bound;
@@ -775,7 +1525,7 @@ private:
             return;
         }
         auto top_other_node = std::get<0>(nodes.top());
-        if (top_other_node->GetLeft().get() == child) {
+        if (top_other_node->GetLeft() == child) {
             MarkVisited(nodes, true);
         } else {
             MarkVisited(nodes, false);
@@ -806,67 +1556,65 @@ private:
         return (node->GetRight() != nullptr) && (!visit_right);
     }
 
-    std::unique_ptr<SetNode<K>> CreateCopied(SetNode<K>* top_other_node,
-                                             SetBaseNode<K>*& prev_node) {
-        auto node = std::make_unique<SetNode<K>>(top_other_node->GetKey(), nullptr, nullptr,
-                                                 top_other_node->GetBalance());
+    SetNode<K>* CreateCopied(SetNode<K>* top_other_node, SetBaseNode<K>*& prev_node) {
+        auto node =
+            CreateNode(top_other_node->GetKey(), nullptr, nullptr, top_other_node->GetBalance());
         node->GetPrev() = prev_node;
-        prev_node->GetNext() = node.get();
-        prev_node = node.get();
+        prev_node->GetNext() = node;
+        prev_node = node;
         return node;
     }
 
-    void PushOrRoot(const SetAVL& other, std::stack<std::unique_ptr<SetNode<K>>>& nodes,
-                    std::unique_ptr<SetNode<K>>&& node, SetNode<K>* top_other_node) {
-        if (top_other_node == other.GetRoot().get()) {
-            GetRoot() = std::move(node);
+    void PushOrRoot(const SetAVL& other, std::stack<SetNode<K>*>& nodes, SetNode<K>* node,
+                    SetNode<K>* top_other_node) {
+        if (top_other_node == other.GetRoot()) {
+            GetRoot() = node;
         } else {
-            nodes.push(std::move(node));
+            nodes.push(node);
         }
     }
 
     void LNVRN(std::stack<std::tuple<SetNode<K>*, bool, bool>>& other_nodes,
                SetNode<K>* top_other_node) {
         other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetLeft().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+        other_nodes.push({top_other_node->GetLeft(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
     }
     void LNVRNV(std::stack<std::tuple<SetNode<K>*, bool, bool>>& other_nodes,
                 SetNode<K>* top_other_node) {
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+        other_nodes.push({top_other_node->GetRight(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
         other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_NOT_VISITED});
-        other_nodes.push({top_other_node->GetLeft().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+        other_nodes.push({top_other_node->GetLeft(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
     }
     void LVRNV(std::stack<std::tuple<SetNode<K>*, bool, bool>>& other_nodes,
                SetNode<K>* top_other_node) {
         other_nodes.pop();
         other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+        other_nodes.push({top_other_node->GetRight(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
     }
     void LNRNV(std::stack<std::tuple<SetNode<K>*, bool, bool>>& other_nodes,
                SetNode<K>* top_other_node) {
         other_nodes.push({top_other_node, LEFT_VISITED, RIGHT_VISITED});
-        other_nodes.push({top_other_node->GetRight().get(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
+        other_nodes.push({top_other_node->GetRight(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
     }
-    std::unique_ptr<SetNode<K>> ConnectL(std::unique_ptr<SetNode<K>>&& node,
-                                         std::stack<std::unique_ptr<SetNode<K>>>& nodes) {
-        node->GetLeft() = std::move(nodes.top());
-        node->GetLeft()->GetParent() = node.get();
+    SetNode<K>* ConnectL(SetNode<K>* node, std::stack<SetNode<K>*>& nodes) {
+        node->GetLeft() = nodes.top();
+        node->GetLeft()->GetParent() = node;
         nodes.pop();
         return node;
     }
-    std::unique_ptr<SetNode<K>> ConnectR(std::stack<std::unique_ptr<SetNode<K>>>& nodes) {
-        auto rhs = std::move(nodes.top());
+    SetNode<K>* ConnectR(std::stack<SetNode<K>*>& nodes) {
+        auto rhs = nodes.top();
         nodes.pop();
-        auto current = std::move(nodes.top());
+        auto current = nodes.top();
         nodes.pop();
-        current->GetRight() = std::move(rhs);
-        current->GetRight()->GetParent() = current.get();
+        current->GetRight() = rhs;
+        current->GetRight()->GetParent() = current;
         return current;
     }
 
     void CopyIteration(const SetAVL& other,
                        std::stack<std::tuple<SetNode<K>*, bool, bool>>& other_nodes,
-                       std::stack<std::unique_ptr<SetNode<K>>>& nodes, SetNode<K>* top_other_node,
+                       std::stack<SetNode<K>*>& nodes, SetNode<K>* top_other_node,
                        bool visit_left, bool visit_right, SetBaseNode<K>*& prev_node) {
         if (LeftNotVisited(top_other_node, visit_left) && RightNull(top_other_node)) {
             LNVRN(other_nodes, top_other_node);
@@ -876,30 +1624,30 @@ private:
         } else if (LeftVisited(top_other_node, visit_left) &&
                    RightNotVisited(top_other_node, visit_right)) {
             auto node = CreateCopied(top_other_node, prev_node);
-            node = ConnectL(std::move(node), nodes);
-            nodes.push(std::move(node));
+            node = ConnectL(node, nodes);
+            nodes.push(node);
             LVRNV(other_nodes, top_other_node);
         } else if (LeftVisited(top_other_node, visit_left) && RightNull(top_other_node)) {
             auto node = CreateCopied(top_other_node, prev_node);
-            node = ConnectL(std::move(node), nodes);
-            PushOrRoot(other, nodes, std::move(node), top_other_node);
+            node = ConnectL(node, nodes);
+            PushOrRoot(other, nodes, node, top_other_node);
             MakeVisited(other_nodes, top_other_node);
         } else if (LeftVisited(top_other_node, visit_left) &&
                    RightVisited(top_other_node, visit_right)) {
             auto current = ConnectR(nodes);
-            PushOrRoot(other, nodes, std::move(current), top_other_node);
+            PushOrRoot(other, nodes, current, top_other_node);
             MakeVisited(other_nodes, top_other_node);
         } else if (LeftNull(top_other_node) && RightNotVisited(top_other_node, visit_right)) {
             auto node = CreateCopied(top_other_node, prev_node);
-            nodes.push(std::move(node));
+            nodes.push(node);
             LNRNV(other_nodes, top_other_node);
         } else if (LeftNull(top_other_node) && RightVisited(top_other_node, visit_right)) {
             auto current = ConnectR(nodes);
-            PushOrRoot(other, nodes, std::move(current), top_other_node);
+            PushOrRoot(other, nodes, current, top_other_node);
             MakeVisited(other_nodes, top_other_node);
         } else if (LeftNull(top_other_node) && RightNull(top_other_node)) {
             auto node = CreateCopied(top_other_node, prev_node);
-            PushOrRoot(other, nodes, std::move(node), top_other_node);
+            PushOrRoot(other, nodes, node, top_other_node);
             MakeVisited(other_nodes, top_other_node);
         }
     }
@@ -910,7 +1658,7 @@ private:
         }
         SetBaseNode<K>* prev_node = std::addressof(end_node_);
         std::stack<std::tuple<SetNode<K>*, bool, bool>> other_nodes;
-        std::stack<std::unique_ptr<SetNode<K>>> nodes;
+        std::stack<SetNode<K>*> nodes;
         other_nodes.push({other.GetRootPtr(), LEFT_NOT_VISITED, RIGHT_NOT_VISITED});
         while (!other_nodes.empty()) {
             auto top_other_node = std::get<0>(other_nodes.top());
@@ -921,7 +1669,7 @@ private:
                           prev_node);
         }
         ConnectSetEndNodesAfterCopy(prev_node);
-        size_ = other.size_;
+        GetSize() = other.Size();
     }
 
     void ConnectPrevNext(SetNode<K>* node, SetBaseNode<K>* prev, SetBaseNode<K>* next) {
@@ -932,7 +1680,7 @@ private:
     }
 
     void IncreaseSize() {
-        ++size_;
+        ++GetSize();
     }
 
     template <typename P>
@@ -942,53 +1690,136 @@ private:
         bool left = false;
         SetBaseNode<K>* current_prev = std::addressof(end_node_);
         SetBaseNode<K>* current_next = std::addressof(end_node_);
+        using Key = std::remove_cvref_t<P>;
 
         while (true) {
+            // With one comparison per level, an equivalent key is the last node the descent
+            // passed on the right.
+            if constexpr (!kThreeWayCompare<Key>) {
+                if (node == nullptr && !current_prev->IsSetEndNode() &&
+                    !KeyCompare()(current_prev->GetSetNode()->GetKey(), key)) {
+                    return {current_prev->GetSetNode(), false};
+                }
+            }
             if ((node == nullptr) && (parent == nullptr)) {
-                GetRoot() = std::make_unique<SetNode<K>>(
-                    std::forward<P>(key), std::addressof(end_node_), std::addressof(end_node_), 0);
+                GetRoot() = CreateNode(std::forward<P>(key), std::addressof(end_node_),
+                                       std::addressof(end_node_), 0);
                 ConnectPrevNext(GetRootPtr(), current_prev, current_next);
                 IncreaseSize();
                 return {GetRootPtr(), true};
             }
             if ((node == nullptr) && (parent != nullptr) && left) {
-                parent->GetLeft() =
-                    std::make_unique<SetNode<K>>(std::forward<P>(key), nullptr, nullptr, 0);
+                parent->GetLeft() = CreateNode(std::forward<P>(key), nullptr, nullptr, 0);
                 parent->GetLeft()->GetParent() = parent;
-                ConnectPrevNext(parent->GetLeft().get(), current_prev, current_next);
+                ConnectPrevNext(parent->GetLeft(), current_prev, current_next);
                 IncreaseSize();
-                return {parent->GetLeft().get(), true};
+                return {parent->GetLeft(), true};
             }
             if ((node == nullptr) && (parent != nullptr) && !left) {
-                parent->GetRight() =
-                    std::make_unique<SetNode<K>>(std::forward<P>(key), nullptr, nullptr, 0);
+                parent->GetRight() = CreateNode(std::forward<P>(key), nullptr, nullptr, 0);
                 parent->GetRight()->GetParent() = parent;
-                ConnectPrevNext(parent->GetRight().get(), current_prev, current_next);
+                ConnectPrevNext(parent->GetRight(), current_prev, current_next);
                 IncreaseSize();
-                return {parent->GetRight().get(), true};
+                return {parent->GetRight(), true};
             }
-            if ((node != nullptr) && Equivalent(node->GetKey(), key, KeyCompare())) {
-                return {node, false};
+            if constexpr (kThreeWayCompare<Key>) {
+                auto order = key <=> node->GetKey();
+                if (order == 0) {
+                    return {node, false};
+                }
+                left = order < 0;
+            } else {
+                left = KeyCompare()(key, node->GetKey());
             }
-            if ((node != nullptr) && (KeyCompare()(key, node->GetKey()))) {
-                left = true;
-                parent = node;
+            parent = node;
+            if (left) {
                 current_next = node;
-                node = node->GetLeft().get();
+                node = node->GetLeft();
             } else {
-                left = false;
-                parent = node;
                 current_prev = node;
-                node = node->GetRight().get();
+                node = node->GetRight();
             }
         }
     }
 
-    SetNode<K>* GetReleased(std::unique_ptr<SetNode<K>>& node) {
-        if (node != nullptr) {
-            return node.release();
+    // Where a key goes when it belongs right before or right after the hint: the node it would
+    // precede, paired with true, or the equivalent node, paired with false. Null when the hint
+    // is not adjacent to the key.
+    std::pair<SetBaseNode<K>*, bool> FindHintedNext(const SetBaseNode<K>* hint,
+                                                     const K& key) const {
+        const Compare& compare = root_compare_.GetSecond();
+        auto next = const_cast<SetBaseNode<K>*>(hint);
+        if (next == nullptr) {
+            next = const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        }
+        if (next->IsSetEndNode() || compare(key, next->GetSetNode()->GetKey())) {
+            auto prev = next->GetPrev();
+            if (prev->IsSetEndNode() || compare(prev->GetSetNode()->GetKey(), key)) {
+                return {next, true};
+            }
+            if (!compare(key, prev->GetSetNode()->GetKey())) {
+                return {prev, false};
+            }
+            return {nullptr, false};
+        }
+        if (!compare(next->GetSetNode()->GetKey(), key)) {
+            return {next, false};
+        }
+        auto after = next->GetNext();
+        if (after->IsSetEndNode() || compare(key, after->GetSetNode()->GetKey())) {
+            return {after, true};
+        }
+        return {nullptr, false};
+    }
+
+    // The same answer as FindHintedNext, found by a descent from the root.
+    std::pair<SetBaseNode<K>*, bool> FindInsertNext(const K& key) const {
+        auto end_node = const_cast<SetEndNode<K>*>(std::addressof(end_node_));
+        SetNode<K>* bound = FindLowerBound(key);
+        if (bound == nullptr) {
+            return {end_node, true};
+        }
+        return {bound, KeyCompare()(key, bound->GetKey())};
+    }
+
+    // Hangs a new node between next and its predecessor. One of the two always has the slot
+    // free: if next has a left subtree, the predecessor is its maximum and has no right child.
+    void LinkSetNodeBefore(SetNode<K>* node, SetBaseNode<K>* next) {
+        SetBaseNode<K>* prev = next->GetPrev();
+        if (GetRootPtr() == nullptr) {
+            GetRoot() = node;
+        } else if (!next->IsSetEndNode() && next->GetSetNode()->GetLeft() == nullptr) {
+            ConnectAfterRotation(next->GetSetNode(), node, true);
+        } else {
+            ConnectAfterRotation(prev->GetSetNode(), node, false);
+        }
+        ConnectPrevNext(node, prev, next);
+        IncreaseSize();
+        BalanceAfterInsert(node);
+    }
+
+    template <typename P>
+    SetBaseNode<K>* InsertSetNodeHint(const SetBaseNode<K>* hint, P&& key) {
+        auto [next, vacant] = FindHintedNext(hint, key);
+        if (next == nullptr) {
+            auto pair = InsertSetNode(std::forward<P>(key));
+            if (pair.second) {
+                BalanceAfterInsert(pair.first);
+            }
+            return pair.first;
         }
-        return nullptr;
+        if (!vacant) {
+            return next;
+        }
+        SetNode<K>* node = CreateNode(std::forward<P>(key), nullptr, nullptr, 0);
+        LinkSetNodeBefore(node, next);
+        return node;
+    }
+
+    SetNode<K>* GetReleased(SetNode<K>*& node) {
+        SetNode<K>* released = node;
+        node = nullptr;
+        return released;
     }
 
     void ConnectAfterRotation(SetNode<K>* parent, SetNode<K>* child, bool left) {
@@ -996,11 +1827,11 @@ private:
             child->GetParent() = parent;
         }
         if (parent != nullptr && left) {
-            parent->GetLeft() = std::unique_ptr<SetNode<K>>(child);
+            parent->GetLeft() = child;
         } else if (parent != nullptr) {
-            parent->GetRight() = std::unique_ptr<SetNode<K>>(child);
+            parent->GetRight() = child;
         } else {
-            GetRoot() = std::unique_ptr<SetNode<K>>(child);
+            GetRoot() = child;
         }
     }
 
@@ -1063,15 +1894,15 @@ private:
         }
     }
 
-    std::pair<SetNode<K>*, SetNode<K>*> DoLeftRotate(std::unique_ptr<SetNode<K>>& node) {
+    std::pair<SetNode<K>*, SetNode<K>*> DoLeftRotate(SetNode<K>*& node) {
 
-        std::unique_ptr<SetNode<K>>& right_child = node->GetRight();
-        std::unique_ptr<SetNode<K>>& left_subtree = node->GetLeft();
-        std::unique_ptr<SetNode<K>>& middle_subtree = right_child->GetLeft();
-        std::unique_ptr<SetNode<K>>& right_subtree = right_child->GetRight();
+        SetNode<K>*& right_child = node->GetRight();
+        SetNode<K>*& left_subtree = node->GetLeft();
+        SetNode<K>*& middle_subtree = right_child->GetLeft();
+        SetNode<K>*& right_subtree = right_child->GetRight();
 
         auto parent_ptr = node->GetParent();
-        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft().get() == node.get());
+        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft() == node);
         auto node_ptr = GetReleased(node);
         auto right_child_ptr = GetReleased(right_child);
         auto left_subtree_ptr = GetReleased(left_subtree);
@@ -1087,7 +1918,7 @@ private:
         return {node_ptr, right_child_ptr};
     }
 
-    SetNode<K>* RotateLeft(std::unique_ptr<SetNode<K>>& node) {
+    SetNode<K>* RotateLeft(SetNode<K>*& node) {
 
         auto pair = DoLeftRotate(node);
         auto left_child_ptr = pair.first;
@@ -1097,15 +1928,15 @@ private:
         return node_ptr;
     }
 
-    std::pair<SetNode<K>*, SetNode<K>*> DoRightRotate(std::unique_ptr<SetNode<K>>& node) {
+    std::pair<SetNode<K>*, SetNode<K>*> DoRightRotate(SetNode<K>*& node) {
 
-        std::unique_ptr<SetNode<K>>& left_child = node->GetLeft();
-        std::unique_ptr<SetNode<K>>& left_subtree = left_child->GetLeft();
-        std::unique_ptr<SetNode<K>>& middle_subtree = left_child->GetRight();
-        std::unique_ptr<SetNode<K>>& right_subtree = node->GetRight();
+        SetNode<K>*& left_child = node->GetLeft();
+        SetNode<K>*& left_subtree = left_child->GetLeft();
+        SetNode<K>*& middle_subtree = left_child->GetRight();
+        SetNode<K>*& right_subtree = node->GetRight();
 
         auto parent_ptr = node->GetParent();
-        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft().get() == node.get());
+        bool left_node = (parent_ptr != nullptr) && (parent_ptr->GetLeft() == node);
         auto node_ptr = GetReleased(node);
         auto left_child_ptr = GetReleased(left_child);
         auto left_subtree_ptr = GetReleased(left_subtree);
@@ -1121,7 +1952,7 @@ private:
         return {node_ptr, left_child_ptr};
     }
 
-    SetNode<K>* RotateRight(std::unique_ptr<SetNode<K>>& node) {
+    SetNode<K>* RotateRight(SetNode<K>*& node) {
         auto pair = DoRightRotate(node);
         auto right_child_ptr = pair.first;
         auto node_ptr = pair.second;
@@ -1130,7 +1961,7 @@ private:
         return node_ptr;
     }
 
-    SetNode<K>* RotateRightLeft(std::unique_ptr<SetNode<K>>& node) {
+    SetNode<K>* RotateRightLeft(SetNode<K>*& node) {
 
         auto pair = DoRightRotate(node->GetRight());
         auto right_child_ptr = pair.first;
@@ -1143,7 +1974,7 @@ private:
         return node_ptr;
     }
 
-    SetNode<K>* RotateLeftRight(std::unique_ptr<SetNode<K>>& node) {
+    SetNode<K>* RotateLeftRight(SetNode<K>*& node) {
 
         auto pair = DoLeftRotate(node->GetLeft());
         auto left_child_ptr = pair.first;
@@ -1156,21 +1987,36 @@ private:
         return node_ptr;
     }
 
-    std::unique_ptr<SetNode<K>>& GetNodeUn(SetNode<K>* node) {
+    SetNode<K>*& GetNodeUn(SetNode<K>* node) {
         if (node->GetParent() == nullptr) {
             return GetRoot();
-        } else if (node->GetParent()->GetLeft().get() == node) {
+        } else if (node->GetParent()->GetLeft() == node) {
             return node->GetParent()->GetLeft();
         } else {
             return node->GetParent()->GetRight();
         }
     }
 
+    // Restores a node whose balance has reached +-2 and returns the new root of its subtree.
+    SetNode<K>* Rebalance(SetNode<K>*& node) {
+        SetNode<K>* current_node = node;
+        if (LeftRotateNeeded(current_node)) {
+            return RotateLeft(node);
+        } else if (RightRotateNeded(current_node)) {
+            return RotateRight(node);
+        } else if (RightLeftRotateNeeded(current_node)) {
+            return RotateRightLeft(node);
+        } else if (LeftRightRotateNeeded(current_node)) {
+            return RotateLeftRight(node);
+        }
+        return current_node;
+    }
+
     void BalanceAfterInsert(SetNode<K>* inserted_node) {
         SetNode<K>* current_node = inserted_node->GetParent();
         SetNode<K>* previous_node = inserted_node;
         while (current_node != nullptr) {
-            if (current_node->GetLeft().get() == previous_node) {
+            if (current_node->GetLeft() == previous_node) {
                 ++(current_node->GetBalance());
             } else {
                 --(current_node->GetBalance());
@@ -1182,16 +2028,7 @@ private:
                 previous_node = current_node;
                 current_node = current_node->GetParent();
             } else {
-                std::unique_ptr<SetNode<K>>& current_node_smart = GetNodeUn(current_node);
-                if (LeftRotateNeeded(current_node)) {
-                    current_node = RotateLeft(current_node_smart);
-                } else if (RightRotateNeded(current_node)) {
-                    current_node = RotateRight(current_node_smart);
-                } else if (RightLeftRotateNeeded(current_node)) {
-                    current_node = RotateRightLeft(current_node_smart);
-                } else if (LeftRightRotateNeeded(current_node)) {
-                    current_node = RotateLeftRight(current_node_smart);
-                }
+                current_node = Rebalance(GetNodeUn(current_node));
                 if (current_node->GetBalance() == 0) {
                     return;
                 } else {
@@ -1202,13 +2039,210 @@ private:
         }
     }
 
-    CompressedPair<std::unique_ptr<SetNode<K>>, Compare> root_compare_;
+    // Retracing after a subtree of the node lost one level of height. Stops as soon as the
+    // height of the current subtree is unchanged.
+    void BalanceAfterErase(SetNode<K>* node, bool left_shrunk) {
+        while (node != nullptr) {
+            SetNode<K>* parent = node->GetParent();
+            bool left = (parent != nullptr) && (parent->GetLeft() == node);
+            if (left_shrunk) {
+                --(node->GetBalance());
+            } else {
+                ++(node->GetBalance());
+            }
+            if (std::abs(node->GetBalance()) == 1) {
+                return;
+            }
+            if (std::abs(node->GetBalance()) == 2) {
+                node = Rebalance(GetNodeUn(node));
+                if (node->GetBalance() != 0) {
+                    return;
+                }
+            }
+            left_shrunk = left;
+            node = parent;
+        }
+    }
+
+    void ReplaceSetNode(SetNode<K>* node, SetNode<K>* replacement) {
+        SetNode<K>* parent = node->GetParent();
+        bool left = (parent != nullptr) && (parent->GetLeft() == node);
+        ConnectAfterRotation(parent, replacement, left);
+    }
+
+    // Takes the node out of the tree and rebalances it. The prev/next thread is left alone.
+    // A node with two children is replaced by its successor, which is relinked rather than
+    // copied, so iterators to the successor stay valid.
+    void DetachSetNode(SetNode<K>* node) {
+        SetNode<K>* retrace_node = nullptr;
+        bool left_shrunk = false;
+        if (node->GetLeft() != nullptr && node->GetRight() != nullptr) {
+            auto successor = static_cast<SetNode<K>*>(node->GetNext());
+            if (successor == node->GetRight()) {
+                retrace_node = successor;
+            } else {
+                retrace_node = successor->GetParent();
+                left_shrunk = true;
+                ConnectAfterRotation(retrace_node, successor->GetRight(), true);
+                ConnectAfterRotation(successor, node->GetRight(), false);
+            }
+            ConnectAfterRotation(successor, node->GetLeft(), true);
+            successor->GetBalance() = node->GetBalance();
+            ReplaceSetNode(node, successor);
+        } else {
+            retrace_node = node->GetParent();
+            left_shrunk = (retrace_node != nullptr) && (retrace_node->GetLeft() == node);
+            ReplaceSetNode(node, node->GetLeft() != nullptr ? node->GetLeft() : node->GetRight());
+        }
+        BalanceAfterErase(retrace_node, left_shrunk);
+    }
+
+    void EraseSetNode(SetNode<K>* node) {
+        DetachSetNode(node);
+        node->GetPrev()->GetNext() = node->GetNext();
+        node->GetNext()->GetPrev() = node->GetPrev();
+        DestroyNode(node);
+        --GetSize();
+    }
+
+    // Height of a subtree, found by descending along its taller side.
+    int GetHeight(const SetNode<K>* node) const {
+        int height = 0;
+        while (node != nullptr) {
+            ++height;
+            node = (node->GetBalance() < 0) ? node->GetRight() : node->GetLeft();
+        }
+        return height;
+    }
+
+    // Joins two detached trees and a middle node, all keys of left < middle < all keys of
+    // right. The middle node is hung on the spine of the taller tree at the height of the
+    // lower one and the tree is retraced as after an insertion, so the cost is proportional
+    // to the difference in heights. Uses the root slot as scratch and returns the new root.
+    SetNode<K>* JoinSetNodes(SetNode<K>* left, SetNode<K>* middle, SetNode<K>* right) {
+        int left_height = GetHeight(left);
+        int right_height = GetHeight(right);
+        middle->GetParent() = nullptr;
+        if (std::abs(left_height - right_height) <= 1) {
+            ConnectAfterRotation(middle, left, true);
+            ConnectAfterRotation(middle, right, false);
+            middle->GetBalance() = static_cast<signed char>(left_height - right_height);
+            return middle;
+        }
+        if (left_height > right_height) {
+            SetNode<K>* parent = nullptr;
+            SetNode<K>* node = left;
+            int height = left_height;
+            while (height > right_height + 1) {
+                height -= (node->GetBalance() > 0) ? 2 : 1;
+                parent = node;
+                node = node->GetRight();
+            }
+            ConnectAfterRotation(middle, node, true);
+            ConnectAfterRotation(middle, right, false);
+            middle->GetBalance() = static_cast<signed char>(height - right_height);
+            GetRoot() = left;
+            ConnectAfterRotation(parent, middle, false);
+        } else {
+            SetNode<K>* parent = nullptr;
+            SetNode<K>* node = right;
+            int height = right_height;
+            while (height > left_height + 1) {
+                height -= (node->GetBalance() < 0) ? 2 : 1;
+                parent = node;
+                node = node->GetLeft();
+            }
+            ConnectAfterRotation(middle, left, true);
+            ConnectAfterRotation(middle, node, false);
+            middle->GetBalance() = static_cast<signed char>(left_height - height);
+            GetRoot() = right;
+            ConnectAfterRotation(parent, middle, true);
+        }
+        BalanceAfterInsert(middle);
+        return GetRoot();
+    }
+
+    SetNode<K>* DetachChild(SetNode<K>* child) {
+        if (child != nullptr) {
+            child->GetParent() = nullptr;
+        }
+        return child;
+    }
+
+    // Splits the tree into the nodes before the pivot and the nodes from the pivot on by
+    // joining the subtrees hanging off the path from the pivot to the root. Returns the two
+    // roots; the root slot is left pointing to garbage.
+    std::pair<SetNode<K>*, SetNode<K>*> SplitSetNodes(SetNode<K>* pivot) {
+        SetNode<K>* parent = pivot->GetParent();
+        SetNode<K>* left = DetachChild(pivot->GetLeft());
+        SetNode<K>* right = DetachChild(pivot->GetRight());
+        right = JoinSetNodes(nullptr, pivot, right);
+        SetNode<K>* child = pivot;
+        while (parent != nullptr) {
+            SetNode<K>* grandparent = parent->GetParent();
+            if (parent->GetLeft() == child) {
+                right = JoinSetNodes(right, parent, DetachChild(parent->GetRight()));
+            } else {
+                left = JoinSetNodes(DetachChild(parent->GetLeft()), parent, left);
+            }
+            child = parent;
+            parent = grandparent;
+        }
+        return {left, right};
+    }
+
+    // Short ranges are erased node by node, each in O(log n). Longer ones are cut out with
+    // two splits and a join, which costs O(log^2 n) on top of visiting the erased nodes.
+    void EraseSetNodes(SetBaseNode<K>* first, SetBaseNode<K>* last) {
+        size_t count = 0;
+        for (auto node = first; node != last; node = node->GetNext()) {
+            ++count;
+        }
+        if (count == Size()) {
+            DestroyNodes();
+            return;
+        }
+        if (count < static_cast<size_t>(GetHeight(GetRoot()))) {
+            while (first != last) {
+                auto next = first->GetNext();
+                EraseSetNode(first->GetSetNode());
+                first = next;
+            }
+            return;
+        }
+        auto [before, rest] = SplitSetNodes(first->GetSetNode());
+        SetNode<K>* after = nullptr;
+        if (!last->IsSetEndNode()) {
+            GetRoot() = rest;
+            after = SplitSetNodes(last->GetSetNode()).second;
+        }
+        if (before == nullptr || after == nullptr) {
+            GetRoot() = (before == nullptr) ? after : before;
+        } else {
+            SetNode<K>* middle = last->GetSetNode();
+            GetRoot() = after;
+            DetachSetNode(middle);
+            GetRoot() = JoinSetNodes(before, middle, GetRoot());
+        }
+        SetBaseNode<K>* prev = first->GetPrev();
+        while (first != last) {
+            auto next = first->GetNext();
+            DestroyNode(first->GetSetNode());
+            first = next;
+        }
+        prev->GetNext() = last;
+        last->GetPrev() = prev;
+        GetSize() -= count;
+    }
+
+    CompressedPair<SetNode<K>*, Compare> root_compare_;
     SetEndNode<K> end_node_{std::addressof(end_node_), std::addressof(end_node_)};
-    size_t size_ = 0;
+    CompressedPair<size_t, NodeAllocator> size_allocator_;
 };
 
-template <typename K, typename Compare>
-bool operator==(const SetAVL<K, Compare>& lhs, const SetAVL<K, Compare>& rhs) {
+template <typename K, typename Compare, typename Allocator>
+bool operator==(const SetAVL<K, Compare, Allocator>& lhs,
+                const SetAVL<K, Compare, Allocator>& rhs) {
     if (lhs.Size() != rhs.Size()) {
         return false;
     }
@@ -1223,13 +2257,14 @@ bool operator==(const SetAVL<K, Compare>& lhs, const SetAVL<K, Compare>& rhs) {
     return true;
 }
 
-template <typename K, typename Compare>
-void Swap(SetAVL<K, Compare>& lhs, SetAVL<K, Compare>& rhs) {
+template <typename K, typename Compare, typename Allocator>
+void Swap(SetAVL<K, Compare, Allocator>& lhs, SetAVL<K, Compare, Allocator>& rhs) {
     lhs.Swap(rhs);
 }
 
-template <typename K, typename Compare>
-bool operator!=(const SetAVL<K, Compare>& lhs, const SetAVL<K, Compare>& rhs) {
+template <typename K, typename Compare, typename Allocator>
+bool operator!=(const SetAVL<K, Compare, Allocator>& lhs,
+                const SetAVL<K, Compare, Allocator>& rhs) {
     return !(lhs == rhs);
 }
 
@@ -1238,8 +2273,28 @@ size_t CalcNodeHeight(const SetNode<K>* node) {
     if (!node) {
         return 0;
     }
-    size_t left_height = CalcNodeHeight(node->GetLeft().get());
-    size_t right_height = CalcNodeHeight(node->GetRight().get());
+    size_t left_height = CalcNodeHeight(node->GetLeft());
+    size_t right_height = CalcNodeHeight(node->GetRight());
+    return 1 + std::max(left_height, right_height);
+}
+
+// Recomputes the height of every subtree and checks it against the stored balances and
+// parent links. Returns -1 if the tree is not a valid AVL tree.
+template <typename K>
+int CheckNodeBalance(const SetNode<K>* node) {
+    if (!node) {
+        return 0;
+    }
+    int left_height = CheckNodeBalance(node->GetLeft());
+    int right_height = CheckNodeBalance(node->GetRight());
+    if (left_height < 0 || right_height < 0 || left_height - right_height != node->GetBalance() ||
+        std::abs(left_height - right_height) > 1) {
+        return -1;
+    }
+    if ((node->GetLeft() && node->GetLeft()->GetParent() != node) ||
+        (node->GetRight() && node->GetRight()->GetParent() != node)) {
+        return -1;
+    }
     return 1 + std::max(left_height, right_height);
 }
 
@@ -0,0 +1,89 @@
+#include "CompactMapAVL.h"
+#include "MapAVL.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+// Bytes in use on the heap, including the bookkeeping of malloc and the blocks it maps
+// directly, where glibc reports them.
+size_t HeapInUse() {
+#if defined(__GLIBC__)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// Builds the map by random inserts and reports the heap bytes per entry it took, also after
+// dropping the spare capacity of a vector, then the time of random lookups.
+template <typename Map>
+void BenchLayout(const std::string& name, size_t size) {
+    auto keys = GenerateShuffledKeys(size, 106);
+    size_t heap_before = HeapInUse();
+    Map map;
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            map.Insert({key, key});
+        }
+    });
+    size_t heap_bytes = HeapInUse() - heap_before;
+    std::cout << "BenchMemory" << name << " size=" << size
+              << " heap_bytes/entry=" << static_cast<double>(heap_bytes) / size << "\n";
+    Report("BenchInsert" + name, size, size, insert_seconds);
+    if constexpr (requires { map.ShrinkToFit(); }) {
+        map.ShrinkToFit();
+        heap_bytes = HeapInUse() - heap_before;
+        std::cout << "BenchMemory" << name << "Shrunk size=" << size
+                  << " heap_bytes/entry=" << static_cast<double>(heap_bytes) / size << "\n";
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(107));
+    size_t checksum = 0;
+    double find_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            checksum += map.Find(key)->second;
+        }
+    });
+    Report("BenchFind" + name, size, size, find_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchLayout<MapAVL<int, int>>("MapAVL", size);
+        BenchLayout<CompactMapAVL<int, int>>("CompactMapAVL", size);
+    }
+}
@@ -0,0 +1,239 @@
+#include "CompactMapAVL.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using CompactMap = CompactMapAVL<int, int>;
+
+// Checks links, balances and heights of the subtree and returns its height.
+template <typename Map>
+int CheckSubtree(const Map& map, uint32_t index, uint32_t parent) {
+    if (index == Map::NullIndex()) {
+        return 0;
+    }
+    assert(map.GetParent(index) == parent);
+    uint32_t left = map.GetLeft(index);
+    uint32_t right = map.GetRight(index);
+    if (left != Map::NullIndex()) {
+        assert(map.GetKeyValue(left).first < map.GetKeyValue(index).first);
+    }
+    if (right != Map::NullIndex()) {
+        assert(map.GetKeyValue(index).first < map.GetKeyValue(right).first);
+    }
+    int left_height = CheckSubtree(map, left, index);
+    int right_height = CheckSubtree(map, right, index);
+    assert(map.GetBalance(index) == right_height - left_height);
+    return 1 + std::max(left_height, right_height);
+}
+
+void CheckSameAsStdMap(const CompactMap& map, const std::map<int, int>& expected) {
+    assert(map.Size() == expected.size());
+    assert(map.Empty() == expected.empty());
+    CheckSubtree(map, map.GetRootIndex(), CompactMap::NullIndex());
+    auto it = map.Begin();
+    for (const auto& [key, value] : expected) {
+        assert(it->first == key && it->second == value);
+        ++it;
+    }
+    assert(it == map.End());
+    for (auto jt = expected.rbegin(); jt != expected.rend(); ++jt) {
+        --it;
+        assert(it->first == jt->first);
+    }
+    assert(it == map.Begin());
+}
+
+void TestEmpty() {
+    CompactMap map;
+    assert(map.Empty() && map.Size() == 0);
+    assert(map.Begin() == map.End());
+    assert(map.Find(1) == map.End());
+    assert(map.LowerBound(1) == map.End());
+    assert(map.Erase(1) == 0);
+    std::cout << "TestEmpty passed\n";
+}
+
+void TestInsertFindErase() {
+    CompactMap map = {{5, 50}, {1, 10}, {9, 90}};
+    assert(!map.Insert({5, 0}).second);
+    assert(map.At(5) == 50);
+    map[7] = 70;
+    ++map[7];
+    assert(map.Find(7)->second == 71);
+    assert(map.LowerBound(6)->first == 7);
+    assert(map.UpperBound(7)->first == 9);
+    assert(map.UpperBound(9) == map.End());
+    bool thrown = false;
+    try {
+        map.At(2);
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(map.Erase(5) == 1 && !map.Contains(5));
+    CheckSameAsStdMap(map, {{1, 10}, {7, 71}, {9, 90}});
+
+    CompactMapAVL<std::string, std::string> strings;
+    strings.TryEmplace("b", 3, 'x');
+    strings.Insert({"a", "y"});
+    assert(strings.Begin()->second == "y" && strings.Find("b")->second == "xxx");
+    strings.Erase("a");
+    assert(strings.Size() == 1 && strings.Begin()->first == "b");
+    std::cout << "TestInsertFindErase passed\n";
+}
+
+void TestRandomAgainstStdMap() {
+    CompactMap map;
+    std::map<int, int> expected;
+    std::mt19937 gen(105);
+    std::uniform_int_distribution<int> keys(0, 2000);
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 500; ++i) {
+            int key = keys(gen);
+            assert(map.Insert({key, i}).second == expected.insert({key, i}).second);
+        }
+        CheckSameAsStdMap(map, expected);
+        for (int i = 0; i < 400; ++i) {
+            int key = keys(gen);
+            assert(map.Erase(key) == expected.erase(key));
+        }
+        CheckSameAsStdMap(map, expected);
+    }
+    for (int key = -1; key <= 2001; ++key) {
+        auto it = map.LowerBound(key);
+        auto jt = expected.lower_bound(key);
+        assert((it == map.End()) == (jt == expected.end()));
+        assert(it == map.End() || it->first == jt->first);
+    }
+
+    CompactMap copy = map;
+    assert(copy == map);
+    copy.Erase(expected.begin()->first);
+    assert(!(copy == map));
+    CompactMap moved = std::move(copy);
+    assert(copy.Empty() && moved.Size() + 1 == map.Size());
+    copy = map;
+    assert(copy == map);
+    map.Clear();
+    CheckSameAsStdMap(map, {});
+    std::cout << "TestRandomAgainstStdMap passed\n";
+}
+
+void TestSequentialKeys() {
+    CompactMap map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 10000; ++i) {
+        map.Insert({i, i});
+        expected.insert({i, i});
+    }
+    CheckSameAsStdMap(map, expected);
+    assert(CheckSubtree(map, map.GetRootIndex(), CompactMap::NullIndex()) <= 20);
+    for (int i = 0; i < 10000; i += 2) {
+        map.Erase(i);
+        expected.erase(i);
+    }
+    CheckSameAsStdMap(map, expected);
+    map.ShrinkToFit();
+    assert(map.MemoryUsage() < sizeof(map) + 5000 * 24);
+    std::cout << "TestSequentialKeys passed\n";
+}
+
+// Key whose copies throw once copies_left runs out. It has no move operations, so the map
+// has to copy it.
+struct ThrowingKey {
+    static inline int copies_left = 0;
+    int value = 0;
+    ThrowingKey(int value) : value(value) {
+    }
+    ThrowingKey(const ThrowingKey& other) : value(other.value) {
+        Count();
+    }
+    ThrowingKey& operator=(const ThrowingKey& other) {
+        Count();
+        value = other.value;
+        return *this;
+    }
+    static void Count() {
+        if (--copies_left < 0) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    bool operator<(const ThrowingKey& other) const {
+        return value < other.value;
+    }
+};
+
+void TestEraseThrowing() {
+    using ThrowingMap = CompactMapAVL<ThrowingKey, int>;
+    ThrowingKey::copies_left = 1 << 20;
+    ThrowingMap map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 300; ++i) {
+        int key = (i * 7919) % 300;
+        map.Insert({ThrowingKey(key), key});
+        expected.insert({key, key});
+    }
+    for (int key = 0; key < 300; key += 7) {
+        ThrowingKey::copies_left = 0;
+        bool thrown = false;
+        try {
+            map.Erase(key);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        ThrowingKey::copies_left = 1 << 20;
+        // Erasing the last node of the vector copies nothing.
+        assert(thrown == map.Contains(key));
+        if (!thrown) {
+            expected.erase(key);
+        }
+        assert(map.Size() == expected.size());
+        CheckSubtree(map, map.GetRootIndex(), ThrowingMap::NullIndex());
+        auto it = map.Begin();
+        for (const auto& [expected_key, value] : expected) {
+            assert(it->first.value == expected_key);
+            assert(it->second == value || expected_key == key);
+            ++it;
+        }
+        assert(it == map.End());
+        assert(map.Erase(key) == (thrown ? 1 : 0));
+        expected.erase(key);
+        CheckSubtree(map, map.GetRootIndex(), ThrowingMap::NullIndex());
+    }
+
+    CompactMapAVL<std::string, std::string> strings;
+    std::map<std::string, std::string> expected_strings;
+    std::mt19937 gen(122);
+    std::uniform_int_distribution<int> keys(0, 500);
+    for (int i = 0; i < 3000; ++i) {
+        std::string key = std::string(20, 'k') + std::to_string(keys(gen));
+        if (i % 3 == 0) {
+            assert(strings.Erase(key) == expected_strings.erase(key));
+        } else {
+            strings.Insert({key, std::string(30, 'v') + key});
+            expected_strings.insert({key, std::string(30, 'v') + key});
+        }
+    }
+    CheckSubtree(strings, strings.GetRootIndex(), decltype(strings)::NullIndex());
+    assert(strings.Size() == expected_strings.size());
+    assert(std::equal(strings.Begin(), strings.End(), expected_strings.begin(),
+                      [](const auto& lhs, const auto& rhs) {
+                          return lhs.first == rhs.first && lhs.second == rhs.second;
+                      }));
+    std::cout << "TestEraseThrowing passed\n";
+}
+
+int main() {
+    TestEmpty();
+    TestInsertFindErase();
+    TestRandomAgainstStdMap();
+    TestSequentialKeys();
+    TestEraseThrowing();
+
+    std::cout << "\nAll tests passed\n";
+}
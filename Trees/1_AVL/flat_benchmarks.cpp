@@ -0,0 +1,137 @@
+#include "FlatMap.h"
+#include "MapAVL.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+double Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    double nanoseconds = seconds * 1e9 / operations;
+    std::cout << name << " size=" << size << " ns/op=" << nanoseconds
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+    return nanoseconds;
+}
+
+// Random keys below limit, where the map holds the even ones.
+std::vector<int> GenerateQueries(size_t count, size_t limit, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(limit) - 1);
+    std::vector<int> queries(count);
+    for (int& key : queries) {
+        key = dis(gen);
+    }
+    return queries;
+}
+
+// Nanoseconds per operation of one map at one size, by operation name.
+using Timings = std::map<std::string, double>;
+
+// The map holds the even keys below 2 * size. Lookups run kQueries times at every size; single
+// inserts and erases of odd keys are timed at the given size, so the map barely grows; the bulk
+// insert merges size / 4 random odd keys into a copy of the map.
+template <typename Map>
+Timings BenchMap(const std::string& name, size_t size) {
+    constexpr size_t kQueries = 1'000'000;
+    std::vector<std::pair<int, int>> entries;
+    for (size_t i = 0; i < size; ++i) {
+        entries.emplace_back(static_cast<int>(2 * i), static_cast<int>(i));
+    }
+    Map map(entries.begin(), entries.end());
+    Timings timings;
+    size_t checksum = 0;
+
+    auto queries = GenerateQueries(kQueries, size, 117);
+    double seconds = MeasureSeconds([&] {
+        for (int key : queries) {
+            checksum += map.Find(2 * key)->second;
+        }
+    });
+    timings["Find"] = Report("BenchFind" + name, size, kQueries, seconds);
+    seconds = MeasureSeconds([&] {
+        for (int key : queries) {
+            auto it = map.LowerBound(2 * key - 1);
+            checksum += it->second;
+        }
+    });
+    timings["LowerBound"] = Report("BenchLowerBound" + name, size, kQueries, seconds);
+    seconds = MeasureSeconds([&] {
+        for (auto it = map.Begin(); it != map.End(); ++it) {
+            checksum += it->second;
+        }
+    });
+    timings["Iterate"] = Report("BenchIterate" + name, size, size, seconds);
+
+    const size_t updates = std::min<size_t>(size, 4096);
+    auto odd_keys = GenerateQueries(updates, size, 118);
+    seconds = MeasureSeconds([&] {
+        for (int key : odd_keys) {
+            checksum += map.Insert({2 * key + 1, key}).second;
+        }
+    });
+    timings["Insert"] = Report("BenchInsert" + name, size, updates, seconds);
+    seconds = MeasureSeconds([&] {
+        for (int key : odd_keys) {
+            checksum += map.Erase(2 * key + 1);
+        }
+    });
+    timings["Erase"] = Report("BenchErase" + name, size, updates, seconds);
+
+    auto batch_keys = GenerateQueries(std::max<size_t>(size / 4, 1), size, 119);
+    std::vector<std::pair<int, int>> batch;
+    for (int key : batch_keys) {
+        batch.emplace_back(2 * key + 1, key);
+    }
+    Map copy = map;
+    seconds = MeasureSeconds([&] { copy.Insert(batch.begin(), batch.end()); });
+    timings["BulkInsert"] = Report("BenchBulkInsert" + name, size, batch.size(), seconds);
+    checksum += copy.Size();
+    std::cerr << "checksum " << checksum << "\n";
+    return timings;
+}
+
+// Runs both maps at sizes 16, 64, 256, ... up to max_size and reports, for every operation,
+// the crossover: the size from which on MapAVL was faster than FlatMap at every size measured.
+int main(int argc, char** argv) {
+    size_t max_size = 4'000'000;
+    if (argc > 1) {
+        max_size = static_cast<size_t>(std::atoll(argv[1]));
+    }
+    std::vector<size_t> sizes;
+    for (size_t size = 16; size <= max_size; size *= 4) {
+        sizes.push_back(size);
+    }
+    // Index into sizes of the first size after the last one at which FlatMap was faster.
+    std::map<std::string, size_t> crossover;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        Timings flat = BenchMap<FlatMap<int, int>>("FlatMap", sizes[i]);
+        Timings tree = BenchMap<MapAVL<int, int>>("MapAVL", sizes[i]);
+        for (const auto& [operation, nanoseconds] : flat) {
+            if (nanoseconds <= tree[operation]) {
+                crossover[operation] = i + 1;
+            } else {
+                crossover.try_emplace(operation, 0);
+            }
+        }
+    }
+    for (const auto& [operation, index] : crossover) {
+        std::cout << "Crossover" << operation << " ";
+        if (index < sizes.size()) {
+            std::cout << "size=" << sizes[index] << "\n";
+        } else {
+            std::cout << "none up to size=" << sizes.back() << "\n";
+        }
+    }
+}
@@ -0,0 +1,223 @@
+#include "FlatMap.h"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using Flat = FlatMap<int, int>;
+
+bool SameElement(const std::pair<int, int>& lhs, const std::pair<const int, int>& rhs) {
+    return lhs.first == rhs.first && lhs.second == rhs.second;
+}
+
+void CheckSameAsStdMap(const Flat& map, const std::map<int, int>& expected) {
+    assert(map.Size() == expected.size());
+    assert(map.Empty() == expected.empty());
+    assert(std::equal(map.Begin(), map.End(), expected.begin(), expected.end(), SameElement));
+    assert(std::equal(map.RBegin(), map.REnd(), expected.rbegin(), expected.rend(),
+                      SameElement));
+}
+
+// Every lookup against every key between and around the elements, which are the even keys
+// below 2 * size, for sizes that hit each depth of the binary search.
+void TestLookups() {
+    for (int size = 0; size <= 70; ++size) {
+        std::vector<std::pair<int, int>> sorted;
+        for (int i = 0; i < size; ++i) {
+            sorted.emplace_back(2 * i, i);
+        }
+        const Flat map(sorted.begin(), sorted.end());
+        assert(map.End() - map.Begin() == size);
+        for (int key = -1; key <= 2 * size; ++key) {
+            const int lower_rank = std::min((key + 1) / 2, size);
+            const int upper_rank = key < 0 ? 0 : std::min(key / 2 + 1, size);
+            assert(map.LowerBound(key) - map.Begin() == lower_rank);
+            assert(map.UpperBound(key) - map.Begin() == upper_rank);
+            bool present = key >= 0 && key % 2 == 0 && key < 2 * size;
+            assert(map.Contains(key) == present && map.Count(key) == (present ? 1u : 0u));
+            auto [first, last] = map.EqualRange(key);
+            assert(first == (present ? map.LowerBound(key) : map.End()));
+            assert(last - first == (present ? 1 : 0));
+            assert((map.Find(key) == map.End()) == !present);
+        }
+        bool thrown = false;
+        try {
+            map.At(1);
+        } catch (const std::out_of_range&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    FlatMap<std::string, int, std::less<>> strings = {{"pear", 1}, {"apple", 2}, {"fig", 3}};
+    assert(strings.Find(std::string_view("fig"))->second == 3);
+    assert(strings.LowerBound(std::string_view("b"))->first == "fig");
+    assert(strings.UpperBound(std::string_view("pear")) == strings.End());
+    assert(!strings.Contains(std::string_view("plum")));
+    assert(strings.Count(std::string_view("apple")) == 1);
+    assert(strings.Count(std::string_view("plum")) == 0);
+    auto [first, last] = strings.EqualRange(std::string_view("fig"));
+    assert(first->first == "fig" && last - first == 1);
+    const auto& const_strings = strings;
+    auto [missing, missing_end] = const_strings.EqualRange(std::string_view("plum"));
+    assert(missing == const_strings.End() && missing_end == missing);
+    std::cout << "TestLookups passed\n";
+}
+
+// A hint right after the key's place inserts without a search; any other hint falls back to
+// one. Both have to land in the same place and return the element.
+void TestHintedInsert() {
+    const std::map<int, int> base = {{10, 1}, {20, 2}, {30, 3}, {40, 4}};
+    for (int key = 5; key <= 45; key += 5) {
+        for (size_t hint_rank = 0; hint_rank <= base.size(); ++hint_rank) {
+            Flat map(base.begin(), base.end());
+            std::map<int, int> expected = base;
+            auto it = map.Insert(map.CBegin() + static_cast<std::ptrdiff_t>(hint_rank),
+                                 {key, -key});
+            expected.insert({key, -key});
+            assert(it->first == key && it->second == expected.at(key));
+            CheckSameAsStdMap(map, expected);
+        }
+    }
+
+    Flat map;
+    for (int i = 0; i < 100; ++i) {
+        auto it = map.EmplaceHint(map.CEnd(), i, i);
+        assert(it == map.End() - 1 && it->first == i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        auto it = map.EmplaceHint(map.CBegin(), -1 - i, i);
+        assert(it == map.Begin() && it->first == -1 - i);
+    }
+    assert(map.Size() == 200 && std::is_sorted(map.Begin(), map.End()));
+    std::cout << "TestHintedInsert passed\n";
+}
+
+// Element that counts its copies and throws once copies_left runs out.
+struct ThrowingValue {
+    static inline int copies_left = 0;
+    int value = 0;
+    ThrowingValue(int value) : value(value) {
+    }
+    ThrowingValue(const ThrowingValue& other) : value(other.value) {
+        if (--copies_left < 0) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    ThrowingValue& operator=(const ThrowingValue& other) = default;
+};
+
+void TestBulkInsert() {
+    // Of equivalent keys the element already in the map wins, then the first in the batch.
+    Flat map = {{2, 20}, {4, 40}};
+    std::vector<std::pair<int, int>> batch = {{5, 1}, {4, 0}, {1, 1}, {5, 2}, {3, 3}, {1, 2}};
+    map.Insert(batch.begin(), batch.end());
+    CheckSameAsStdMap(map, {{1, 1}, {2, 20}, {3, 3}, {4, 40}, {5, 1}});
+    // A batch that sorts entirely before or after the map, one that is empty, and one that
+    // only repeats keys.
+    std::vector<std::pair<int, int>> before = {{-1, 0}, {-2, 0}};
+    std::vector<std::pair<int, int>> after = {{9, 0}, {7, 0}};
+    std::vector<std::pair<int, int>> repeated = {{1, 0}, {9, 1}};
+    map.Insert(before.begin(), before.end());
+    map.Insert(after.begin(), after.end());
+    map.Insert(after.end(), after.end());
+    map.Insert(repeated.begin(), repeated.end());
+    CheckSameAsStdMap(map, {{-2, 0}, {-1, 0}, {1, 1}, {2, 20}, {3, 3}, {4, 40}, {5, 1},
+                            {7, 0}, {9, 0}});
+
+    std::mt19937 gen(115);
+    std::uniform_int_distribution<int> keys(0, 3000);
+    Flat random_map;
+    std::map<int, int> expected;
+    for (int round = 0; round < 20; ++round) {
+        std::vector<std::pair<int, int>> random_batch;
+        for (int i = 0; i < 300; ++i) {
+            random_batch.emplace_back(keys(gen), round * 1000 + i);
+        }
+        if (round % 4 == 0) {
+            std::sort(random_batch.begin(), random_batch.end());
+        }
+        random_map.Insert(random_batch.begin(), random_batch.end());
+        expected.insert(random_batch.begin(), random_batch.end());
+        CheckSameAsStdMap(random_map, expected);
+    }
+    FlatMap<int, int, std::greater<int>> reversed(expected.begin(), expected.end());
+    assert(std::equal(reversed.Begin(), reversed.End(), expected.rbegin(), expected.rend(),
+                      SameElement));
+
+    // A copy that throws while the batch is appended leaves the map as it was.
+    ThrowingValue::copies_left = 1000;
+    FlatMap<int, ThrowingValue> throwing;
+    std::vector<std::pair<int, ThrowingValue>> throwing_batch;
+    for (int i = 0; i < 50; ++i) {
+        throwing.Insert({2 * i, ThrowingValue(i)});
+        throwing_batch.emplace_back(2 * i + 1, ThrowingValue(i));
+    }
+    ThrowingValue::copies_left = 20;
+    bool thrown = false;
+    try {
+        throwing.Insert(throwing_batch.begin(), throwing_batch.end());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && throwing.Size() == 50);
+    for (int i = 0; i < 50; ++i) {
+        assert((throwing.Begin() + i)->first == 2 * i);
+    }
+    std::cout << "TestBulkInsert passed\n";
+}
+
+void TestUpdates() {
+    Flat map = {{1, 10}, {3, 30}, {5, 50}, {7, 70}};
+    assert(!map.InsertOrAssign(3, 33).second && map.At(3) == 33);
+    assert(map.InsertOrAssign(4, 40).second && map.Find(4) - map.Begin() == 2);
+    map[6] += 60;
+    assert(map.At(6) == 60);
+    assert(!map.Emplace(5, 0).second && map.At(5) == 50);
+
+    FlatMap<int, std::string> strings;
+    std::string text = "kept";
+    strings.TryEmplace(1, std::move(text));
+    text = "kept";
+    assert(!strings.TryEmplace(1, std::move(text)).second && text == "kept");
+
+    // Erase returns the element after the erased ones, which shift into their place.
+    auto it = map.Erase(map.Find(4));
+    assert(it->first == 5 && it - map.Begin() == 2);
+    it = map.Erase(map.Find(3), map.Find(6));
+    assert(it->first == 6 && it - map.Begin() == 1);
+    it = map.Erase(map.End() - 1);
+    assert(it == map.End());
+    assert(map.Erase(1) == 1 && map.Erase(1) == 0);
+    CheckSameAsStdMap(map, {{6, 60}});
+
+    map.Reserve(100);
+    Flat copy = map;
+    assert(copy == map && copy.Size() == 1);
+    copy.Insert({0, 0});
+    assert(copy != map);
+    Flat moved = std::move(copy);
+    Swap(moved, map);
+    CheckSameAsStdMap(map, {{0, 0}, {6, 60}});
+    CheckSameAsStdMap(moved, {{6, 60}});
+    map.Clear();
+    map.ShrinkToFit();
+    assert(map.Empty() && map.Begin() == map.End());
+    std::cout << "TestUpdates passed\n";
+}
+
+int main() {
+    TestLookups();
+    TestHintedInsert();
+    TestBulkInsert();
+    TestUpdates();
+
+    std::cout << "\nAll tests passed\n";
+}
@@ -0,0 +1,82 @@
+#include "MapAVL.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+// Random lookups of present keys for Find and of absent ones for LowerBound, then a full scan.
+template <typename Map>
+void BenchLookups(const std::string& name, const Map& map, const std::vector<int>& queries) {
+    size_t checksum = 0;
+    double find_seconds = MeasureSeconds([&] {
+        for (int key : queries) {
+            checksum += map.Find(2 * key)->second;
+        }
+    });
+    Report("BenchFind" + name, map.Size(), queries.size(), find_seconds);
+    double lower_bound_seconds = MeasureSeconds([&] {
+        for (int key : queries) {
+            checksum += map.LowerBound(2 * key - 1)->second;
+        }
+    });
+    Report("BenchLowerBound" + name, map.Size(), queries.size(), lower_bound_seconds);
+    double iterate_seconds = MeasureSeconds([&] {
+        for (auto it = map.Begin(); it != map.End(); ++it) {
+            checksum += it->second;
+        }
+    });
+    Report("BenchIterate" + name, map.Size(), map.Size(), iterate_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Compares the pointer-based tree with its frozen copy on the same keys, the even numbers
+// below 2 * size, with kQueries lookups at every size so that small maps stay in cache.
+void BenchFreeze(size_t size) {
+    constexpr size_t kQueries = 2'000'000;
+    MapAVL<int, int> map;
+    {
+        std::vector<std::pair<const int, int>> entries;
+        entries.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            entries.emplace_back(static_cast<int>(2 * i), static_cast<int>(i));
+        }
+        map = MapAVL<int, int>(entries.begin(), entries.end());
+    }
+    FrozenMap<int, int> frozen;
+    double freeze_seconds = MeasureSeconds([&] { frozen = map.Freeze(); });
+    Report("BenchFreeze", size, size, freeze_seconds);
+
+    std::mt19937 gen(114);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(size) - 1);
+    std::vector<int> queries(kQueries);
+    for (int& key : queries) {
+        key = dis(gen);
+    }
+    BenchLookups("MapAVL", map, queries);
+    BenchLookups("FrozenMap", frozen, queries);
+}
+
+int main(int argc, char** argv) {
+    size_t max_size = 100'000'000;
+    if (argc > 1) {
+        max_size = static_cast<size_t>(std::atoll(argv[1]));
+    }
+    for (size_t size = 1'000; size <= max_size; size *= 10) {
+        BenchFreeze(size);
+    }
+}
@@ -0,0 +1,139 @@
+#include "MapAVL.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void TestRankOf() {
+    // The rank of every index has to match an in-order walk of the implicit tree.
+    for (size_t size = 1; size <= 300; ++size) {
+        std::vector<size_t> in_order;
+        std::vector<size_t> stack;
+        size_t index = 1;
+        while (index <= size || !stack.empty()) {
+            for (; index <= size; index *= 2) {
+                stack.push_back(index);
+            }
+            index = stack.back();
+            stack.pop_back();
+            in_order.push_back(index);
+            index = 2 * index + 1;
+        }
+        assert(in_order.size() == size);
+        for (size_t rank = 0; rank < size; ++rank) {
+            assert(EytzingerIndex<int>::RankOf(in_order[rank], size) == rank);
+        }
+    }
+    std::cout << "TestRankOf passed\n";
+}
+
+void TestEmpty() {
+    MapAVL<int, int> map;
+    FrozenMap<int, int> frozen = map.Freeze();
+    assert(frozen.Empty() && frozen.Size() == 0);
+    assert(frozen.Begin() == frozen.End());
+    assert(frozen.Find(1) == frozen.End() && frozen.LowerBound(1) == frozen.End());
+    assert(frozen.UpperBound(1) == frozen.End() && !frozen.Contains(1));
+    std::cout << "TestEmpty passed\n";
+}
+
+void TestAgainstStdMap() {
+    std::mt19937 gen(113);
+    for (int size : {1, 2, 3, 7, 8, 15, 16, 17, 100, 1000, 4095, 4096, 10000}) {
+        std::uniform_int_distribution<int> keys(0, 4 * size);
+        MapAVL<int, int> map;
+        std::map<int, int> expected;
+        for (int i = 0; i < size; ++i) {
+            int key = keys(gen);
+            map.Insert({key, i});
+            expected.insert({key, i});
+        }
+        FrozenMap<int, int> frozen = map.Freeze();
+        assert(frozen.Size() == expected.size());
+        assert(std::equal(frozen.Begin(), frozen.End(), expected.begin(), expected.end()));
+        assert(std::equal(frozen.RBegin(), frozen.REnd(), expected.rbegin(), expected.rend()));
+        for (int key = -1; key <= 4 * size + 1; ++key) {
+            auto lower = frozen.LowerBound(key);
+            auto expected_lower = expected.lower_bound(key);
+            assert(lower - frozen.Begin() == std::distance(expected.begin(), expected_lower));
+            auto upper = frozen.UpperBound(key);
+            assert(upper - frozen.Begin() ==
+                   std::distance(expected.begin(), expected.upper_bound(key)));
+            auto it = frozen.Find(key);
+            auto jt = expected.find(key);
+            assert((it == frozen.End()) == (jt == expected.end()));
+            assert(it == frozen.End() || (it->first == jt->first && it->second == jt->second));
+            auto [first, last] = frozen.EqualRange(key);
+            assert(last - first == static_cast<long>(expected.count(key)));
+        }
+    }
+    std::cout << "TestAgainstStdMap passed\n";
+}
+
+void TestValuesAndCompare() {
+    MapAVL<std::string, std::string, std::greater<std::string>> map;
+    map.Insert({{"b", "2"}, {"d", "4"}, {"a", "1"}, {"c", "3"}});
+    auto frozen = map.Freeze();
+    map.Clear();
+    assert(frozen.Begin()->first == "d" && frozen.At("c") == "3");
+    assert(frozen.LowerBound("bb")->first == "b" && frozen.UpperBound("a") == frozen.End());
+    assert(frozen.Count("a") == 1 && frozen.Count("e") == 0);
+    bool thrown = false;
+    try {
+        frozen.At("e");
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    auto copy = frozen;
+    assert(copy == frozen);
+    auto moved = std::move(copy);
+    assert(moved == frozen && moved.Find("a")->second == "1");
+    decltype(frozen) assigned;
+    assigned = frozen;
+    assert(assigned == frozen && assigned.At("d") == "4");
+    assigned = assigned;
+    assert(assigned == frozen);
+    assigned = decltype(frozen)();
+    assert(assigned.Empty() && assigned != frozen);
+    std::cout << "TestValuesAndCompare passed\n";
+}
+
+// Keys compare by their absolute value, so 2 and -2 are equivalent without being equal.
+struct AbsLess {
+    bool operator()(int lhs, int rhs) const {
+        return std::abs(lhs) < std::abs(rhs);
+    }
+};
+
+void TestEquality() {
+    MapAVL<int, int, AbsLess> map;
+    MapAVL<int, int, AbsLess> other;
+    for (int i = 1; i <= 50; ++i) {
+        map.Insert({i, i});
+        other.Insert({i % 2 == 0 ? -i : i, i});
+    }
+    assert(map == other && map.Freeze() == other.Freeze());
+    other.InsertOrAssign(-10, 0);
+    assert(map != other && map.Freeze() != other.Freeze());
+    other.Erase(10);
+    assert(map.Freeze() != other.Freeze());
+    std::cout << "TestEquality passed\n";
+}
+
+int main() {
+    TestRankOf();
+    TestEmpty();
+    TestAgainstStdMap();
+    TestValuesAndCompare();
+    TestEquality();
+
+    std::cout << "\nAll tests passed\n";
+}
@@ -0,0 +1,71 @@
+#include "IntervalMapAVL.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+// Matches timestamps against time windows of up to max_length, spread over a day of
+// milliseconds: a scan over all windows against a point query on the interval map.
+void BenchStab(size_t windows, long long max_length, size_t probes) {
+    const long long day = 86'400'000;
+    std::mt19937_64 gen(102);
+    std::uniform_int_distribution<long long> begins(0, day);
+    std::uniform_int_distribution<long long> lengths(1, max_length);
+    std::vector<Interval<long long>> scanned;
+    IntervalMapAVL<long long, int> intervals;
+    for (size_t i = 0; i < windows; ++i) {
+        long long begin = begins(gen);
+        Interval<long long> window{begin, begin + lengths(gen)};
+        if (intervals.Insert({window, static_cast<int>(i)}).second) {
+            scanned.push_back(window);
+        }
+    }
+    std::vector<long long> timestamps(probes);
+    for (long long& timestamp : timestamps) {
+        timestamp = begins(gen);
+    }
+    const std::string suffix = std::to_string(max_length);
+    size_t checksum = 0;
+    double tree_seconds = MeasureSeconds([&] {
+        for (long long timestamp : timestamps) {
+            checksum += intervals.CountOverlapping(timestamp);
+        }
+    });
+    Report("BenchStabTree" + suffix, windows, probes, tree_seconds);
+    const size_t scan_probes = std::max<size_t>(1, probes / 100);
+    double scan_seconds = MeasureSeconds([&] {
+        for (size_t i = 0; i < scan_probes; ++i) {
+            for (const auto& window : scanned) {
+                checksum += window.Contains(timestamps[i]);
+            }
+        }
+    });
+    Report("BenchStabScan" + suffix, windows, scan_probes, scan_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {10'000, 1'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchStab(size, 1'000, 100'000);
+        BenchStab(size, 60'000, 100'000);
+    }
+}
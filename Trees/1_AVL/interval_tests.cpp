@@ -0,0 +1,122 @@
+#include "IntervalMapAVL.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using Window = Interval<int>;
+
+// Brute-force answer: the keys of all windows that pass the predicate, in order.
+template <typename Predicate>
+std::vector<Window> ScanOverlapping(const std::vector<Window>& windows, Predicate predicate) {
+    std::vector<Window> result;
+    for (const auto& window : windows) {
+        if (predicate(window)) {
+            result.push_back(window);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<Window> Keys(const std::vector<IntervalMapAVL<int, int>::ConstIterator>& found) {
+    std::vector<Window> result;
+    for (auto it : found) {
+        result.push_back(it->first);
+    }
+    return result;
+}
+
+// Recomputes the largest end of every subtree and compares it against the stored one.
+int CheckMaxEndpoints(const MapNode<Window, int, MaxEndpoint<int>>* node) {
+    if (node == nullptr) {
+        return MaxEndpoint<int>::Identity();
+    }
+    int max_end = std::max({node->GetKey().end, CheckMaxEndpoints(node->GetLeft()),
+                            CheckMaxEndpoints(node->GetRight())});
+    assert(node->GetSummary() == max_end);
+    return max_end;
+}
+
+void CheckAgainstScan(const IntervalMapAVL<int, int>& intervals,
+                      const std::vector<Window>& windows) {
+    assert(intervals.Size() == windows.size());
+    CheckMaxEndpoints(intervals.GetTree().GetRootPtr());
+    for (int point = -5; point < 1100; point += 7) {
+        auto expected =
+            ScanOverlapping(windows, [&](const Window& w) { return w.Contains(point); });
+        assert(Keys(intervals.Overlapping(point)) == expected);
+        assert(intervals.CountOverlapping(point) == expected.size());
+    }
+    for (int begin = -5; begin < 1100; begin += 31) {
+        for (int end = begin - 10; end < begin + 200; end += 23) {
+            Window query{begin, end};
+            auto expected =
+                ScanOverlapping(windows, [&](const Window& w) { return w.Overlaps(query); });
+            assert(Keys(intervals.Overlapping(query)) == expected);
+        }
+    }
+}
+
+void TestEmpty() {
+    IntervalMapAVL<int, int> intervals;
+    assert(intervals.Empty());
+    assert(intervals.Overlapping(0).empty());
+    assert(intervals.Overlapping(Window{0, 10}).empty());
+    std::cout << "TestEmpty passed\n";
+}
+
+void TestHalfOpenBounds() {
+    IntervalMapAVL<int, int> intervals;
+    intervals.Insert({{10, 20}, 1});
+    intervals.Insert({{20, 30}, 2});
+    intervals.Insert({{15, 15}, 3});
+    assert(Keys(intervals.Overlapping(9)).empty());
+    assert(Keys(intervals.Overlapping(10)) == std::vector<Window>({{10, 20}}));
+    assert(Keys(intervals.Overlapping(15)) == std::vector<Window>({{10, 20}}));
+    assert(Keys(intervals.Overlapping(20)) == std::vector<Window>({{20, 30}}));
+    assert(Keys(intervals.Overlapping(30)).empty());
+    assert(Keys(intervals.Overlapping(Window{19, 21})) ==
+           std::vector<Window>({{10, 20}, {20, 30}}));
+    assert(Keys(intervals.Overlapping(Window{0, 10})).empty());
+    assert(Keys(intervals.Overlapping(Window{12, 12})).empty());
+    assert(Keys(intervals.Overlapping(Window{14, 16})) == std::vector<Window>({{10, 20}}));
+    assert(!intervals.Insert({{10, 20}, 4}).second);
+    assert(intervals.Find(Window{10, 20})->second == 1);
+    std::cout << "TestHalfOpenBounds passed\n";
+}
+
+void TestRandomAgainstScan() {
+    IntervalMapAVL<int, int> intervals;
+    std::vector<Window> windows;
+    std::mt19937 gen(101);
+    std::uniform_int_distribution<int> begins(0, 1000);
+    std::uniform_int_distribution<int> lengths(0, 120);
+    for (int i = 0; i < 600; ++i) {
+        int begin = begins(gen);
+        Window window{begin, begin + lengths(gen)};
+        if (intervals.Insert({window, i}).second) {
+            windows.push_back(window);
+        }
+    }
+    CheckAgainstScan(intervals, windows);
+    for (int i = 0; i < 300; ++i) {
+        size_t index = gen() % windows.size();
+        assert(intervals.Erase(windows[index]) == 1);
+        windows.erase(windows.begin() + static_cast<std::ptrdiff_t>(index));
+    }
+    CheckAgainstScan(intervals, windows);
+    intervals.Clear();
+    windows.clear();
+    CheckAgainstScan(intervals, windows);
+    std::cout << "TestRandomAgainstScan passed\n";
+}
+
+int main() {
+    TestEmpty();
+    TestHalfOpenBounds();
+    TestRandomAgainstScan();
+
+    std::cout << "\nAll tests passed\n";
+}
@@ -0,0 +1,488 @@
+#include "MapAVL.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+void BenchFind(size_t size) {
+    auto keys = GenerateShuffledKeys(size, 42);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    auto probes = GenerateShuffledKeys(size, 43);
+    long long checksum = 0;
+    double seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += map_avl.Find(key)->second;
+        }
+    });
+    Report("BenchFind", size, probes.size(), seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+void BenchIterate(size_t size) {
+    auto keys = GenerateShuffledKeys(size, 44);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    const size_t rounds = 5;
+    long long checksum = 0;
+    double seconds = MeasureSeconds([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            for (auto it = map_avl.CBegin(); it != map_avl.CEnd(); ++it) {
+                checksum += it->second;
+            }
+        }
+    });
+    Report("BenchIterate", size, rounds * size, seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Random lookups in groups of `batch` keys, as a request handler would issue them: a loop over
+// Find against FindBatch and ContainsBatch.
+void BenchFindBatch(size_t size, size_t batch) {
+    auto keys = GenerateShuffledKeys(size, 42);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    auto probes = GenerateShuffledKeys(size, 43);
+    std::vector<MapAVL<int, int>::Iterator> results(batch, map_avl.End());
+    std::unique_ptr<bool[]> contained(new bool[batch]);
+    const size_t operations = probes.size() / batch * batch;
+    long long checksum = 0;
+    double loop_seconds = MeasureSeconds([&] {
+        for (size_t first = 0; first < operations; first += batch) {
+            for (size_t i = first; i < first + batch; ++i) {
+                checksum += map_avl.Find(probes[i])->second;
+            }
+        }
+    });
+    Report("BenchFindLoop" + std::to_string(batch), size, operations, loop_seconds);
+    double batch_seconds = MeasureSeconds([&] {
+        for (size_t first = 0; first < operations; first += batch) {
+            map_avl.FindBatch(std::span<const int>(probes).subspan(first, batch), results);
+            for (const auto& it : results) {
+                checksum += it->second;
+            }
+        }
+    });
+    Report("BenchFindBatch" + std::to_string(batch), size, operations, batch_seconds);
+    double contains_seconds = MeasureSeconds([&] {
+        for (size_t first = 0; first < operations; first += batch) {
+            map_avl.ContainsBatch(std::span<const int>(probes).subspan(first, batch),
+                                  std::span<bool>(contained.get(), batch));
+            checksum += contained[0];
+        }
+    });
+    Report("BenchContainsBatch" + std::to_string(batch), size, operations, contains_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Counts its calls, to report comparisons per lookup next to the time.
+struct CountingLess {
+    static inline size_t calls = 0;
+    bool operator()(int lhs, int rhs) const {
+        ++calls;
+        return lhs < rhs;
+    }
+};
+
+// Sorted probes that land `stride` elements apart on average, as in a merge join: a loop over
+// LowerBound against LowerBoundSorted, which starts each search at the previous answer.
+void BenchLowerBoundSorted(size_t size, size_t stride) {
+    auto keys = GenerateShuffledKeys(size, 42);
+    MapAVL<int, int, CountingLess> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key * 2, key});
+    }
+    std::vector<int> probes(size / stride);
+    std::mt19937 gen(50);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(size) * 2);
+    for (int& probe : probes) {
+        probe = dis(gen);
+    }
+    std::sort(probes.begin(), probes.end());
+    std::vector<MapAVL<int, int, CountingLess>::Iterator> results(probes.size(), map_avl.End());
+    auto report = [&](const std::string& name, double seconds) {
+        Report(name + std::to_string(stride), size, probes.size(), seconds);
+        std::cout << "  comparisons/op=" << static_cast<double>(CountingLess::calls) / probes.size()
+                  << "\n";
+        CountingLess::calls = 0;
+    };
+    CountingLess::calls = 0;
+    double loop_seconds = MeasureSeconds([&] {
+        for (size_t i = 0; i < probes.size(); ++i) {
+            results[i] = map_avl.LowerBound(probes[i]);
+        }
+    });
+    report("BenchLowerBoundLoop", loop_seconds);
+    double sorted_seconds =
+        MeasureSeconds([&] { map_avl.LowerBoundSorted(probes, results); });
+    report("BenchLowerBoundSorted", sorted_seconds);
+}
+
+// Loads a sorted snapshot, once through the bulk path and once element by element.
+void BenchBuildSorted(size_t size) {
+    std::vector<std::pair<int, int>> snapshot(size);
+    for (size_t i = 0; i < size; ++i) {
+        snapshot[i] = {static_cast<int>(i), static_cast<int>(i)};
+    }
+    size_t checksum = 0;
+    double bulk_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> map_avl(snapshot.begin(), snapshot.end());
+        checksum += map_avl.Size();
+    });
+    Report("BenchBuildSortedBulk", size, size, bulk_seconds);
+    double insert_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> map_avl;
+        for (const auto& key_value : snapshot) {
+            map_avl.Insert(key_value);
+        }
+        checksum += map_avl.Size();
+    });
+    Report("BenchBuildSortedInsert", size, size, insert_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Appends increasing keys one at a time, as a log indexed by sequence number grows: plain Insert
+// against Insert with End() as the hint.
+void BenchAppendSorted(size_t size) {
+    size_t checksum = 0;
+    double insert_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> map_avl;
+        for (size_t i = 0; i < size; ++i) {
+            map_avl.Insert({static_cast<int>(i), static_cast<int>(i)});
+        }
+        checksum += map_avl.Size();
+    });
+    Report("BenchAppendSortedInsert", size, size, insert_seconds);
+    double hint_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> map_avl;
+        for (size_t i = 0; i < size; ++i) {
+            map_avl.Insert(map_avl.CEnd(), {static_cast<int>(i), static_cast<int>(i)});
+        }
+        checksum += map_avl.Size();
+    });
+    Report("BenchAppendSortedHint", size, size, hint_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// A 4 KB page, zeroed on construction, as a buffer cache keyed by page number would store it.
+struct Page {
+    std::array<char, 4096> bytes{};
+};
+
+// Loads pages into a cache that already holds most of them: Insert has to build the pair, page
+// included, before it finds the key, while TryEmplace builds a page only for a missing key.
+void BenchHeavyValue(size_t pages, size_t operations) {
+    MapAVL<int, Page> by_insert;
+    MapAVL<int, Page> by_try_emplace;
+    for (size_t i = 0; i < pages; ++i) {
+        by_insert.TryEmplace(static_cast<int>(i));
+        by_try_emplace.TryEmplace(static_cast<int>(i));
+    }
+    std::mt19937 gen(51);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(pages + pages / 16));
+    std::vector<int> probes(operations);
+    for (int& probe : probes) {
+        probe = dis(gen);
+    }
+    size_t checksum = 0;
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += by_insert.Insert({key, Page()}).second;
+        }
+    });
+    Report("BenchHeavyValueInsert", pages, operations, insert_seconds);
+    double try_emplace_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += by_try_emplace.TryEmplace(key).second;
+        }
+    });
+    Report("BenchHeavyValueTryEmplace", pages, operations, try_emplace_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Percentile queries, as a latency dashboard would issue them: walking the iterator from Begin()
+// against Nth on a map that keeps subtree sizes.
+void BenchPercentile(size_t size) {
+    auto keys = GenerateShuffledKeys(size, 52);
+    MapAVL<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, OrderStatistics>
+        map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    const size_t queries = 100;
+    long long checksum = 0;
+    double walk_seconds = MeasureSeconds([&] {
+        for (size_t i = 0; i < queries; ++i) {
+            auto it = map_avl.CBegin();
+            for (size_t j = 0; j < size * i / queries; ++j) {
+                ++it;
+            }
+            checksum += it->second;
+        }
+    });
+    Report("BenchPercentileWalk", size, queries, walk_seconds);
+    double nth_seconds = MeasureSeconds([&] {
+        for (size_t i = 0; i < queries; ++i) {
+            checksum += map_avl.Nth(size * i / queries)->second;
+        }
+    });
+    Report("BenchPercentileNth", size, queries, nth_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Total bytes of the entries in a key range, as a storage report would ask for it: summing over
+// the range with a ConstIterator against Aggregate on a map that keeps subtree sums.
+void BenchRangeSum(size_t size, size_t range) {
+    auto keys = GenerateShuffledKeys(size, 53);
+    MapAVL<int, long long, std::less<int>, std::allocator<std::pair<const int, long long>>,
+           SumOfValues<long long>>
+        map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key % 4096});
+    }
+    const size_t queries = std::max<size_t>(1, size * 4 / range);
+    std::mt19937 gen(54);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(size - range));
+    std::vector<int> lowers(queries);
+    for (int& lower : lowers) {
+        lower = dis(gen);
+    }
+    long long checksum = 0;
+    double iterate_seconds = MeasureSeconds([&] {
+        for (int lower : lowers) {
+            int upper = lower + static_cast<int>(range);
+            for (auto it = map_avl.LowerBound(lower); it != map_avl.CEnd() && it->first < upper;
+                 ++it) {
+                checksum += it->second;
+            }
+        }
+    });
+    Report("BenchRangeSumIterate" + std::to_string(range), size, queries, iterate_seconds);
+    double aggregate_seconds = MeasureSeconds([&] {
+        for (int lower : lowers) {
+            checksum += map_avl.Aggregate(lower, lower + static_cast<int>(range));
+        }
+    });
+    Report("BenchRangeSumAggregate" + std::to_string(range), size, queries, aggregate_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Repartitions a map into shards by key range and merges them back, as a sharding layer would:
+// copying every element into the shards with hinted inserts against Split and Join.
+void BenchSplitJoin(size_t size, size_t shards) {
+    auto keys = GenerateShuffledKeys(size, 55);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    const int step = static_cast<int>(size / shards);
+    size_t checksum = 0;
+    double insert_seconds = MeasureSeconds([&] {
+        std::vector<MapAVL<int, int>> parts(shards);
+        for (auto it = map_avl.CBegin(); it != map_avl.CEnd(); ++it) {
+            auto& part = parts[std::min<size_t>(it->first / step, shards - 1)];
+            part.Insert(part.CEnd(), *it);
+        }
+        MapAVL<int, int> merged;
+        for (const auto& part : parts) {
+            for (auto it = part.CBegin(); it != part.CEnd(); ++it) {
+                merged.Insert(merged.CEnd(), *it);
+            }
+        }
+        checksum += merged.Size();
+    });
+    Report("BenchRepartitionInsert" + std::to_string(shards), size, shards, insert_seconds);
+    double split_seconds = MeasureSeconds([&] {
+        std::vector<MapAVL<int, int>> parts;
+        for (size_t i = shards - 1; i > 0; --i) {
+            parts.push_back(map_avl.Split(static_cast<int>(i) * step));
+        }
+        for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+            map_avl.Join(std::move(*it));
+        }
+        checksum += map_avl.Size();
+    });
+    Report("BenchRepartitionSplitJoin" + std::to_string(shards), size, shards, split_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Copies a map built by random inserts, as a snapshot for persistence does: the copy
+// constructor with std::allocator and with PoolAllocator, and the copy on a TaskPool with
+// one thread per core.
+void BenchCopy(size_t size) {
+    auto keys = GenerateShuffledKeys(size, 57);
+    MapAVL<int, int> map_avl;
+    MapAVL<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>> pooled;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+        pooled.Insert({key, key});
+    }
+    size_t checksum = 0;
+    double copy_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> copy(map_avl);
+        checksum += copy.Size();
+    });
+    Report("BenchCopyStdAllocator", size, size, copy_seconds);
+    double pool_seconds = MeasureSeconds([&] {
+        auto copy = pooled;
+        checksum += copy.Size();
+    });
+    Report("BenchCopyPoolAllocator", size, size, pool_seconds);
+    TaskPool pool;
+    double parallel_seconds = MeasureSeconds([&] {
+        MapAVL<int, int> copy(map_avl, pool);
+        checksum += copy.Size();
+    });
+    Report("BenchCopyParallel" + std::to_string(pool.Size()), size, size, parallel_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+void BenchErase(size_t size) {
+    auto keys = GenerateShuffledKeys(size, 46);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    auto probes = GenerateShuffledKeys(size, 47);
+    double seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            map_avl.Erase(key);
+        }
+    });
+    Report("BenchErase", size, probes.size(), seconds);
+}
+
+// Evicts batches of consecutive keys, as a cache dropping its oldest entries would.
+void BenchEraseRange(size_t size, size_t batch) {
+    auto keys = GenerateShuffledKeys(size, 48);
+    MapAVL<int, int> map_avl;
+    for (int key : keys) {
+        map_avl.Insert({key, key});
+    }
+    const size_t batches = size / batch / 2;
+    std::mt19937 gen(49);
+    std::uniform_int_distribution<int> dis(0, static_cast<int>(size));
+    double seconds = MeasureSeconds([&] {
+        for (size_t i = 0; i < batches; ++i) {
+            auto first = map_avl.LowerBound(dis(gen));
+            auto last = first;
+            for (size_t j = 0; j < batch && last != map_avl.End(); ++j) {
+                ++last;
+            }
+            map_avl.Erase(first, last);
+        }
+    });
+    Report("BenchEraseRange" + std::to_string(batch), size, size - map_avl.Size(), seconds);
+}
+
+template <typename Allocator>
+void BenchInsertAndDestroy(const std::string& name, size_t size) {
+    auto keys = GenerateShuffledKeys(size, 45);
+    auto map_avl = std::make_unique<MapAVL<int, int, std::less<int>, Allocator>>();
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            map_avl->Insert({key, key});
+        }
+    });
+    Report(name + "Insert", size, size, insert_seconds);
+    double destroy_seconds = MeasureSeconds([&] { map_avl.reset(); });
+    Report(name + "Destroy", size, size, destroy_seconds);
+}
+
+// Insert, find and iterate over a threaded and an unthreaded tree. The unthreaded nodes are
+// 16 bytes smaller and skip the thread updates on insert; their iterators walk parent links.
+template <typename Threading>
+void BenchThreading(const std::string& name, size_t size) {
+    using Map = MapAVL<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                       NoAugmentation, Threading>;
+    auto keys = GenerateShuffledKeys(size, 46);
+    Map map_avl;
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            map_avl.Insert({key, key});
+        }
+    });
+    Report(name + "Insert", size, size, insert_seconds);
+    auto probes = GenerateShuffledKeys(size, 47);
+    long long checksum = 0;
+    double find_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += map_avl.Find(key)->second;
+        }
+    });
+    Report(name + "Find", size, size, find_seconds);
+    const size_t rounds = 5;
+    double iterate_seconds = MeasureSeconds([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            for (auto it = map_avl.CBegin(); it != map_avl.CEnd(); ++it) {
+                checksum += it->second;
+            }
+        }
+    });
+    Report(name + "Iterate", size, rounds * size, iterate_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchFind(size);
+        BenchIterate(size);
+        BenchFindBatch(size, 16);
+        BenchFindBatch(size, 256);
+        BenchLowerBoundSorted(size, 1);
+        BenchLowerBoundSorted(size, 64);
+        BenchBuildSorted(size);
+        BenchAppendSorted(size);
+        BenchHeavyValue(16'384, size);
+        BenchPercentile(size);
+        BenchRangeSum(size, 16);
+        BenchRangeSum(size, 4096);
+        BenchSplitJoin(size, 16);
+        BenchCopy(size);
+        BenchErase(size);
+        BenchEraseRange(size, 16);
+        BenchEraseRange(size, 4096);
+        BenchInsertAndDestroy<std::allocator<std::pair<const int, int>>>("StdAllocator", size);
+        BenchInsertAndDestroy<PoolAllocator<std::pair<const int, int>>>("PoolAllocator", size);
+        BenchThreading<Threaded>("Threaded", size);
+        BenchThreading<Unthreaded>("Unthreaded", size);
+    }
+}
@@ -1,10 +1,19 @@
 #include "MapAVL.h"
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <compare>
 #include <iostream>
 #include <map>
+#include <memory_resource>
+#include <numeric>
 #include <random>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -1044,6 +1053,1140 @@ void TestLogarithmicAVLHeightProperty() {
     std::cout << "TestLogarithmicAVLHeightProperty passed\n";
 }
 
+template <typename Map>
+void CheckSameAsStdMap(const Map& map_avl, const std::map<int, int>& expected) {
+    assert(map_avl.Size() == expected.size());
+    assert(map_avl.Empty() == expected.empty());
+    assert(CheckNodeBalance(map_avl.GetRootPtr()) >= 0);
+    assert(map_avl.GetRootPtr() == nullptr || map_avl.GetRootPtr()->GetParent() == nullptr);
+    auto it = map_avl.Begin();
+    for (const auto& [key, value] : expected) {
+        assert(it->first == key && it->second == value);
+        ++it;
+    }
+    assert(it == map_avl.End());
+    auto rit = map_avl.RBegin();
+    for (auto jt = expected.rbegin(); jt != expected.rend(); ++jt) {
+        assert(rit->first == jt->first);
+        ++rit;
+    }
+    assert(rit == map_avl.REnd());
+}
+
+void TestEraseKey() {
+    MapAVL<int, int> map_avl;
+    std::map<int, int> expected;
+    assert(map_avl.Erase(1) == 0);
+    auto input = GenerateRandomVector(5000, -2000, 2000, 70);
+    for (int val : input) {
+        map_avl.Insert({val, val * 2});
+        expected.insert({val, val * 2});
+    }
+    auto to_erase = GenerateRandomVector(5000, -2100, 2100, 71);
+    for (size_t i = 0; i < to_erase.size(); ++i) {
+        assert(map_avl.Erase(to_erase[i]) == expected.erase(to_erase[i]));
+        if (i % 250 == 0) {
+            CheckSameAsStdMap(map_avl, expected);
+        }
+    }
+    CheckSameAsStdMap(map_avl, expected);
+    for (int key : input) {
+        map_avl.Erase(key);
+    }
+    assert(map_avl.Empty());
+    assert(map_avl.Begin() == map_avl.End());
+    map_avl.Insert({1, 1});
+    assert(map_avl.Begin()->first == 1);
+    assert(++map_avl.Begin() == map_avl.End());
+
+    MapAVL<int, int> sequential;
+    for (int i = 0; i < 1000; ++i) {
+        sequential.Insert({i, i});
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        assert(sequential.Erase(i) == 1);
+        assert(CheckNodeBalance(sequential.GetRootPtr()) >= 0);
+    }
+    assert(sequential.Size() == 500);
+    assert(sequential.Begin()->first == 1);
+    assert(sequential.RBegin()->first == 999);
+    std::cout << "TestEraseKey passed\n";
+}
+
+void TestEraseIterator() {
+    MapAVL<int, int> map_avl;
+    std::map<int, int> expected;
+    for (int val : GenerateRandomVector(3000, 0, 10000, 72)) {
+        map_avl.Insert({val, val});
+        expected.insert({val, val});
+    }
+    MapAVL<int, int>::Iterator kept = map_avl.Find(expected.rbegin()->first);
+    auto it = map_avl.Begin();
+    auto jt = expected.begin();
+    while (it != map_avl.End()) {
+        it = map_avl.Erase(it);
+        jt = expected.erase(jt);
+        assert((it == map_avl.End()) == (jt == expected.end()));
+        if (it != map_avl.End()) {
+            assert(it->first == jt->first);
+            ++it;
+            ++jt;
+        }
+    }
+    CheckSameAsStdMap(map_avl, expected);
+    assert(kept->first == expected.rbegin()->first);
+
+    MapAVL<int, int>::ConstIterator last = map_avl.Find(expected.begin()->first);
+    auto next = map_avl.Erase(last);
+    expected.erase(expected.begin());
+    assert(next->first == expected.begin()->first);
+    CheckSameAsStdMap(map_avl, expected);
+
+    bool thrown = false;
+    try {
+        map_avl.Erase(map_avl.End());
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    CheckSameAsStdMap(map_avl, expected);
+    std::cout << "TestEraseIterator passed\n";
+}
+
+void TestEraseRange() {
+    std::mt19937 gen(73);
+    for (size_t size : {1, 2, 10, 100, 1000, 5000}) {
+        for (int round = 0; round < 20; ++round) {
+            MapAVL<int, int> map_avl;
+            std::map<int, int> expected;
+            for (int val : GenerateRandomVector(size, 0, static_cast<int>(size) * 4, round)) {
+                map_avl.Insert({val, val});
+                expected.insert({val, val});
+            }
+            std::uniform_int_distribution<size_t> dis(0, expected.size());
+            size_t from = dis(gen);
+            size_t to = dis(gen);
+            if (from > to) {
+                std::swap(from, to);
+            }
+            auto first = map_avl.Begin();
+            auto jt_first = expected.begin();
+            for (size_t i = 0; i < from; ++i, ++first, ++jt_first) {
+            }
+            auto last = first;
+            auto jt_last = jt_first;
+            for (size_t i = from; i < to; ++i, ++last, ++jt_last) {
+            }
+            auto result = map_avl.Erase(first, last);
+            auto jt_result = expected.erase(jt_first, jt_last);
+            assert(result == last);
+            assert((result == map_avl.End()) == (jt_result == expected.end()));
+            CheckSameAsStdMap(map_avl, expected);
+            for (int val : GenerateRandomVector(size / 2, 0, static_cast<int>(size) * 4, 100)) {
+                map_avl.Insert({val, val});
+                expected.insert({val, val});
+            }
+            CheckSameAsStdMap(map_avl, expected);
+        }
+    }
+
+    MapAVL<int, int> map_avl;
+    for (int i = 0; i < 100; ++i) {
+        map_avl.Insert({i, i});
+    }
+    auto result = map_avl.Erase(map_avl.Begin(), map_avl.End());
+    assert(result == map_avl.End());
+    assert(map_avl.Empty());
+    map_avl.Insert({5, 5});
+    map_avl.Erase(map_avl.Begin(), map_avl.Begin());
+    assert(map_avl.Size() == 1);
+    std::cout << "TestEraseRange passed\n";
+}
+
+struct ThrowingValue {
+    static inline int copies_left = 0;
+    int value = 0;
+    ThrowingValue(int value) : value(value) {
+    }
+    ThrowingValue(const ThrowingValue& other) : value(other.value) {
+        if (--copies_left < 0) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    bool operator!=(const ThrowingValue& other) const {
+        return value != other.value;
+    }
+};
+
+// Key whose copy throws once copies_left runs out. live counts the keys in existence, so a
+// node that is not freed after a failed copy shows up as a leak.
+struct ThrowingKey {
+    static inline std::atomic<int> copies_left = 0;
+    static inline std::atomic<int> live = 0;
+    int value = 0;
+    ThrowingKey(int value) : value(value) {
+        ++live;
+    }
+    ThrowingKey(const ThrowingKey& other) : value(other.value) {
+        if (--copies_left < 0) {
+            throw std::runtime_error("copy failed");
+        }
+        ++live;
+    }
+    ~ThrowingKey() {
+        --live;
+    }
+    bool operator<(const ThrowingKey& other) const {
+        return value < other.value;
+    }
+};
+
+// Copies map with the key copy failing after each of copies, and checks that every failed
+// copy throws and frees all it has built.
+template <typename Map, typename MakeCopy>
+void CheckCopyThrows(const Map& map, const std::vector<int>& copies, MakeCopy make_copy) {
+    const int live = ThrowingKey::live;
+    for (int count : copies) {
+        ThrowingKey::copies_left = count;
+        bool thrown = false;
+        try {
+            make_copy(map);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && ThrowingKey::live == live);
+    }
+    ThrowingKey::copies_left = static_cast<int>(map.Size());
+    Map copy = make_copy(map);
+    assert(copy == map && ThrowingKey::live == live + static_cast<int>(map.Size()));
+}
+
+void TestCopyThrowing() {
+    using ThrowingMap = MapAVL<ThrowingKey, int>;
+    ThrowingKey::copies_left = 1000;
+    ThrowingMap map;
+    for (int i = 0; i < 200; ++i) {
+        map.Insert({ThrowingKey(i), i});
+    }
+    CheckCopyThrows(map, {0, 1, 2, 3, 57, 100, 199},
+                    [](const ThrowingMap& source) { return ThrowingMap(source); });
+    std::cout << "TestCopyThrowing passed\n";
+}
+
+void TestInsertSorted() {
+    for (int size = 0; size <= 300; ++size) {
+        std::vector<std::pair<int, int>> input;
+        std::map<int, int> expected;
+        for (int i = 0; i < size; ++i) {
+            input.emplace_back(i * 3, i);
+            expected.insert({i * 3, i});
+        }
+        MapAVL<int, int> map_avl(input.begin(), input.end());
+        CheckSameAsStdMap(map_avl, expected);
+        assert(CalcNodeHeight(map_avl.GetRootPtr()) ==
+               static_cast<size_t>(std::bit_width(static_cast<size_t>(size))));
+        map_avl.Insert({1, 1});
+        expected.insert({1, 1});
+        map_avl.Erase(0);
+        expected.erase(0);
+        CheckSameAsStdMap(map_avl, expected);
+    }
+
+    std::vector<std::pair<int, int>> with_duplicates = {{1, 1}, {1, 2}, {2, 3}, {2, 4}, {5, 5}};
+    MapAVL<int, int> deduplicated;
+    deduplicated.Insert(with_duplicates.begin(), with_duplicates.end());
+    CheckSameAsStdMap(deduplicated, {{1, 1}, {2, 3}, {5, 5}});
+
+    auto keys = GenerateRandomVector(2000, 0, 100000, 74);
+    std::sort(keys.begin(), keys.begin() + 1500);
+    std::vector<std::pair<int, int>> partly_sorted;
+    std::map<int, int> expected;
+    for (int key : keys) {
+        partly_sorted.emplace_back(key, -key);
+        expected.insert({key, -key});
+    }
+    MapAVL<int, int> map_avl(partly_sorted.begin(), partly_sorted.end());
+    CheckSameAsStdMap(map_avl, expected);
+    map_avl.Insert(partly_sorted.begin(), partly_sorted.end());
+    CheckSameAsStdMap(map_avl, expected);
+
+    std::vector<std::pair<int, std::string>> strings;
+    for (int i = 0; i < 100; ++i) {
+        strings.emplace_back(i, std::string(40, static_cast<char>('a' + i % 26)));
+    }
+    MapAVL<int, std::string> moved(std::make_move_iterator(strings.begin()),
+                                   std::make_move_iterator(strings.end()));
+    assert(moved.Size() == 100);
+    assert(moved.Find(27)->second == std::string(40, 'b'));
+    assert(strings[27].second.empty());
+
+    ThrowingValue::copies_left = 1000;
+    std::vector<std::pair<int, ThrowingValue>> throwing;
+    for (int i = 0; i < 100; ++i) {
+        throwing.emplace_back(i, ThrowingValue(i));
+    }
+    ThrowingValue::copies_left = 60;
+    MapAVL<int, ThrowingValue> partial;
+    bool thrown = false;
+    try {
+        partial.Insert(throwing.begin(), throwing.end());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(partial.Size() == 60);
+    assert(CheckNodeBalance(partial.GetRootPtr()) >= 0);
+    assert(partial.RBegin()->first == 59);
+    ThrowingValue::copies_left = 10;
+    thrown = false;
+    try {
+        MapAVL<int, ThrowingValue> failed(throwing.begin(), throwing.end());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::cout << "TestInsertSorted passed\n";
+}
+
+void TestPoolAllocator() {
+    using PoolMap = MapAVL<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>>;
+    auto input = GenerateRandomVector(10000, -5000, 5000, 60);
+    std::map<int, int> expected;
+    PoolMap map_avl;
+    for (int val : input) {
+        map_avl.Insert({val, val * 2});
+        expected.insert({val, val * 2});
+    }
+    assert(map_avl.Size() == expected.size());
+    auto it = map_avl.Begin();
+    for (const auto& [key, value] : expected) {
+        assert(it->first == key && it->second == value);
+        ++it;
+    }
+    assert(map_avl.GetAllocator().GetArena()->ChunkCount() > 0);
+
+    PoolMap copy(map_avl);
+    assert(copy == map_avl);
+    assert(copy.GetAllocator() != map_avl.GetAllocator());
+    assert(copy.GetAllocator().GetArena()->ChunkCount() == 1);
+    for (auto prev = copy.Begin(), jt = ++copy.Begin(); jt != copy.End(); ++prev, ++jt) {
+        assert(std::less<const void*>()(std::addressof(*prev), std::addressof(*jt)));
+    }
+
+    PoolMap moved(std::move(copy));
+    assert(moved == map_avl);
+    assert(copy.Empty());
+    copy.Insert({1, 1});
+    assert(copy.Size() == 1);
+
+    PoolMap assigned;
+    assigned = map_avl;
+    assert(assigned == map_avl);
+    assigned = std::move(moved);
+    assert(assigned == map_avl);
+
+    map_avl.Clear();
+    assert(map_avl.Empty());
+    assert(map_avl.Begin() == map_avl.End());
+    assert(map_avl.GetAllocator().GetArena()->ChunkCount() == 0);
+    for (int val : input) {
+        map_avl.Insert({val, val * 2});
+    }
+    assert(map_avl == assigned);
+
+    PoolAllocator<std::pair<const int, int>> shared_pool;
+    PoolMap first(std::less<int>(), shared_pool);
+    PoolMap second(std::less<int>(), shared_pool);
+    for (int i = 0; i < 1000; ++i) {
+        first.Insert({i, i});
+        second.Insert({-i, i});
+    }
+    first.Clear();
+    assert(second.Size() == 1000);
+    assert(second.Find(-999)->second == 999);
+    first.Swap(second);
+    assert(first.Size() == 1000 && second.Empty());
+    std::cout << "TestPoolAllocator passed\n";
+}
+
+void TestPmrAllocator() {
+    using PmrMap = MapAVL<int, std::pmr::string, std::less<int>,
+                          std::pmr::polymorphic_allocator<std::pair<const int, std::pmr::string>>>;
+    std::pmr::monotonic_buffer_resource first_resource;
+    std::pmr::unsynchronized_pool_resource second_resource;
+    auto input = GenerateRandomVector(1000, -500, 500, 61);
+    std::map<int, std::string> expected;
+
+    PmrMap map_avl(&first_resource);
+    for (int val : input) {
+        map_avl.Insert({val, std::pmr::string(std::to_string(val) + " long enough for the heap")});
+        expected.insert({val, std::to_string(val) + " long enough for the heap"});
+    }
+    assert(map_avl.GetAllocator().resource() == &first_resource);
+    auto check = [&expected](const PmrMap& map) {
+        assert(map.Size() == expected.size());
+        auto it = map.Begin();
+        for (const auto& [key, value] : expected) {
+            assert(it->first == key && std::string_view(it->second) == value);
+            ++it;
+        }
+    };
+    check(map_avl);
+
+    PmrMap copy(map_avl);
+    assert(copy.GetAllocator().resource() == std::pmr::get_default_resource());
+    check(copy);
+
+    PmrMap other(&second_resource);
+    other.Insert({1, "one"});
+    other = std::move(map_avl);
+    assert(other.GetAllocator().resource() == &second_resource);
+    assert(map_avl.Empty());
+    check(other);
+
+    PmrMap same(&second_resource);
+    same = std::move(other);
+    assert(other.Empty());
+    check(same);
+    std::cout << "TestPmrAllocator passed\n";
+}
+
+void TestFindBatch() {
+    MapAVL<int, int> map_avl;
+    for (int val : GenerateRandomVector(5000, -10000, 10000, 77)) {
+        map_avl.Insert({val, val});
+    }
+    const auto& const_map = map_avl;
+    for (size_t size : {0, 1, 15, 16, 17, 1000}) {
+        auto keys = GenerateRandomVector(size, -11000, 11000, static_cast<unsigned>(size));
+        std::vector<MapAVL<int, int>::Iterator> found(size, map_avl.End());
+        std::vector<MapAVL<int, int>::ConstIterator> const_found(size, const_map.End());
+        std::vector<MapAVL<int, int>::Iterator> bounds(size, map_avl.End());
+        std::vector<MapAVL<int, int>::ConstIterator> const_bounds(size, const_map.End());
+        std::unique_ptr<bool[]> contained(new bool[size]);
+        map_avl.FindBatch(keys, found);
+        const_map.FindBatch(keys, const_found);
+        map_avl.LowerBoundBatch(keys, bounds);
+        const_map.LowerBoundBatch(keys, const_bounds);
+        const_map.ContainsBatch(keys, std::span<bool>(contained.get(), size));
+        for (size_t i = 0; i < size; ++i) {
+            assert(found[i] == map_avl.Find(keys[i]));
+            assert(const_found[i] == const_map.Find(keys[i]));
+            assert(bounds[i] == map_avl.LowerBound(keys[i]));
+            assert(const_bounds[i] == const_map.LowerBound(keys[i]));
+            assert(contained[i] == map_avl.Contains(keys[i]));
+        }
+    }
+
+    MapAVL<int, int> empty;
+    std::vector<int> keys = {1, 2, 3};
+    std::vector<MapAVL<int, int>::Iterator> results(keys.size(), map_avl.Begin());
+    empty.FindBatch(keys, results);
+    for (const auto& it : results) {
+        assert(it == empty.End());
+    }
+    bool thrown = false;
+    try {
+        empty.LowerBoundBatch(keys, std::span(results).first(2));
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::cout << "TestFindBatch passed\n";
+}
+
+void TestLowerBoundHint() {
+    MapAVL<int, int> map_avl;
+    for (int val : GenerateRandomVector(2000, 0, 10000, 78)) {
+        map_avl.Insert({val, val});
+    }
+    const auto& const_map = map_avl;
+    std::vector<MapAVL<int, int>::ConstIterator> hints;
+    for (auto it = map_avl.CBegin(); it != map_avl.CEnd(); ++it) {
+        hints.push_back(it);
+    }
+    hints.push_back(map_avl.CEnd());
+    auto probes = GenerateRandomVector(200, -100, 10100, 79);
+    for (size_t i = 0; i < hints.size(); i += 7) {
+        for (int key : probes) {
+            assert(map_avl.LowerBound(hints[i], key) == map_avl.LowerBound(key));
+            assert(const_map.LowerBound(hints[i], key) == map_avl.LowerBound(key));
+        }
+    }
+
+    for (bool sorted : {true, false}) {
+        auto keys = GenerateRandomVector(3000, -100, 10100, 80);
+        if (sorted) {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::vector<MapAVL<int, int>::Iterator> results(keys.size(), map_avl.End());
+        std::vector<MapAVL<int, int>::ConstIterator> const_results(keys.size(), map_avl.CEnd());
+        map_avl.LowerBoundSorted(keys, results);
+        const_map.LowerBoundSorted(keys, const_results);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            assert(results[i] == map_avl.LowerBound(keys[i]));
+            assert(const_results[i] == map_avl.LowerBound(keys[i]));
+        }
+    }
+
+    MapAVL<int, int> empty;
+    assert(empty.LowerBound(empty.CEnd(), 5) == empty.End());
+    std::vector<int> keys = {1, 2};
+    std::vector<MapAVL<int, int>::Iterator> results(keys.size(), map_avl.End());
+    empty.LowerBoundSorted(keys, results);
+    assert(results[0] == empty.End() && results[1] == empty.End());
+    std::cout << "TestLowerBoundHint passed\n";
+}
+
+void TestInsertHint() {
+    MapAVL<int, int> appended;
+    std::map<int, int> expected;
+    for (int i = 0; i < 1000; ++i) {
+        auto it = appended.Insert(appended.CEnd(), {i * 2, i});
+        assert(it->first == i * 2);
+        expected[i * 2] = i;
+    }
+    CheckSameAsStdMap(appended, expected);
+    auto prev = appended.Find(998);
+    for (int i = 0; i < 1000; i += 2) {
+        prev = appended.Insert(prev, {999 - i, -i});
+        assert(prev->first == 999 - i);
+        expected[999 - i] = -i;
+    }
+    CheckSameAsStdMap(appended, expected);
+    auto duplicate = appended.Insert(appended.CBegin(), {4, 100});
+    assert(duplicate->first == 4 && duplicate->second == 2);
+
+    MapAVL<int, int> map_avl;
+    expected.clear();
+    std::mt19937 gen(81);
+    std::uniform_int_distribution<int> dis(0, 3000);
+    for (int i = 0; i < 3000; ++i) {
+        auto hint = map_avl.LowerBound(dis(gen));
+        if (i % 3 == 0 && hint != map_avl.End()) {
+            ++hint;
+        }
+        int key = dis(gen);
+        auto it = map_avl.End();
+        if (i % 2 == 0) {
+            it = map_avl.Insert(hint, {key, i});
+        } else {
+            it = map_avl.EmplaceHint(hint, key, i);
+        }
+        expected.insert({key, i});
+        assert(it->first == key && it->second == expected[key]);
+        if (i % 500 == 0) {
+            CheckSameAsStdMap(map_avl, expected);
+        }
+    }
+    CheckSameAsStdMap(map_avl, expected);
+
+    MapAVL<std::string, std::string> strings;
+    auto it = strings.EmplaceHint(strings.CEnd(), std::piecewise_construct,
+                                  std::forward_as_tuple(3, 'a'), std::forward_as_tuple("x"));
+    assert(it->first == "aaa" && it->second == "x");
+    it = strings.EmplaceHint(it, "aaa", "y");
+    assert(strings.Size() == 1 && it->second == "x");
+    it = strings.EmplaceHint(it, "b", "z");
+    assert(strings.Size() == 2 && it == --strings.End());
+    std::cout << "TestInsertHint passed\n";
+}
+
+// Counts how many values were built, to check that a present key builds none.
+struct CountedValue {
+    static inline int constructed = 0;
+    std::string text;
+    explicit CountedValue(std::string text_value) : text(std::move(text_value)) {
+        ++constructed;
+    }
+    CountedValue(size_t count, char symbol) : text(count, symbol) {
+        ++constructed;
+    }
+    CountedValue(const CountedValue& other) : text(other.text) {
+        ++constructed;
+    }
+    CountedValue& operator=(const CountedValue& other) = default;
+};
+
+void TestEmplace() {
+    MapAVL<int, CountedValue> map;
+    CountedValue::constructed = 0;
+    auto [it, inserted] = map.Emplace(1, "one");
+    assert(inserted && it->first == 1 && it->second.text == "one");
+    std::tie(it, inserted) = map.Emplace(1, "uno");
+    assert(!inserted && it->second.text == "one");
+    assert(CountedValue::constructed == 1);
+    std::tie(it, inserted) = map.Emplace(std::piecewise_construct, std::forward_as_tuple(2),
+                                         std::forward_as_tuple(3, 'b'));
+    assert(inserted && it->second.text == "bbb");
+    std::tie(it, inserted) = map.Emplace(std::make_pair(2, CountedValue("two")));
+    assert(!inserted && it->second.text == "bbb");
+
+    CountedValue::constructed = 0;
+    std::tie(it, inserted) = map.TryEmplace(3, 2, 'c');
+    assert(inserted && it->first == 3 && it->second.text == "cc");
+    std::tie(it, inserted) = map.TryEmplace(3, 5, 'x');
+    assert(!inserted && it->second.text == "cc");
+    assert(CountedValue::constructed == 1);
+
+    std::tie(it, inserted) = map.InsertOrAssign(0, CountedValue("zero"));
+    assert(inserted && it == map.Begin() && it->second.text == "zero");
+    std::tie(it, inserted) = map.InsertOrAssign(3, CountedValue("three"));
+    assert(!inserted && it->second.text == "three");
+    assert(map.Size() == 4);
+
+    MapAVL<std::string, std::string> strings;
+    std::string key = "key";
+    std::string value = "value";
+    strings.TryEmplace(std::move(key), std::move(value));
+    assert(key.empty() && value.empty() && strings.Find("key")->second == "value");
+    std::string taken = "value";
+    strings.TryEmplace("key", std::move(taken));
+    assert(taken == "value");
+
+    std::map<int, int> expected;
+    MapAVL<int, int> random;
+    std::mt19937 gen(82);
+    std::uniform_int_distribution<int> dis(0, 500);
+    for (int i = 0; i < 2000; ++i) {
+        int key = dis(gen);
+        if (i % 3 == 0) {
+            random.Emplace(key, i);
+            expected.emplace(key, i);
+        } else if (i % 3 == 1) {
+            random.TryEmplace(key, i);
+            expected.try_emplace(key, i);
+        } else {
+            random.InsertOrAssign(key, i);
+            expected.insert_or_assign(key, i);
+        }
+    }
+    CheckSameAsStdMap(random, expected);
+    std::cout << "TestEmplace passed\n";
+}
+
+void TestTransparentLookup() {
+    MapAVL<std::string, int, std::less<>> map_avl;
+    for (int i = 0; i < 100; ++i) {
+        map_avl.Insert({"key" + std::to_string(i * 2), i});
+    }
+    const auto& const_map = map_avl;
+    std::string_view present = "key10";
+    assert(map_avl.Find(present) == map_avl.Find(std::string("key10")));
+    assert(map_avl.Find(present) != map_avl.End());
+    assert(const_map.Find("key10") == map_avl.Find(present));
+    assert(map_avl.Find(std::string_view("key11")) == map_avl.End());
+    assert(map_avl.Contains("key0") && !map_avl.Contains(std::string_view("key")));
+    assert(map_avl.Count(std::string_view("key4")) == 1 && const_map.Count("key5") == 0);
+    for (const char* probe : {"", "key", "key1", "key10", "key11", "key98", "key99", "z"}) {
+        std::string key = probe;
+        std::string_view view = probe;
+        assert(map_avl.LowerBound(view) == map_avl.LowerBound(key));
+        assert(const_map.LowerBound(probe) == map_avl.LowerBound(key));
+        assert(map_avl.UpperBound(view) == map_avl.UpperBound(key));
+        assert(const_map.UpperBound(probe) == map_avl.UpperBound(key));
+        assert(map_avl.EqualRange(view) == map_avl.EqualRange(key));
+        assert(const_map.EqualRange(probe).first == map_avl.LowerBound(key));
+    }
+
+    MapAVL<std::string, int> plain;
+    plain.Insert({"key", 1});
+    assert(plain.Find("key") != plain.End() && plain.Contains("key"));
+    std::cout << "TestTransparentLookup passed\n";
+}
+
+// Counts its comparisons, whether made through operator< or operator<=>.
+struct CountedInt {
+    static inline size_t comparisons = 0;
+    int value;
+
+    friend bool operator<(const CountedInt& lhs, const CountedInt& rhs) {
+        ++comparisons;
+        return lhs.value < rhs.value;
+    }
+    friend std::strong_ordering operator<=>(const CountedInt& lhs, const CountedInt& rhs) {
+        ++comparisons;
+        return lhs.value <=> rhs.value;
+    }
+    friend bool operator==(const CountedInt& lhs, const CountedInt& rhs) {
+        ++comparisons;
+        return lhs.value == rhs.value;
+    }
+};
+
+struct CountedIntLess {
+    bool operator()(const CountedInt& lhs, const CountedInt& rhs) const {
+        return lhs < rhs;
+    }
+};
+
+template <typename Compare>
+void CheckComparisonsPerLevel() {
+    MapAVL<CountedInt, int, Compare> map_avl;
+    for (int val : GenerateRandomVector(1000, 0, 5000, 83)) {
+        map_avl.Insert({CountedInt{val * 2}, val});
+    }
+    size_t levels = static_cast<size_t>(CheckNodeBalance(map_avl.GetRootPtr()));
+    for (int val : GenerateRandomVector(200, -10, 10010, 84)) {
+        CountedInt key{val};
+        CountedInt::comparisons = 0;
+        auto it = map_avl.Find(key);
+        assert(CountedInt::comparisons <= levels + 1);
+        CountedInt::comparisons = 0;
+        auto bound = map_avl.LowerBound(key);
+        assert(CountedInt::comparisons <= levels);
+        assert(it == map_avl.End() || it == bound);
+        CountedInt::comparisons = 0;
+        bool inserted = map_avl.Insert({key, val}).second;
+        assert(CountedInt::comparisons <= levels + 1);
+        assert(inserted == (it == map_avl.End()));
+        map_avl.Erase(key);
+        if (!inserted) {
+            map_avl.Insert({key, val / 2});
+        }
+    }
+}
+
+void TestComparisonsPerLevel() {
+    CheckComparisonsPerLevel<CountedIntLess>();
+    CheckComparisonsPerLevel<std::less<CountedInt>>();
+    std::cout << "TestComparisonsPerLevel passed\n";
+}
+
+// Recounts every subtree and compares it against the size stored in its root.
+size_t CheckSubtreeSizes(const MapNode<int, int, OrderStatistics>* node) {
+    if (node == nullptr) {
+        return 0;
+    }
+    size_t size = 1 + CheckSubtreeSizes(node->GetLeft()) + CheckSubtreeSizes(node->GetRight());
+    assert(node->GetSummary() == size);
+    return size;
+}
+
+using RankedMap = MapAVL<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                         OrderStatistics>;
+
+// Checks every order statistic of the map against a sorted vector of its keys.
+void CheckOrderStatistics(const RankedMap& map_avl, const std::vector<int>& keys) {
+    assert(CheckSubtreeSizes(map_avl.GetRootPtr()) == keys.size());
+    assert(map_avl.Nth(keys.size()) == map_avl.End());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto it = map_avl.Nth(i);
+        assert(it->first == keys[i]);
+        assert(it - map_avl.Begin() == static_cast<std::ptrdiff_t>(i));
+        assert(map_avl.Begin() + static_cast<std::ptrdiff_t>(i) == it);
+        assert(map_avl.End() - static_cast<std::ptrdiff_t>(keys.size() - i) == it);
+        assert(map_avl.Rank(keys[i]) == i);
+        size_t below = std::lower_bound(keys.begin(), keys.end(), keys[i] + 1) - keys.begin();
+        assert(map_avl.Rank(keys[i] + 1) == below);
+    }
+    assert(map_avl.End() - map_avl.Begin() == static_cast<std::ptrdiff_t>(keys.size()));
+}
+
+void TestOrderStatistics() {
+    RankedMap map_avl;
+    std::vector<int> keys;
+    CheckOrderStatistics(map_avl, keys);
+    std::mt19937 gen(91);
+    std::uniform_int_distribution<int> dis(0, 2000);
+    for (int i = 0; i < 1000; ++i) {
+        int key = dis(gen);
+        if (map_avl.Insert({key, i}).second) {
+            keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+        }
+    }
+    CheckOrderStatistics(map_avl, keys);
+    for (int i = 0; i < 300; ++i) {
+        int key = dis(gen);
+        if (map_avl.Erase(key) != 0) {
+            keys.erase(std::lower_bound(keys.begin(), keys.end(), key));
+        }
+        auto hint = map_avl.LowerBound(dis(gen));
+        int inserted = dis(gen);
+        if (!map_avl.Contains(inserted)) {
+            map_avl.Insert(hint, {inserted, i});
+            keys.insert(std::lower_bound(keys.begin(), keys.end(), inserted), inserted);
+        }
+    }
+    CheckOrderStatistics(map_avl, keys);
+
+    for (int lower = -10; lower < 2010; lower += 97) {
+        for (int upper = lower - 50; upper < 2010; upper += 301) {
+            size_t expected = 0;
+            if (lower < upper) {
+                expected = std::lower_bound(keys.begin(), keys.end(), upper) -
+                           std::lower_bound(keys.begin(), keys.end(), lower);
+            }
+            assert(map_avl.CountRange(lower, upper) == expected);
+        }
+    }
+
+    auto first = map_avl.Nth(100);
+    auto last = first + 400;
+    map_avl.Erase(first, last);
+    keys.erase(keys.begin() + 100, keys.begin() + 500);
+    CheckOrderStatistics(map_avl, keys);
+
+    RankedMap copy(map_avl);
+    CheckOrderStatistics(copy, keys);
+    std::vector<std::pair<int, int>> sorted(1000);
+    for (int i = 0; i < 1000; ++i) {
+        sorted[i] = {i, i};
+    }
+    RankedMap built(sorted.begin(), sorted.end());
+    std::vector<int> built_keys(1000);
+    std::iota(built_keys.begin(), built_keys.end(), 0);
+    CheckOrderStatistics(built, built_keys);
+
+    auto it = built.CBegin();
+    it += 500;
+    assert(it->first == 500);
+    it -= 200;
+    assert(it->first == 300);
+    bool thrown = false;
+    try {
+        it += 701;
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown && it->first == 300);
+    std::cout << "TestOrderStatistics passed\n";
+}
+
+// Concatenates the keys in order, so a summary combined out of order shows up.
+struct KeySequence {
+    using Summary = std::string;
+
+    static Summary Identity() {
+        return {};
+    }
+    static Summary Lift(const std::pair<const int, int>& key_value) {
+        return std::to_string(key_value.first) + ",";
+    }
+    static Summary Combine(const Summary& lhs, const Summary& rhs) {
+        return lhs + rhs;
+    }
+};
+
+template <typename Augment>
+using AugmentedMap =
+    MapAVL<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, Augment>;
+
+void TestAggregate() {
+    AugmentedMap<SumOfValues<int>> sums;
+    AugmentedMap<MinMaxOfValues<int>> extremes;
+    AugmentedMap<OrderStatistics> counts;
+    AugmentedMap<KeySequence> sequences;
+    std::map<int, int> expected;
+    auto check = [&] {
+        for (int lower = -5; lower < 520; lower += 37) {
+            for (int upper = lower - 20; upper < 520; upper += 53) {
+                int sum = 0;
+                MinMaxOfValues<int>::Summary min_max;
+                size_t count = 0;
+                std::string sequence;
+                for (auto it = expected.lower_bound(lower);
+                     lower < upper && it != expected.end() && it->first < upper; ++it) {
+                    sum += it->second;
+                    min_max = MinMaxOfValues<int>::Combine(min_max, {it->second, it->second});
+                    ++count;
+                    sequence += std::to_string(it->first) + ",";
+                }
+                assert(sums.Aggregate(lower, upper) == sum);
+                auto extreme = extremes.Aggregate(lower, upper);
+                assert(extreme.min == min_max.min && extreme.max == min_max.max);
+                assert(counts.Aggregate(lower, upper) == count);
+                assert(sequences.Aggregate(lower, upper) == sequence);
+            }
+        }
+        assert(counts.Aggregate() == expected.size());
+    };
+    check();
+    std::mt19937 gen(92);
+    std::uniform_int_distribution<int> dis(0, 500);
+    for (int i = 0; i < 400; ++i) {
+        int key = dis(gen);
+        int value = dis(gen) - 250;
+        sums.InsertOrAssign(key, value);
+        extremes.InsertOrAssign(key, value);
+        counts.InsertOrAssign(key, value);
+        sequences.InsertOrAssign(key, value);
+        expected[key] = value;
+    }
+    check();
+    for (int i = 0; i < 200; ++i) {
+        int key = dis(gen);
+        sums.Erase(key);
+        extremes.Erase(key);
+        counts.Erase(key);
+        sequences.Erase(key);
+        expected.erase(key);
+    }
+    check();
+    std::cout << "TestAggregate passed\n";
+}
+
+std::map<int, int> SplitStdMap(std::map<int, int>& map, int key) {
+    std::map<int, int> upper(map.lower_bound(key), map.end());
+    map.erase(map.lower_bound(key), map.end());
+    return upper;
+}
+
+void TestSplitJoin() {
+    std::map<int, int> expected;
+    MapAVL<int, int> map_avl;
+    for (int val : GenerateRandomVector(3000, -5000, 5000, 93)) {
+        map_avl.Insert({val, val * 3});
+        expected.insert({val, val * 3});
+    }
+    for (int key : {-6000, expected.begin()->first, -1234, 0, 17, expected.rbegin()->first, 6000}) {
+        MapAVL<int, int> lower = map_avl;
+        std::map<int, int> expected_lower = expected;
+        MapAVL<int, int> upper = lower.Split(key);
+        std::map<int, int> expected_upper = SplitStdMap(expected_lower, key);
+        CheckSameAsStdMap(lower, expected_lower);
+        CheckSameAsStdMap(upper, expected_upper);
+        lower.Join(std::move(upper));
+        CheckSameAsStdMap(lower, expected);
+        CheckSameAsStdMap(upper, {});
+        upper.Insert({1, 1});
+        CheckSameAsStdMap(upper, {{1, 1}});
+    }
+
+    MapAVL<int, int> left;
+    MapAVL<int, int> right;
+    for (int i = 0; i < 100; ++i) {
+        left.Insert({i, i});
+    }
+    for (int i = 0; i < 7; ++i) {
+        right.Insert({200 + i, i});
+    }
+    bool thrown = false;
+    try {
+        right.Join(std::move(left));
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown && left.Size() == 100 && right.Size() == 7);
+    left.Join({150, 150}, std::move(right));
+    std::map<int, int> joined;
+    for (int i = 0; i < 100; ++i) {
+        joined[i] = i;
+    }
+    joined[150] = 150;
+    for (int i = 0; i < 7; ++i) {
+        joined[200 + i] = i;
+    }
+    CheckSameAsStdMap(left, joined);
+
+    auto extracted = map_avl.ExtractRange(-1000, 2500);
+    std::map<int, int> expected_upper = SplitStdMap(expected, -1000);
+    std::map<int, int> expected_rest = SplitStdMap(expected_upper, 2500);
+    expected.insert(expected_rest.begin(), expected_rest.end());
+    CheckSameAsStdMap(extracted, expected_upper);
+    CheckSameAsStdMap(map_avl, expected);
+    CheckSameAsStdMap(map_avl.ExtractRange(10, 10), {});
+
+    RankedMap ranked;
+    std::vector<int> keys(500);
+    for (int i = 0; i < 500; ++i) {
+        ranked.Insert({i * 2, i});
+        keys[i] = i * 2;
+    }
+    RankedMap ranked_upper = ranked.Split(301);
+    CheckOrderStatistics(ranked, std::vector<int>(keys.begin(), keys.begin() + 151));
+    CheckOrderStatistics(ranked_upper, std::vector<int>(keys.begin() + 151, keys.end()));
+    ranked.Join(std::move(ranked_upper));
+    CheckOrderStatistics(ranked, keys);
+    std::cout << "TestSplitJoin passed\n";
+}
+
+void TestMerge() {
+    MapAVL<int, int> map_avl;
+    MapAVL<int, int> other;
+    std::map<int, int> expected;
+    std::map<int, int> expected_other;
+    for (int val : GenerateRandomVector(1000, 0, 3000, 94)) {
+        map_avl.Insert({val, 1});
+        expected.insert({val, 1});
+    }
+    for (int val : GenerateRandomVector(1000, 0, 3000, 95)) {
+        other.Insert({val, 2});
+        expected_other.insert({val, 2});
+    }
+    auto kept = map_avl.Find(expected.begin()->first);
+    map_avl.Merge(other);
+    expected.merge(expected_other);
+    CheckSameAsStdMap(map_avl, expected);
+    CheckSameAsStdMap(other, expected_other);
+    assert(kept == map_avl.Begin());
+
+    MapAVL<int, int> before;
+    MapAVL<int, int> after;
+    for (int i = 0; i < 50; ++i) {
+        before.Insert({-100 - i, i});
+        after.Insert({5000 + i, i});
+        expected.insert({-100 - i, i});
+        expected.insert({5000 + i, i});
+    }
+    map_avl.Merge(std::move(before));
+    map_avl.Merge(after);
+    CheckSameAsStdMap(map_avl, expected);
+    CheckSameAsStdMap(before, {});
+    CheckSameAsStdMap(after, {});
+
+    using PmrMap = MapAVL<int, int, std::less<int>,
+                          std::pmr::polymorphic_allocator<std::pair<const int, int>>>;
+    std::pmr::unsynchronized_pool_resource first_resource;
+    std::pmr::unsynchronized_pool_resource second_resource;
+    PmrMap first(&first_resource);
+    PmrMap second(&second_resource);
+    for (int i = 0; i < 100; ++i) {
+        first.Insert({i, i});
+        second.Insert({i + 50, -i});
+    }
+    first.Merge(second);
+    assert(first.Size() == 150 && second.Size() == 50);
+    assert(second.Begin()->first == 50 && (--second.End())->first == 99);
+    PmrMap third(&second_resource);
+    third.Insert({1000, 0});
+    first.Join(std::move(third));
+    assert(first.Size() == 151 && third.Empty() && (--first.End())->first == 1000);
+    std::cout << "TestMerge passed\n";
+}
+
+void TestParallel() {
+    TaskPool pool(4);
+    std::map<int, int> expected;
+    for (int val : GenerateRandomVector(100000, 0, 1000000, 96)) {
+        expected.insert({val, -val});
+    }
+    std::vector<std::pair<int, int>> sorted(expected.begin(), expected.end());
+    MapAVL<int, int> built(sorted.begin(), sorted.end(), pool);
+    CheckSameAsStdMap(built, expected);
+    MapAVL<int, int> copied(built, pool);
+    CheckSameAsStdMap(copied, expected);
+    assert(copied.Equal(built, pool) && built.Equal(copied, pool));
+    copied.Find(sorted[sorted.size() / 3].first)->second = 0;
+    assert(!copied.Equal(built, pool));
+    copied.Erase(sorted[sorted.size() / 3].first);
+    copied.Insert({sorted.back().first + 1, 0});
+    assert(!copied.Equal(built, pool));
+
+    std::vector<std::pair<int, int>> shuffled = sorted;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(97));
+    shuffled.push_back(shuffled.front());
+    CheckSameAsStdMap(MapAVL<int, int>(shuffled.begin(), shuffled.end(), pool), expected);
+    CheckSameAsStdMap(MapAVL<int, int>(sorted.begin(), sorted.begin(), pool), {});
+
+    RankedMap ranked(sorted.begin(), sorted.end(), pool);
+    std::vector<int> keys;
+    for (const auto& [key, value] : sorted) {
+        keys.push_back(key);
+    }
+    CheckOrderStatistics(ranked, keys);
+    CheckOrderStatistics(RankedMap(ranked, pool), keys);
+
+    using PoolMap = MapAVL<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>>;
+    PoolMap pooled(sorted.begin(), sorted.end(), pool);
+    PoolMap pooled_copy(pooled, pool);
+    assert(pooled_copy.Size() == sorted.size() && pooled_copy.Equal(pooled, pool));
+
+    using ThrowingMap = MapAVL<ThrowingKey, int>;
+    ThrowingKey::copies_left = 1 << 30;
+    std::vector<std::pair<ThrowingKey, int>> throwing;
+    for (const auto& [key, value] : sorted) {
+        throwing.emplace_back(ThrowingKey(key), value);
+    }
+    ThrowingMap throwing_map(throwing.begin(), throwing.end(), pool);
+    CheckCopyThrows(throwing_map, {0, 1, 5000, 50000, static_cast<int>(sorted.size()) - 1},
+                    [&](const ThrowingMap& source) { return ThrowingMap(source, pool); });
+    std::cout << "TestParallel passed\n";
+}
+
+using UnthreadedMap = MapAVL<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                             NoAugmentation, Unthreaded>;
+
+void TestUnthreaded() {
+    static_assert(sizeof(MapNode<int, int, NoAugmentation, Unthreaded>) + 2 * sizeof(void*) ==
+                  sizeof(MapNode<int, int>));
+    UnthreadedMap map_avl;
+    std::map<int, int> expected;
+    CheckSameAsStdMap(map_avl, expected);
+    assert(map_avl.Begin() == map_avl.End() && map_avl.RBegin() == map_avl.REnd());
+    std::mt19937 gen(98);
+    std::uniform_int_distribution<int> keys(0, 3000);
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 600; ++i) {
+            int key = keys(gen);
+            assert(map_avl.Insert({key, i}).second == expected.insert({key, i}).second);
+        }
+        CheckSameAsStdMap(map_avl, expected);
+        assert((--map_avl.End())->first == expected.rbegin()->first);
+        for (int i = 0; i < 200; ++i) {
+            int key = keys(gen);
+            assert(map_avl.Erase(key) == expected.erase(key));
+            auto it = map_avl.LowerBound(key);
+            if (it != map_avl.End()) {
+                auto jt = expected.erase(expected.find(it->first));
+                auto next = map_avl.Erase(it);
+                assert((next == map_avl.End()) == (jt == expected.end()));
+                assert(next == map_avl.End() || next->first == jt->first);
+            }
+        }
+        CheckSameAsStdMap(map_avl, expected);
+    }
+
+    auto first = map_avl.LowerBound(500);
+    auto last = map_avl.LowerBound(2500);
+    map_avl.Erase(first, last);
+    expected.erase(expected.lower_bound(500), expected.lower_bound(2500));
+    CheckSameAsStdMap(map_avl, expected);
+    auto fourth = std::next(expected.begin(), 3);
+    map_avl.Erase(map_avl.Begin(), map_avl.Find(fourth->first));
+    map_avl.Erase(map_avl.LowerBound(2800), map_avl.End());
+    expected.erase(expected.begin(), fourth);
+    expected.erase(expected.lower_bound(2800), expected.end());
+    CheckSameAsStdMap(map_avl, expected);
+
+    auto hint = map_avl.Begin();
+    for (int key = -10; key < 0; ++key) {
+        hint = map_avl.Insert(map_avl.End(), {key, key});
+        map_avl.Emplace(key + 10000, key);
+        expected.insert({key, key});
+        expected.insert({key + 10000, key});
+    }
+    assert(hint->first == -1);
+    assert(map_avl.LowerBound(hint, 600)->first == expected.lower_bound(600)->first);
+    CheckSameAsStdMap(map_avl, expected);
+
+    UnthreadedMap copy = map_avl;
+    CheckSameAsStdMap(copy, expected);
+    UnthreadedMap moved = std::move(copy);
+    UnthreadedMap other;
+    other.Swap(moved);
+    assert(moved.Empty() && other == map_avl);
+    CheckSameAsStdMap(other, expected);
+    other.Clear();
+    CheckSameAsStdMap(other, {});
+
+    std::vector<std::pair<int, int>> sorted(expected.begin(), expected.end());
+    CheckSameAsStdMap(UnthreadedMap(sorted.begin(), sorted.end()), expected);
+    TaskPool pool(4);
+    UnthreadedMap built(sorted.begin(), sorted.end(), pool);
+    CheckSameAsStdMap(built, expected);
+    assert(UnthreadedMap(built, pool).Equal(built, pool));
+
+    using RankedUnthreadedMap =
+        MapAVL<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>,
+               OrderStatistics, Unthreaded>;
+    RankedUnthreadedMap ranked(sorted.begin(), sorted.end());
+    assert(ranked.End() - ranked.Begin() == static_cast<std::ptrdiff_t>(sorted.size()));
+    assert(ranked.Nth(sorted.size() - 1) + 1 == ranked.End());
+    assert((ranked.End() - 1)->first == sorted.back().first);
+    std::cout << "TestUnthreaded passed\n";
+}
+
 int main() {
     TestDefaultConstructor();
     TestComparatorConstructor();
@@ -1078,6 +2221,25 @@ int main() {
     TestOperatorNotEqual();
     TestSwapOuter();
     TestLogarithmicAVLHeightProperty();
+    TestEraseKey();
+    TestEraseIterator();
+    TestEraseRange();
+    TestInsertSorted();
+    TestCopyThrowing();
+    TestPoolAllocator();
+    TestPmrAllocator();
+    TestFindBatch();
+    TestLowerBoundHint();
+    TestInsertHint();
+    TestEmplace();
+    TestTransparentLookup();
+    TestComparisonsPerLevel();
+    TestOrderStatistics();
+    TestAggregate();
+    TestSplitJoin();
+    TestMerge();
+    TestParallel();
+    TestUnthreaded();
 
     std::cout << "\nAll tests passed\n";
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "MapAVL.h"
+#include "MappedMap.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Key = int64_t;
+using Value = int64_t;
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " ms=" << seconds * 1e3 << "\n";
+}
+
+// Reads the elements back from the image with plain file reads, the way a loader without
+// mmap would, for the rebuilds to start from.
+std::vector<std::pair<Key, Value>> ReadImage(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    MappedMapHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    std::vector<Key> keys(header.size);
+    std::vector<Value> values(header.size);
+    in.seekg(static_cast<std::streamoff>(header.keys_offset));
+    in.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(Key));
+    in.seekg(static_cast<std::streamoff>(header.values_offset));
+    in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(Value));
+    std::vector<std::pair<Key, Value>> entries(header.size);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        entries[i] = {keys[i], values[i]};
+    }
+    return entries;
+}
+
+// Times from nothing in memory to the answer of the first query: rebuilding a MapAVL from the
+// file by Insert per element or by one sorted bulk Insert, against mapping the image. Then
+// times random lookups on the rebuilt and the mapped map. The image was just written, so it
+// is in the page cache; drop the cache before the mapped run to see a cold start.
+void BenchOpen(size_t size, const std::string& path) {
+    constexpr size_t kQueries = 1'000'000;
+    {
+        MapAVL<Key, Value> map;
+        for (size_t i = 0; i < size; ++i) {
+            map.Insert(map.End(), {static_cast<Key>(3 * i), static_cast<Value>(i)});
+        }
+        double seconds = MeasureSeconds([&] { MappedMap<Key, Value>::Write(path, map); });
+        Report("BenchWrite", size, size, seconds);
+    }
+    const auto query = static_cast<Key>(3 * (size / 2));
+    size_t checksum = 0;
+
+    double seconds = MeasureSeconds([&] {
+        auto entries = ReadImage(path);
+        MapAVL<Key, Value> map;
+        for (const auto& key_value : entries) {
+            map.Insert(key_value);
+        }
+        checksum += map.Find(query)->second;
+    });
+    Report("BenchOpenRebuildInsert", size, 1, seconds);
+    MapAVL<Key, Value> rebuilt;
+    seconds = MeasureSeconds([&] {
+        auto entries = ReadImage(path);
+        rebuilt.Insert(entries.begin(), entries.end());
+        checksum += rebuilt.Find(query)->second;
+    });
+    Report("BenchOpenRebuildSorted", size, 1, seconds);
+    MappedMap<Key, Value> mapped;
+    seconds = MeasureSeconds([&] {
+        mapped.Open(path);
+        checksum += mapped.Find(query)->second;
+    });
+    Report("BenchOpenMapped", size, 1, seconds);
+
+    std::mt19937_64 gen(121);
+    std::uniform_int_distribution<size_t> dis(0, size - 1);
+    std::vector<Key> queries(kQueries);
+    for (Key& key : queries) {
+        key = static_cast<Key>(3 * dis(gen));
+    }
+    seconds = MeasureSeconds([&] {
+        for (Key key : queries) {
+            checksum += rebuilt.Find(key)->second;
+        }
+    });
+    Report("BenchFindMapAVL", size, kQueries, seconds);
+    seconds = MeasureSeconds([&] {
+        for (Key key : queries) {
+            checksum += mapped.Find(key)->second;
+        }
+    });
+    Report("BenchFindMappedMap", size, kQueries, seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t size = 30'000'000;
+    std::string path = (std::filesystem::temp_directory_path() / "mapped_benchmarks.img").string();
+    if (argc > 1) {
+        size = static_cast<size_t>(std::atoll(argv[1]));
+    }
+    if (argc > 2) {
+        path = argv[2];
+    }
+    BenchOpen(size, path);
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,199 @@
+#include "MapAVL.h"
+#include "MappedMap.h"
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+std::string TemporaryPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("mapped_tests_" + name)).string();
+}
+
+template <typename Mapped, typename Map>
+void CheckSameAsMap(const Mapped& mapped, const Map& map) {
+    assert(mapped.Size() == map.Size() && mapped.Empty() == map.Empty());
+    auto it = mapped.Begin();
+    for (auto jt = map.Begin(); jt != map.End(); ++jt, ++it) {
+        assert(it->first == jt->first && it->second == jt->second);
+    }
+    assert(it == mapped.End());
+}
+
+void TestEmpty() {
+    const std::string path = TemporaryPath("empty");
+    MappedMap<int, int>::Write(path, MapAVL<int, int>());
+    MappedMap<int, int> mapped(path);
+    assert(mapped.Empty() && mapped.Begin() == mapped.End());
+    assert(mapped.Find(1) == mapped.End() && mapped.LowerBound(1) == mapped.End());
+    MappedMap<int, int> unopened;
+    assert(unopened.Empty() && unopened.Find(1) == unopened.End());
+    std::filesystem::remove(path);
+    std::cout << "TestEmpty passed\n";
+}
+
+void TestAgainstMapAVL() {
+    const std::string path = TemporaryPath("random");
+    std::mt19937_64 gen(120);
+    std::uniform_int_distribution<int64_t> keys(0, 400000);
+    MapAVL<int64_t, double> map;
+    for (int i = 0; i < 100000; ++i) {
+        int64_t key = keys(gen);
+        map.Insert({key, key * 0.5});
+    }
+    MappedMap<int64_t, double>::Write(path, map);
+    MappedMap<int64_t, double> mapped(path);
+    CheckSameAsMap(mapped, map);
+    for (int64_t key = -1; key <= 400001; ++key) {
+        auto it = mapped.LowerBound(key);
+        auto jt = map.LowerBound(key);
+        assert((it == mapped.End()) == (jt == map.End()));
+        assert(it == mapped.End() || (it->first == jt->first && it->second == jt->second));
+        auto upper = mapped.UpperBound(key);
+        auto expected_upper = map.UpperBound(key);
+        assert((upper == mapped.End()) == (expected_upper == map.End()));
+        assert(upper == mapped.End() || upper->first == expected_upper->first);
+        assert(mapped.Contains(key) == map.Contains(key));
+    }
+    auto last = mapped.End();
+    --last;
+    assert((*last).first == map.RBegin()->first);
+
+    MappedMap<int64_t, double> moved(std::move(mapped));
+    assert(mapped.Empty() && moved.Size() == map.Size());
+    mapped = std::move(moved);
+    CheckSameAsMap(mapped, map);
+    // Rewriting the file replaces it, so the open mapping still sees the old image.
+    MappedMap<int64_t, double>::Write(path, MapAVL<int64_t, double>());
+    CheckSameAsMap(mapped, map);
+    mapped.Open(path);
+    assert(mapped.Empty());
+    std::filesystem::remove(path);
+    std::cout << "TestAgainstMapAVL passed\n";
+}
+
+void TestCustomCompare() {
+    const std::string path = TemporaryPath("greater");
+    MapAVL<int, char, std::greater<int>> map;
+    map.Insert({{1, 'a'}, {3, 'c'}, {2, 'b'}});
+    MappedMap<int, char, std::greater<int>>::Write(path, map);
+    MappedMap<int, char, std::greater<int>> mapped(path);
+    CheckSameAsMap(mapped, map);
+    assert(mapped.LowerBound(4)->first == 3 && mapped.Find(2)->second == 'b');
+    assert(mapped.UpperBound(1) == mapped.End());
+    auto [first, last] = mapped.EqualRange(3);
+    assert(first == mapped.Begin() && last == ++mapped.Begin());
+    std::filesystem::remove(path);
+    std::cout << "TestCustomCompare passed\n";
+}
+
+void TestBadImages() {
+    const std::string path = TemporaryPath("bad");
+    bool thrown = false;
+    try {
+        MappedMap<int, int> mapped(path + "_missing");
+    } catch (const std::system_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    MapAVL<int, int> map;
+    for (int i = 0; i < 1000; ++i) {
+        map.Insert({i, i});
+    }
+    MappedMap<int, int>::Write(path, map);
+    thrown = false;
+    try {
+        MappedMap<int64_t, int> mapped(path);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+    thrown = false;
+    try {
+        MappedMap<int, int> mapped(path);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Offsets out of order, or large enough to wrap around when an array length is added.
+    auto patch_offset = [&](uint64_t MappedMapHeader::*field, uint64_t offset) {
+        MappedMapHeader header;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        header.*field = offset;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    };
+    MapAVL<int, int> small;
+    for (int i = 0; i < 64; ++i) {
+        small.Insert({i, i});
+    }
+    using Patch = std::pair<uint64_t MappedMapHeader::*, uint64_t>;
+    for (auto [field, offset] : {Patch{&MappedMapHeader::keys_offset, ~uint64_t{63}},
+                                 Patch{&MappedMapHeader::keys_offset, 0},
+                                 Patch{&MappedMapHeader::values_offset, ~uint64_t{63}},
+                                 Patch{&MappedMapHeader::values_offset, 64}}) {
+        MappedMap<int, int>::Write(path, small);
+        patch_offset(field, offset);
+        thrown = false;
+        try {
+            MappedMap<int, int> mapped(path);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    std::ofstream(path, std::ios::trunc) << "not an image";
+    thrown = false;
+    try {
+        MappedMap<int, int> mapped(path);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::filesystem::remove(path);
+    std::cout << "TestBadImages passed\n";
+}
+
+// A rename onto a directory fails; the temporary file must not be left behind.
+void TestWriteFailure() {
+    const std::string path = TemporaryPath("directory");
+    std::filesystem::create_directories(std::filesystem::path(path) / "inside");
+    MapAVL<int, int> map;
+    map.Insert({1, 1});
+    bool thrown = false;
+    try {
+        MappedMap<int, int>::Write(path, map);
+    } catch (const std::filesystem::filesystem_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    const std::string prefix = std::filesystem::path(path).filename().string() + ".tmp";
+    for (const auto& entry :
+         std::filesystem::directory_iterator(std::filesystem::path(path).parent_path())) {
+        assert(!entry.path().filename().string().starts_with(prefix));
+    }
+    std::filesystem::remove_all(path);
+    std::cout << "TestWriteFailure passed\n";
+}
+
+int main() {
+    TestEmpty();
+    TestAgainstMapAVL();
+    TestCustomCompare();
+    TestBadImages();
+    TestWriteFailure();
+
+    std::cout << "\nAll tests passed\n";
+}
@@ -0,0 +1,80 @@
+#include "SetAVL.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t threads, double seconds,
+            double single_thread_seconds) {
+    std::cout << name << " size=" << size << " threads=" << threads << " ms=" << seconds * 1e3
+              << " speedup=" << single_thread_seconds / seconds << "\n";
+}
+
+std::vector<int64_t> GenerateSortedKeys(size_t size, int64_t range, unsigned seed) {
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<int64_t> dis(0, range);
+    std::vector<int64_t> keys(size);
+    for (int64_t& key : keys) {
+        key = dis(gen);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Times the parallel bulk operations of SetAVL on pools of 1, 2, 4, ... threads up to
+// max_threads. Each line reports the speedup over the pool of one thread.
+void BenchScaling(size_t size, size_t max_threads) {
+    const auto range = static_cast<int64_t>(size) * 4;
+    auto lhs_keys = GenerateSortedKeys(size, range, 103);
+    auto rhs_keys = GenerateSortedKeys(size, range, 104);
+    std::vector<double> single_thread(5);
+    size_t checksum = 0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        TaskPool pool(threads);
+        std::vector<double> seconds(5);
+        SetAVL<int64_t> lhs;
+        seconds[0] = MeasureSeconds(
+            [&] { lhs = SetAVL<int64_t>(lhs_keys.begin(), lhs_keys.end(), pool); });
+        SetAVL<int64_t> rhs(rhs_keys.begin(), rhs_keys.end(), pool);
+        seconds[1] = MeasureSeconds([&] { checksum += SetAVL<int64_t>(lhs, pool).Size(); });
+        seconds[2] = MeasureSeconds([&] { checksum += lhs.Union(rhs, pool).Size(); });
+        seconds[3] = MeasureSeconds([&] { checksum += lhs.Intersection(rhs, pool).Size(); });
+        SetAVL<int64_t> copy(lhs, pool);
+        seconds[4] = MeasureSeconds([&] { checksum += lhs.Equal(copy, pool); });
+        if (threads == 1) {
+            single_thread = seconds;
+        }
+        const char* names[] = {"BenchParallelBuild", "BenchParallelCopy", "BenchParallelUnion",
+                               "BenchParallelIntersection", "BenchParallelEqual"};
+        for (size_t i = 0; i < seconds.size(); ++i) {
+            Report(names[i], size, threads, seconds[i], single_thread[i]);
+        }
+    }
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t size = 50'000'000;
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        size = static_cast<size_t>(std::atoll(argv[1]));
+    }
+    if (argc > 2) {
+        max_threads = static_cast<size_t>(std::atoll(argv[2]));
+    }
+    BenchScaling(size, max_threads);
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Shared state of PoolAllocator.
+// Memory is carved out of large chunks with a bump pointer, freed blocks are kept on
+// free lists (one per block size) and the chunks themselves are returned to the system
+// only all together, in Release() or in the destructor. Not thread-safe.
+class PoolArena {
+public:
+    static constexpr size_t kFirstChunkSize = 64 * 1024;
+    static constexpr size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+    PoolArena() noexcept = default;
+    PoolArena(const PoolArena& other) = delete;
+    PoolArena& operator=(const PoolArena& other) = delete;
+    PoolArena(PoolArena&& other) = delete;
+    PoolArena& operator=(PoolArena&& other) = delete;
+    ~PoolArena() {
+        Release();
+    }
+
+    void* Allocate(size_t bytes, size_t alignment) {
+        if (alignment > alignof(std::max_align_t)) {
+            return ::operator new(bytes, std::align_val_t{alignment});
+        }
+        bytes = BlockSize(bytes, alignment);
+        FreeList& free_list = GetFreeList(bytes);
+        if (free_list.head != nullptr) {
+            FreeBlock* block = free_list.head;
+            free_list.head = block->next;
+            return block;
+        }
+        return Bump(bytes, std::max(alignment, alignof(FreeBlock)));
+    }
+    void Deallocate(void* ptr, size_t bytes, size_t alignment) noexcept {
+        if (alignment > alignof(std::max_align_t)) {
+            ::operator delete(ptr, std::align_val_t{alignment});
+            return;
+        }
+        bytes = BlockSize(bytes, alignment);
+        for (auto& free_list : free_lists_) {
+            if (free_list.bytes == bytes) {
+                free_list.head = ::new (ptr) FreeBlock{free_list.head};
+                return;
+            }
+        }
+    }
+    // Makes room for count blocks of the given size in the current chunk, so that the next
+    // count allocations of that size are carved out of one contiguous block.
+    void Reserve(size_t count, size_t bytes, size_t alignment) {
+        if (alignment > alignof(std::max_align_t) || count == 0) {
+            return;
+        }
+        alignment = std::max(alignment, alignof(FreeBlock));
+        bytes = BlockSize(bytes, alignment);
+        if (count > (std::numeric_limits<size_t>::max() - alignment) / bytes) {
+            throw std::bad_array_new_length();
+        }
+        size_t space = static_cast<size_t>(end_ - current_);
+        if (current_ == nullptr || space < count * bytes + alignment) {
+            AddChunk(count * bytes + alignment);
+        }
+    }
+    // Returns every chunk to the system. All blocks handed out so far become invalid.
+    void Release() noexcept {
+        for (auto& chunk : chunks_) {
+            ::operator delete(chunk.first, chunk.second);
+        }
+        chunks_.clear();
+        free_lists_.clear();
+        current_ = nullptr;
+        end_ = nullptr;
+        next_chunk_size_ = kFirstChunkSize;
+    }
+    size_t ChunkCount() const noexcept {
+        return chunks_.size();
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next = nullptr;
+    };
+    struct FreeList {
+        size_t bytes = 0;
+        FreeBlock* head = nullptr;
+    };
+
+    static size_t BlockSize(size_t bytes, size_t alignment) noexcept {
+        alignment = std::max(alignment, alignof(FreeBlock));
+        bytes = std::max(bytes, sizeof(FreeBlock));
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+    FreeList& GetFreeList(size_t bytes) {
+        for (auto& free_list : free_lists_) {
+            if (free_list.bytes == bytes) {
+                return free_list;
+            }
+        }
+        free_lists_.push_back({bytes, nullptr});
+        return free_lists_.back();
+    }
+    void* Bump(size_t bytes, size_t alignment) {
+        size_t space = static_cast<size_t>(end_ - current_);
+        void* ptr = current_;
+        if (current_ == nullptr || std::align(alignment, bytes, ptr, space) == nullptr) {
+            AddChunk(bytes + alignment);
+            ptr = current_;
+            space = static_cast<size_t>(end_ - current_);
+            std::align(alignment, bytes, ptr, space);
+        }
+        current_ = static_cast<std::byte*>(ptr) + bytes;
+        return ptr;
+    }
+    void AddChunk(size_t min_size) {
+        size_t size = std::max(next_chunk_size_, min_size);
+        chunks_.reserve(chunks_.size() + 1);
+        auto chunk = static_cast<std::byte*>(::operator new(size));
+        chunks_.push_back({chunk, size});
+        current_ = chunk;
+        end_ = chunk + size;
+        next_chunk_size_ = std::min(next_chunk_size_ * 2, kMaxChunkSize);
+    }
+
+    std::vector<std::pair<std::byte*, size_t>> chunks_;
+    std::vector<FreeList> free_lists_;
+    std::byte* current_ = nullptr;
+    std::byte* end_ = nullptr;
+    size_t next_chunk_size_ = kFirstChunkSize;
+};
+
+// Node allocator for the tree containers. Copies (including rebound ones) share one
+// PoolArena, so nodes can be returned through any of them. A container that holds the
+// only reference to its arena drops all of its nodes with PoolArena::Release().
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    PoolAllocator() : arena_(std::make_shared<PoolArena>()) {
+    }
+    explicit PoolAllocator(std::shared_ptr<PoolArena> arena) noexcept : arena_(std::move(arena)) {
+    }
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : arena_(other.GetArena()) {
+    }
+
+    T* allocate(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(arena_->Allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t count) noexcept {
+        arena_->Deallocate(ptr, count * sizeof(T), alignof(T));
+    }
+    // A copied container gets an arena of its own.
+    PoolAllocator select_on_container_copy_construction() const {
+        return PoolAllocator();
+    }
+
+    const std::shared_ptr<PoolArena>& GetArena() const noexcept {
+        return arena_;
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const noexcept {
+        return arena_ == other.GetArena();
+    }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const noexcept {
+        return arena_ != other.GetArena();
+    }
+
+private:
+    std::shared_ptr<PoolArena> arena_;
+};
+
+// Teardown hooks used by the containers. For any allocator other than an unshared
+// PoolAllocator the nodes have to be deallocated one by one.
+template <typename Allocator>
+bool IsExclusivePool(const Allocator& /*allocator*/) noexcept {
+    return false;
+}
+
+template <typename T>
+bool IsExclusivePool(const PoolAllocator<T>& allocator) noexcept {
+    return allocator.GetArena().use_count() == 1;
+}
+
+template <typename Allocator>
+void ReleasePool(Allocator& /*allocator*/) noexcept {
+}
+
+template <typename T>
+void ReleasePool(PoolAllocator<T>& allocator) noexcept {
+    allocator.GetArena()->Release();
+}
+
+// Bulk preallocation for count nodes about to be created one after another.
+template <typename Allocator>
+void ReservePool(Allocator& /*allocator*/, size_t /*count*/) noexcept {
+}
+
+template <typename T>
+void ReservePool(PoolAllocator<T>& allocator, size_t count) {
+    allocator.GetArena()->Reserve(count, sizeof(T), alignof(T));
+}
@@ -0,0 +1,117 @@
+#include "SetAVL.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+std::vector<int64_t> GenerateSortedKeys(size_t size, int64_t range, unsigned seed) {
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<int64_t> dis(0, range);
+    std::vector<int64_t> keys(size);
+    for (int64_t& key : keys) {
+        key = dis(gen);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Intersects a set of `large` keys with one of `small` keys drawn from the same range: an
+// iterator loop with Contains and Insert, as callers do it today, the finger-search merge of
+// Intersection, and std::set_intersection over sorted vectors as the baseline.
+void BenchIntersection(size_t large, size_t small) {
+    const auto range = static_cast<int64_t>(large) * 4;
+    auto large_keys = GenerateSortedKeys(large, range, 56);
+    auto small_keys = GenerateSortedKeys(small, range, 57);
+    SetAVL<int64_t> large_set(large_keys.begin(), large_keys.end());
+    SetAVL<int64_t> small_set(small_keys.begin(), small_keys.end());
+    const std::string suffix = std::to_string(small);
+    const size_t rounds = std::max<size_t>(1, 1'000'000 / small);
+    size_t checksum = 0;
+    double loop_seconds = MeasureSeconds([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            SetAVL<int64_t> result;
+            for (auto it = small_set.CBegin(); it != small_set.CEnd(); ++it) {
+                if (large_set.Contains(*it)) {
+                    result.Insert(*it);
+                }
+            }
+            checksum += result.Size();
+        }
+    });
+    Report("BenchIntersectionLoop" + suffix, large, rounds, loop_seconds);
+    double set_seconds = MeasureSeconds([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            checksum += large_set.Intersection(small_set).Size();
+        }
+    });
+    Report("BenchIntersectionSetAVL" + suffix, large, rounds, set_seconds);
+    double vector_seconds = MeasureSeconds([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            std::vector<int64_t> result;
+            std::set_intersection(large_keys.begin(), large_keys.end(), small_keys.begin(),
+                                  small_keys.end(), std::back_inserter(result));
+            checksum += result.size();
+        }
+    });
+    Report("BenchIntersectionVector" + suffix, large, rounds, vector_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// Unions of two sets of equal size, the case in which no run can be skipped.
+void BenchUnion(size_t size) {
+    auto lhs_keys = GenerateSortedKeys(size, static_cast<int64_t>(size) * 4, 58);
+    auto rhs_keys = GenerateSortedKeys(size, static_cast<int64_t>(size) * 4, 59);
+    SetAVL<int64_t> lhs(lhs_keys.begin(), lhs_keys.end());
+    SetAVL<int64_t> rhs(rhs_keys.begin(), rhs_keys.end());
+    size_t checksum = 0;
+    double loop_seconds = MeasureSeconds([&] {
+        SetAVL<int64_t> result = lhs;
+        for (auto it = rhs.CBegin(); it != rhs.CEnd(); ++it) {
+            result.Insert(*it);
+        }
+        checksum += result.Size();
+    });
+    Report("BenchUnionLoop", size, 1, loop_seconds);
+    double set_seconds = MeasureSeconds([&] { checksum += lhs.Union(rhs).Size(); });
+    Report("BenchUnionSetAVL", size, 1, set_seconds);
+    double vector_seconds = MeasureSeconds([&] {
+        std::vector<int64_t> result;
+        std::set_union(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(),
+                       std::back_inserter(result));
+        checksum += result.size();
+    });
+    Report("BenchUnionVector", size, 1, vector_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchIntersection(size, 1'000);
+        BenchIntersection(size, size / 100);
+        BenchIntersection(size, size);
+        BenchUnion(size);
+    }
+}
@@ -1,10 +1,17 @@
 #include "SetAVL.h"
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
 #include <set>
+#include <stdexcept>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
+#include <bit>
 #include <functional>
 #include <utility>
 #include <random>
@@ -1003,6 +1010,532 @@ void TestLogarithmicAVLHeightProperty() {
     std::cout << "TestLogarithmicAVLHeightProperty passed\n";
 }
 
+void CheckSameAsStdSet(const SetAVL<int>& set_avl, const std::set<int>& expected) {
+    assert(set_avl.Size() == expected.size());
+    assert(set_avl.Empty() == expected.empty());
+    assert(CheckNodeBalance(set_avl.GetRootPtr()) >= 0);
+    assert(set_avl.GetRootPtr() == nullptr || set_avl.GetRootPtr()->GetParent() == nullptr);
+    auto it = set_avl.Begin();
+    for (int key : expected) {
+        assert(*it == key);
+        ++it;
+    }
+    assert(it == set_avl.End());
+    auto rit = set_avl.RBegin();
+    for (auto jt = expected.rbegin(); jt != expected.rend(); ++jt) {
+        assert(*rit == *jt);
+        ++rit;
+    }
+    assert(rit == set_avl.REnd());
+}
+
+void TestEraseKey() {
+    SetAVL<int> set_avl;
+    std::set<int> expected;
+    assert(set_avl.Erase(1) == 0);
+    auto input = GenerateRandomVector(5000, -2000, 2000, 70);
+    for (int val : input) {
+        set_avl.Insert(val);
+        expected.insert(val);
+    }
+    auto to_erase = GenerateRandomVector(5000, -2100, 2100, 71);
+    for (size_t i = 0; i < to_erase.size(); ++i) {
+        assert(set_avl.Erase(to_erase[i]) == expected.erase(to_erase[i]));
+        if (i % 250 == 0) {
+            CheckSameAsStdSet(set_avl, expected);
+        }
+    }
+    CheckSameAsStdSet(set_avl, expected);
+    for (int key : input) {
+        set_avl.Erase(key);
+    }
+    assert(set_avl.Empty());
+    assert(set_avl.Begin() == set_avl.End());
+
+    SetAVL<int> sequential;
+    for (int i = 0; i < 1000; ++i) {
+        sequential.Insert(i);
+    }
+    for (int i = 999; i >= 0; i -= 2) {
+        assert(sequential.Erase(i) == 1);
+        assert(CheckNodeBalance(sequential.GetRootPtr()) >= 0);
+    }
+    assert(sequential.Size() == 500);
+    assert(*sequential.Begin() == 0);
+    assert(*sequential.RBegin() == 998);
+    std::cout << "TestEraseKey passed\n";
+}
+
+void TestEraseIterator() {
+    SetAVL<int> set_avl;
+    std::set<int> expected;
+    for (int val : GenerateRandomVector(3000, 0, 10000, 72)) {
+        set_avl.Insert(val);
+        expected.insert(val);
+    }
+    auto it = set_avl.Begin();
+    auto jt = expected.begin();
+    while (it != set_avl.End()) {
+        ++it;
+        ++jt;
+        if (it != set_avl.End()) {
+            it = set_avl.Erase(it);
+            jt = expected.erase(jt);
+        }
+    }
+    CheckSameAsStdSet(set_avl, expected);
+
+    bool thrown = false;
+    try {
+        set_avl.Erase(set_avl.CEnd());
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    CheckSameAsStdSet(set_avl, expected);
+    std::cout << "TestEraseIterator passed\n";
+}
+
+void TestEraseRange() {
+    std::mt19937 gen(73);
+    for (size_t size : {1, 2, 10, 100, 1000, 5000}) {
+        for (int round = 0; round < 20; ++round) {
+            SetAVL<int> set_avl;
+            std::set<int> expected;
+            for (int val : GenerateRandomVector(size, 0, static_cast<int>(size) * 4, round)) {
+                set_avl.Insert(val);
+                expected.insert(val);
+            }
+            std::uniform_int_distribution<size_t> dis(0, expected.size());
+            size_t from = dis(gen);
+            size_t to = dis(gen);
+            if (from > to) {
+                std::swap(from, to);
+            }
+            auto first = set_avl.Begin();
+            auto jt_first = expected.begin();
+            for (size_t i = 0; i < from; ++i, ++first, ++jt_first) {
+            }
+            auto last = first;
+            auto jt_last = jt_first;
+            for (size_t i = from; i < to; ++i, ++last, ++jt_last) {
+            }
+            auto result = set_avl.Erase(first, last);
+            expected.erase(jt_first, jt_last);
+            assert(result == last);
+            CheckSameAsStdSet(set_avl, expected);
+            for (int val : GenerateRandomVector(size / 2, 0, static_cast<int>(size) * 4, 100)) {
+                set_avl.Insert(val);
+                expected.insert(val);
+            }
+            CheckSameAsStdSet(set_avl, expected);
+        }
+    }
+    std::cout << "TestEraseRange passed\n";
+}
+
+void TestInsertSorted() {
+    for (int size = 0; size <= 300; ++size) {
+        std::vector<int> input;
+        for (int i = 0; i < size; ++i) {
+            input.push_back(i * 3);
+        }
+        SetAVL<int> set_avl(input.begin(), input.end());
+        CheckSameAsStdSet(set_avl, std::set<int>(input.begin(), input.end()));
+        assert(CalcNodeHeight(set_avl.GetRootPtr()) ==
+               static_cast<size_t>(std::bit_width(static_cast<size_t>(size))));
+    }
+
+    std::vector<int> with_duplicates = {1, 1, 2, 2, 2, 5, 8, 8};
+    SetAVL<int> deduplicated;
+    deduplicated.Insert(with_duplicates.begin(), with_duplicates.end());
+    CheckSameAsStdSet(deduplicated, {1, 2, 5, 8});
+
+    auto keys = GenerateRandomVector(2000, 0, 100000, 74);
+    std::sort(keys.begin(), keys.begin() + 1500);
+    SetAVL<int> set_avl(keys.begin(), keys.end());
+    std::set<int> expected(keys.begin(), keys.end());
+    CheckSameAsStdSet(set_avl, expected);
+    set_avl.Insert(keys.begin(), keys.end());
+    CheckSameAsStdSet(set_avl, expected);
+
+    std::vector<std::string> strings;
+    for (int i = 0; i < 100; ++i) {
+        strings.push_back(std::to_string(1000 + i) + std::string(40, 'x'));
+    }
+    SetAVL<std::string> moved(std::make_move_iterator(strings.begin()),
+                              std::make_move_iterator(strings.end()));
+    assert(moved.Size() == 100);
+    assert(strings[0].empty());
+    assert(*moved.Begin() == "1000" + std::string(40, 'x'));
+    std::cout << "TestInsertSorted passed\n";
+}
+
+void TestPoolAllocator() {
+    using PoolSet = SetAVL<int, std::less<int>, PoolAllocator<int>>;
+    auto input = GenerateRandomVector(10000, -5000, 5000, 60);
+    std::set<int> expected(input.begin(), input.end());
+    PoolSet set_avl;
+    for (int val : input) {
+        set_avl.Insert(val);
+    }
+    assert(set_avl.Size() == expected.size());
+    auto it = set_avl.Begin();
+    for (int key : expected) {
+        assert(*it == key);
+        ++it;
+    }
+    assert(set_avl.GetAllocator().GetArena()->ChunkCount() > 0);
+
+    PoolSet copy(set_avl);
+    assert(copy == set_avl);
+    assert(copy.GetAllocator() != set_avl.GetAllocator());
+    PoolSet moved(std::move(copy));
+    assert(moved == set_avl);
+    assert(copy.Empty());
+
+    set_avl.Clear();
+    assert(set_avl.Empty());
+    assert(set_avl.GetAllocator().GetArena()->ChunkCount() == 0);
+    for (int val : input) {
+        set_avl.Insert(val);
+    }
+    assert(set_avl == moved);
+
+    PoolAllocator<int> shared_pool;
+    PoolSet first(std::less<int>(), shared_pool);
+    PoolSet second(std::less<int>(), shared_pool);
+    for (int i = 0; i < 1000; ++i) {
+        first.Insert(i);
+        second.Insert(-i);
+    }
+    first.Clear();
+    assert(second.Size() == 1000);
+    assert(second.Contains(-999));
+    std::cout << "TestPoolAllocator passed\n";
+}
+
+void TestPmrAllocator() {
+    using PmrSet = SetAVL<std::pmr::string, std::less<std::pmr::string>,
+                          std::pmr::polymorphic_allocator<std::pmr::string>>;
+    std::pmr::monotonic_buffer_resource first_resource;
+    std::pmr::unsynchronized_pool_resource second_resource;
+    auto input = GenerateRandomVector(1000, -500, 500, 61);
+    std::set<std::pmr::string> expected;
+
+    PmrSet set_avl(&first_resource);
+    for (int val : input) {
+        std::pmr::string key(std::to_string(val) + " long enough for the heap");
+        set_avl.Insert(key);
+        expected.insert(key);
+    }
+    auto check = [&expected](const PmrSet& set) {
+        assert(set.Size() == expected.size());
+        auto it = set.Begin();
+        for (const auto& key : expected) {
+            assert(*it == key);
+            ++it;
+        }
+    };
+    check(set_avl);
+
+    PmrSet copy(set_avl);
+    check(copy);
+    PmrSet other(&second_resource);
+    other.Insert("one");
+    other = std::move(set_avl);
+    assert(other.GetAllocator().resource() == &second_resource);
+    assert(set_avl.Empty());
+    check(other);
+    std::cout << "TestPmrAllocator passed\n";
+}
+
+void TestLowerBoundHint() {
+    SetAVL<int> set_avl;
+    for (int val : GenerateRandomVector(2000, 0, 10000, 78)) {
+        set_avl.Insert(val);
+    }
+    const auto& const_set = set_avl;
+    std::vector<SetAVL<int>::ConstIterator> hints;
+    for (auto it = set_avl.CBegin(); it != set_avl.CEnd(); ++it) {
+        hints.push_back(it);
+    }
+    hints.push_back(set_avl.CEnd());
+    auto probes = GenerateRandomVector(200, -100, 10100, 79);
+    for (size_t i = 0; i < hints.size(); i += 7) {
+        for (int key : probes) {
+            assert(set_avl.LowerBound(hints[i], key) == set_avl.LowerBound(key));
+            assert(const_set.LowerBound(hints[i], key) == set_avl.LowerBound(key));
+        }
+    }
+
+    for (bool sorted : {true, false}) {
+        auto keys = GenerateRandomVector(3000, -100, 10100, 80);
+        if (sorted) {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::vector<SetAVL<int>::Iterator> results(keys.size(), set_avl.End());
+        std::vector<SetAVL<int>::ConstIterator> const_results(keys.size(), set_avl.CEnd());
+        set_avl.LowerBoundSorted(keys, results);
+        const_set.LowerBoundSorted(keys, const_results);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            assert(results[i] == set_avl.LowerBound(keys[i]));
+            assert(const_results[i] == set_avl.LowerBound(keys[i]));
+        }
+    }
+
+    SetAVL<int> empty;
+    assert(empty.LowerBound(empty.CEnd(), 5) == empty.End());
+    std::vector<int> keys = {1, 2};
+    std::vector<SetAVL<int>::Iterator> results(keys.size(), set_avl.End());
+    empty.LowerBoundSorted(keys, results);
+    assert(results[0] == empty.End() && results[1] == empty.End());
+    std::cout << "TestLowerBoundHint passed\n";
+}
+
+void TestInsertHint() {
+    SetAVL<int> appended;
+    std::set<int> expected;
+    for (int i = 0; i < 1000; ++i) {
+        auto it = appended.Insert(appended.CEnd(), i * 2);
+        assert(*it == i * 2);
+        expected.insert(i * 2);
+    }
+    CheckSameAsStdSet(appended, expected);
+    auto prev = appended.Find(998);
+    for (int i = 0; i < 1000; i += 2) {
+        prev = appended.Insert(prev, 999 - i);
+        assert(*prev == 999 - i);
+        expected.insert(999 - i);
+    }
+    CheckSameAsStdSet(appended, expected);
+    assert(appended.Insert(appended.CBegin(), 4) == appended.Find(4));
+    assert(appended.Size() == expected.size());
+
+    SetAVL<int> set_avl;
+    expected.clear();
+    std::mt19937 gen(81);
+    std::uniform_int_distribution<int> dis(0, 3000);
+    for (int i = 0; i < 3000; ++i) {
+        auto hint = set_avl.LowerBound(dis(gen));
+        if (i % 3 == 0 && hint != set_avl.End()) {
+            ++hint;
+        }
+        int key = dis(gen);
+        auto it = (i % 2 == 0) ? set_avl.Insert(hint, key) : set_avl.EmplaceHint(hint, key);
+        expected.insert(key);
+        assert(*it == key);
+        if (i % 500 == 0) {
+            CheckSameAsStdSet(set_avl, expected);
+        }
+    }
+    CheckSameAsStdSet(set_avl, expected);
+
+    SetAVL<std::string> strings;
+    auto it = strings.EmplaceHint(strings.CEnd(), 3, 'a');
+    assert(*it == "aaa");
+    it = strings.EmplaceHint(it, "aaa");
+    assert(strings.Size() == 1);
+    it = strings.EmplaceHint(it, "b");
+    assert(strings.Size() == 2 && it == --strings.End());
+    std::cout << "TestInsertHint passed\n";
+}
+
+void TestTransparentLookup() {
+    SetAVL<std::string, std::less<>> set_avl;
+    for (int i = 0; i < 100; ++i) {
+        set_avl.Insert("key" + std::to_string(i * 2));
+    }
+    const auto& const_set = set_avl;
+    std::string_view present = "key10";
+    assert(set_avl.Find(present) == set_avl.Find(std::string("key10")));
+    assert(set_avl.Find(present) != set_avl.End());
+    assert(const_set.Find("key10") == set_avl.Find(present));
+    assert(set_avl.Find(std::string_view("key11")) == set_avl.End());
+    assert(set_avl.Contains("key0") && !set_avl.Contains(std::string_view("key")));
+    assert(set_avl.Count(std::string_view("key4")) == 1 && const_set.Count("key5") == 0);
+    for (const char* probe : {"", "key", "key1", "key10", "key11", "key98", "key99", "z"}) {
+        std::string key = probe;
+        std::string_view view = probe;
+        assert(set_avl.LowerBound(view) == set_avl.LowerBound(key));
+        assert(const_set.LowerBound(probe) == set_avl.LowerBound(key));
+        assert(set_avl.UpperBound(view) == set_avl.UpperBound(key));
+        assert(const_set.UpperBound(probe) == set_avl.UpperBound(key));
+        assert(set_avl.EqualRange(view) == set_avl.EqualRange(key));
+        assert(const_set.EqualRange(probe).first == set_avl.LowerBound(key));
+    }
+
+    SetAVL<std::string> plain;
+    plain.Insert("key");
+    assert(plain.Find("key") != plain.End() && plain.Contains("key"));
+    std::cout << "TestTransparentLookup passed\n";
+}
+
+void TestSetAlgebra() {
+    struct Case {
+        size_t lhs_size;
+        size_t rhs_size;
+        int range;
+    };
+    for (auto [lhs_size, rhs_size, range] : {Case{0, 0, 10}, Case{0, 300, 1000},
+                                            Case{300, 0, 1000}, Case{500, 500, 1000},
+                                            Case{2000, 20, 5000}, Case{20, 2000, 5000},
+                                            Case{1000, 1000, 100000}}) {
+        auto lhs_keys = GenerateRandomVector(lhs_size, 0, range, 96);
+        auto rhs_keys = GenerateRandomVector(rhs_size, 0, range, 97);
+        std::set<int> lhs_expected(lhs_keys.begin(), lhs_keys.end());
+        std::set<int> rhs_expected(rhs_keys.begin(), rhs_keys.end());
+        SetAVL<int> lhs(lhs_keys.begin(), lhs_keys.end());
+        SetAVL<int> rhs(rhs_keys.begin(), rhs_keys.end());
+        std::set<int> union_expected;
+        std::set<int> intersection_expected;
+        std::set<int> difference_expected;
+        std::set<int> symmetric_expected;
+        std::set_union(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(),
+                       rhs_expected.end(), std::inserter(union_expected, union_expected.end()));
+        std::set_intersection(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(),
+                              rhs_expected.end(),
+                              std::inserter(intersection_expected, intersection_expected.end()));
+        std::set_difference(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(),
+                            rhs_expected.end(),
+                            std::inserter(difference_expected, difference_expected.end()));
+        std::set_symmetric_difference(lhs_expected.begin(), lhs_expected.end(),
+                                      rhs_expected.begin(), rhs_expected.end(),
+                                      std::inserter(symmetric_expected, symmetric_expected.end()));
+        CheckSameAsStdSet(lhs.Union(rhs), union_expected);
+        CheckSameAsStdSet(lhs.Intersection(rhs), intersection_expected);
+        CheckSameAsStdSet(lhs.Difference(rhs), difference_expected);
+        CheckSameAsStdSet(lhs.SymmetricDifference(rhs), symmetric_expected);
+        CheckSameAsStdSet(lhs, lhs_expected);
+        CheckSameAsStdSet(rhs, rhs_expected);
+    }
+    SetAVL<int> set_avl;
+    set_avl.Insert({1, 2, 3});
+    CheckSameAsStdSet(set_avl.Intersection(set_avl), {1, 2, 3});
+    CheckSameAsStdSet(set_avl.Difference(set_avl), {});
+    std::cout << "TestSetAlgebra passed\n";
+}
+
+// Key whose copy throws once copies_left runs out. live counts the keys in existence, so a
+// node that is not freed after a failed copy shows up as a leak.
+struct ThrowingKey {
+    static inline std::atomic<int> copies_left = 0;
+    static inline std::atomic<int> live = 0;
+    int value = 0;
+    ThrowingKey(int value) : value(value) {
+        ++live;
+    }
+    ThrowingKey(const ThrowingKey& other) : value(other.value) {
+        if (--copies_left < 0) {
+            throw std::runtime_error("copy failed");
+        }
+        ++live;
+    }
+    ~ThrowingKey() {
+        --live;
+    }
+    bool operator<(const ThrowingKey& other) const {
+        return value < other.value;
+    }
+};
+
+void TestParallel() {
+    TaskPool pool(4);
+    auto lhs_keys = GenerateRandomVector(100000, 0, 400000, 98);
+    auto rhs_keys = GenerateRandomVector(60000, 0, 400000, 99);
+    std::set<int> lhs_expected(lhs_keys.begin(), lhs_keys.end());
+    std::set<int> rhs_expected(rhs_keys.begin(), rhs_keys.end());
+    std::vector<int> lhs_sorted(lhs_expected.begin(), lhs_expected.end());
+    SetAVL<int> lhs(lhs_sorted.begin(), lhs_sorted.end(), pool);
+    SetAVL<int> rhs(rhs_keys.begin(), rhs_keys.end(), pool);
+    CheckSameAsStdSet(lhs, lhs_expected);
+    CheckSameAsStdSet(rhs, rhs_expected);
+
+    std::set<int> union_expected;
+    std::set<int> intersection_expected;
+    std::set_union(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(),
+                   rhs_expected.end(), std::inserter(union_expected, union_expected.end()));
+    std::set_intersection(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(),
+                          rhs_expected.end(),
+                          std::inserter(intersection_expected, intersection_expected.end()));
+    CheckSameAsStdSet(lhs.Union(rhs, pool), union_expected);
+    CheckSameAsStdSet(rhs.Union(lhs, pool), union_expected);
+    CheckSameAsStdSet(lhs.Intersection(rhs, pool), intersection_expected);
+    CheckSameAsStdSet(rhs.Intersection(lhs, pool), intersection_expected);
+
+    SetAVL<int> copied(lhs, pool);
+    CheckSameAsStdSet(copied, lhs_expected);
+    assert(copied.Equal(lhs, pool) && !copied.Equal(rhs, pool));
+    copied.Erase(lhs_sorted[lhs_sorted.size() / 2]);
+    copied.Insert(lhs_sorted.back() + 1);
+    assert(!copied.Equal(lhs, pool) && !lhs.Equal(copied, pool));
+
+    ThrowingKey::copies_left = 1 << 30;
+    std::vector<ThrowingKey> throwing(lhs_sorted.begin(), lhs_sorted.end());
+    SetAVL<ThrowingKey> throwing_set(throwing.begin(), throwing.end(), pool);
+    const int live = ThrowingKey::live;
+    for (int count : {0, 1, 5000, 50000, static_cast<int>(lhs_sorted.size()) - 1}) {
+        ThrowingKey::copies_left = count;
+        bool thrown = false;
+        try {
+            SetAVL<ThrowingKey> failed(throwing_set, pool);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && ThrowingKey::live == live);
+    }
+    ThrowingKey::copies_left = static_cast<int>(lhs_sorted.size());
+    SetAVL<ThrowingKey> throwing_copy(throwing_set, pool);
+    assert(throwing_copy.Equal(throwing_set, pool));
+    std::cout << "TestParallel passed\n";
+}
+
+void TestFreeze() {
+    for (int size = 0; size <= 100; ++size) {
+        SetAVL<int> set;
+        std::set<int> expected;
+        for (int i = 0; i < size; ++i) {
+            set.Insert(2 * i);
+            expected.insert(2 * i);
+        }
+        FrozenSet<int> frozen = set.Freeze();
+        assert(frozen.Size() == expected.size() && frozen.Empty() == expected.empty());
+        assert(std::equal(frozen.Begin(), frozen.End(), expected.begin(), expected.end()));
+        for (int key = -1; key <= 2 * size; ++key) {
+            assert(frozen.LowerBound(key) - frozen.Begin() ==
+                   std::distance(expected.begin(), expected.lower_bound(key)));
+            assert(frozen.UpperBound(key) - frozen.Begin() ==
+                   std::distance(expected.begin(), expected.upper_bound(key)));
+            assert(frozen.Contains(key) == expected.contains(key));
+        }
+    }
+
+    SetAVL<std::string, std::greater<std::string>> strings;
+    strings.Insert({"b", "d", "a", "c"});
+    auto frozen = strings.Freeze();
+    assert(*frozen.Begin() == "d" && *frozen.LowerBound("bb") == "b");
+    assert(frozen.Find("e") == frozen.End() && frozen.UpperBound("a") == frozen.End());
+    auto copy = frozen;
+    assert(copy == frozen && *copy.Find("c") == "c");
+
+    // Equal when the keys are equivalent, as for SetAVL, even where they differ.
+    struct AbsLess {
+        bool operator()(int lhs, int rhs) const {
+            return std::abs(lhs) < std::abs(rhs);
+        }
+    };
+    SetAVL<int, AbsLess> positive;
+    SetAVL<int, AbsLess> mixed;
+    for (int i = 1; i <= 20; ++i) {
+        positive.Insert(i);
+        mixed.Insert(i % 2 == 0 ? -i : i);
+    }
+    assert(positive == mixed && positive.Freeze() == mixed.Freeze());
+    mixed.Erase(4);
+    assert(positive.Freeze() != mixed.Freeze());
+    std::cout << "TestFreeze passed\n";
+}
+
 int main() {
 
     TestDefaultConstructor();
@@ -1038,6 +1571,18 @@ int main() {
     TestOperatorNotEqual();
     TestSwapOuter();
     TestLogarithmicAVLHeightProperty();
+    TestEraseKey();
+    TestEraseIterator();
+    TestEraseRange();
+    TestInsertSorted();
+    TestPoolAllocator();
+    TestPmrAllocator();
+    TestLowerBoundHint();
+    TestInsertHint();
+    TestTransparentLookup();
+    TestSetAlgebra();
+    TestParallel();
+    TestFreeze();
 
     std::cout << "\nAll tests passed\n";
 }
@@ -0,0 +1,171 @@
+#include "MapAVL.h"
+#include <algorithm>
+#include <chrono>
+#include <compare>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every allocation of the program goes through here, so the lookups can be checked to make
+// none.
+size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+// Too long for the small string buffer, as URLs and file paths usually are.
+std::string MakeKey(int index) {
+    return "/var/lib/service/objects/" + std::to_string(index);
+}
+
+// Lookups by std::string_view, as they arrive from a parser: with std::less<std::string> every
+// lookup builds a std::string, with the transparent std::less<> none does.
+template <typename Compare>
+void BenchStringViewFind(const std::string& name, size_t size) {
+    MapAVL<std::string, int, Compare> map_avl;
+    for (int key : GenerateShuffledKeys(size, 42)) {
+        map_avl.Insert({MakeKey(key), key});
+    }
+    std::vector<std::string> storage;
+    for (int key : GenerateShuffledKeys(size, 43)) {
+        storage.push_back(MakeKey(key));
+    }
+    std::vector<std::string_view> probes(storage.begin(), storage.end());
+    long long checksum = 0;
+    size_t allocations_before = allocations;
+    double seconds = MeasureSeconds([&] {
+        for (std::string_view probe : probes) {
+            if constexpr (MapAVL<std::string, int, Compare>::kTransparentCompare) {
+                checksum += map_avl.Find(probe)->second;
+            } else {
+                checksum += map_avl.Find(std::string(probe))->second;
+            }
+        }
+    });
+    Report(name, size, probes.size(), seconds);
+    std::cout << "  allocations/op="
+              << static_cast<double>(allocations - allocations_before) / probes.size() << "\n";
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+// A string key that counts its comparisons, whether through operator< or operator<=>.
+struct CountedKey {
+    static inline size_t comparisons = 0;
+    std::string text;
+
+    friend bool operator<(const CountedKey& lhs, const CountedKey& rhs) {
+        ++comparisons;
+        return lhs.text < rhs.text;
+    }
+    friend std::strong_ordering operator<=>(const CountedKey& lhs, const CountedKey& rhs) {
+        ++comparisons;
+        return lhs.text <=> rhs.text;
+    }
+    friend bool operator==(const CountedKey& lhs, const CountedKey& rhs) {
+        ++comparisons;
+        return lhs.text == rhs.text;
+    }
+};
+
+// Orders through operator< only, which hides the three-way comparison from the tree.
+struct OperatorLess {
+    bool operator()(const CountedKey& lhs, const CountedKey& rhs) const {
+        return lhs < rhs;
+    }
+};
+
+// Comparisons per operation for string keys that share a long prefix, so that each comparison
+// is a real memcmp.
+template <typename Compare>
+void BenchStringComparisons(const std::string& name, size_t size) {
+    auto keys = GenerateShuffledKeys(size, 42);
+    auto probes = GenerateShuffledKeys(size, 43);
+    MapAVL<CountedKey, int, Compare> map_avl;
+    auto report = [&](const std::string& operation, double seconds) {
+        Report(name + operation, size, size, seconds);
+        std::cout << "  comparisons/op=" << static_cast<double>(CountedKey::comparisons) / size
+                  << "\n";
+        CountedKey::comparisons = 0;
+    };
+    CountedKey::comparisons = 0;
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            map_avl.Insert({CountedKey{MakeKey(key * 2)}, key});
+        }
+    });
+    report("Insert", insert_seconds);
+    std::vector<CountedKey> present;
+    std::vector<CountedKey> absent;
+    for (int key : probes) {
+        present.push_back(CountedKey{MakeKey(key * 2)});
+        absent.push_back(CountedKey{MakeKey(key * 2 + 1)});
+    }
+    long long checksum = 0;
+    CountedKey::comparisons = 0;
+    double find_seconds = MeasureSeconds([&] {
+        for (const auto& key : present) {
+            checksum += map_avl.Find(key)->second;
+        }
+    });
+    report("Find", find_seconds);
+    double lower_bound_seconds = MeasureSeconds([&] {
+        for (const auto& key : absent) {
+            checksum += map_avl.LowerBound(key) != map_avl.End();
+        }
+    });
+    report("LowerBound", lower_bound_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {100'000, 1'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchStringViewFind<std::less<std::string>>("BenchStringViewFindLess", size);
+        BenchStringViewFind<std::less<>>("BenchStringViewFindTransparent", size);
+        BenchStringComparisons<OperatorLess>("BenchStringOperatorLess", size);
+        BenchStringComparisons<std::less<CountedKey>>("BenchStringStdLess", size);
+    }
+}
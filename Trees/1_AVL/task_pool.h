@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fork-join thread pool with work stealing, for the parallel bulk operations of the trees.
+// Every worker keeps a deque of forked tasks: it pushes and pops its own at the back, so it
+// runs them depth first, while idle workers steal from the front of the other deques, where
+// the largest pieces of work wait. Threads outside the pool share one more deque. A thread
+// that waits for a stolen task runs other tasks meanwhile, so Invoke nests without deadlock.
+class TaskPool {
+public:
+    // A pool of `threads` threads in total, the caller included: it starts threads - 1
+    // workers, and the thread that calls Invoke does its share of the work.
+    explicit TaskPool(size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; ++i) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 1; i < threads; ++i) {
+            workers_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+    TaskPool(const TaskPool& other) = delete;
+    TaskPool& operator=(const TaskPool& other) = delete;
+    TaskPool(TaskPool&& other) = delete;
+    TaskPool& operator=(TaskPool&& other) = delete;
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    size_t Size() const noexcept {
+        return queues_.size();
+    }
+
+    // Runs both functions, possibly in parallel, and returns when both have finished. The
+    // second one is offered to the other threads while the caller runs the first. If either
+    // throws, the exception is rethrown here once both are done.
+    template <typename F, typename G>
+    void Invoke(F&& first, G&& second) {
+        if (Size() == 1) {
+            first();
+            second();
+            return;
+        }
+        Task task;
+        task.function = std::ref(second);
+        Queue& queue = *queues_[CurrentIndex()];
+        Push(queue, &task);
+        std::exception_ptr error;
+        try {
+            first();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        if (TryPopBack(queue, &task)) {
+            Run(&task);
+        }
+        while (!task.done.load(std::memory_order_acquire)) {
+            if (!RunOne(CurrentIndex())) {
+                std::this_thread::yield();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (task.error) {
+            std::rethrow_exception(task.error);
+        }
+    }
+
+    // Calls function(i) for every i in [begin, end), splitting the range in halves down to
+    // single indices.
+    template <typename F>
+    void ParallelFor(size_t begin, size_t end, const F& function) {
+        if (end - begin <= 1) {
+            if (begin < end) {
+                function(begin);
+            }
+            return;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        Invoke([&] { ParallelFor(begin, middle, function); },
+               [&] { ParallelFor(middle, end, function); });
+    }
+
+private:
+    struct Task {
+        std::function<void()> function;
+        std::atomic<bool> done{false};
+        std::exception_ptr error;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+    };
+
+    void Push(Queue& queue, Task* task) {
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(task);
+        }
+        pending_.fetch_add(1, std::memory_order_release);
+        // A worker that has just seen no work either sees the count or is already waiting.
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_one();
+    }
+
+    // Takes the task back if no other thread has stolen it. Tasks forked later by this
+    // thread have all been joined by now, so it can only be at the back.
+    bool TryPopBack(Queue& queue, Task* task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty() || queue.tasks.back() != task) {
+            return false;
+        }
+        queue.tasks.pop_back();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Task* Pop(size_t index) {
+        {
+            Queue& queue = *queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                Task* task = queue.tasks.back();
+                queue.tasks.pop_back();
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            Queue& queue = *queues_[(index + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                Task* task = queue.tasks.front();
+                queue.tasks.pop_front();
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    bool RunOne(size_t index) {
+        Task* task = Pop(index);
+        if (task == nullptr) {
+            return false;
+        }
+        Run(task);
+        return true;
+    }
+
+    static void Run(Task* task) {
+        try {
+            task->function();
+        } catch (...) {
+            task->error = std::current_exception();
+        }
+        task->done.store(true, std::memory_order_release);
+    }
+
+    void WorkerLoop(size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+        while (true) {
+            if (RunOne(index)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] {
+                return stop_ || pending_.load(std::memory_order_acquire) > 0;
+            });
+            if (stop_) {
+                return;
+            }
+        }
+    }
+
+    // Workers use their own deque; every other thread uses deque 0.
+    size_t CurrentIndex() const noexcept {
+        return current_pool_ == this ? current_index_ : 0;
+    }
+
+    static inline thread_local const TaskPool* current_pool_ = nullptr;
+    static inline thread_local size_t current_index_ = 0;
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> pending_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
@@ -0,0 +1,1288 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "node_search.h"
+
+// Slots per node: enough for 256 bytes of keys, so that a node spans a handful of cache lines.
+template <typename K>
+constexpr size_t DefaultBTreeSlots() {
+    return std::clamp<size_t>(256 / sizeof(K), 4, 64);
+}
+
+// Fixed-capacity storage for the keys or key/value pairs of a node. Only the first GetSize()
+// slots of the owning node are constructed.
+template <typename T, size_t kSlots>
+class BTreeSlots {
+public:
+    T* Data() noexcept {
+        return std::launder(reinterpret_cast<T*>(storage_));
+    }
+    const T* Data() const noexcept {
+        return std::launder(reinterpret_cast<const T*>(storage_));
+    }
+    T& operator[](size_t index) noexcept {
+        return Data()[index];
+    }
+    const T& operator[](size_t index) const noexcept {
+        return Data()[index];
+    }
+    template <typename... Args>
+    void Construct(size_t index, Args&&... args) {
+        ::new (static_cast<void*>(storage_ + index * sizeof(T))) T(std::forward<Args>(args)...);
+    }
+    void Destroy(size_t index) noexcept {
+        std::destroy_at(Data() + index);
+    }
+    // Moves a constructed slot into an unconstructed one, possibly of another node.
+    void Relocate(size_t from, BTreeSlots& to_slots, size_t to) {
+        to_slots.Construct(to, std::move((*this)[from]));
+        Destroy(from);
+    }
+
+private:
+    alignas(T) std::byte storage_[sizeof(T) * kSlots];
+};
+
+template <typename K, typename V, size_t kSlots>
+class BTreeInner;
+
+template <typename K, typename V, size_t kSlots>
+class BTreeLeaf;
+
+// Header shared by leaves, inner nodes and the end sentinel.
+template <typename K, typename V, size_t kSlots>
+class BTreeNode {
+public:
+    BTreeNode(bool leaf, bool end_node) noexcept : leaf_(leaf), end_node_(end_node) {
+    }
+    BTreeNode(const BTreeNode& other) = delete;
+    BTreeNode& operator=(const BTreeNode& other) = delete;
+    BTreeNode(BTreeNode&& other) = delete;
+    BTreeNode& operator=(BTreeNode&& other) = delete;
+    ~BTreeNode() noexcept = default;
+
+    BTreeInner<K, V, kSlots>* GetParent() const noexcept {
+        return parent_;
+    }
+    BTreeInner<K, V, kSlots>*& GetParent() noexcept {
+        return parent_;
+    }
+    size_t GetSize() const noexcept {
+        return size_;
+    }
+    void SetSize(size_t size) noexcept {
+        size_ = static_cast<uint16_t>(size);
+    }
+    bool IsLeaf() const noexcept {
+        return leaf_;
+    }
+    bool IsEndNode() const noexcept {
+        return end_node_;
+    }
+
+private:
+    BTreeInner<K, V, kSlots>* parent_ = nullptr;
+    uint16_t size_ = 0;
+    bool leaf_;
+    bool end_node_;
+};
+
+// Leaves are threaded into a list that starts and ends at the end sentinel of the map.
+template <typename K, typename V, size_t kSlots>
+class BTreeLeafBase : public BTreeNode<K, V, kSlots> {
+public:
+    BTreeLeafBase(BTreeLeafBase* prev, BTreeLeafBase* next, bool end_node) noexcept
+        : BTreeNode<K, V, kSlots>(true, end_node), prev_(prev), next_(next) {
+    }
+
+    BTreeLeafBase* GetPrev() const noexcept {
+        return prev_;
+    }
+    BTreeLeafBase*& GetPrev() noexcept {
+        return prev_;
+    }
+    BTreeLeafBase* GetNext() const noexcept {
+        return next_;
+    }
+    BTreeLeafBase*& GetNext() noexcept {
+        return next_;
+    }
+    const BTreeLeaf<K, V, kSlots>* GetLeaf() const {
+        if (this->IsEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<const BTreeLeaf<K, V, kSlots>*>(this);
+    }
+    BTreeLeaf<K, V, kSlots>* GetLeaf() {
+        if (this->IsEndNode()) {
+            throw std::out_of_range("Out of range!");
+        }
+        return static_cast<BTreeLeaf<K, V, kSlots>*>(this);
+    }
+
+private:
+    BTreeLeafBase* prev_;
+    BTreeLeafBase* next_;
+};
+
+template <typename K, typename V, size_t kSlots>
+class BTreeLeaf : public BTreeLeafBase<K, V, kSlots> {
+public:
+    BTreeLeaf() noexcept : BTreeLeafBase<K, V, kSlots>(nullptr, nullptr, false) {
+    }
+    ~BTreeLeaf() {
+        for (size_t i = 0; i < this->GetSize(); ++i) {
+            values_.Destroy(i);
+        }
+    }
+
+    const K& GetKey(size_t index) const noexcept {
+        return values_[index].first;
+    }
+    const std::pair<const K, V>& GetKeyValue(size_t index) const noexcept {
+        return values_[index];
+    }
+    std::pair<const K, V>& GetKeyValue(size_t index) noexcept {
+        return values_[index];
+    }
+    BTreeSlots<std::pair<const K, V>, kSlots>& GetValues() noexcept {
+        return values_;
+    }
+    const BTreeSlots<std::pair<const K, V>, kSlots>& GetValues() const noexcept {
+        return values_;
+    }
+
+    // Small trivially copyable keys are also kept in an array of their own, so that a search
+    // scans contiguous keys instead of key/value pairs. Whoever changes the elements from
+    // some position on has to call UpdateKeys for it.
+    static constexpr bool kKeyArray = std::is_trivially_copyable_v<K> && sizeof(K) <= 8;
+
+    const K* GetKeyArray() const noexcept {
+        return keys_.Data();
+    }
+    void UpdateKeys(size_t from) noexcept {
+        if constexpr (kKeyArray) {
+            for (size_t i = from; i < this->GetSize(); ++i) {
+                keys_.Construct(i, values_[i].first);
+            }
+        }
+    }
+
+private:
+    struct NoKeyArray {};
+
+    BTreeSlots<std::pair<const K, V>, kSlots> values_;
+    [[no_unique_address]] std::conditional_t<kKeyArray, BTreeSlots<K, kSlots>, NoKeyArray> keys_;
+};
+
+// An inner node with GetSize() keys has GetSize() + 1 children. All keys of child i are less
+// than key i, which is not greater than any key of child i + 1.
+template <typename K, typename V, size_t kSlots>
+class BTreeInner : public BTreeNode<K, V, kSlots> {
+public:
+    BTreeInner() noexcept : BTreeNode<K, V, kSlots>(false, false) {
+    }
+    ~BTreeInner() {
+        for (size_t i = 0; i < this->GetSize(); ++i) {
+            keys_.Destroy(i);
+        }
+    }
+
+    const K& GetKey(size_t index) const noexcept {
+        return keys_[index];
+    }
+    K& GetKey(size_t index) noexcept {
+        return keys_[index];
+    }
+    BTreeSlots<K, kSlots>& GetKeys() noexcept {
+        return keys_;
+    }
+    const BTreeSlots<K, kSlots>& GetKeys() const noexcept {
+        return keys_;
+    }
+    BTreeNode<K, V, kSlots>* GetChild(size_t index) const noexcept {
+        return children_[index];
+    }
+    BTreeNode<K, V, kSlots>*& GetChild(size_t index) noexcept {
+        return children_[index];
+    }
+
+private:
+    BTreeSlots<K, kSlots> keys_;
+    BTreeNode<K, V, kSlots>* children_[kSlots + 1] = {};
+};
+
+template <typename K, typename V, size_t kSlots>
+class BTreeEndNode : public BTreeLeafBase<K, V, kSlots> {
+public:
+    BTreeEndNode(BTreeLeafBase<K, V, kSlots>* prev, BTreeLeafBase<K, V, kSlots>* next) noexcept
+        : BTreeLeafBase<K, V, kSlots>(prev, next, true) {
+    }
+};
+
+// Ordered map on a B+ tree: the elements live in wide leaves that are chained in key order,
+// and the inner nodes hold only separator keys. Unlike MapAVL, Insert and Erase move elements
+// between nodes and so invalidate iterators.
+template <typename K, typename V, typename Compare = std::less<K>,
+          size_t kSlots = DefaultBTreeSlots<K>()>
+class MapBTree {
+    static_assert(kSlots >= 3 && kSlots <= std::numeric_limits<uint16_t>::max(),
+                  "A node must hold between 3 and 65535 slots");
+
+    using Node = BTreeNode<K, V, kSlots>;
+    using LeafBase = BTreeLeafBase<K, V, kSlots>;
+    using Leaf = BTreeLeaf<K, V, kSlots>;
+    using Inner = BTreeInner<K, V, kSlots>;
+
+public:
+    using ValueType = std::pair<const K, V>;
+    using Reference = ValueType&;
+    using Pointer = ValueType*;
+    using ConstReference = const ValueType&;
+    using ConstPointer = const ValueType*;
+
+    static constexpr size_t kMinLeafSize = kSlots / 2;
+    static constexpr size_t kMinInnerSize = (kSlots - 1) / 2;
+
+    class Iterator {
+    public:
+        Iterator(LeafBase* leaf, size_t index) noexcept : leaf_(leaf), index_(index) {
+        }
+        Reference operator*() const {
+            return leaf_->GetLeaf()->GetKeyValue(index_);
+        }
+        Pointer operator->() const {
+            return std::addressof(leaf_->GetLeaf()->GetKeyValue(index_));
+        }
+        Iterator& operator++() {
+            Inc();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator tmp = *this;
+            Inc();
+            return tmp;
+        }
+        Iterator& operator--() {
+            Dec();
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator tmp = *this;
+            Dec();
+            return tmp;
+        }
+        bool operator==(const Iterator& other) const noexcept {
+            return leaf_ == other.leaf_ && index_ == other.index_;
+        }
+        bool operator!=(const Iterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        friend class ConstIterator;
+        friend class MapBTree;
+
+    private:
+        void Inc() {
+            if (leaf_ != nullptr && !leaf_->IsEndNode()) {
+                if (++index_ == leaf_->GetSize()) {
+                    leaf_ = leaf_->GetNext();
+                    index_ = 0;
+                }
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        void Dec() {
+            if (leaf_ != nullptr && index_ > 0) {
+                --index_;
+            } else if (leaf_ != nullptr && !leaf_->GetPrev()->IsEndNode()) {
+                leaf_ = leaf_->GetPrev();
+                index_ = leaf_->GetSize() - 1;
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        LeafBase* leaf_ = nullptr;
+        size_t index_ = 0;
+    };
+
+    class ConstIterator {
+    public:
+        ConstIterator(const LeafBase* leaf, size_t index) noexcept : leaf_(leaf), index_(index) {
+        }
+        ConstIterator(Iterator it) noexcept : leaf_(it.leaf_), index_(it.index_) {
+        }
+        ConstReference operator*() const {
+            return leaf_->GetLeaf()->GetKeyValue(index_);
+        }
+        ConstPointer operator->() const {
+            return std::addressof(leaf_->GetLeaf()->GetKeyValue(index_));
+        }
+        ConstIterator& operator++() {
+            Inc();
+            return *this;
+        }
+        ConstIterator operator++(int) {
+            ConstIterator tmp = *this;
+            Inc();
+            return tmp;
+        }
+        ConstIterator& operator--() {
+            Dec();
+            return *this;
+        }
+        ConstIterator operator--(int) {
+            ConstIterator tmp = *this;
+            Dec();
+            return tmp;
+        }
+        bool operator==(const ConstIterator& other) const noexcept {
+            return leaf_ == other.leaf_ && index_ == other.index_;
+        }
+        bool operator!=(const ConstIterator& other) const noexcept {
+            return !(*this == other);
+        }
+        friend class MapBTree;
+
+    private:
+        void Inc() {
+            if (leaf_ != nullptr && !leaf_->IsEndNode()) {
+                if (++index_ == leaf_->GetSize()) {
+                    leaf_ = leaf_->GetNext();
+                    index_ = 0;
+                }
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        void Dec() {
+            if (leaf_ != nullptr && index_ > 0) {
+                --index_;
+            } else if (leaf_ != nullptr && !leaf_->GetPrev()->IsEndNode()) {
+                leaf_ = leaf_->GetPrev();
+                index_ = leaf_->GetSize() - 1;
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        const LeafBase* leaf_ = nullptr;
+        size_t index_ = 0;
+    };
+
+    class ReverseIterator {
+    public:
+        ReverseIterator(LeafBase* leaf, size_t index) noexcept : leaf_(leaf), index_(index) {
+        }
+        Reference operator*() const {
+            return leaf_->GetLeaf()->GetKeyValue(index_);
+        }
+        Pointer operator->() const {
+            return std::addressof(leaf_->GetLeaf()->GetKeyValue(index_));
+        }
+        ReverseIterator& operator++() {
+            Inc();
+            return *this;
+        }
+        ReverseIterator operator++(int) {
+            ReverseIterator tmp = *this;
+            Inc();
+            return tmp;
+        }
+        ReverseIterator& operator--() {
+            Dec();
+            return *this;
+        }
+        ReverseIterator operator--(int) {
+            ReverseIterator tmp = *this;
+            Dec();
+            return tmp;
+        }
+        bool operator==(const ReverseIterator& other) const noexcept {
+            return leaf_ == other.leaf_ && index_ == other.index_;
+        }
+        bool operator!=(const ReverseIterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        friend class ConstReverseIterator;
+
+    private:
+        void Inc() {
+            if (leaf_ != nullptr && !leaf_->IsEndNode()) {
+                if (index_ > 0) {
+                    --index_;
+                } else {
+                    leaf_ = leaf_->GetPrev();
+                    index_ = leaf_->IsEndNode() ? 0 : leaf_->GetSize() - 1;
+                }
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        void Dec() {
+            if (leaf_ != nullptr && index_ + 1 < leaf_->GetSize()) {
+                ++index_;
+            } else if (leaf_ != nullptr && !leaf_->GetNext()->IsEndNode()) {
+                leaf_ = leaf_->GetNext();
+                index_ = 0;
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        LeafBase* leaf_ = nullptr;
+        size_t index_ = 0;
+    };
+
+    class ConstReverseIterator {
+    public:
+        ConstReverseIterator(const LeafBase* leaf, size_t index) noexcept
+            : leaf_(leaf), index_(index) {
+        }
+        ConstReverseIterator(ReverseIterator it) noexcept : leaf_(it.leaf_), index_(it.index_) {
+        }
+        ConstReference operator*() const {
+            return leaf_->GetLeaf()->GetKeyValue(index_);
+        }
+        ConstPointer operator->() const {
+            return std::addressof(leaf_->GetLeaf()->GetKeyValue(index_));
+        }
+        ConstReverseIterator& operator++() {
+            Inc();
+            return *this;
+        }
+        ConstReverseIterator operator++(int) {
+            ConstReverseIterator tmp = *this;
+            Inc();
+            return tmp;
+        }
+        ConstReverseIterator& operator--() {
+            Dec();
+            return *this;
+        }
+        ConstReverseIterator operator--(int) {
+            ConstReverseIterator tmp = *this;
+            Dec();
+            return tmp;
+        }
+        bool operator==(const ConstReverseIterator& other) const noexcept {
+            return leaf_ == other.leaf_ && index_ == other.index_;
+        }
+        bool operator!=(const ConstReverseIterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+    private:
+        void Inc() {
+            if (leaf_ != nullptr && !leaf_->IsEndNode()) {
+                if (index_ > 0) {
+                    --index_;
+                } else {
+                    leaf_ = leaf_->GetPrev();
+                    index_ = leaf_->IsEndNode() ? 0 : leaf_->GetSize() - 1;
+                }
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        void Dec() {
+            if (leaf_ != nullptr && index_ + 1 < leaf_->GetSize()) {
+                ++index_;
+            } else if (leaf_ != nullptr && !leaf_->GetNext()->IsEndNode()) {
+                leaf_ = leaf_->GetNext();
+                index_ = 0;
+            } else {
+                leaf_ = nullptr;
+            }
+        }
+        const LeafBase* leaf_ = nullptr;
+        size_t index_ = 0;
+    };
+
+    MapBTree() : MapBTree(Compare()) {
+    }
+    explicit MapBTree(const Compare& compare) : compare_(compare) {
+    }
+    MapBTree(const MapBTree& other) : compare_(other.compare_) {
+        if (other.root_ != nullptr) {
+            LeafBase* prev_leaf = std::addressof(end_node_);
+            root_ = CopyNode(other.root_, prev_leaf);
+            prev_leaf->GetNext() = std::addressof(end_node_);
+            end_node_.GetPrev() = prev_leaf;
+            size_ = other.size_;
+            height_ = other.height_;
+        }
+    }
+    MapBTree& operator=(const MapBTree& other) {
+        return *this = MapBTree(other);
+    }
+    MapBTree(MapBTree&& other) noexcept : compare_(other.compare_) {
+        SwapNodes(other);
+    }
+    MapBTree& operator=(MapBTree&& other) noexcept {
+        MapBTree tmp = std::move(other);
+        Swap(tmp);
+        return *this;
+    }
+    ~MapBTree() {
+        DestroyNodes();
+    }
+
+    void Clear() noexcept {
+        DestroyNodes();
+    }
+    void Swap(MapBTree& other) {
+        std::swap(compare_, other.compare_);
+        SwapNodes(other);
+    }
+    std::pair<Iterator, bool> Insert(const ValueType& key_value) {
+        return InsertValue(key_value);
+    }
+    std::pair<Iterator, bool> Insert(ValueType&& key_value) {
+        return InsertValue(std::move(key_value));
+    }
+    template <typename P>
+    std::pair<Iterator, bool> Insert(P&& key_value) {
+        return InsertValue(std::forward<P>(key_value));
+    }
+    template <typename InputIt>
+    void Insert(InputIt first, InputIt last) {
+        for (auto it = first; it != last; ++it) {
+            Insert(*it);
+        }
+    }
+    void Insert(std::initializer_list<ValueType> ilist) {
+        Insert(ilist.begin(), ilist.end());
+    }
+    Iterator Erase(ConstIterator pos) {
+        auto leaf = const_cast<LeafBase*>(pos.leaf_)->GetLeaf();
+        return EraseValue(leaf, pos.index_);
+    }
+    Iterator Erase(Iterator pos) {
+        return Erase(ConstIterator{pos});
+    }
+    Iterator Erase(ConstIterator first, ConstIterator last) {
+        size_t count = 0;
+        for (auto it = first; it != last; ++it) {
+            ++count;
+        }
+        Iterator it{const_cast<LeafBase*>(first.leaf_), first.index_};
+        for (; count > 0; --count) {
+            it = Erase(it);
+        }
+        return it;
+    }
+    size_t Erase(const K& key) {
+        auto it = Find(key);
+        if (it == End()) {
+            return 0;
+        }
+        Erase(it);
+        return 1;
+    }
+    Iterator Find(const K& key) {
+        auto [leaf, index] = FindPosition(key);
+        return Iterator{leaf, index};
+    }
+    ConstIterator Find(const K& key) const {
+        auto [leaf, index] = FindPosition(key);
+        return ConstIterator{leaf, index};
+    }
+    Iterator LowerBound(const K& key) {
+        auto [leaf, index] = FindLowerBound(key);
+        return Iterator{leaf, index};
+    }
+    ConstIterator LowerBound(const K& key) const {
+        auto [leaf, index] = FindLowerBound(key);
+        return ConstIterator{leaf, index};
+    }
+    Iterator UpperBound(const K& key) {
+        auto [leaf, index] = FindUpperBound(key);
+        return Iterator{leaf, index};
+    }
+    ConstIterator UpperBound(const K& key) const {
+        auto [leaf, index] = FindUpperBound(key);
+        return ConstIterator{leaf, index};
+    }
+    std::pair<Iterator, Iterator> EqualRange(const K& key) {
+        auto first = LowerBound(key);
+        if (first != End() && Equivalent(first->first, key, compare_)) {
+            auto last = first;
+            return {first, ++last};
+        }
+        return {first, first};
+    }
+    std::pair<ConstIterator, ConstIterator> EqualRange(const K& key) const {
+        auto first = LowerBound(key);
+        if (first != End() && Equivalent(first->first, key, compare_)) {
+            auto last = first;
+            return {first, ++last};
+        }
+        return {first, first};
+    }
+    bool Contains(const K& key) const {
+        return Find(key) != End();
+    }
+    size_t Count(const K& key) const {
+        return static_cast<size_t>(Contains(key));
+    }
+    Iterator Begin() noexcept {
+        return Iterator{end_node_.GetNext(), 0};
+    }
+    ConstIterator Begin() const noexcept {
+        return ConstIterator{end_node_.GetNext(), 0};
+    }
+    Iterator End() noexcept {
+        return Iterator{std::addressof(end_node_), 0};
+    }
+    ConstIterator End() const noexcept {
+        return ConstIterator{std::addressof(end_node_), 0};
+    }
+    ConstIterator CBegin() const noexcept {
+        return Begin();
+    }
+    ConstIterator CEnd() const noexcept {
+        return End();
+    }
+    ReverseIterator RBegin() noexcept {
+        LeafBase* last = end_node_.GetPrev();
+        return ReverseIterator{last, last->IsEndNode() ? 0 : last->GetSize() - 1};
+    }
+    ConstReverseIterator RBegin() const noexcept {
+        const LeafBase* last = end_node_.GetPrev();
+        return ConstReverseIterator{last, last->IsEndNode() ? 0 : last->GetSize() - 1};
+    }
+    ReverseIterator REnd() noexcept {
+        return ReverseIterator{std::addressof(end_node_), 0};
+    }
+    ConstReverseIterator REnd() const noexcept {
+        return ConstReverseIterator{std::addressof(end_node_), 0};
+    }
+    ConstReverseIterator CRBegin() const noexcept {
+        return RBegin();
+    }
+    ConstReverseIterator CREnd() const noexcept {
+        return REnd();
+    }
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+    static constexpr size_t MaxSize() noexcept {
+        return (std::numeric_limits<std::ptrdiff_t>::max() / sizeof(ValueType));
+    }
+    bool Empty() const noexcept {
+        return (root_ == nullptr);
+    }
+    Compare KeyCompare() const {
+        return compare_;
+    }
+    const Node* GetRootPtr() const noexcept {
+        return root_;
+    }
+    // Number of levels, leaves included; 0 for an empty map.
+    size_t GetHeight() const noexcept {
+        return height_;
+    }
+
+private:
+    static bool Equivalent(const K& key_1, const K& key_2, const Compare& compare) {
+        return !compare(key_1, key_2) && !compare(key_2, key_1);
+    }
+
+    // Position of the first key in the leaf that is not less than the key.
+    size_t LeafLowerBound(const Leaf* leaf, const K& key) const {
+        if constexpr (Leaf::kKeyArray) {
+            return NodeLowerBound(leaf->GetKeyArray(), leaf->GetSize(), key, compare_);
+        }
+        const ValueType* values = leaf->GetValues().Data();
+        return std::lower_bound(values, values + leaf->GetSize(), key,
+                                [this](const ValueType& key_value, const K& other) {
+                                    return compare_(key_value.first, other);
+                                }) -
+               values;
+    }
+    size_t LeafUpperBound(const Leaf* leaf, const K& key) const {
+        if constexpr (Leaf::kKeyArray) {
+            return NodeUpperBound(leaf->GetKeyArray(), leaf->GetSize(), key, compare_);
+        }
+        const ValueType* values = leaf->GetValues().Data();
+        return std::upper_bound(values, values + leaf->GetSize(), key,
+                                [this](const K& other, const ValueType& key_value) {
+                                    return compare_(other, key_value.first);
+                                }) -
+               values;
+    }
+    // Index of the child of the inner node whose range holds the key.
+    size_t ChildFor(const Inner* inner, const K& key) const {
+        return NodeUpperBound(inner->GetKeys().Data(), inner->GetSize(), key, compare_);
+    }
+
+    Leaf* FindLeaf(const K& key) const {
+        Node* node = root_;
+        while (!node->IsLeaf()) {
+            auto inner = static_cast<Inner*>(node);
+            node = inner->GetChild(ChildFor(inner, key));
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    // The end sentinel is reported as leaf position 0, so the results map onto iterators.
+    std::pair<LeafBase*, size_t> EndPosition() const noexcept {
+        return {const_cast<BTreeEndNode<K, V, kSlots>*>(std::addressof(end_node_)), 0};
+    }
+    std::pair<LeafBase*, size_t> Normalize(LeafBase* leaf, size_t index) const noexcept {
+        if (index == leaf->GetSize()) {
+            return {leaf->GetNext(), 0};
+        }
+        return {leaf, index};
+    }
+    std::pair<LeafBase*, size_t> FindPosition(const K& key) const {
+        if (Empty()) {
+            return EndPosition();
+        }
+        Leaf* leaf = FindLeaf(key);
+        size_t index = LeafLowerBound(leaf, key);
+        if (index < leaf->GetSize() && Equivalent(leaf->GetKey(index), key, compare_)) {
+            return {leaf, index};
+        }
+        return EndPosition();
+    }
+    std::pair<LeafBase*, size_t> FindLowerBound(const K& key) const {
+        if (Empty()) {
+            return EndPosition();
+        }
+        Leaf* leaf = FindLeaf(key);
+        return Normalize(leaf, LeafLowerBound(leaf, key));
+    }
+    std::pair<LeafBase*, size_t> FindUpperBound(const K& key) const {
+        if (Empty()) {
+            return EndPosition();
+        }
+        Leaf* leaf = FindLeaf(key);
+        return Normalize(leaf, LeafUpperBound(leaf, key));
+    }
+
+    size_t ChildIndex(const Inner* parent, const Node* child) const noexcept {
+        size_t index = 0;
+        while (parent->GetChild(index) != child) {
+            ++index;
+        }
+        return index;
+    }
+
+    void LinkLeafAfter(LeafBase* prev, Leaf* leaf) noexcept {
+        leaf->GetPrev() = prev;
+        leaf->GetNext() = prev->GetNext();
+        prev->GetNext()->GetPrev() = leaf;
+        prev->GetNext() = leaf;
+    }
+    void UnlinkLeaf(Leaf* leaf) noexcept {
+        leaf->GetPrev()->GetNext() = leaf->GetNext();
+        leaf->GetNext()->GetPrev() = leaf->GetPrev();
+    }
+
+    // Shifts the tail of the leaf right by one and constructs the element in the gap. If the
+    // construction throws, the tail is shifted back.
+    template <typename P>
+    void LeafInsert(Leaf* leaf, size_t index, P&& key_value) {
+        auto& values = leaf->GetValues();
+        size_t size = leaf->GetSize();
+        for (size_t i = size; i > index; --i) {
+            values.Relocate(i - 1, values, i);
+        }
+        try {
+            values.Construct(index, std::forward<P>(key_value));
+        } catch (...) {
+            for (size_t i = index; i < size; ++i) {
+                values.Relocate(i + 1, values, i);
+            }
+            throw;
+        }
+        leaf->SetSize(size + 1);
+        leaf->UpdateKeys(index);
+    }
+    void LeafErase(Leaf* leaf, size_t index) {
+        auto& values = leaf->GetValues();
+        values.Destroy(index);
+        for (size_t i = index + 1; i < leaf->GetSize(); ++i) {
+            values.Relocate(i, values, i - 1);
+        }
+        leaf->SetSize(leaf->GetSize() - 1);
+        leaf->UpdateKeys(index);
+    }
+    // Puts the key at key_index and the child at key_index + 1, shifting the rest right.
+    void InnerInsert(Inner* inner, size_t key_index, K key, Node* child) {
+        auto& keys = inner->GetKeys();
+        size_t size = inner->GetSize();
+        for (size_t i = size; i > key_index; --i) {
+            keys.Relocate(i - 1, keys, i);
+            inner->GetChild(i + 1) = inner->GetChild(i);
+        }
+        keys.Construct(key_index, std::move(key));
+        inner->GetChild(key_index + 1) = child;
+        child->GetParent() = inner;
+        inner->SetSize(size + 1);
+    }
+    // Drops the key at key_index and the child at child_index, which is key_index or
+    // key_index + 1.
+    void InnerErase(Inner* inner, size_t key_index, size_t child_index) {
+        auto& keys = inner->GetKeys();
+        size_t size = inner->GetSize();
+        keys.Destroy(key_index);
+        for (size_t i = key_index + 1; i < size; ++i) {
+            keys.Relocate(i, keys, i - 1);
+        }
+        for (size_t i = child_index + 1; i <= size; ++i) {
+            inner->GetChild(i - 1) = inner->GetChild(i);
+        }
+        inner->GetChild(size) = nullptr;
+        inner->SetSize(size - 1);
+    }
+
+    template <typename P>
+    std::pair<Iterator, bool> InsertValue(P&& key_value) {
+        if (root_ == nullptr) {
+            auto leaf = new Leaf();
+            LinkLeafAfter(std::addressof(end_node_), leaf);
+            root_ = leaf;
+            height_ = 1;
+        }
+        Leaf* leaf = FindLeaf(key_value.first);
+        size_t index = LeafLowerBound(leaf, key_value.first);
+        if (index < leaf->GetSize() && Equivalent(leaf->GetKey(index), key_value.first, compare_)) {
+            return {Iterator{leaf, index}, false};
+        }
+        if (leaf->GetSize() == kSlots) {
+            Leaf* right = SplitLeaf(leaf);
+            if (index > leaf->GetSize()) {
+                index -= leaf->GetSize();
+                leaf = right;
+            }
+        }
+        try {
+            LeafInsert(leaf, index, std::forward<P>(key_value));
+        } catch (...) {
+            if (size_ == 0) {
+                DestroyNodes();
+            }
+            throw;
+        }
+        ++size_;
+        return {Iterator{leaf, index}, true};
+    }
+
+    // Moves the upper half of a full leaf to a new leaf on its right.
+    Leaf* SplitLeaf(Leaf* leaf) {
+        auto right = new Leaf();
+        size_t middle = kSlots / 2;
+        try {
+            InsertIntoParent(leaf, K(leaf->GetKey(middle)), right);
+        } catch (...) {
+            delete right;
+            throw;
+        }
+        auto& values = leaf->GetValues();
+        for (size_t i = middle; i < kSlots; ++i) {
+            values.Relocate(i, right->GetValues(), i - middle);
+        }
+        leaf->SetSize(middle);
+        right->SetSize(kSlots - middle);
+        right->UpdateKeys(0);
+        LinkLeafAfter(leaf, right);
+        return right;
+    }
+
+    // Hangs the new right sibling of the node off their parent, splitting the parent if it is
+    // full and growing a new root if the node was the root.
+    void InsertIntoParent(Node* node, K key, Node* right) {
+        if (node == root_) {
+            auto root = new Inner();
+            root->GetKeys().Construct(0, std::move(key));
+            root->SetSize(1);
+            root->GetChild(0) = node;
+            root->GetChild(1) = right;
+            node->GetParent() = root;
+            right->GetParent() = root;
+            root_ = root;
+            ++height_;
+            return;
+        }
+        Inner* parent = node->GetParent();
+        size_t index = ChildIndex(parent, node);
+        if (parent->GetSize() == kSlots) {
+            auto [sibling, middle] = SplitInner(parent);
+            if (index > middle) {
+                index -= middle + 1;
+                parent = sibling;
+            }
+        }
+        InnerInsert(parent, index, std::move(key), right);
+    }
+
+    // Moves the keys after the middle one and their children to a new inner node on the right
+    // and pushes the middle key up. Returns the new node and the size of the left one.
+    std::pair<Inner*, size_t> SplitInner(Inner* inner) {
+        auto right = new Inner();
+        size_t middle = kSlots / 2;
+        try {
+            InsertIntoParent(inner, K(inner->GetKey(middle)), right);
+        } catch (...) {
+            delete right;
+            throw;
+        }
+        auto& keys = inner->GetKeys();
+        for (size_t i = middle + 1; i < kSlots; ++i) {
+            keys.Relocate(i, right->GetKeys(), i - middle - 1);
+        }
+        for (size_t i = middle + 1; i <= kSlots; ++i) {
+            right->GetChild(i - middle - 1) = inner->GetChild(i);
+            right->GetChild(i - middle - 1)->GetParent() = right;
+            inner->GetChild(i) = nullptr;
+        }
+        keys.Destroy(middle);
+        inner->SetSize(middle);
+        right->SetSize(kSlots - middle - 1);
+        return {right, middle};
+    }
+
+    Iterator EraseValue(Leaf* leaf, size_t index) {
+        LeafErase(leaf, index);
+        --size_;
+        if (leaf == root_) {
+            if (leaf->GetSize() == 0) {
+                DestroyNodes();
+                return End();
+            }
+        } else if (leaf->GetSize() < kMinLeafSize) {
+            std::tie(leaf, index) = RebalanceLeaf(leaf, index);
+        }
+        auto [next_leaf, next_index] = Normalize(leaf, index);
+        return Iterator{next_leaf, next_index};
+    }
+
+    // Refills a leaf that fell below the minimum from a sibling, or merges it with one.
+    // Returns where the element at the given position of the leaf ended up.
+    std::pair<Leaf*, size_t> RebalanceLeaf(Leaf* leaf, size_t index) {
+        Inner* parent = leaf->GetParent();
+        size_t child_index = ChildIndex(parent, leaf);
+        auto left = child_index > 0 ? static_cast<Leaf*>(parent->GetChild(child_index - 1))
+                                    : nullptr;
+        auto right = child_index < parent->GetSize()
+                         ? static_cast<Leaf*>(parent->GetChild(child_index + 1))
+                         : nullptr;
+        if (left != nullptr && left->GetSize() > kMinLeafSize) {
+            size_t last = left->GetSize() - 1;
+            auto& values = leaf->GetValues();
+            for (size_t i = leaf->GetSize(); i > 0; --i) {
+                values.Relocate(i - 1, values, i);
+            }
+            left->GetValues().Relocate(last, values, 0);
+            left->SetSize(last);
+            leaf->SetSize(leaf->GetSize() + 1);
+            leaf->UpdateKeys(0);
+            parent->GetKey(child_index - 1) = leaf->GetKey(0);
+            return {leaf, index + 1};
+        }
+        if (right != nullptr && right->GetSize() > kMinLeafSize) {
+            right->GetValues().Relocate(0, leaf->GetValues(), leaf->GetSize());
+            leaf->SetSize(leaf->GetSize() + 1);
+            auto& values = right->GetValues();
+            for (size_t i = 1; i < right->GetSize(); ++i) {
+                values.Relocate(i, values, i - 1);
+            }
+            right->SetSize(right->GetSize() - 1);
+            leaf->UpdateKeys(leaf->GetSize() - 1);
+            right->UpdateKeys(0);
+            parent->GetKey(child_index) = right->GetKey(0);
+            return {leaf, index};
+        }
+        if (left != nullptr) {
+            index += left->GetSize();
+            MergeLeaves(left, leaf);
+            RemoveFromInner(parent, child_index - 1, child_index);
+            return {left, index};
+        }
+        MergeLeaves(leaf, right);
+        RemoveFromInner(parent, child_index, child_index + 1);
+        return {leaf, index};
+    }
+
+    void MergeLeaves(Leaf* left, Leaf* right) {
+        size_t size = left->GetSize();
+        for (size_t i = 0; i < right->GetSize(); ++i) {
+            right->GetValues().Relocate(i, left->GetValues(), size + i);
+        }
+        left->SetSize(size + right->GetSize());
+        left->UpdateKeys(size);
+        right->SetSize(0);
+        UnlinkLeaf(right);
+        delete right;
+    }
+
+    void RemoveFromInner(Inner* inner, size_t key_index, size_t child_index) {
+        InnerErase(inner, key_index, child_index);
+        if (inner == root_) {
+            if (inner->GetSize() == 0) {
+                root_ = inner->GetChild(0);
+                root_->GetParent() = nullptr;
+                delete inner;
+                --height_;
+            }
+        } else if (inner->GetSize() < kMinInnerSize) {
+            RebalanceInner(inner);
+        }
+    }
+
+    // Same as RebalanceLeaf, but the separator in the parent rotates through the node.
+    void RebalanceInner(Inner* inner) {
+        Inner* parent = inner->GetParent();
+        size_t child_index = ChildIndex(parent, inner);
+        auto left = child_index > 0 ? static_cast<Inner*>(parent->GetChild(child_index - 1))
+                                    : nullptr;
+        auto right = child_index < parent->GetSize()
+                         ? static_cast<Inner*>(parent->GetChild(child_index + 1))
+                         : nullptr;
+        auto& keys = inner->GetKeys();
+        size_t size = inner->GetSize();
+        if (left != nullptr && left->GetSize() > kMinInnerSize) {
+            size_t last = left->GetSize() - 1;
+            for (size_t i = size; i > 0; --i) {
+                keys.Relocate(i - 1, keys, i);
+            }
+            for (size_t i = size + 1; i > 0; --i) {
+                inner->GetChild(i) = inner->GetChild(i - 1);
+            }
+            keys.Construct(0, std::move(parent->GetKey(child_index - 1)));
+            inner->GetChild(0) = left->GetChild(last + 1);
+            inner->GetChild(0)->GetParent() = inner;
+            inner->SetSize(size + 1);
+            parent->GetKey(child_index - 1) = std::move(left->GetKey(last));
+            left->GetKeys().Destroy(last);
+            left->GetChild(last + 1) = nullptr;
+            left->SetSize(last);
+            return;
+        }
+        if (right != nullptr && right->GetSize() > kMinInnerSize) {
+            keys.Construct(size, std::move(parent->GetKey(child_index)));
+            inner->GetChild(size + 1) = right->GetChild(0);
+            inner->GetChild(size + 1)->GetParent() = inner;
+            inner->SetSize(size + 1);
+            parent->GetKey(child_index) = std::move(right->GetKey(0));
+            right->GetChild(0) = right->GetChild(1);
+            InnerErase(right, 0, 1);
+            return;
+        }
+        if (left != nullptr) {
+            MergeInners(left, parent->GetKey(child_index - 1), inner);
+            RemoveFromInner(parent, child_index - 1, child_index);
+            return;
+        }
+        MergeInners(inner, parent->GetKey(child_index), right);
+        RemoveFromInner(parent, child_index, child_index + 1);
+    }
+
+    void MergeInners(Inner* left, K& separator, Inner* right) {
+        size_t size = left->GetSize();
+        left->GetKeys().Construct(size, std::move(separator));
+        for (size_t i = 0; i < right->GetSize(); ++i) {
+            right->GetKeys().Relocate(i, left->GetKeys(), size + 1 + i);
+        }
+        for (size_t i = 0; i <= right->GetSize(); ++i) {
+            left->GetChild(size + 1 + i) = right->GetChild(i);
+            left->GetChild(size + 1 + i)->GetParent() = left;
+        }
+        left->SetSize(size + 1 + right->GetSize());
+        right->SetSize(0);
+        delete right;
+    }
+
+    // Copies a subtree, threading the new leaves after prev_leaf. A subtree that fails half way
+    // is freed before the exception leaves. The recursion is as deep as the tree is high.
+    Node* CopyNode(const Node* other, LeafBase*& prev_leaf) {
+        if (other->IsLeaf()) {
+            auto other_leaf = static_cast<const Leaf*>(other);
+            auto leaf = new Leaf();
+            try {
+                for (size_t i = 0; i < other_leaf->GetSize(); ++i) {
+                    leaf->GetValues().Construct(i, other_leaf->GetKeyValue(i));
+                    leaf->SetSize(i + 1);
+                }
+            } catch (...) {
+                delete leaf;
+                throw;
+            }
+            leaf->UpdateKeys(0);
+            leaf->GetPrev() = prev_leaf;
+            prev_leaf->GetNext() = leaf;
+            prev_leaf = leaf;
+            return leaf;
+        }
+        auto other_inner = static_cast<const Inner*>(other);
+        auto inner = new Inner();
+        size_t children = 0;
+        try {
+            for (size_t i = 0; i < other_inner->GetSize(); ++i) {
+                inner->GetKeys().Construct(i, other_inner->GetKey(i));
+                inner->SetSize(i + 1);
+            }
+            for (; children <= other_inner->GetSize(); ++children) {
+                inner->GetChild(children) = CopyNode(other_inner->GetChild(children), prev_leaf);
+                inner->GetChild(children)->GetParent() = inner;
+            }
+        } catch (...) {
+            for (size_t i = 0; i < children; ++i) {
+                DestroyNode(inner->GetChild(i));
+            }
+            delete inner;
+            throw;
+        }
+        return inner;
+    }
+
+    void DestroyNode(Node* node) noexcept {
+        if (node->IsLeaf()) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        auto inner = static_cast<Inner*>(node);
+        for (size_t i = 0; i <= inner->GetSize(); ++i) {
+            DestroyNode(inner->GetChild(i));
+        }
+        delete inner;
+    }
+
+    void DestroyNodes() noexcept {
+        if (root_ != nullptr) {
+            DestroyNode(root_);
+        }
+        root_ = nullptr;
+        size_ = 0;
+        height_ = 0;
+        end_node_.GetNext() = std::addressof(end_node_);
+        end_node_.GetPrev() = std::addressof(end_node_);
+    }
+
+    void ConnectEndNode() noexcept {
+        if (root_ == nullptr) {
+            end_node_.GetNext() = std::addressof(end_node_);
+            end_node_.GetPrev() = std::addressof(end_node_);
+        } else {
+            end_node_.GetNext()->GetPrev() = std::addressof(end_node_);
+            end_node_.GetPrev()->GetNext() = std::addressof(end_node_);
+        }
+    }
+
+    void SwapNodes(MapBTree& other) noexcept {
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        std::swap(height_, other.height_);
+        std::swap(end_node_.GetNext(), other.end_node_.GetNext());
+        std::swap(end_node_.GetPrev(), other.end_node_.GetPrev());
+        ConnectEndNode();
+        other.ConnectEndNode();
+    }
+
+    Node* root_ = nullptr;
+    size_t size_ = 0;
+    size_t height_ = 0;
+    [[no_unique_address]] Compare compare_;
+    BTreeEndNode<K, V, kSlots> end_node_{std::addressof(end_node_), std::addressof(end_node_)};
+};
+
+template <typename K, typename V, typename Compare, size_t kSlots>
+bool operator==(const MapBTree<K, V, Compare, kSlots>& lhs,
+                const MapBTree<K, V, Compare, kSlots>& rhs) {
+    if (lhs.Size() != rhs.Size()) {
+        return false;
+    }
+
+    Compare compare = lhs.KeyCompare();
+
+    for (auto it = lhs.Begin(), jt = rhs.Begin(); it != lhs.End(); ++it, ++jt) {
+        if (compare(it->first, jt->first) || compare(jt->first, it->first) ||
+            (it->second != jt->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename K, typename V, typename Compare, size_t kSlots>
+void Swap(MapBTree<K, V, Compare, kSlots>& lhs, MapBTree<K, V, Compare, kSlots>& rhs) {
+    lhs.Swap(rhs);
+}
+
+template <typename K, typename V, typename Compare, size_t kSlots>
+bool operator!=(const MapBTree<K, V, Compare, kSlots>& lhs,
+                const MapBTree<K, V, Compare, kSlots>& rhs) {
+    return !(lhs == rhs);
+}
+
+// Returns the height of a valid subtree and -1 otherwise. Checks the key order, the separator
+// bounds (keys lie in [lower, upper) where given), the fill of non-root nodes, the parent links
+// and that all leaves are at the same depth.
+template <typename K, typename V, size_t kSlots, typename Compare>
+int CheckBTreeNode(const BTreeNode<K, V, kSlots>* node, const Compare& compare,
+                   const K* lower = nullptr, const K* upper = nullptr) {
+    if (!node) {
+        return 0;
+    }
+    size_t size = node->GetSize();
+    bool root = node->GetParent() == nullptr;
+    auto in_bounds = [&](const K& key) {
+        return (!lower || !compare(key, *lower)) && (!upper || compare(key, *upper));
+    };
+    if (node->IsLeaf()) {
+        auto leaf = static_cast<const BTreeLeaf<K, V, kSlots>*>(node);
+        if (size == 0 || size > kSlots || (!root && size < kSlots / 2)) {
+            return -1;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (!in_bounds(leaf->GetKey(i)) ||
+                (i > 0 && !compare(leaf->GetKey(i - 1), leaf->GetKey(i)))) {
+                return -1;
+            }
+            if constexpr (BTreeLeaf<K, V, kSlots>::kKeyArray) {
+                const K& copy = leaf->GetKeyArray()[i];
+                if (compare(copy, leaf->GetKey(i)) || compare(leaf->GetKey(i), copy)) {
+                    return -1;
+                }
+            }
+        }
+        return 1;
+    }
+    auto inner = static_cast<const BTreeInner<K, V, kSlots>*>(node);
+    if (size == 0 || size > kSlots || (!root && size < (kSlots - 1) / 2)) {
+        return -1;
+    }
+    int height = -1;
+    for (size_t i = 0; i <= size; ++i) {
+        if (i < size && (!in_bounds(inner->GetKey(i)) ||
+                         (i > 0 && !compare(inner->GetKey(i - 1), inner->GetKey(i))))) {
+            return -1;
+        }
+        const auto child = inner->GetChild(i);
+        if (child == nullptr || child->GetParent() != inner) {
+            return -1;
+        }
+        int child_height = CheckBTreeNode(child, compare, i > 0 ? &inner->GetKey(i - 1) : lower,
+                                          i < size ? &inner->GetKey(i) : upper);
+        if (child_height < 0 || (height >= 0 && child_height != height)) {
+            return -1;
+        }
+        height = child_height;
+    }
+    return height + 1;
+}
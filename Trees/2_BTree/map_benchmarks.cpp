@@ -0,0 +1,84 @@
+#include "../1_AVL/MapAVL.h"
+#include "MapBTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+// Runs the same workload against MapAVL and MapBTree: random inserts, random hits, lower
+// bounds of absent keys, a full scan and random erases.
+template <typename Map>
+void BenchMap(const std::string& name, size_t size) {
+    auto keys = GenerateShuffledKeys(size, 42);
+    auto probes = GenerateShuffledKeys(size, 43);
+    long long checksum = 0;
+    Map map;
+    double insert_seconds = MeasureSeconds([&] {
+        for (int key : keys) {
+            map.Insert({key * 2, key});
+        }
+    });
+    Report(name + "Insert", size, size, insert_seconds);
+    double find_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += map.Find(key * 2)->second;
+        }
+    });
+    Report(name + "Find", size, size, find_seconds);
+    double lower_bound_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            auto it = map.LowerBound(key * 2 - 1);
+            checksum += it->second;
+        }
+    });
+    Report(name + "LowerBound", size, size, lower_bound_seconds);
+    double iterate_seconds = MeasureSeconds([&] {
+        for (auto it = map.CBegin(); it != map.CEnd(); ++it) {
+            checksum += it->second;
+        }
+    });
+    Report(name + "Iterate", size, size, iterate_seconds);
+    double erase_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            map.Erase(key * 2);
+        }
+    });
+    Report(name + "Erase", size, size, erase_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {100'000, 1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    for (size_t size : sizes) {
+        BenchMap<MapAVL<int, int>>("MapAVL", size);
+        BenchMap<MapBTree<int, int>>("MapBTree", size);
+    }
+}
@@ -0,0 +1,608 @@
+#include "MapBTree.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ComplexKey {
+    int x;
+    std::string y;
+    bool operator<(const ComplexKey& other) const {
+        if (x != other.x) {
+            return x < other.x;
+        }
+        return y < other.y;
+    }
+    bool operator==(const ComplexKey& other) const {
+        return x == other.x && y == other.y;
+    }
+};
+
+std::vector<int> GenerateRandomVector(size_t size, int min_val, int max_val, unsigned seed = 42) {
+    std::vector<int> result;
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dis(min_val, max_val);
+    result.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        result.push_back(dis(gen));
+    }
+    return result;
+}
+std::vector<ComplexKey> GenerateRandomComplexKeys(size_t size, unsigned seed = 42) {
+    std::vector<ComplexKey> result;
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dis(0, 100);
+    std::vector<std::string> strings = {"a", "b", "c", "d", "e"};
+    std::uniform_int_distribution<> str_dis(0, strings.size() - 1);
+    result.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        result.push_back({dis(gen), strings[str_dis(gen)]});
+    }
+    return result;
+}
+std::vector<int> SortedUnique(std::vector<int> input) {
+    std::sort(input.begin(), input.end());
+    input.erase(std::unique(input.begin(), input.end()), input.end());
+    return input;
+}
+
+template <typename Map>
+void CheckSameAsStdMap(const Map& map_btree, const std::map<int, int>& expected) {
+    assert(map_btree.Size() == expected.size());
+    assert(map_btree.Empty() == expected.empty());
+    int height = CheckBTreeNode(map_btree.GetRootPtr(), map_btree.KeyCompare());
+    assert(height >= 0 && static_cast<size_t>(height) == map_btree.GetHeight());
+    auto it = map_btree.Begin();
+    for (const auto& [key, value] : expected) {
+        assert(it->first == key && it->second == value);
+        ++it;
+    }
+    assert(it == map_btree.End());
+    auto rit = map_btree.RBegin();
+    for (auto jt = expected.rbegin(); jt != expected.rend(); ++jt) {
+        assert(rit->first == jt->first);
+        ++rit;
+    }
+    assert(rit == map_btree.REnd());
+}
+
+void TestDefaultConstructor() {
+    MapBTree<int, int> map_btree;
+    assert(map_btree.Empty());
+    assert(map_btree.Size() == 0);
+    assert(map_btree.GetHeight() == 0);
+    assert(map_btree.Begin() == map_btree.End());
+    assert(map_btree.CBegin() == map_btree.CEnd());
+    assert(map_btree.RBegin() == map_btree.REnd());
+    assert(map_btree.CRBegin() == map_btree.CREnd());
+    std::cout << "TestDefaultConstructor passed\n";
+}
+
+void TestComparatorConstructor() {
+    MapBTree<int, int, std::greater<int>> map_btree{std::greater<int>()};
+    assert(map_btree.Empty());
+    assert(map_btree.KeyCompare()(3, 1));
+    std::cout << "TestComparatorConstructor passed\n";
+}
+
+void TestCopyAndMove() {
+    auto input = GenerateRandomVector(1000, -5000, 5000, 42);
+    MapBTree<int, int> original;
+    std::map<int, int> expected;
+    for (int val : input) {
+        original.Insert({val, val});
+        expected.insert({val, val});
+    }
+
+    MapBTree<int, int> copy(original);
+    CheckSameAsStdMap(copy, expected);
+    CheckSameAsStdMap(original, expected);
+    copy.Insert({10000, 1});
+    assert(!original.Contains(10000));
+
+    MapBTree<int, int> assigned;
+    assigned.Insert({1, 1});
+    assigned = original;
+    CheckSameAsStdMap(assigned, expected);
+
+    MapBTree<int, int> moved(std::move(assigned));
+    CheckSameAsStdMap(moved, expected);
+    assert(assigned.Empty());
+    assert(assigned.Begin() == assigned.End());
+
+    MapBTree<int, int> move_assigned;
+    move_assigned = std::move(moved);
+    CheckSameAsStdMap(move_assigned, expected);
+    assert(moved.Empty());
+    std::cout << "TestCopyAndMove passed\n";
+}
+
+void TestClearAndSwap() {
+    auto input_a = GenerateRandomVector(500, -500, 500, 47);
+    auto input_b = GenerateRandomVector(50, -500, 500, 48);
+    MapBTree<int, int> map_a;
+    MapBTree<int, int> map_b;
+    std::map<int, int> expected_a;
+    std::map<int, int> expected_b;
+    for (int val : input_a) {
+        map_a.Insert({val, val});
+        expected_a.insert({val, val});
+    }
+    for (int val : input_b) {
+        map_b.Insert({val, val});
+        expected_b.insert({val, val});
+    }
+
+    map_a.Swap(map_b);
+    CheckSameAsStdMap(map_a, expected_b);
+    CheckSameAsStdMap(map_b, expected_a);
+    Swap(map_a, map_b);
+    CheckSameAsStdMap(map_a, expected_a);
+    CheckSameAsStdMap(map_b, expected_b);
+
+    MapBTree<int, int> empty;
+    map_a.Swap(empty);
+    CheckSameAsStdMap(map_a, {});
+    CheckSameAsStdMap(empty, expected_a);
+
+    empty.Clear();
+    CheckSameAsStdMap(empty, {});
+    empty.Insert({1, 1});
+    CheckSameAsStdMap(empty, {{1, 1}});
+    std::cout << "TestClearAndSwap passed\n";
+}
+
+void TestInsert() {
+    MapBTree<std::string, std::string> map_btree;
+    std::vector<std::string> input = {"apple", "banana", "cherry", "apple", "date"};
+    for (auto& val : input) {
+        auto result = map_btree.Insert({std::string(val), std::string(val)});
+        assert(result.first->first == val);
+        assert(result.first->second == val);
+    }
+    assert(map_btree.Size() == 4);
+
+    MapBTree<int, int> numbers;
+    auto keys = GenerateRandomVector(5000, -2000, 2000, 49);
+    std::map<int, int> expected;
+    for (int key : keys) {
+        auto result = numbers.Insert({key, key * 3});
+        auto expected_result = expected.insert({key, key * 3});
+        assert(result.second == expected_result.second);
+        assert(result.first->first == key);
+        assert(result.first->second == expected_result.first->second);
+    }
+    CheckSameAsStdMap(numbers, expected);
+
+    std::vector<std::pair<int, int>> range;
+    for (int key : GenerateRandomVector(100, 3000, 4000, 50)) {
+        range.emplace_back(key, key);
+        expected.insert({key, key});
+    }
+    numbers.Insert(range.begin(), range.end());
+    numbers.Insert({{-5000, 1}, {5000, 2}});
+    expected.insert({{-5000, 1}, {5000, 2}});
+    CheckSameAsStdMap(numbers, expected);
+    std::cout << "TestInsert passed\n";
+}
+
+void TestFindAndBounds() {
+    auto input = GenerateRandomVector(3000, -10000, 10000, 53);
+    MapBTree<int, int> map_btree;
+    for (int val : input) {
+        map_btree.Insert({val, val});
+    }
+    auto sorted_unique = SortedUnique(input);
+
+    const auto& const_map = map_btree;
+    for (int val : sorted_unique) {
+        auto it = map_btree.Find(val);
+        assert(it != map_btree.End() && it->first == val && it->second == val);
+        auto const_it = const_map.Find(val);
+        assert(const_it != const_map.CEnd() && const_it->first == val);
+        assert(map_btree.Contains(val) && map_btree.Count(val) == 1);
+    }
+    for (int key = -10500; key <= 10500; ++key) {
+        auto lower = std::lower_bound(sorted_unique.begin(), sorted_unique.end(), key);
+        auto upper = std::upper_bound(sorted_unique.begin(), sorted_unique.end(), key);
+        auto lb = map_btree.LowerBound(key);
+        auto ub = const_map.UpperBound(key);
+        assert((lb == map_btree.End()) == (lower == sorted_unique.end()));
+        assert(lb == map_btree.End() || lb->first == *lower);
+        assert((ub == const_map.CEnd()) == (upper == sorted_unique.end()));
+        assert(ub == const_map.CEnd() || ub->first == *upper);
+        auto [first, last] = map_btree.EqualRange(key);
+        assert(first == lb);
+        assert((first == last) == (lower == upper));
+        if (lower == upper) {
+            assert(map_btree.Find(key) == map_btree.End());
+            assert(!map_btree.Contains(key) && map_btree.Count(key) == 0);
+        }
+    }
+
+    MapBTree<int, int> empty;
+    assert(empty.Find(0) == empty.End());
+    assert(empty.LowerBound(0) == empty.End());
+    assert(empty.UpperBound(0) == empty.End());
+    auto range = empty.EqualRange(0);
+    assert(range.first == range.second);
+    std::cout << "TestFindAndBounds passed\n";
+}
+
+void TestIterators() {
+    auto input = GenerateRandomVector(1000, -1000, 1000, 58);
+    MapBTree<int, int> map_btree;
+    for (int val : input) {
+        map_btree.Insert({val, val});
+    }
+    auto sorted_unique = SortedUnique(input);
+
+    auto it = map_btree.Begin();
+    for (size_t i = 0; i < sorted_unique.size(); ++i) {
+        assert(it->first == sorted_unique[i]);
+        it++->second *= 2;
+    }
+    assert(it == map_btree.End());
+    for (size_t i = sorted_unique.size(); i > 0; --i) {
+        --it;
+        assert(it->first == sorted_unique[i - 1] && it->second == sorted_unique[i - 1] * 2);
+    }
+    assert(it == map_btree.Begin());
+    assert(--it == (MapBTree<int, int>::Iterator{nullptr, 0}));
+
+    auto rit = map_btree.CRBegin();
+    for (size_t i = sorted_unique.size(); i > 0; --i) {
+        assert(rit->first == sorted_unique[i - 1]);
+        ++rit;
+    }
+    assert(rit == map_btree.CREnd());
+    assert((--rit)->first == sorted_unique.front());
+
+    bool thrown = false;
+    try {
+        *map_btree.End();
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::cout << "TestIterators passed\n";
+}
+
+void TestWithCustomCompare() {
+    auto input = GenerateRandomVector(2000, -1000, 1000, 62);
+    MapBTree<int, int, std::greater<int>> map_btree{std::greater<int>()};
+    for (int val : input) {
+        map_btree.Insert({val, val});
+    }
+    std::vector<int> sorted_unique = SortedUnique(input);
+    std::reverse(sorted_unique.begin(), sorted_unique.end());
+    assert(CheckBTreeNode(map_btree.GetRootPtr(), std::greater<int>()) > 0);
+
+    auto it = map_btree.Begin();
+    for (size_t i = 0; i < sorted_unique.size(); ++i) {
+        assert(it->first == sorted_unique[i]);
+        ++it;
+    }
+    assert(it == map_btree.End());
+
+    for (int key = -1500; key <= 1500; key += 7) {
+        auto lb = map_btree.LowerBound(key);
+        auto expected =
+            std::lower_bound(sorted_unique.begin(), sorted_unique.end(), key, std::greater<int>());
+        assert((lb == map_btree.End()) == (expected == sorted_unique.end()));
+        assert(lb == map_btree.End() || lb->first == *expected);
+        auto ub = map_btree.UpperBound(key);
+        auto expected_ub =
+            std::upper_bound(sorted_unique.begin(), sorted_unique.end(), key, std::greater<int>());
+        assert((ub == map_btree.End()) == (expected_ub == sorted_unique.end()));
+        assert(ub == map_btree.End() || ub->first == *expected_ub);
+    }
+    std::cout << "TestWithCustomCompare passed\n";
+}
+
+void TestWithComplexKeys() {
+    auto input = GenerateRandomComplexKeys(300, 63);
+    MapBTree<ComplexKey, std::string> map_btree;
+    for (const auto& val : input) {
+        map_btree.Insert({val, val.y});
+    }
+    std::vector<ComplexKey> sorted_unique = input;
+    std::sort(sorted_unique.begin(), sorted_unique.end());
+    sorted_unique.erase(std::unique(sorted_unique.begin(), sorted_unique.end()),
+                        sorted_unique.end());
+
+    assert(map_btree.Size() == sorted_unique.size());
+    auto it = map_btree.Begin();
+    for (size_t i = 0; i < sorted_unique.size(); ++i) {
+        assert(it->first == sorted_unique[i]);
+        assert(it->second == sorted_unique[i].y);
+        ++it;
+    }
+    assert(it == map_btree.End());
+
+    MapBTree<ComplexKey, std::string> copy = map_btree;
+    for (size_t i = 0; i < sorted_unique.size(); i += 2) {
+        assert(copy.Erase(sorted_unique[i]) == 1);
+    }
+    assert(copy.Size() == sorted_unique.size() / 2);
+    assert(map_btree.Size() == sorted_unique.size());
+    std::cout << "TestWithComplexKeys passed\n";
+}
+
+void TestLargeTree() {
+    MapBTree<int, int> large_map;
+    std::map<int, int> expected;
+    for (int val : GenerateRandomVector(200000, -1000000, 1000000, 65)) {
+        large_map.Insert({val, val});
+        expected.insert({val, val});
+    }
+    CheckSameAsStdMap(large_map, expected);
+    assert(large_map.GetHeight() <= 4);
+
+    MapBTree<int, int> ascending;
+    for (int i = 0; i < 100000; ++i) {
+        ascending.Insert({i, i});
+    }
+    assert(CheckBTreeNode(ascending.GetRootPtr(), ascending.KeyCompare()) > 0);
+    assert(ascending.Size() == 100000);
+    std::cout << "TestLargeTree passed\n";
+}
+
+void TestOperatorEqual() {
+    std::mt19937 gen(123);
+    for (int trial = 0; trial < 50; ++trial) {
+        auto input1 = GenerateRandomVector(100, -100, 100, gen());
+        auto input2 = GenerateRandomVector(100, -100, 100, gen());
+
+        MapBTree<int, int> map1, map2;
+        std::map<int, int> stdmap1, stdmap2;
+        for (int v : input1) {
+            map1.Insert({v, v});
+            stdmap1.insert({v, v});
+        }
+        for (int v : input2) {
+            map2.Insert({v, v});
+            stdmap2.insert({v, v});
+        }
+        bool expected_equal = (stdmap1 == stdmap2);
+        assert((map1 == map2) == expected_equal);
+        assert((map1 != map2) == !expected_equal);
+        MapBTree<int, int> copy = map1;
+        assert(copy == map1);
+    }
+    std::cout << "TestOperatorEqual passed\n";
+}
+
+void TestEraseKey() {
+    MapBTree<int, int> map_btree;
+    std::map<int, int> expected;
+    assert(map_btree.Erase(1) == 0);
+    for (int val : GenerateRandomVector(5000, -2000, 2000, 70)) {
+        map_btree.Insert({val, val * 2});
+        expected.insert({val, val * 2});
+    }
+    auto probes = GenerateRandomVector(6000, -2500, 2500, 71);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        assert(map_btree.Erase(probes[i]) == expected.erase(probes[i]));
+        if (i % 500 == 0) {
+            CheckSameAsStdMap(map_btree, expected);
+        }
+    }
+    CheckSameAsStdMap(map_btree, expected);
+    for (auto it = expected.begin(); it != expected.end();) {
+        assert(map_btree.Erase(it->first) == 1);
+        it = expected.erase(it);
+    }
+    CheckSameAsStdMap(map_btree, expected);
+    map_btree.Insert({7, 7});
+    CheckSameAsStdMap(map_btree, {{7, 7}});
+    std::cout << "TestEraseKey passed\n";
+}
+
+void TestEraseIterator() {
+    MapBTree<int, int> map_btree;
+    std::map<int, int> expected;
+    for (int val : GenerateRandomVector(3000, 0, 10000, 72)) {
+        map_btree.Insert({val, val});
+        expected.insert({val, val});
+    }
+    auto it = map_btree.Begin();
+    auto jt = expected.begin();
+    while (it != map_btree.End()) {
+        it = map_btree.Erase(it);
+        jt = expected.erase(jt);
+        assert((it == map_btree.End()) == (jt == expected.end()));
+        if (it != map_btree.End()) {
+            assert(it->first == jt->first);
+            ++it;
+            ++jt;
+        }
+    }
+    CheckSameAsStdMap(map_btree, expected);
+
+    auto rit = expected.rbegin();
+    while (!expected.empty()) {
+        auto next = map_btree.Erase(map_btree.Find(rit->first));
+        assert(next == map_btree.End());
+        expected.erase(rit->first);
+        rit = expected.rbegin();
+    }
+    CheckSameAsStdMap(map_btree, expected);
+
+    bool thrown = false;
+    try {
+        map_btree.Erase(map_btree.End());
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::cout << "TestEraseIterator passed\n";
+}
+
+void TestEraseRange() {
+    std::mt19937 gen(73);
+    for (size_t size : {1, 2, 10, 100, 1000, 5000}) {
+        for (int round = 0; round < 10; ++round) {
+            MapBTree<int, int> map_btree;
+            std::map<int, int> expected;
+            for (int val : GenerateRandomVector(size, 0, static_cast<int>(size) * 4, round)) {
+                map_btree.Insert({val, val});
+                expected.insert({val, val});
+            }
+            std::uniform_int_distribution<size_t> dis(0, expected.size());
+            size_t from = dis(gen);
+            size_t to = dis(gen);
+            if (from > to) {
+                std::swap(from, to);
+            }
+            auto first = map_btree.Begin();
+            auto jt_first = expected.begin();
+            for (size_t i = 0; i < from; ++i, ++first, ++jt_first) {
+            }
+            auto last = first;
+            auto jt_last = jt_first;
+            for (size_t i = from; i < to; ++i, ++last, ++jt_last) {
+            }
+            auto result = map_btree.Erase(first, last);
+            auto jt_result = expected.erase(jt_first, jt_last);
+            assert((result == map_btree.End()) == (jt_result == expected.end()));
+            assert(result == map_btree.End() || result->first == jt_result->first);
+            CheckSameAsStdMap(map_btree, expected);
+        }
+    }
+    std::cout << "TestEraseRange passed\n";
+}
+
+// The smallest nodes split and merge on almost every operation.
+template <size_t kSlots>
+void CheckRandomOperationsWithSlots() {
+    MapBTree<int, int, std::less<int>, kSlots> map_btree;
+    std::map<int, int> expected;
+    std::mt19937 gen(74 + kSlots);
+    std::uniform_int_distribution<int> key_dis(0, 600);
+    std::uniform_int_distribution<int> op_dis(0, 2);
+    for (int step = 0; step < 20000; ++step) {
+        int key = key_dis(gen);
+        if (op_dis(gen) == 0) {
+            assert(map_btree.Erase(key) == expected.erase(key));
+        } else {
+            assert(map_btree.Insert({key, step}).second == expected.insert({key, step}).second);
+        }
+        if (step % 1000 == 0) {
+            CheckSameAsStdMap(map_btree, expected);
+            auto copy = map_btree;
+            CheckSameAsStdMap(copy, expected);
+        }
+    }
+    CheckSameAsStdMap(map_btree, expected);
+    while (!expected.empty()) {
+        auto it = map_btree.Erase(map_btree.Find(expected.begin()->first));
+        expected.erase(expected.begin());
+        assert(it == map_btree.Begin());
+    }
+    CheckSameAsStdMap(map_btree, expected);
+}
+
+void TestSmallNodes() {
+    CheckRandomOperationsWithSlots<3>();
+    CheckRandomOperationsWithSlots<4>();
+    CheckRandomOperationsWithSlots<5>();
+    CheckRandomOperationsWithSlots<8>();
+    std::cout << "TestSmallNodes passed\n";
+}
+
+template <typename K>
+void CheckNodeSearchKernels() {
+    std::mt19937 gen(75);
+    std::vector<NodeSearchIsa> isas = {NodeSearchIsa::kScalar};
+    if (kNodeSearchIsa != NodeSearchIsa::kScalar) {
+        isas.push_back(NodeSearchIsa::kSse42);
+    }
+    if (kNodeSearchIsa == NodeSearchIsa::kAvx2) {
+        isas.push_back(NodeSearchIsa::kAvx2);
+    }
+    for (size_t size = 0; size <= 70; ++size) {
+        std::vector<K> keys;
+        for (int val : SortedUnique(GenerateRandomVector(size * 3, -200, 200, gen()))) {
+            keys.push_back(static_cast<K>(val) / 2);
+        }
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        keys.resize(std::min(keys.size(), size));
+        for (int probe = -210; probe <= 210; ++probe) {
+            K key = static_cast<K>(probe) / 2;
+            size_t lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            size_t upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            assert(NodeLowerBound(keys.data(), keys.size(), key, std::less<K>()) == lower);
+            assert(NodeUpperBound(keys.data(), keys.size(), key, std::less<K>()) == upper);
+            for (NodeSearchIsa isa : isas) {
+                assert(VectorCountBelow<false>(isa, keys.data(), keys.size(), key) == lower);
+                assert(VectorCountBelow<true>(isa, keys.data(), keys.size(), key) == upper);
+            }
+        }
+    }
+}
+
+template <typename K>
+void CheckVectorSearchMap() {
+    static_assert(kVectorNodeSearch<K, std::less<K>>);
+    MapBTree<K, int> map_btree;
+    std::map<K, int> expected;
+    for (int val : GenerateRandomVector(20000, -50000, 50000, 76)) {
+        K key = static_cast<K>(val) * 3;
+        map_btree.Insert({key, val});
+        expected.insert({key, val});
+    }
+    assert(CheckBTreeNode(map_btree.GetRootPtr(), map_btree.KeyCompare()) > 0);
+    for (int probe = -160000; probe <= 160000; probe += 7) {
+        K key = static_cast<K>(probe);
+        auto lb = map_btree.LowerBound(key);
+        auto expected_lb = expected.lower_bound(key);
+        assert((lb == map_btree.End()) == (expected_lb == expected.end()));
+        assert(lb == map_btree.End() || lb->first == expected_lb->first);
+        auto ub = map_btree.UpperBound(key);
+        auto expected_ub = expected.upper_bound(key);
+        assert((ub == map_btree.End()) == (expected_ub == expected.end()));
+        assert(ub == map_btree.End() || ub->first == expected_ub->first);
+        assert(map_btree.Contains(key) == expected.contains(key));
+    }
+}
+
+void TestNodeSearch() {
+    static_assert(!kVectorNodeSearch<int, std::greater<int>>);
+    static_assert(!kVectorNodeSearch<unsigned, std::less<unsigned>>);
+    CheckNodeSearchKernels<int32_t>();
+    CheckNodeSearchKernels<int64_t>();
+    CheckNodeSearchKernels<long long>();
+    CheckNodeSearchKernels<float>();
+    CheckVectorSearchMap<int>();
+    CheckVectorSearchMap<long long>();
+    CheckVectorSearchMap<float>();
+    std::cout << "TestNodeSearch passed\n";
+}
+
+int main() {
+    TestDefaultConstructor();
+    TestComparatorConstructor();
+    TestCopyAndMove();
+    TestClearAndSwap();
+    TestInsert();
+    TestFindAndBounds();
+    TestIterators();
+    TestWithCustomCompare();
+    TestWithComplexKeys();
+    TestLargeTree();
+    TestOperatorEqual();
+    TestEraseKey();
+    TestEraseIterator();
+    TestEraseRange();
+    TestSmallNodes();
+    TestNodeSearch();
+
+    std::cout << "\nAll tests passed\n";
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NODE_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+// Search over the sorted keys of one B-tree node. Nodes of int32, int64 and float keys ordered
+// by std::less are compared against the probe a whole vector of keys at a time; everything else
+// goes through a plain binary search.
+
+enum class NodeSearchIsa { kScalar, kSse42, kAvx2 };
+
+inline NodeSearchIsa DetectNodeSearchIsa() noexcept {
+#ifdef NODE_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return NodeSearchIsa::kAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return NodeSearchIsa::kSse42;
+    }
+#endif
+    return NodeSearchIsa::kScalar;
+}
+
+// The best instruction set of the running CPU, detected once at startup.
+inline const NodeSearchIsa kNodeSearchIsa = DetectNodeSearchIsa();
+
+template <typename K, typename Compare>
+constexpr bool kVectorNodeSearch =
+    std::is_same_v<Compare, std::less<K>> &&
+    ((std::is_integral_v<K> && std::is_signed_v<K> && (sizeof(K) == 4 || sizeof(K) == 8)) ||
+     std::is_same_v<K, float>);
+
+template <typename K, typename Compare>
+size_t ScalarLowerBound(const K* keys, size_t size, const K& key, const Compare& compare) {
+    size_t first = 0;
+    while (size > 0) {
+        size_t half = size / 2;
+        if (compare(keys[first + half], key)) {
+            first += half + 1;
+            size -= half + 1;
+        } else {
+            size = half;
+        }
+    }
+    return first;
+}
+
+template <typename K, typename Compare>
+size_t ScalarUpperBound(const K* keys, size_t size, const K& key, const Compare& compare) {
+    size_t first = 0;
+    while (size > 0) {
+        size_t half = size / 2;
+        if (!compare(key, keys[first + half])) {
+            first += half + 1;
+            size -= half + 1;
+        } else {
+            size = half;
+        }
+    }
+    return first;
+}
+
+#ifdef NODE_SEARCH_X86
+
+// The kernels scan the sorted keys a vector at a time and stop at the first vector that is not
+// entirely below the probe; the set bits of its mask are then a prefix. With kOrEqual the keys
+// equal to the probe count as below it, which turns the lower bound into the upper bound.
+
+template <bool kOrEqual, typename K>
+[[gnu::target("avx2")]] unsigned Avx2BelowMask(const K* keys, K key) noexcept {
+    if constexpr (std::is_same_v<K, float>) {
+        __m256 lanes = _mm256_loadu_ps(keys);
+        __m256 probe = _mm256_set1_ps(key);
+        return _mm256_movemask_ps(_mm256_cmp_ps(lanes, probe, kOrEqual ? _CMP_LE_OQ : _CMP_LT_OQ));
+    } else if constexpr (sizeof(K) == 4) {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+        __m256i probe = _mm256_set1_epi32(static_cast<int32_t>(key));
+        __m256i mask =
+            kOrEqual ? _mm256_cmpgt_epi32(lanes, probe) : _mm256_cmpgt_epi32(probe, lanes);
+        unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+        return kOrEqual ? ~bits & 0xFFu : bits;
+    } else {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+        __m256i probe = _mm256_set1_epi64x(static_cast<int64_t>(key));
+        __m256i mask =
+            kOrEqual ? _mm256_cmpgt_epi64(lanes, probe) : _mm256_cmpgt_epi64(probe, lanes);
+        unsigned bits = _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+        return kOrEqual ? ~bits & 0xFu : bits;
+    }
+}
+
+template <bool kOrEqual, typename K>
+[[gnu::target("avx2")]] size_t Avx2CountBelow(const K* keys, size_t size, K key) noexcept {
+    constexpr size_t kLanes = 32 / sizeof(K);
+    constexpr unsigned kFull = (1u << kLanes) - 1;
+    size_t index = 0;
+    for (; index + kLanes <= size; index += kLanes) {
+        unsigned mask = Avx2BelowMask<kOrEqual>(keys + index, key);
+        if (mask != kFull) {
+            return index + std::countr_one(mask);
+        }
+    }
+    while (index < size && (kOrEqual ? !(key < keys[index]) : keys[index] < key)) {
+        ++index;
+    }
+    return index;
+}
+
+template <bool kOrEqual, typename K>
+[[gnu::target("sse4.2")]] unsigned Sse42BelowMask(const K* keys, K key) noexcept {
+    if constexpr (std::is_same_v<K, float>) {
+        __m128 lanes = _mm_loadu_ps(keys);
+        __m128 probe = _mm_set1_ps(key);
+        return _mm_movemask_ps(kOrEqual ? _mm_cmple_ps(lanes, probe) : _mm_cmplt_ps(lanes, probe));
+    } else if constexpr (sizeof(K) == 4) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+        __m128i probe = _mm_set1_epi32(static_cast<int32_t>(key));
+        __m128i mask = kOrEqual ? _mm_cmpgt_epi32(lanes, probe) : _mm_cmpgt_epi32(probe, lanes);
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+        return kOrEqual ? ~bits & 0xFu : bits;
+    } else {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+        __m128i probe = _mm_set1_epi64x(static_cast<int64_t>(key));
+        __m128i mask = kOrEqual ? _mm_cmpgt_epi64(lanes, probe) : _mm_cmpgt_epi64(probe, lanes);
+        unsigned bits = _mm_movemask_pd(_mm_castsi128_pd(mask));
+        return kOrEqual ? ~bits & 0x3u : bits;
+    }
+}
+
+template <bool kOrEqual, typename K>
+[[gnu::target("sse4.2")]] size_t Sse42CountBelow(const K* keys, size_t size, K key) noexcept {
+    constexpr size_t kLanes = 16 / sizeof(K);
+    constexpr unsigned kFull = (1u << kLanes) - 1;
+    size_t index = 0;
+    for (; index + kLanes <= size; index += kLanes) {
+        unsigned mask = Sse42BelowMask<kOrEqual>(keys + index, key);
+        if (mask != kFull) {
+            return index + std::countr_one(mask);
+        }
+    }
+    while (index < size && (kOrEqual ? !(key < keys[index]) : keys[index] < key)) {
+        ++index;
+    }
+    return index;
+}
+
+#endif
+
+// Number of keys below the probe (or not above it, with kOrEqual) using the given instruction
+// set, which the caller has to make sure the CPU supports. Requires kVectorNodeSearch.
+template <bool kOrEqual, typename K>
+size_t VectorCountBelow(NodeSearchIsa isa, const K* keys, size_t size, K key) noexcept {
+#ifdef NODE_SEARCH_X86
+    if (isa == NodeSearchIsa::kAvx2) {
+        return Avx2CountBelow<kOrEqual>(keys, size, key);
+    }
+    if (isa == NodeSearchIsa::kSse42) {
+        return Sse42CountBelow<kOrEqual>(keys, size, key);
+    }
+#endif
+    if constexpr (kOrEqual) {
+        return ScalarUpperBound(keys, size, key, std::less<K>());
+    } else {
+        return ScalarLowerBound(keys, size, key, std::less<K>());
+    }
+}
+
+template <typename K, typename Compare>
+size_t NodeLowerBound(const K* keys, size_t size, const K& key, const Compare& compare) {
+    if constexpr (kVectorNodeSearch<K, Compare>) {
+        return VectorCountBelow<false>(kNodeSearchIsa, keys, size, key);
+    } else {
+        return ScalarLowerBound(keys, size, key, compare);
+    }
+}
+
+template <typename K, typename Compare>
+size_t NodeUpperBound(const K* keys, size_t size, const K& key, const Compare& compare) {
+    if constexpr (kVectorNodeSearch<K, Compare>) {
+        return VectorCountBelow<true>(kNodeSearchIsa, keys, size, key);
+    } else {
+        return ScalarUpperBound(keys, size, key, compare);
+    }
+}
@@ -0,0 +1,98 @@
+#include "../1_AVL/SetAVL.h"
+#include "MapBTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// Same order as std::less, but hides it from the vector node search.
+template <typename K>
+struct ScalarLess {
+    bool operator()(const K& lhs, const K& rhs) const {
+        return lhs < rhs;
+    }
+};
+
+std::vector<int> GenerateShuffledKeys(size_t size, unsigned seed = 42) {
+    std::vector<int> result(size);
+    std::iota(result.begin(), result.end(), 0);
+    std::mt19937 gen(seed);
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+}
+
+template <typename F>
+double MeasureSeconds(F&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+void Report(const std::string& name, size_t size, size_t operations, double seconds) {
+    std::cout << name << " size=" << size << " ns/op=" << seconds * 1e9 / operations
+              << " Mops/s=" << operations / seconds / 1e6 << "\n";
+}
+
+void BenchSetAVLFind(size_t size) {
+    SetAVL<int> set_avl;
+    for (int key : GenerateShuffledKeys(size, 42)) {
+        set_avl.Insert(key * 2);
+    }
+    auto probes = GenerateShuffledKeys(size, 43);
+    size_t found = 0;
+    double seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            found += set_avl.Find(key * 2) != set_avl.End();
+        }
+    });
+    Report("SetAVL<int>Find", size, size, seconds);
+    std::cerr << "found " << found << "\n";
+}
+
+// Find of present keys and LowerBound of absent ones, which fall between two present keys.
+template <typename K, typename Compare>
+void BenchMapBTreeSearch(const std::string& name, size_t size) {
+    MapBTree<K, int, Compare> map_btree;
+    for (int key : GenerateShuffledKeys(size, 42)) {
+        map_btree.Insert({static_cast<K>(key) * 2, key});
+    }
+    auto probes = GenerateShuffledKeys(size, 43);
+    long long checksum = 0;
+    double find_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += map_btree.Find(static_cast<K>(key) * 2)->second;
+        }
+    });
+    Report(name + "Find", size, size, find_seconds);
+    double lower_bound_seconds = MeasureSeconds([&] {
+        for (int key : probes) {
+            checksum += map_btree.LowerBound(static_cast<K>(key) * 2 - 1)->second;
+        }
+    });
+    Report(name + "LowerBound", size, size, lower_bound_seconds);
+    std::cerr << "checksum " << checksum << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {10'000, 1'000'000, 10'000'000};
+    if (argc > 1) {
+        sizes = {static_cast<size_t>(std::atoll(argv[1]))};
+    }
+    const char* isa_names[] = {"scalar", "sse4.2", "avx2"};
+    std::cout << "vector search: " << isa_names[static_cast<int>(kNodeSearchIsa)] << "\n";
+    for (size_t size : sizes) {
+        BenchSetAVLFind(size);
+        BenchMapBTreeSearch<int, ScalarLess<int>>("MapBTree<int>Scalar", size);
+        BenchMapBTreeSearch<int, std::less<int>>("MapBTree<int>Vector", size);
+        BenchMapBTreeSearch<int64_t, ScalarLess<int64_t>>("MapBTree<int64_t>Scalar", size);
+        BenchMapBTreeSearch<int64_t, std::less<int64_t>>("MapBTree<int64_t>Vector", size);
+        BenchMapBTreeSearch<float, ScalarLess<float>>("MapBTree<float>Scalar", size);
+        BenchMapBTreeSearch<float, std::less<float>>("MapBTree<float>Vector", size);
+    }
+}